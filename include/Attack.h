@@ -0,0 +1,147 @@
+#ifndef ATTACK_H
+#define ATTACK_H
+
+#include "GameBoard.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <bit>
+
+// Garbage lines sent by a clear, guideline style:
+//
+//   base       single 0, double 1, triple 2, tetris 4
+//              t-spin single 2, double 4, triple 6 / mini single 0, mini double 1
+//   b2b        tetrises and spins with lines are "difficult" clears, a chain of them in a row gets a
+//              bonus that grows with the chain length (level 1 from the second one, up to 4)
+//   combo      0 for the first clear in a row, then 1, 1, 2, 2, 3, 3, 4, 4, 4 and 5 from the 11th clear
+//   perfect    a clear that empties the board sends 10 more
+//
+// Everything is looked up in tables built at compile time: a clear is one array read, so the bot can
+// afford it at every placement it simulates. The board scores its placements here too, so the bot
+// and the game never disagree on an attack.
+class AttackTable
+{
+    public:
+        static constexpr unsigned int MAX_CHAIN = 24;          // longer back to back chains have the same bonus
+        static constexpr unsigned int MAX_COMBO = 12;          // same for combos
+        static constexpr unsigned int PERFECT_CLEAR = 10;
+
+        // lines sent by clearing 'cleared' lines with the spin, 'chain' being the back to back chain before
+        // the clear and 'combo' the combo after it
+        static inline unsigned int Lines(unsigned int cleared, SpinType spin, unsigned int chain, unsigned int combo)
+        {
+            return LINES[cleared][spin][CHAIN_LEVEL[std::min(chain, MAX_CHAIN)]][std::min(combo, MAX_COMBO)];
+        }
+
+        // back to back chain after the clear: difficult clears extend it, other clears break it, placements
+        // without clears keep it
+        static inline unsigned int Chain(unsigned int cleared, SpinType spin, unsigned int chain)
+        {
+            return (chain + 1) * DIFFICULT[cleared][spin] + chain * (cleared == 0);
+        }
+
+    private:
+        static constexpr unsigned int CHAIN_LEVELS = 5;
+
+        static constexpr unsigned int BASE[5][3] = {
+            // none, mini, full
+            { 0, 0, 0 },
+            { 0, 0, 2 },
+            { 1, 1, 4 },
+            { 2, 2, 6 },
+            { 4, 4, 4 },
+        };
+        static constexpr unsigned int DIFFICULT[5][3] = {
+            { 0, 0, 0 },
+            { 0, 1, 1 },
+            { 0, 1, 1 },
+            { 0, 1, 1 },
+            { 1, 1, 1 },
+        };
+        // by GameBoard::Combo, which is 1 for the first clear in a row
+        static constexpr unsigned int COMBO_BONUS[MAX_COMBO + 1] = { 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 4, 5, 5 };
+
+        // level of the bonus by chain length: 1-2 -> 1, 3-7 -> 2, 8-23 -> 3, 24+ -> 4
+        static constexpr std::array<uint8_t, MAX_CHAIN + 1> CHAIN_LEVEL = []() {
+            std::array<uint8_t, MAX_CHAIN + 1> levels = {};
+            for (unsigned int chain = 1; chain <= MAX_CHAIN; chain++)
+                levels[chain] = chain >= 24 ? 4 : chain >= 8 ? 3 : chain >= 3 ? 2 : 1;
+            return levels;
+        }();
+
+        using LineTable = std::array<std::array<std::array<std::array<uint8_t, MAX_COMBO + 1>, CHAIN_LEVELS>, 3>, 5>;
+        static constexpr LineTable LINES = []() {
+            LineTable lines = {};
+            for (unsigned int cleared = 1; cleared <= 4; cleared++)
+                for (unsigned int spin = 0; spin < 3; spin++)
+                    for (unsigned int level = 0; level < CHAIN_LEVELS; level++)
+                        for (unsigned int combo = 0; combo <= MAX_COMBO; combo++)
+                            lines[cleared][spin][level][combo] = BASE[cleared][spin] + DIFFICULT[cleared][spin] * level + COMBO_BONUS[combo];
+            return lines;
+        }();
+
+        AttackTable() { }
+};
+
+// Spin classification of a piece that was rotated into its final position (the drop doesn't move it),
+// on rows of occupancy bits: bit 'col' of rows[row], the layout of GameBoard::RowMasks and Bitboard::Rows.
+//
+//   T          3-corner rule: at least 3 of the 4 cells diagonal to the center are filled (walls and
+//              floor count as filled). Full if both corners on the side the T points to are filled,
+//              mini otherwise, unless the rotation was a 90 degree one that used the last kick of its
+//              list, the TST kick (then full). The 180 degree lists are other kicks, they don't upgrade.
+//   others     all-spin: the piece can't move left, right or up. Counted as minis. Their corners aren't
+//              read, the center of an I or an O can be off the matrix.
+//   O          never spins.
+//
+// The corners are 4 bits read from two padded rows and the T rules are a table indexed by them, so a
+// classification is a handful of bit operations. The board and the bot both classify their
+// placements here, so a spin the bot plans for is the one the board scores.
+class SpinDetector
+{
+    public:
+        // rotation and position: state after the last rotation, tstKick: it used the TST kick (see above)
+        // immobile: the piece collides when shifted left, right and up, checked by the caller on its board
+        static inline SpinType Classify(const uint16_t *rows, MinoType piece, int rotation, glm::ivec2 position, bool tstKick, bool immobile)
+        {
+            if (piece != BLOCK_T)
+                return static_cast<SpinType>(immobile & (piece != BLOCK_O));
+            return T_SPINS[tstKick][rotation][Corners(rows, position.x, position.y)];
+        }
+
+        // cells diagonal to (row, col): bit 0 top left, 1 top right, 2 bottom left, 3 bottom right
+        static inline unsigned int Corners(const uint16_t *rows, int row, int col)
+        {
+            // rows shifted by one with a wall on both sides, col - 1 and col + 1 are bits col and col + 2
+            const uint32_t walls = 1 | (1 << (MATRIX_COLS + 1));
+            uint32_t above = row + 1 < MATRIX_ROWS ? (uint32_t(rows[row + 1]) << 1) | walls : walls;
+            uint32_t below = row > 0 ? (uint32_t(rows[row - 1]) << 1) | walls : 0xFFFF;
+            return ((above >> col) & 1) | (((above >> (col + 2)) & 1) << 1)
+                | (((below >> col) & 1) << 2) | (((below >> (col + 2)) & 1) << 3);
+        }
+
+    private:
+        // corners the T points to, by rotation (north, east, south, west)
+        static constexpr unsigned int FRONT_CORNERS[4] = { 0b0011, 0b1010, 0b1100, 0b0101 };
+
+        // by TST kick used, rotation and corners
+        using SpinTable = std::array<std::array<std::array<SpinType, 16>, 4>, 2>;
+        static constexpr SpinTable T_SPINS = []() {
+            SpinTable spins = {};
+            for (int tstKick = 0; tstKick < 2; tstKick++)
+                for (int rotation = 0; rotation < 4; rotation++)
+                    for (unsigned int corners = 0; corners < 16; corners++)
+                    {
+                        bool front = (corners & FRONT_CORNERS[rotation]) == FRONT_CORNERS[rotation];
+                        spins[tstKick][rotation][corners] = std::popcount(corners) < 3 ? SPIN_NONE : front || tstKick ? SPIN_FULL : SPIN_MINI;
+                    }
+            return spins;
+        }();
+
+        SpinDetector() { }
+};
+
+#endif // ATTACK_H
@@ -0,0 +1,104 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "GameBoard.h"
+#include "Zobrist.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <bit>
+#include <array>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// shape of a tetromino in a given rotation, precomputed so collision checks are a few shifts and ands
+// row masks are relative to MinCol: bit 0 is the leftmost column of the piece
+struct PieceShape
+{
+    std::array<glm::ivec2, 4> Cells;
+    int MinRow, MaxRow;
+    int MinCol, MaxCol;
+    int Height;
+    uint16_t RowMasks[4];
+};
+
+// flat lookup tables built once from the (hash map based) rotation and kick tables used by GameBoard
+// indexed by [MinoType][rotation], only the BLOCK_* entries are populated
+class PieceTable
+{
+    public:
+        PieceShape Shapes[8][4];
+        std::vector<glm::ivec2> Kicks[8][4][4];
+
+        PieceTable(const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable);
+};
+
+// one bit per cell occupancy of the matrix, bit 'col' of Rows[row] is set when the cell is not empty
+struct Bitboard
+{
+    uint16_t Rows[MATRIX_ROWS];
+    uint64_t SolidRows;             // bit 'row' is set when the row contains solid garbage and can never be cleared
+    uint64_t Hash;                  // zobrist hash of the occupancy, kept up to date by Place and ClearLines
+
+    void Clear();
+    void FromMatrix(const MinoType (&matrix)[MATRIX_ROWS][MATRIX_COLS]);
+
+    // true if the piece would overlap a mino or leave the matrix at the given position
+    inline bool Collides(const PieceShape& shape, glm::ivec2 position) const
+    {
+        int col = position.y + shape.MinCol;
+        int row = position.x + shape.MinRow;
+        if (col < 0 || position.y + shape.MaxCol >= MATRIX_COLS || row < 0)
+            return true;
+
+        for (int r = 0; r < shape.Height && row + r < MATRIX_ROWS; r++)
+        {
+            if (Rows[row + r] & (shape.RowMasks[r] << col))
+                return true;
+        }
+        return false;
+    }
+
+    // position the piece would land on if hard dropped from the given position
+    inline glm::ivec2 DropPosition(const PieceShape& shape, glm::ivec2 position) const
+    {
+        while (!Collides(shape, glm::ivec2(position.x - 1, position.y)))
+            position.x = position.x - 1;
+        return position;
+    }
+
+    inline void Place(const PieceShape& shape, glm::ivec2 position)
+    {
+        const Zobrist& keys = Zobrist::Keys();
+        int col = position.y + shape.MinCol;
+        int row = position.x + shape.MinRow;
+        for (int r = 0; r < shape.Height; r++)
+        {
+            uint16_t old = Rows[row + r];
+            Rows[row + r] = old | (shape.RowMasks[r] << col);
+            Hash ^= keys.Row(row + r, old) ^ keys.Row(row + r, Rows[row + r]);
+        }
+    }
+
+    // removes full rows and returns the number of cleared lines
+    // only the rows that actually move are rehashed
+    unsigned int ClearLines();
+
+    // hash of the occupancy computed from scratch
+    uint64_t ComputeHash() const;
+
+    // index of the highest non empty row + 1
+    int StackHeight() const;
+
+    // board written as rows from top to bottom separated by '/', '.' or '_' for an empty cell, anything
+    // else for a mino (the tools take boards this way), throws std::runtime_error for a row that isn't
+    // MATRIX_COLS cells wide
+    static Bitboard Parse(const std::string& text);
+};
+
+// piece of its letter, in any case, throws std::runtime_error for a letter that isn't one of IJLOSTZ
+MinoType ParsePiece(char letter);
+
+#endif // BITBOARD_H
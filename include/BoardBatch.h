@@ -0,0 +1,71 @@
+#ifndef BOARDBATCH_H
+#define BOARDBATCH_H
+
+#include "GameBoard.h"
+#include "Bitboard.h"
+
+#include <cstdint>
+#include <vector>
+
+// placement chosen for one board: optional hold, then the piece is dropped straight down
+// from the top of the matrix in the given rotation and column (leftmost column of the piece, 0 to 9)
+struct BoardAction
+{
+    uint8_t Hold;
+    uint8_t Rotation;
+    int8_t Column;
+};
+
+// N independent boards stepped in lockstep, meant for reinforcement learning environments.
+// Structure of arrays layout: Rows[row * Size + board], so one matrix row of all the boards is
+// contiguous and the drop, place and line clear loops run over the boards in the innermost loop
+// with fixed width integer arithmetic and no branches, which the compiler turns into SIMD code.
+// Only the per board bookkeeping (queue, spawn check) is scalar.
+// Pieces come from a per board 7-bag driven by a xorshift generator, not GameBoard's mt19937.
+class BoardBatch
+{
+    public:
+        static const int QUEUE_CAPACITY = 16;
+        static const int PADDING_ROWS = 4;      // always empty rows above the matrix, so compaction can read past the top
+
+        const size_t Size;
+
+        std::vector<uint16_t> Rows;             // (MATRIX_ROWS + PADDING_ROWS) * Size
+        std::vector<uint8_t> Heights;           // stack height of every board
+        std::vector<uint8_t> Current, Hold;     // MinoType of every board
+        std::vector<uint8_t> Queue;             // QUEUE_CAPACITY ring per board
+        std::vector<uint8_t> QueueHead, QueueSize;
+        std::vector<uint32_t> RNG;
+        std::vector<uint32_t> LinesCleared, PiecesPlaced;
+        std::vector<uint8_t> IsOver;
+
+        BoardBatch(size_t size, const PieceTable& pieces);
+
+        // empties the board and restarts its piece sequence from the seed
+        void Reset(size_t board, uint32_t seed);
+
+        // applies one action to every board that isn't over, lines[board] receives the lines cleared by the step
+        void Step(const BoardAction* actions, uint8_t* lines);
+
+        // i-th upcoming piece of the board (0 is the next one)
+        MinoType Preview(size_t board, int index) const;
+
+        // bit (rotation * 10 + column) is set for every action that lands the piece inside the matrix,
+        // column being the leftmost column of the piece like BoardAction::Column
+        uint64_t ValidPlacements(size_t board, MinoType piece) const;
+
+    private:
+        const PieceTable& Pieces;
+
+        // scratch arrays of the current step, one entry per board
+        std::vector<uint16_t> Masks[4];
+        std::vector<int16_t> Landing;
+        std::vector<uint8_t> Full[4];
+        std::vector<uint8_t> PieceHeights;
+
+        void FillQueue(size_t board);
+        MinoType PopQueue(size_t board);
+        bool SpawnCollides(size_t board) const;
+};
+
+#endif // BOARDBATCH_H
@@ -0,0 +1,217 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "GameBoard.h"
+#include "Bitboard.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+#include "Zobrist.h"
+#include "CancellationToken.h"
+#include "OpeningBook.h"
+#include "Attack.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <list>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+// weights of the board evaluation, positive values are rewarded and negative ones penalized
+struct BotWeights
+{
+    static const int COUNT = 12;
+
+    float Height        = -0.35f;   // per row of the highest column
+    float Holes         = -4.0f;    // per empty cell covered by a mino
+    float Bumpiness     = -0.25f;   // sum of the height differences between neighbouring columns
+    float BumpinessSq   = -0.05f;   // same as above, but squared so that cliffs are punished harder
+    float WellDepth     =  0.40f;   // per row of the deepest well (capped at 4, a tetris ready well)
+    float TSlots        =  1.5f;    // per t-spin double slot on the board
+    float Clears[5]     = { 0.0f, -1.6f, -1.2f, -0.6f, 4.0f };  // reward for clearing 0, 1, 2, 3 or 4 lines
+    float Combo         =  0.4f;    // per combo step
+    float Attack        =  0.0f;    // per garbage line sent (clears, spins, back to back and combo together, see AttackTable)
+
+    // flat access to the weights, for tuning and for config files
+    float& operator[](int index);
+    float operator[](int index) const;
+    static const char* Name(int index);
+};
+
+struct BotConfig
+{
+    int BeamWidth = 64;             // nodes kept after every search level
+    int Depth = 3;                  // number of pieces searched (current piece included), limited by the previews
+    int MaxBeamWidth = 1024;        // with a deadline, the beam keeps widening up to this size while there's time left
+    double DeadlineMargin = 0.001;  // (seconds) the search stops this long before the deadline to leave time to return the result
+    unsigned int Threads = 0;       // 0 means one per hardware thread, 1 searches on the calling thread
+    unsigned int HashBits = 0;      // the transposition table has 2^HashBits slots, 0 disables it (see Bot::AddChild)
+    BotWeights Weights;
+};
+
+// a reachable final position of a piece
+struct Placement
+{
+    MinoType Piece;
+    int Rotation;
+    glm::ivec2 Position;
+    SpinType Spin;                  // best spin the placement can be reached with
+    std::vector<MoveType> Moves;    // inputs from spawn, ending with a harddrop (only filled when requested)
+};
+
+// compact game state the search works on
+struct BotState
+{
+    Bitboard Board;
+    MinoType Current, Hold;
+    unsigned int QueueIndex;        // index of the next piece in the snapshot queue
+    unsigned int Combo;
+    unsigned int BackToBack;
+
+    // everything the rest of the search depends on: equal hashes have the same future
+    inline uint64_t Hash() const
+    {
+        return Zobrist::Mix(Board.Hash ^ Zobrist::Keys().Pieces(Current, Hold, QueueIndex), uint64_t(Combo) | uint64_t(BackToBack) << 32);
+    }
+};
+
+// what the bot knows about a game when it starts thinking
+struct BotSnapshot
+{
+    BotState State;                 // QueueIndex is always 0, Queue starts with the next piece
+    std::vector<MinoType> Queue;    // visible previews
+    bool HoldUsed;
+};
+
+struct SearchNode
+{
+    BotState State;
+    float Reward;                   // accumulated reward of the placements leading to this node
+    float Score;                    // reward + evaluation of the board, used to rank the beam
+    int Root;                       // index of the first placement of the path
+};
+
+struct BotSearchStats
+{
+    int DepthReached = 0;           // depth of the deepest completed iteration
+    int BeamWidthReached = 0;       // beam width of the deepest completed iteration
+    int Iterations = 0;             // completed iterations
+    bool Cancelled = false;         // the last iteration was interrupted by the token
+    double Seconds = 0.0;
+};
+
+struct BotDecision
+{
+    bool Valid = false;
+    bool UseHold = false;
+    Placement Target;
+    std::list<MoveType> Moves;      // ready to be fed to GameBoard::ExecuteMoves
+    float Score = 0.0f;
+    size_t NodesExpanded = 0;
+    size_t NodesPruned = 0;         // children dropped because the same state was already reached by a better path
+    BotSearchStats Stats;
+};
+
+// Beam search bot playing with the same rules as GameBoard.
+// Every search level expands all beam nodes in parallel on a work stealing pool,
+// every worker writes the children in its own arena, which is reused between levels and searches.
+// Without a deadline the search runs once at the configured depth and width. With a deadline it is
+// an anytime search: iterative deepening up to the configured depth, then widening of the beam,
+// always keeping the result of the last completed iteration.
+class Bot
+{
+    public:
+        BotConfig Config;
+        PieceTable Pieces;
+        std::shared_ptr<const OpeningBook> Book;    // positions it knows are played from it without searching
+
+        Bot(const BotConfig& config, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable);
+
+        // searches the best placement for the current piece of the board
+        // the search stops early (returning its best result so far) when the token is cancelled
+        BotDecision Think(const GameBoard& board, const CancellationToken* token = nullptr);
+        BotDecision Think(const BotSnapshot& snapshot, const CancellationToken* token = nullptr);
+
+        static BotSnapshot Snapshot(const GameBoard& board);
+
+        // the snapshot the game will be in once the decision has been executed, the last preview being unknown
+        BotSnapshot Predict(const BotSnapshot& snapshot, const BotDecision& decision) const;
+
+        // all distinct final positions of the piece reachable from spawn
+        // when the board is empty from startRow up, the search can start from every position on that row
+        // instead (much less states to visit), the moves are then not available
+        void GeneratePlacements(const Bitboard& board, MinoType piece, std::vector<Placement>& out, bool withMoves, int startRow = -1) const;
+
+        float Evaluate(const Bitboard& board) const;
+
+    private:
+        std::unique_ptr<ThreadPool> Pool;     // nullptr when searching on the calling thread
+        std::unique_ptr<TranspositionTable> Table;
+        std::vector<std::vector<SearchNode>> Arenas;
+        std::vector<std::vector<Placement>> PlacementBuffers;
+        std::vector<size_t> PrunedCounts;
+        std::vector<MinoType> Queue;
+
+        // index of the placement the book plays in the snapshot, -1 if it doesn't know the position
+        int BookPlacement(const BotSnapshot& snapshot, const std::vector<Placement>& placements, const std::vector<bool>& useHold) const;
+        // both return the number of children pruned by the transposition table
+        size_t Expand(const SearchNode& node, std::vector<SearchNode>& arena, std::vector<Placement>& buffer) const;
+        size_t AddChild(const SearchNode& node, const Placement& placement, MinoType nextCurrent, MinoType nextHold, unsigned int nextQueueIndex, std::vector<SearchNode>& arena) const;
+
+        // one beam search from the root children, returns false if it was cancelled (or ran past stopTime) before completion
+        bool SearchIteration(const std::vector<SearchNode>& rootChildren, int depth, int width, const CancellationToken* token, CancellationToken::Clock::time_point stopTime, BotDecision& decision, int& bestRoot);
+};
+
+// aggregated over all the decisions of a controller
+struct BotControllerStats
+{
+    size_t Decisions = 0;
+    size_t PonderHits = 0;          // decisions taken from the search done during the previous piece
+    size_t DeadlineMisses = 0;      // decisions that took longer than the budget
+    double TotalDepth = 0.0;
+    double MaxSeconds = 0.0;
+};
+
+// drives a GameBoard with the bot decisions, placing pieces at a fixed rate
+// while waiting for the next piece, the bot already thinks about it on the predicted board (pondering)
+// the searches never run on the calling thread: when the prediction was wrong, the piece is searched on the
+// pondering thread and Update returns no inputs until that search is done
+class BotController
+{
+    public:
+        float PPS;
+        float ThinkTime;                // seconds per decision, 0 uses most of the time between two pieces
+        BotControllerStats Stats;
+
+        BotController(const BotConfig& config, float pps, float thinkTime, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable, std::shared_ptr<const OpeningBook> book = nullptr);
+        ~BotController();
+
+        void Reset();
+
+        // returns the inputs to execute this frame, empty if it's not yet time for the next piece or its search
+        // isn't done yet (Stats.Decisions only counts the decisions that were returned). A decision without
+        // moves (Stats.Decisions went up) means no placement is left: the caller tops the board out
+        std::list<MoveType> Update(const GameBoard& board, float dt);
+
+    private:
+        Bot Engine;
+        float PieceTimer;
+
+        std::thread PonderThread;
+        CancellationToken PonderToken;
+        BotSnapshot PonderSnapshot;
+        BotDecision PonderDecision;
+        std::atomic<bool> PonderDone;   // the search of PonderThread returned
+        bool Deciding;                  // PonderThread searches the piece in play, not the predicted one
+
+        float DecisionBudget() const;
+        void StartSearch(const BotSnapshot& snapshot, float timeout);
+        void StartPondering(const BotSnapshot& snapshot, const BotDecision& decision);
+        std::list<MoveType> Decide(const BotSnapshot& snapshot, BotDecision decision);
+        // stops the pondering search, returns true if it was searching the given snapshot
+        bool StopPondering(const BotSnapshot& snapshot);
+};
+
+#endif // BOT_H
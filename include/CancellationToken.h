@@ -0,0 +1,72 @@
+#ifndef CANCELLATIONTOKEN_H
+#define CANCELLATIONTOKEN_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Cooperative cancellation for long running searches: the token is cancelled either
+// explicitly from another thread or implicitly once its deadline passed.
+// The search polls IsCancelled() between units of work and returns its best result so far.
+class CancellationToken
+{
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        CancellationToken()
+        :   Cancelled(false),
+            Deadline(INT64_MAX)
+        {
+
+        }
+
+        void Cancel()
+        {
+            Cancelled.store(true, std::memory_order_relaxed);
+        }
+
+        void SetDeadline(Clock::time_point deadline)
+        {
+            Deadline.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+        }
+
+        // deadline relative to now, a non positive timeout means no deadline
+        void SetTimeout(double seconds)
+        {
+            if (seconds <= 0.0)
+                Deadline.store(INT64_MAX, std::memory_order_relaxed);
+            else
+                SetDeadline(Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)));
+        }
+
+        // makes the token usable again for a new search
+        void Reset()
+        {
+            Cancelled.store(false, std::memory_order_relaxed);
+            Deadline.store(INT64_MAX, std::memory_order_relaxed);
+        }
+
+        bool HasDeadline() const
+        {
+            return Deadline.load(std::memory_order_relaxed) != INT64_MAX;
+        }
+
+        Clock::time_point GetDeadline() const
+        {
+            return Clock::time_point(Clock::duration(Deadline.load(std::memory_order_relaxed)));
+        }
+
+        bool IsCancelled() const
+        {
+            if (Cancelled.load(std::memory_order_relaxed))
+                return true;
+            int64_t deadline = Deadline.load(std::memory_order_relaxed);
+            return deadline != INT64_MAX && Clock::now().time_since_epoch().count() >= deadline;
+        }
+
+    private:
+        std::atomic<bool> Cancelled;
+        std::atomic<int64_t> Deadline;      // in Clock ticks since epoch
+};
+
+#endif // CANCELLATIONTOKEN_H
@@ -0,0 +1,24 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Fast block compression producing the LZ4 block format (greedy matching, 64 KiB window),
+// so the output can be read back with any LZ4 implementation (e.g. lz4.block.decompress with
+// uncompressed_size set). It compresses the columns of the training export.
+class Compression
+{
+    public:
+        // appends the compressed block to out, returns its size
+        static size_t Compress(const uint8_t *data, size_t size, std::vector<uint8_t>& out);
+
+        // decompresses a whole block of known decompressed size, false if the block is malformed
+        static bool Decompress(const uint8_t *data, size_t size, uint8_t *out, size_t outSize);
+
+    private:
+        Compression() { }
+};
+
+#endif // COMPRESSION_H
@@ -6,9 +6,14 @@
 
 #include "ResourceManager.h"
 #include "SpriteRenderer.h"
+#include "InstancedRenderer.h"
 #include "TextRenderer.h"
 #include "GameBoard.h"
 #include "GameSettings.h"
+#include "Bot.h"
+#include "HintWorker.h"
+#include "Versus.h"
+#include "SpectatorFeed.h"
 
 #include <unordered_map>
 #include <string>
@@ -30,6 +35,11 @@ class Game
         static const glm::vec2 BOARD_BACK_POS;
         static const glm::vec2 BOARD_BACK_SIZE;
         static const float GHOST_OPACITY;
+        static const float HINT_OPACITY;
+        static const float KNOCKED_OUT_SHADE;
+        static const float GRID_TEXTURED_MINO;
+        static const float GRID_TEXT_MINO;
+        static const unsigned int MAX_TICKS_PER_FRAME;
 
         const GameSettings&     Settings;
         GameState               State;
@@ -42,8 +52,23 @@ class Game
         unsigned int            Width, Height;
 
         SpriteRenderer          *SpriteRender;
+        InstancedRenderer       *GridRender;    // draws the boards of a versus match
         TextRenderer            *TextRender;
         GameBoard               *Board;
+        BotController           *BotPlayer;     // nullptr when the board is played from the keyboard
+        HintWorker              *Hints;         // created the first time hints are shown
+        std::shared_ptr<const OpeningBook> Book;    // nullptr without opening book
+
+        VersusMatch             *Match;         // nullptr in the single player game
+        int                     KeyboardBoard;  // board of the match played from the keyboard, -1 for none
+        float                   TickTime;       // time the match still has to simulate, it advances by fixed ticks
+        bool                    MatchRecorded;
+        SpectatorFeed           *Spectators;    // nullptr unless a grid of boards is watched
+
+        bool                    ShowHint;
+        bool                    HintSubmitted;
+        uint64_t                HintSequence;   // identifies the board state the hint has to be computed for
+        uint64_t                HintBoardKey;
 
         glm::vec2               BoardSize;
         glm::vec2               BoardPosition;
@@ -70,10 +95,21 @@ class Game
         void Render();
 
     private:
+        void UpdateHint();
+        void InitVersus();
+        void RestartVersus();
+        void UpdateVersus(float dt);
+        void RecordVersus();
+        void InitSpectators();
         void DrawBoard();
         void DrawStatistics();
         void DrawTetrominoPreview(MinoType type, int previewIndex);
         void DrawTetromino(MinoType type, MinoType minoColor, int rotation, glm::vec2 pos);
+        void DrawGrid();
+        void DrawSpectators();
+        void DrawGridBoard(const GameBoard& board, glm::vec2 position, glm::vec2 minoSize);
+        void DrawFlatBoard(const GameBoard& board, glm::vec2 position, glm::vec2 minoSize);
+        void AddGridTetromino(const GameBoard& board, MinoType type, MinoType minoColor, int rotation, glm::vec2 pos, glm::vec2 minoSize, float shade);
 };
 
 #endif // GAME_H
@@ -1,20 +1,19 @@
 #ifndef GAMEBOARD_H
 #define GAMEBOARD_H
 
-#include "SpriteRenderer.h"
-#include "ResourceManager.h"
-
 #include <glm/glm.hpp>
 
 #include <vector>
 #include <array>
 #include <list>
+#include <iterator>
 #include <string>
 #include <unordered_map>
 #include <random>
 #include <algorithm>
 #include <ranges>
 #include <chrono>
+#include <cstdint>
 
 enum MinoType
 {
@@ -55,7 +54,18 @@ enum MoveType
     MOVE_DOWN
 };
 
+// how the piece that was placed got into place, see SpinDetector
+enum SpinType : uint8_t
+{
+    SPIN_NONE,
+    SPIN_MINI,
+    SPIN_FULL
+};
+
 const int PREVIEW_NUMBER = 6;
+const int MATRIX_ROWS = 40;
+const int MATRIX_COLS = 10;
+const uint16_t FULL_ROW = 0x3FF;
 const std::array<MinoType, 7> SEVEN_PIECE_BAG = { BLOCK_I, BLOCK_J, BLOCK_L, BLOCK_O, BLOCK_S, BLOCK_T, BLOCK_Z };
 
 struct Tetromino
@@ -63,6 +73,15 @@ struct Tetromino
     std::array<glm::ivec2, 4> PieceOffsets;
 };
 
+const int MAX_GARBAGE_PACKETS = 16;
+
+// garbage lines received at once, they share their hole (see GameBoard::GarbageMessiness)
+struct GarbagePacket
+{
+    unsigned int Lines;
+    unsigned int ReadyAt;           // value of PiecesPlaced from which the packet can enter the board
+};
+
 // block rotations
 // notation:
 // 0: default rotation / spawn state / north orientation
@@ -272,15 +291,64 @@ const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec
     { BLOCK_Z, JLSTZ_SRS_PLUS_KICK_TABLE}
 };
 
-class GameBoard
+// Fixed capacity queue of the next pieces. It's a ring buffer, so refilling it never allocates and
+// copying it (board snapshots) is a plain copy. Same interface as the std containers it replaced.
+class PieceQueue
 {
     public:
-        std::unordered_map<MinoType, std::array<Tetromino, 4>> RotationOffsets;
-        std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>> KickTable;
+        static constexpr unsigned int CAPACITY = 16;
+
+        class Iterator
+        {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = MinoType;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const MinoType*;
+                using reference = MinoType;
 
+                Iterator() : Queue(nullptr), Index(0) { }
+                Iterator(const PieceQueue *queue, unsigned int index) : Queue(queue), Index(index) { }
+                MinoType operator*() const { return Queue->Pieces[(Queue->First + Index) % CAPACITY]; }
+                Iterator& operator++() { Index = Index + 1; return *this; }
+                Iterator operator++(int) { Iterator old = *this; Index = Index + 1; return old; }
+                bool operator==(const Iterator& other) const { return Index == other.Index; }
+                bool operator!=(const Iterator& other) const { return Index != other.Index; }
+
+            private:
+                const PieceQueue *Queue;
+                unsigned int Index;
+        };
+
+        PieceQueue() : Pieces(), First(0), Count(0) { }
+
+        void clear() { First = 0; Count = 0; }
+        bool empty() const { return Count == 0; }
+        size_t size() const { return Count; }
+        MinoType front() const { return Pieces[First]; }
+        void push_back(MinoType piece) { Pieces[(First + Count) % CAPACITY] = piece; Count = Count + 1; }
+        void pop_front() { First = (First + 1) % CAPACITY; Count = Count - 1; }
+
+        Iterator begin() const { return Iterator(this, 0); }
+        Iterator end() const { return Iterator(this, Count); }
+
+    private:
+        MinoType Pieces[CAPACITY];
+        unsigned int First, Count;
+};
+
+// the previews, a bag added to them and the piece being taken out
+static_assert(PREVIEW_NUMBER + 1 + 7 <= PieceQueue::CAPACITY, "the queue must hold the previews and a new bag");
+
+// Everything a board changes while it's played. It's a plain copyable class, so saving and restoring a
+// board (GameBoard::SaveState / LoadState, the rollback netcode does it every frame) is a single copy.
+// The rotation and kick tables and the clock aren't part of it.
+class GameBoardState
+{
+    public:
         // game  state
         MinoType Matrix[40][10];        // internal state of the board
-        std::list<MinoType> TetrominoQueue;
+        PieceQueue TetrominoQueue;
 
         MinoType CurrentPiece, HoldPiece;
         glm::ivec2 CurrentPosition, GhostPosition;
@@ -288,24 +356,110 @@ class GameBoard
         bool HoldUsed;
 
         unsigned int LinesCleared, PiecesPlaced, Combo;
-        std::chrono::time_point<std::chrono::high_resolution_clock> StartTime, StopTime;
+        unsigned int BackToBack;        // difficult clears (tetrises and spins) in a row, see AttackTable
+        unsigned int LinesSent;         // garbage lines sent by all the placements
+        unsigned int LastAttack;        // same, by the last one
+        SpinType LastSpin;              // spin of the last placement
+
+        MoveType LastAction;            // last input that moved or rotated the current piece (NO_MOVE since it spawned)
+        int LastKick;                   // index in the kick table of the offset used by the last rotation
+        bool LastKickTST;               // that offset was the last one of a 90 degree rotation (the TST kick)
+
+        // Incoming garbage. Received packets wait in order, the attack of every placement cancels the
+        // oldest ones first and only what is left (Outgoing) goes to the opponents. A placement that
+        // doesn't clear lines raises the stack with every packet that is ready. Hole columns come from
+        // their own generator, so the same seed and packets always give the same garbage.
+        GarbagePacket PendingGarbage[MAX_GARBAGE_PACKETS];      // oldest first
+        unsigned int PendingPackets;
+        unsigned int Outgoing;          // attack of the last placement left after cancelling
+        unsigned int GarbageDelay;      // placements a packet waits before it can enter the board (kept by Load)
+        unsigned int GarbageMessiness;  // chance in percent for every line of a packet to move the hole (kept by Load)
+        unsigned int GarbageSeed;
+        std::mt19937 GarbageRNG;
+        unsigned int GarbageDraws;      // outputs taken from GarbageRNG since Load
+        int GarbageHole;                // hole column of the last garbage line
+
+        // board metrics, kept up to date by every placement, line clear and SetMatrix (read only)
+        int ColumnHeights[10];          // index of the highest mino of every column + 1
+        int ColumnHoles[10];            // empty cells below the highest mino of every column
+        int RowFill[40];                // minos in every row
+        uint16_t RowMasks[40];          // occupied cells of every row, bit n is column n
+        uint64_t SolidRows;             // bit n is set when row n contains solid garbage and can never be cleared
+        int StackHeight;                // highest column
+        int Holes;                      // all columns
+        uint64_t ColumnMasks[10];       // occupied cells of every column, bit n is row n
+        uint64_t MatrixHash;            // Zobrist hash of RowMasks (see GameBoard::StateHash)
 
         unsigned int BagSeed;
         std::mt19937 BagRNG;
+        unsigned int BagDraws;          // bags drawn from BagRNG since Load
 
         bool IsOver, IsPaused;
+};
+
+class GameBoard;
+
+// told about every placement of ExecuteTick (the training export of recorded matches)
+class PlacementObserver
+{
+    public:
+        virtual ~PlacementObserver() = default;
+
+        // the piece in play is about to be hard dropped where it is
+        virtual void Placing(const GameBoard& board) = 0;
+        // it was placed, the next piece is in play
+        virtual void Placed(const GameBoard& board) = 0;
+};
+
+class GameBoard : public GameBoardState
+{
+    public:
+        std::unordered_map<MinoType, std::array<Tetromino, 4>> RotationOffsets;
+        std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>> KickTable;
+        std::chrono::time_point<std::chrono::high_resolution_clock> StartTime, StopTime;
 
         // constructor
         GameBoard(const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable);
 
         // prepares board
         void Load();
+        // same as above, with a fixed bag seed so the piece sequence can be reproduced
+        void Load(unsigned int bagSeed);
+        // same as above, with a fixed garbage seed too (the one above derives it from the bag seed)
+        void Load(unsigned int bagSeed, unsigned int garbageSeed);
+        // Loads and starts the board of a player in a match: all the boards of the match deal the same
+        // pieces, each one with garbage holes of its own. Every kind of match (versus, rollback, server,
+        // self-play) loads its boards here, so the same seed gives the same match everywhere.
+        void LoadMatch(unsigned int seed, unsigned int player, unsigned int garbageDelay, unsigned int garbageMessiness);
 
         // set matrix configuration
         // works with all sizes equal or smaller than the matrix used
         void SetMatrix(const std::vector<std::vector<MinoType>>& matrix);
 
         void ExecuteMoves(const std::list<MoveType>& moves);
+        // same, without allocating (the list above is the convenient form for the game and the bot)
+        void ExecuteMoves(const MoveType *moves, size_t count);
+
+        // the inputs of a match tick, returns the garbage their placements send (see Outgoing)
+        unsigned int ExecuteTick(const std::list<MoveType>& moves, PlacementObserver *observer = nullptr);
+        unsigned int ExecuteTick(const MoveType *moves, size_t count, PlacementObserver *observer = nullptr);
+
+        // the state is copied as is, loading it back resumes the board exactly where it was saved
+        void SaveState(GameBoardState& state) const;
+        void LoadState(const GameBoardState& state);
+
+        // Hash of everything that decides how the board plays on: matrix occupancy, solid rows, queue,
+        // piece in play and hold, counters, pending garbage and both generators (seed and draws, their
+        // outputs follow from them). The matrix part is kept up to date by every placement, line clear
+        // and garbage insertion like the metrics, the rest is a few words, so it's cheap enough to be
+        // computed every tick to detect desyncs. Mino types aren't hashed: they're only drawn.
+        uint64_t StateHash() const;
+        // readable dump of the same state, to compare two boards that stopped agreeing
+        std::string DumpState() const;
+
+        // queues garbage sent by an opponent, it enters after GarbageDelay placements unless cancelled
+        void ReceiveGarbage(unsigned int lines);
+        unsigned int PendingGarbageLines() const;
 
         std::chrono::duration<double> GetElapsedTime();
 
@@ -314,12 +468,30 @@ class GameBoard
 
     private:
         void ClearBoard();
+        void AddMino(int row, int col, MinoType type);
+        void ComputeMetrics();
+        void ComputeColumnMetrics();
+        void ComputeMatrixHash();
+        // the moves of both ExecuteMoves, any range of MoveType
+        template <typename Moves>
+        void ExecuteMoveRange(const Moves& moves);
+        // the inputs of both ExecuteTick
+        template <typename Moves>
+        unsigned int ExecuteTickRange(const Moves& moves, PlacementObserver *observer);
+        // returns the attack left after cancelling pending garbage
+        unsigned int CancelGarbage(unsigned int attack);
+        void TakeGarbage();
+        void InsertGarbage(unsigned int lines);
+        unsigned int DrawGarbage();
         std::array<MinoType, 7> GetNextBag();
         void PopulateQueue();
         glm::ivec2 SoftDropPosition();
         bool CurrentPieceCanMoveAt(glm::ivec2 position, int rotation);
         void NextPiece();
-        unsigned int ClearLines();
+        // puts the piece at the spawn, the board tops out if it doesn't fit there
+        void SpawnPiece(MinoType piece);
+        // clears the full rows between fromRow and toRow (the ones the last piece touched)
+        unsigned int ClearLines(int fromRow, int toRow);
         bool RotateWithKick(MoveType rot);
 };
 
@@ -3,6 +3,7 @@
 
 #include <toml++/toml.h>
 #include <string>
+#include <vector>
 #include <GLFW/glfw3.h>
 
 class GameSettings {
@@ -12,9 +13,28 @@ public:
     int Hold;
     int RotateClockwise, RotateAnticlockwise, Rotate180;
     int Restart, Quit;
+    int ToggleHint;
     double DAS, ARR, SDR;
     bool ResetDASOnDirectionChange;
 
+    bool BotEnabled;
+    double BotPPS, BotThinkTime;
+    int BotBeamWidth, BotDepth, BotThreads;
+    std::string BotBook;
+
+    bool HintEnabled;
+    double HintThinkTime;
+    bool HintPerfectClear;
+
+    int VersusBoards;
+    std::vector<std::string> VersusInputs;
+    int VersusGarbageDelay, VersusMessiness;
+    std::string VersusReplay, VersusRecord;
+
+    int SpectatorBoards;
+    std::string SpectatorSource, SpectatorServer;
+    std::vector<std::string> SpectatorReplays;
+
     GameSettings(const std::string& filename);
 
 private:
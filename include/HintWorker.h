@@ -0,0 +1,65 @@
+#ifndef HINTWORKER_H
+#define HINTWORKER_H
+
+#include "Bot.h"
+#include "PerfectClear.h"
+#include "LockFree.h"
+#include "CancellationToken.h"
+
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// best placement for the board state identified by Sequence
+struct Hint
+{
+    uint64_t Sequence = 0;
+    bool Valid = false;
+    bool UseHold = false;
+    MinoType Piece = MinoType::EMPTY;
+    int Rotation = 0;
+    glm::ivec2 Position = glm::ivec2(0, 0);
+};
+
+// Runs the bot on a background thread to suggest a placement for the current piece.
+// Known openings are suggested from the opening book, if there is one. With the perfect clear
+// search enabled, the first step of a perfect clear is suggested whenever one is found in the
+// first half of the think time.
+// Board snapshots go in through a lock-free ring and results come out through a triple buffer,
+// so the game thread never waits on the search: it submits a snapshot whenever the board changes
+// and draws whatever hint was last published, provided it was computed for the current state.
+class HintWorker
+{
+    public:
+        float ThinkTime;
+
+        HintWorker(const BotConfig& config, float thinkTime, bool perfectClear, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable, std::shared_ptr<const OpeningBook> book = nullptr);
+        ~HintWorker();
+
+        // game thread: queues a search of the board, a newer submission cancels the running search
+        // returns false if the queue is full, the caller should try again later
+        bool Submit(const GameBoard& board, uint64_t sequence);
+
+        // game thread: latest hint, nullptr if there's none for the given state yet
+        const Hint* Latest(uint64_t sequence);
+
+    private:
+        struct Request
+        {
+            uint64_t Sequence;
+            BotSnapshot Snapshot;
+        };
+
+        Bot Engine;
+        std::unique_ptr<PerfectClearSolver> Solver;     // nullptr when perfect clears aren't searched
+        std::thread Thread;
+        SpscQueue<Request, 16> Requests;
+        TripleBuffer<Hint> Results;
+        CancellationToken Token;
+        std::atomic<uint32_t> Signal;       // bumped on every submission, the worker sleeps on it
+        std::atomic<bool> Stopping;
+
+        void Run();
+};
+
+#endif // HINTWORKER_H
@@ -0,0 +1,45 @@
+#ifndef INSTANCEDRENDERER_H
+#define INSTANCEDRENDERER_H
+
+#include "glad.h"
+#include <glm/glm.hpp>
+
+#include "Texture.h"
+#include "Shader.h"
+
+#include <vector>
+
+// Draws many colored quads of the same texture with a single instanced draw call.
+// Quads are queued with Add() and drawn by Flush(), one draw call per texture used since the last flush.
+class InstancedRenderer
+{
+public:
+    // Constructor (inits shaders/shapes)
+    InstancedRenderer(Shader &shader);
+    // Destructor
+    ~InstancedRenderer();
+    // Queues a quad textured with given sprite
+    void Add(const Texture2D &texture, glm::vec2 position, glm::vec2 size, glm::vec4 color = glm::vec4(1.0f));
+    // Draws the queued quads, in the order their textures were first used
+    void Flush();
+private:
+    // instances of one texture: position, size and color, 8 floats each
+    struct Batch
+    {
+        Texture2D          texture;
+        std::vector<float> instances;
+    };
+
+    // Render state
+    Shader             shader;
+    unsigned int       quadVAO;
+    unsigned int       quadVBO;
+    unsigned int       instanceVBO;
+    size_t             instanceCapacity;
+    std::vector<Batch> batches;         // kept between frames with their memory, the first activeBatches are in use
+    size_t             activeBatches;
+    // Initializes and configures the quad's buffer and vertex attributes
+    void initRenderData();
+};
+
+#endif // INSTANCEDRENDERER_H
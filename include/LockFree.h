@@ -0,0 +1,104 @@
+#ifndef LOCKFREE_H
+#define LOCKFREE_H
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded single producer / single consumer ring buffer.
+// Push and Pop never block: they fail when the ring is full or empty.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of 2");
+
+    public:
+        SpscQueue()
+        :   Head(0),
+            Tail(0)
+        {
+
+        }
+
+        // producer side
+        bool Push(const T& value)
+        {
+            size_t tail = Tail.load(std::memory_order_relaxed);
+            if (tail - Head.load(std::memory_order_acquire) == Capacity)
+                return false;
+
+            Slots[tail & (Capacity - 1)] = value;
+            Tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side
+        bool Pop(T& value)
+        {
+            size_t head = Head.load(std::memory_order_relaxed);
+            if (head == Tail.load(std::memory_order_acquire))
+                return false;
+
+            value = std::move(Slots[head & (Capacity - 1)]);
+            Head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool Empty() const
+        {
+            return Head.load(std::memory_order_acquire) == Tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::array<T, Capacity> Slots;
+        alignas(64) std::atomic<size_t> Head;   // next slot to read, written by the consumer only
+        alignas(64) std::atomic<size_t> Tail;   // next slot to write, written by the producer only
+};
+
+// Wait-free single writer / single reader publication of the latest value.
+// The writer fills a back buffer and swaps it with the shared middle one, the reader
+// swaps the middle buffer with its front one only when something new was published,
+// so neither side ever waits for the other and the reader never sees a half written value.
+template <typename T>
+class TripleBuffer
+{
+    public:
+        TripleBuffer()
+        :   Middle(1),
+            Back(2),
+            Front(0)
+        {
+
+        }
+
+        // writer side: fill Write() then Publish() it
+        T& Write()
+        {
+            return Buffers[Back];
+        }
+
+        void Publish()
+        {
+            Back = Middle.exchange(Back | DIRTY, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // reader side: latest published value (or the previous one if nothing new was published)
+        const T& Read()
+        {
+            if (Middle.load(std::memory_order_relaxed) & DIRTY)
+                Front = Middle.exchange(Front, std::memory_order_acq_rel) & INDEX;
+            return Buffers[Front];
+        }
+
+    private:
+        static const uint8_t DIRTY = 4;
+        static const uint8_t INDEX = 3;
+
+        std::array<T, 3> Buffers;
+        std::atomic<uint8_t> Middle;
+        uint8_t Back;       // owned by the writer
+        uint8_t Front;      // owned by the reader
+};
+
+#endif // LOCKFREE_H
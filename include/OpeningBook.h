@@ -0,0 +1,109 @@
+#ifndef OPENINGBOOK_H
+#define OPENINGBOOK_H
+
+#include "GameBoard.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// one placement of a book line
+struct BookMove
+{
+    uint8_t UseHold;
+    uint8_t Piece;
+    uint8_t Rotation;
+    int8_t Row, Column;
+    uint8_t Reserved[3];
+};
+
+// a book position: the zobrist hash of the board (Bitboard::Hash) and the pieces, packed as
+// hold (3 bits) | count (3 bits) | current and previews (count x 3 bits, at most 7 pieces)
+struct BookKey
+{
+    uint64_t BoardHash;
+    uint32_t Pieces;
+    uint32_t Reserved;
+
+    inline bool operator<(const BookKey& other) const
+    {
+        return BoardHash != other.BoardHash ? BoardHash < other.BoardHash : Pieces < other.Pieces;
+    }
+    inline bool operator==(const BookKey& other) const
+    {
+        return BoardHash == other.BoardHash && Pieces == other.Pieces;
+    }
+};
+
+struct BookEntry
+{
+    BookKey Key;
+    uint32_t First;                 // index of the first move of the line
+    uint32_t Count;                 // moves in the line
+};
+
+// Opening book, a read only memory mapped file, all numbers little endian:
+//
+//   header   char Magic[4] = "STKB", uint32_t Version, uint32_t Entries, uint32_t Moves
+//   entries  Entries x BookEntry (24 bytes), sorted by board hash then pieces
+//   moves    Moves x BookMove (8 bytes)
+//
+// Opening the book maps the file and checks its sizes and that every line stays inside the moves (one
+// pass over the entries), nothing is parsed or copied. Board hashes are uniformly distributed, so
+// lookups use an interpolation search on them (a couple of probes for any book size) and finish with a
+// binary search. A position is found from the pieces left in the bag the line was planned for: the
+// lookup tries the visible pieces from the longest prefix down.
+// The hashes are Zobrist::Keys() ones, a book stays valid as long as ZOBRIST_SEED doesn't change.
+class OpeningBook
+{
+    public:
+        static const uint32_t VERSION = 1;
+        static const unsigned int MAX_PIECES = 7;
+
+        // throws std::runtime_error if the file can't be mapped or isn't a book
+        OpeningBook(const std::string& path);
+        ~OpeningBook();
+
+        OpeningBook(const OpeningBook&) = delete;
+        OpeningBook& operator=(const OpeningBook&) = delete;
+
+        static BookKey Key(uint64_t boardHash, MinoType hold, const MinoType *pieces, unsigned int count);
+
+        // line to play from the position, nullptr if the book doesn't know it
+        const BookEntry* Find(const BookKey& key) const;
+        // same, for the longest prefix of the pieces (current piece first) the book knows
+        const BookEntry* Find(uint64_t boardHash, MinoType hold, const MinoType *pieces, unsigned int count) const;
+
+        const BookMove* Moves(const BookEntry& entry) const;
+        size_t Size() const;
+
+    private:
+        void *Mapping;
+        size_t MappingSize;
+        const BookEntry *Entries;
+        const BookMove *MoveData;
+        uint32_t EntryCount;
+        uint32_t MoveCount;
+};
+
+// Collects lines and writes them as a book. A line is a sequence of moves and the keys of the
+// positions before every move, each of them gets an entry pointing into the line. When the same
+// position is reached by several lines the first one added is kept.
+class OpeningBookBuilder
+{
+    public:
+        // keys[i] is the position before moves[i]
+        void AddLine(const std::vector<BookKey>& keys, const std::vector<BookMove>& moves);
+
+        // throws std::runtime_error if the file can't be written
+        void Write(const std::string& path) const;
+
+        size_t Size() const;
+
+    private:
+        std::vector<BookEntry> Entries;
+        std::vector<BookMove> Moves;
+};
+
+#endif // OPENINGBOOK_H
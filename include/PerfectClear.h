@@ -0,0 +1,87 @@
+#ifndef PERFECTCLEAR_H
+#define PERFECTCLEAR_H
+
+#include "Bot.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+#include "CancellationToken.h"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+struct PerfectClearConfig
+{
+    int MaxHeight = 4;              // highest perfect clear searched, in lines
+    bool Hold = true;               // false searches without ever using hold
+    unsigned int Threads = 0;       // 0 means one per hardware thread, 1 searches on the calling thread
+    unsigned int HashBits = 20;     // size of the table of states known to have no solution
+};
+
+struct PerfectClearStep
+{
+    bool UseHold;
+    Placement Target;               // Moves are filled
+};
+
+struct PerfectClearSolution
+{
+    bool Found = false;
+    int Height = 0;                 // lines cleared by the perfect clear
+    std::vector<PerfectClearStep> Steps;
+    size_t NodesSearched = 0;
+    bool Cancelled = false;
+    double Seconds = 0.0;
+};
+
+// Finds a sequence of placements of the visible pieces (current, hold and previews) clearing the
+// whole board within MaxHeight lines. Heights are tried from the lowest one the cell count allows.
+// Every piece must stay below the target height, so each one is checked against:
+//  - cell count: the empty cells below the height must be filled by the pieces still available
+//  - regions: every enclosed empty region must have a multiple of 4 cells
+//  - parity: on a checkerboard only T pieces cover an odd number of dark cells, so the dark / light
+//    imbalance of the empty cells must be coverable by the T pieces left
+// States proven to have no solution are memoised in a lock-free table shared by the threads searching
+// the first placements in parallel. The key covers the board, current and hold pieces and the ordered
+// pieces left in the queue, so it stays valid from one solve to the next and can be shared by several
+// solvers with the same rules (e.g. one per thread solving different queues).
+class PerfectClearSolver
+{
+    public:
+        PerfectClearConfig Config;
+
+        // without a memo table the solver allocates its own with Config.HashBits
+        PerfectClearSolver(const PerfectClearConfig& config, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable, std::shared_ptr<TranspositionTable> memo = nullptr);
+
+        PerfectClearSolution Solve(const GameBoard& board, const CancellationToken* token = nullptr);
+        PerfectClearSolution Solve(const BotSnapshot& snapshot, const CancellationToken* token = nullptr);
+
+    private:
+        struct Choice
+        {
+            bool UseHold;
+            Placement Target;
+            BotState Next;
+            int Height;             // lines left to clear after the placement
+        };
+
+        Bot Generator;              // only used for placement generation
+        std::unique_ptr<ThreadPool> Pool;
+        std::shared_ptr<TranspositionTable> Dead;
+        std::vector<MinoType> Queue;
+        std::vector<uint64_t> QueueKeys;        // [i] identifies the pieces of the queue from index i on
+        std::vector<std::vector<Placement>> PlacementBuffers;       // [worker]
+        std::vector<std::unordered_map<uint64_t, std::vector<Placement>>> PlacementCache;     // [worker], by board hash and piece
+        std::vector<std::vector<std::vector<Choice>>> ChoiceBuffers; // [worker][depth]
+        std::atomic<bool> Found;
+        std::atomic<size_t> Nodes;
+
+        // children of the state that keep every mino below the height, in search order
+        void Expand(const BotState& state, int height, bool canHold, unsigned int worker, std::vector<Choice>& out);
+        bool Search(const BotState& state, int height, int depth, unsigned int worker, const CancellationToken* token, std::vector<Choice>& path);
+        bool Feasible(const BotState& state, int height) const;
+        bool Aborted(const CancellationToken* token) const;
+        uint64_t MemoKey(const BotState& state, int height) const;
+};
+
+#endif // PERFECTCLEAR_H
@@ -0,0 +1,180 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include "GameBoard.h"
+
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+const unsigned int MAX_TICK_MOVES = 15;         // longer input sequences are spread over several ticks
+
+// the inputs of a player for one tick (MoveType values)
+struct TickInput
+{
+    uint8_t Count;
+    uint8_t Moves[MAX_TICK_MOVES];
+
+    inline bool operator==(const TickInput& other) const
+    {
+        return Count == other.Count && std::equal(Moves, Moves + Count, other.Moves);
+    }
+};
+
+// executes the input on the board, returns the garbage it sent (after cancelling)
+unsigned int RunTickInput(GameBoard& board, const TickInput& input);
+
+struct RollbackStats
+{
+    size_t Rollbacks = 0;
+    size_t ResimulatedTicks = 0;
+    unsigned int MaxRollback = 0;       // most ticks re-simulated at once
+    size_t PacketsReceived = 0;
+    size_t PacketsIgnored = 0;          // malformed, or their inputs don't follow the ones received
+};
+
+// GGPO style rollback for an online match of two boards.
+//
+// Both peers simulate both boards with the same seed. The local inputs are applied at once, the remote
+// ones are predicted (no input, players mostly wait between two inputs) until they arrive. Before every
+// tick the boards are saved, and when a remote input turns out to differ from the prediction the boards
+// are restored to the tick it was for and re-simulated up to the present, in the same AdvanceTick call.
+// Snapshots are plain copies of GameBoardState and a tick executes its inputs with the allocation free
+// ExecuteMoves, so re-simulating the whole window (MAX_ROLLBACK ticks) costs a few microseconds.
+//
+// The session doesn't own a socket: it writes and reads packets, moving them is up to the caller
+// (UdpSocket, or LossyLink to test without a network). A packet carries every local input the remote
+// peer didn't acknowledge yet, so lost packets are covered by the next ones.
+//
+// Desyncs are detected with a rolling hash of both boards (GameBoard::StateHash), folded in once a tick
+// is confirmed. The hashes are acknowledged and resent like the inputs, so every confirmed tick gets
+// compared and the first one that differs is reported with a dump of the boards after it.
+//
+//   packet   uint32_t Magic = "STKN", uint32_t FirstTick, uint32_t Ack, uint32_t Count,
+//            uint32_t FirstHash, uint32_t HashAck, uint32_t HashCount,
+//            Count x TickInput (16 bytes), the sender's inputs from FirstTick
+//            HashCount x uint32_t, low half of the sender's rolling hash after every tick from FirstHash
+//            Ack, HashAck: remote inputs and hashes the sender received so far (all the ticks below it)
+class RollbackSession
+{
+    public:
+        static constexpr unsigned int PLAYERS = 2;
+        static constexpr unsigned int MAX_ROLLBACK = 16;       // ticks the simulation can run ahead of the remote inputs
+        static constexpr unsigned int INPUT_WINDOW = 32;       // local inputs kept until the remote peer acknowledged them
+        static constexpr unsigned int HASH_WINDOW = 64;        // confirmed hashes kept until compared, and board snapshots
+        static constexpr size_t MAX_PACKET_SIZE = 28 + INPUT_WINDOW * sizeof(TickInput) + HASH_WINDOW * sizeof(uint32_t);
+
+        unsigned int LocalPlayer;
+        uint32_t Tick;                          // next tick to simulate
+        uint32_t RemoteReceived;                // remote inputs received, all the ticks below it
+        uint32_t RemoteAcked;                   // local inputs the remote peer received
+        RollbackStats Stats;
+        std::unique_ptr<GameBoard> Boards[PLAYERS];
+
+        uint32_t HashesChecked;                 // ticks compared with the remote hashes, all the ticks below it
+        int64_t DesyncTick;                     // first tick after which the hashes differed, -1 while in sync
+        uint32_t DesyncHashes[2];               // local and remote hash after it
+        std::string DesyncDump;                 // both boards after it, as simulated by this peer
+
+        // both peers have to use the same seed and garbage settings, player 0 on one and 1 on the other
+        RollbackSession(unsigned int localPlayer, unsigned int seed, unsigned int garbageDelay, unsigned int garbageMessiness);
+
+        RollbackSession(const RollbackSession&) = delete;
+        RollbackSession& operator=(const RollbackSession&) = delete;
+
+        // false while the simulation is too far ahead of the remote inputs or hashes, or the remote peer
+        // too far behind the local ones: the caller waits (keeps exchanging packets) until it can go on
+        bool CanAdvance() const;
+
+        // re-simulates the mispredicted ticks if any, then simulates the next tick with the local input
+        void AdvanceTick(const TickInput& local);
+        // only the first part, to settle the boards on the inputs received without advancing
+        void Resimulate();
+
+        // ticks simulated with the inputs of both players, they can't be rolled back anymore
+        uint32_t ConfirmedTick() const;
+
+        // returns the packet size, buffer holds MAX_PACKET_SIZE bytes
+        size_t WritePacket(uint8_t *buffer) const;
+        void ReadPacket(const uint8_t *data, size_t size);
+
+        // one tick of a match: the inputs of both boards, then the garbage they sent to each other
+        static void SimulateTick(GameBoard& first, GameBoard& second, const TickInput& firstInput, const TickInput& secondInput);
+
+    private:
+        static constexpr uint32_t MAGIC = 0x4E4B5453;          // "STKN"
+
+        TickInput LocalInputs[INPUT_WINDOW];                    // by tick % INPUT_WINDOW
+        TickInput RemoteInputs[INPUT_WINDOW];
+        GameBoardState Snapshots[HASH_WINDOW + 1][PLAYERS];     // boards before the tick, by tick % (HASH_WINDOW + 1)
+        uint32_t Mispredicted;                                  // first tick simulated with a wrong prediction, Tick if none
+
+        uint64_t TickHashes[HASH_WINDOW];                       // both boards after the tick, by tick % HASH_WINDOW
+        uint64_t LocalHashes[HASH_WINDOW];                      // rolling hash after the tick once it's confirmed
+        uint32_t RemoteHashes[HASH_WINDOW];
+        uint32_t HashesConfirmed;                               // ticks folded into LocalHashes, all the ticks below it
+        uint32_t RemoteHashesReceived;
+        uint32_t RemoteHashesAcked;                             // local hashes the remote peer received
+
+        // the input of the player for a tick, predicted if it didn't arrive yet
+        TickInput Input(unsigned int player, uint32_t tick) const;
+        void Simulate(uint32_t tick);
+        // folds the ticks confirmed since the last call into the rolling hash, once they're re-simulated
+        void ConfirmHashes();
+        void CheckHashes();
+        std::string DumpBoards(uint32_t tick) const;
+};
+
+// Simulated network between two peers for the loopback harness: every packet is delayed by the latency
+// plus a uniform jitter (so packets can arrive out of order) and dropped with the loss probability.
+// Time is whatever the caller counts in, milliseconds in stacker-netsim.
+class LossyLink
+{
+    public:
+        size_t Sent, Dropped;
+
+        // loss is a probability, latency and jitter in the caller's time unit
+        LossyLink(double latency, double jitter, double loss, unsigned int seed);
+
+        void Send(double now, const uint8_t *data, size_t size);
+        // the next packet delivered by 'now', false if there is none
+        bool Receive(double now, std::vector<uint8_t>& packet);
+
+    private:
+        struct InFlight
+        {
+            double DeliverAt;
+            std::vector<uint8_t> Data;
+        };
+
+        double Latency, Jitter, Loss;
+        std::mt19937 RNG;
+        std::vector<InFlight> Packets;
+};
+
+// Non blocking UDP socket bound to a local port and sending to one remote address.
+class UdpSocket
+{
+    public:
+        // throws std::runtime_error if the socket can't be created or bound, or the host isn't an IPv4 address
+        UdpSocket(uint16_t localPort, const std::string& remoteHost, uint16_t remotePort);
+        ~UdpSocket();
+
+        UdpSocket(const UdpSocket&) = delete;
+        UdpSocket& operator=(const UdpSocket&) = delete;
+
+        void Send(const uint8_t *data, size_t size);
+        // returns the size of the datagram received, 0 if none is waiting
+        size_t Receive(uint8_t *buffer, size_t size);
+
+    private:
+        int Socket;
+        sockaddr_in RemoteAddress;
+};
+
+#endif // ROLLBACK_H
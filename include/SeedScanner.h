@@ -0,0 +1,90 @@
+#ifndef SEEDSCANNER_H
+#define SEEDSCANNER_H
+
+#include "GameBoard.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+const unsigned int MAX_SCAN_BAGS = 4;
+
+// a seed and the pieces GameBoard::Load(seed) deals first
+struct SeedMatch
+{
+    uint32_t Seed;
+    MinoType Pieces[MAX_SCAN_BAGS * 7];
+};
+
+// Deals the opening bags of many GameBoard seeds. GameBoard seeds a std::mt19937 with the bag seed and
+// shuffles every bag with it, so the first bags only use the first few outputs of the generator. Those
+// only depend on the first ~430 words of the seeded state (output k twists words k, k + 1 and k + 397),
+// so DealLanes seeds that much of the state, for LANES seeds side by side so the loops vectorise, and
+// replays the outputs through std::shuffle to get exactly the bags of the game.
+class SeedScanner
+{
+    public:
+        static const unsigned int LANES = 16;
+
+        // pieces dealt by GameBoard::Load(seed), bag after bag, one seed with the real generator
+        static void Deal(uint32_t seed, unsigned int bags, MinoType *pieces);
+
+        // same for the LANES seeds from firstSeed on, pieces[lane * bags * 7 + i]
+        static void DealLanes(uint32_t firstSeed, unsigned int bags, MinoType *pieces);
+
+        // matches of a file written by SeedMatchWriter with first <= Seed <= last, using its index
+        // throws std::runtime_error if the file can't be read
+        static std::vector<SeedMatch> ReadMatches(const std::string& path, uint32_t first, uint32_t last, unsigned int *bags = nullptr);
+
+    private:
+        SeedScanner();
+};
+
+// Writes scan results to an indexed file, all numbers little endian:
+//
+//   header   char Magic[4] = "STKS", uint32_t Version, uint32_t Bags, uint32_t FilterLength, char Filter[FilterLength]
+//   matches  { uint32_t Seed, uint8_t Pieces[Bags * 7] } in increasing seed order
+//   index    Blocks x { uint32_t FirstSeed, uint32_t Matches, uint64_t Offset (of the block's first match) }
+//   trailer  uint64_t IndexOffset, uint32_t Blocks, char Magic[4] = "STKI"
+//
+// Seeds are scanned in blocks added in increasing seed order, every block gets an index entry (even
+// without matches) so a reader can seek to the matches of a seed range without reading the others.
+class SeedMatchWriter
+{
+    public:
+        static const uint32_t VERSION = 1;
+
+        // the filter describes what the matches satisfy, throws std::runtime_error if the file can't be created
+        SeedMatchWriter(const std::string& path, unsigned int bags, const std::string& filter);
+        ~SeedMatchWriter();
+
+        SeedMatchWriter(const SeedMatchWriter&) = delete;
+        SeedMatchWriter& operator=(const SeedMatchWriter&) = delete;
+
+        // throws std::runtime_error if the file reports a write error (full disk...)
+        void AddBlock(uint32_t firstSeed, const std::vector<SeedMatch>& matches);
+
+        // writes the index and closes the file, called by the destructor if needed (which ignores errors).
+        // Throws std::runtime_error if a write or the close failed: the index may be missing
+        void Finish();
+
+        uint64_t MatchesWritten() const;
+
+    private:
+        struct IndexEntry
+        {
+            uint32_t FirstSeed;
+            uint32_t Matches;
+            uint64_t Offset;
+        };
+
+        std::string Path;
+        std::FILE *File;
+        unsigned int Bags;
+        uint64_t Offset;
+        uint64_t Written;
+        std::vector<IndexEntry> Index;
+};
+
+#endif // SEEDSCANNER_H
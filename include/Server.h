@@ -0,0 +1,166 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "GameBoard.h"
+#include "Rollback.h"
+#include "Spectator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+const unsigned int SERVER_TICK_RATE = 60;
+const unsigned int SERVER_MAX_BOARDS = 2;
+const unsigned int SPRINT_LINES = 40;                   // a sprint is won by clearing them
+const uint32_t MAX_MATCH_TICKS = 10 * 60 * SERVER_TICK_RATE;   // a match still going after 10 minutes ends without winner
+const uint8_t NO_WINNER = 0xFF;
+const uint8_t SPECTATOR = 0xFF;                         // player of a START sent to a spectator
+
+enum MatchMode : uint8_t
+{
+    MODE_SPRINT,            // one board, alone
+    MODE_VERSUS             // two boards sending garbage to each other
+};
+
+enum ServerMessageType : uint8_t
+{
+    MSG_JOIN = 1,
+    MSG_INPUT,
+    MSG_START,
+    MSG_TICK,
+    MSG_END,
+    MSG_SPECTATE,
+    MSG_FRAME
+};
+
+// Protocol of stacker-server, over TCP, all numbers little endian. Every message is framed as
+//
+//   uint16_t Size (type and payload), uint8_t Type, payload
+//
+//   JOIN    client   uint8_t Mode                              queues for a match, a versus waits for an opponent
+//   INPUT   client   uint32_t Tick, TickInput                  inputs stamped with the match tick the client was at
+//   START   server   uint32_t Seed, uint8_t Mode, uint8_t Player, uint8_t Boards,
+//                    uint8_t GarbageDelay, uint8_t GarbageMessiness
+//   TICK    server   uint32_t Tick, uint32_t Hash, Boards x (uint8_t Count, Count x uint8_t Move)
+//   END     server   uint32_t Tick, uint8_t Winner, Boards x (uint32_t PiecesPlaced, uint32_t LinesCleared, uint32_t LinesSent)
+//   SPECTATE client   (none)                                    follows a match being played, or the next one to start
+//   FRAME   server   uint8_t Board, frame of the board's spectator stream (see SpectatorEncoder)
+//
+// The boards of a match are loaded from its seed by GameBoard::LoadMatch and nothing happens to them
+// without inputs, so TICK, sent for the ticks some board had inputs on, is the delta of the match state:
+// a client applying it (MatchMirror) keeps the same boards as the server. Hash is the low half of the
+// state hashes of the boards after the tick, to check it does.
+//
+// A spectator gets the match as it is instead: START (Player is SPECTATOR), a keyframe of every board,
+// then the FRAME of every board that changed on a tick, and END. The frames of a tick are encoded once
+// for all the spectators of the match (SpectatorMirror applies them).
+class ServerProtocol
+{
+    public:
+        static const size_t HEADER_SIZE = 3;
+        static const size_t MAX_MESSAGE_SIZE = 2 + SpectatorEncoder::MAX_FRAME_SIZE;   // type and payload, larger ones are a protocol error
+
+        // writes a framed message, returns its size (0 if it doesn't fit in the capacity)
+        static size_t Write(uint8_t *buffer, size_t capacity, ServerMessageType type, const uint8_t *payload, size_t size);
+        // size of the first message of the data, 0 while it's incomplete and SIZE_MAX if it's invalid
+        static size_t Read(const uint8_t *data, size_t size, uint8_t& type, const uint8_t *&payload, size_t& payloadSize);
+
+    private:
+        ServerProtocol();
+};
+
+// Client side copy of a server match, kept up to date with the messages of the server.
+class MatchMirror
+{
+    public:
+        MatchMode Mode;
+        unsigned int Boards;
+        unsigned int Player;                    // board of this client
+        uint32_t Seed;
+        uint32_t Tick;                          // next tick, after the last one received
+        bool Playing;                           // between START and END
+        uint8_t Winner;
+        size_t Desyncs;                         // ticks whose hash didn't match the boards here
+        std::unique_ptr<GameBoard> Board[SERVER_MAX_BOARDS];
+
+        MatchMirror();
+
+        // applies a START, TICK or END message, false if it's malformed or not one of them
+        bool Apply(uint8_t type, const uint8_t *payload, size_t size);
+};
+
+// Client side view of a server match followed as a spectator, kept up to date with its frames. The
+// boards are only good for drawing (see SpectatorView).
+class SpectatorMirror
+{
+    public:
+        unsigned int Boards;
+        bool Playing;                           // between START and END
+        uint8_t Winner;
+        size_t Mismatches;                      // boards whose results in END weren't the ones streamed
+        SpectatorDecoder Decoder[SERVER_MAX_BOARDS];
+        std::unique_ptr<GameBoard> Board[SERVER_MAX_BOARDS];
+
+        SpectatorMirror();
+
+        // applies a START, FRAME or END message, false if it's malformed, not one of them or a frame
+        // that doesn't follow the previous one
+        bool Apply(uint8_t type, const uint8_t *payload, size_t size);
+};
+
+struct ServerStats
+{
+    uint64_t Clients = 0;                   // connected
+    uint64_t Spectators = 0;                // of them, following a match or waiting for one
+    uint64_t Matches = 0;                   // being played
+    uint64_t MatchesPlayed = 0;
+    uint64_t Ticks = 0;                     // match ticks simulated
+    uint64_t Inputs = 0;
+    uint64_t LateInputs = 0;                // stamped with a tick already simulated, executed on the next one
+    uint64_t LateTicks = 0;                 // sum of their delays
+    uint64_t BytesIn = 0, BytesOut = 0;
+    uint64_t Rejected = 0;                  // connections refused (every slot taken) or dropped (protocol error, too slow)
+    double MaxFrameSeconds = 0.0;           // longest tick of a shard, all its matches together
+};
+
+class ServerShard;
+
+// Authoritative server of concurrent sprint and versus matches, for the headless core.
+//
+// The work is split in shards, one per core, that share nothing: every shard runs its own epoll loop on
+// its own thread, with its own listening socket on the same port (SO_REUSEPORT, the kernel spreads the
+// connections between them) and its own table of matches. A match and its clients always belong to the
+// shard that accepted them, so a versus pairs two clients of the same shard. The match and client slots
+// of a shard are allocated once when it's created, with their boards: starting and ending matches never
+// allocates and the memory used doesn't depend on the load.
+//
+// Every shard ticks all its matches at SERVER_TICK_RATE on a timerfd: the inputs due (stamped with a tick
+// up to the current one) are executed, garbage is exchanged, and the TICK messages are queued and sent
+// once the frame is done.
+class MatchServer
+{
+    public:
+        // throws std::runtime_error if a listening socket can't be created
+        MatchServer(uint16_t port, unsigned int shards, unsigned int matchesPerShard, unsigned int garbageDelay, unsigned int garbageMessiness, unsigned int seed);
+        ~MatchServer();
+
+        MatchServer(const MatchServer&) = delete;
+        MatchServer& operator=(const MatchServer&) = delete;
+
+        // runs the shards on their threads until Stop
+        void Start();
+        void Stop();
+
+        // sum of the shards (the longest frame of all of them)
+        ServerStats Stats() const;
+
+    private:
+        std::vector<std::unique_ptr<ServerShard>> Shards;
+        std::vector<std::thread> Threads;
+        std::atomic<bool> Running;
+};
+
+#endif // SERVER_H
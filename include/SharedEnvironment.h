@@ -0,0 +1,123 @@
+#ifndef SHAREDENVIRONMENT_H
+#define SHAREDENVIRONMENT_H
+
+#include "BoardBatch.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Vectorised environment over POSIX shared memory, for trainers running in another process.
+//
+// The region (shm_open name, e.g. "/stacker-env") starts with a SharedEnvironmentHeader followed by
+// two rings of Slots entries: observations written by the environment and actions written by the
+// trainer. Step n uses observation slot n % Slots and action slot n % Slots, so the trainer reads its
+// observations in place and a slot stays valid until Slots more steps have been published.
+// Every array is indexed by board (Boards entries), arrays of arrays are row major with boards
+// contiguous, the same layout as BoardBatch:
+//
+//   observation slot                                    action slot
+//     uint64_t Step                                       uint8_t  Hold[Boards]
+//     uint16_t Rows[MATRIX_ROWS][Boards]                  uint8_t  Rotation[Boards]
+//     uint8_t  Current[Boards], Hold[Boards]              int8_t   Column[Boards]  leftmost column of the piece
+//     uint8_t  Queue[PREVIEW_NUMBER][Boards]
+//     uint8_t  Lines[Boards]       lines cleared by the last step
+//     uint8_t  Over[Boards]        the episode ended on the last step, the board has been reset
+//     uint64_t Valid[Boards]       ValidPlacements of the current piece, bit rotation * 10 + Column
+//     uint64_t ValidHold[Boards]   ValidPlacements of the piece hold would bring in
+//
+// Version 2 changed Column (and the Valid bits) from the centre column of the piece to its leftmost one.
+//
+// The Observations and Actions counters are the futex words: the environment publishes observation n
+// by storing Observations = n + 1, the trainer answers by storing Actions = n + 1, each side waking
+// the other with FUTEX_WAKE. Setting Closed (and waking both words) ends the session.
+struct SharedEnvironmentHeader
+{
+    static const uint32_t MAGIC = 0x53544B45;   // "STKE"
+    static const uint32_t VERSION = 2;
+
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Boards;
+    uint32_t Slots;
+    uint64_t ObservationOffset, ObservationStride;
+    uint64_t ActionOffset, ActionStride;
+    uint64_t Size;
+
+    alignas(64) std::atomic<uint32_t> Observations;
+    alignas(64) std::atomic<uint32_t> Actions;
+    alignas(64) std::atomic<uint32_t> Closed;
+};
+
+// pointers into one observation slot
+struct SharedObservation
+{
+    uint64_t *Step;
+    uint16_t *Rows;
+    uint8_t *Current, *Hold, *Queue, *Lines, *Over;
+    uint64_t *Valid, *ValidHold;
+};
+
+// pointers into one action slot
+struct SharedActions
+{
+    uint8_t *Hold, *Rotation;
+    int8_t *Column;
+};
+
+// Mapping of the region, shared by both sides: the environment creates it, the trainer opens it.
+// Throws std::runtime_error when the region can't be created, opened or doesn't match the layout.
+class SharedEnvironmentRegion
+{
+    public:
+        SharedEnvironmentHeader *Header;
+
+        // environment side: creates (or replaces) the region
+        SharedEnvironmentRegion(const std::string& name, uint32_t boards, uint32_t slots);
+        // trainer side: maps an existing region
+        SharedEnvironmentRegion(const std::string& name);
+        ~SharedEnvironmentRegion();
+
+        SharedEnvironmentRegion(const SharedEnvironmentRegion&) = delete;
+        SharedEnvironmentRegion& operator=(const SharedEnvironmentRegion&) = delete;
+
+        SharedObservation Observation(uint32_t step) const;
+        SharedActions Actions(uint32_t step) const;
+
+        // blocks until the counter moves past 'seen' (or the session is closed), returns the new value
+        uint32_t Wait(const std::atomic<uint32_t>& counter, uint32_t seen) const;
+        void Publish(std::atomic<uint32_t>& counter, uint32_t value) const;
+        void Close() const;
+
+    private:
+        std::string Name;
+        bool Owner;
+        void *Memory;
+        size_t Length;
+};
+
+// Environment side: steps a BoardBatch with the actions of the trainer, boards that end are reset
+// with a seed derived from the run seed, the board index and the episode number.
+class SharedEnvironment
+{
+    public:
+        SharedEnvironment(const std::string& name, uint32_t boards, uint32_t slots, uint64_t seed);
+
+        // serves steps until the trainer closes the session, returns the number of steps served
+        uint64_t Run();
+
+    private:
+        SharedEnvironmentRegion Region;
+        PieceTable Pieces;
+        BoardBatch Batch;
+        uint64_t Seed;
+        std::vector<uint32_t> Episodes;
+        std::vector<BoardAction> StepActions;
+        std::vector<uint8_t> StepLines;
+
+        void ResetBoard(uint32_t board);
+        void WriteObservation(uint32_t step, const std::vector<uint8_t>& over);
+};
+
+#endif // SHAREDENVIRONMENT_H
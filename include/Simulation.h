@@ -0,0 +1,58 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "GameBoard.h"
+#include "Bot.h"
+#include "TrainingExporter.h"
+#include "Versus.h"
+
+#include <memory>
+
+// outcome of a headless game
+struct GameResult
+{
+    unsigned int Pieces = 0;
+    unsigned int Lines = 0;
+    unsigned int Tetrises = 0;
+    unsigned int Attack = 0;        // garbage lines sent
+    bool ToppedOut = false;
+};
+
+// outcome of a headless 1v1 match
+struct MatchResult
+{
+    GameResult Players[2];
+    double ThinkSeconds[2] = { 0.0, 0.0 };     // time every bot spent searching
+    double Seconds = 0.0;                       // length of the match on the placement clock
+    int Winner = -1;                            // -1 for a draw, both boards still playing after maxPieces
+};
+
+// Headless games: no window, no clock, the board only advances when a piece is placed.
+// Everything is determined by the bag seed, so a game can be replayed exactly.
+// The games of the tuner, the tournament, self-play and the shared environment are played here.
+class Simulation
+{
+    public:
+        // plays a game with the bot until it tops out or placed maxPieces pieces
+        // every placement is recorded if an exporter is given
+        static GameResult PlayBotGame(Bot& bot, unsigned int bagSeed, unsigned int maxPieces, TrainingExporter *exporter = nullptr);
+
+        // plays a versus match of two bots on a placement clock: board i places its pieces at k / pps[i]
+        // seconds, the earliest placement goes first (the first board on ties) and its attack is routed to
+        // the other board at once. The boards are loaded by GameBoard::LoadMatch, the match is over
+        // when a board tops out or both placed maxPieces pieces, and it only depends on the seed.
+        static MatchResult PlayBotMatch(Bot& first, Bot& second, const float pps[2], unsigned int bagSeed, unsigned int garbageDelay, unsigned int garbageMessiness, unsigned int maxPieces);
+
+        // plays a recorded match back and records every placement of its boards (the moves of a keyboard
+        // player don't say which placement they aimed for, the records hold the one they ended on),
+        // returns the placements recorded
+        static unsigned int ExportReplay(std::shared_ptr<const VersusReplay> replay, TrainingExporter& exporter);
+
+        // reproducible seed of the n-th game of a run
+        static unsigned int GameSeed(uint64_t runSeed, uint64_t index);
+
+    private:
+        Simulation() { }
+};
+
+#endif // SIMULATION_H
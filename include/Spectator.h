@@ -0,0 +1,111 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include "GameBoard.h"
+
+#include <cstdint>
+#include <cstddef>
+
+// What a spectator sees of a board: the part of GameBoardState drawn on screen, in bytes.
+struct SpectatorView
+{
+    uint8_t Matrix[MATRIX_ROWS][MATRIX_COLS];   // MinoType
+    uint8_t Queue[PieceQueue::CAPACITY];
+    uint8_t QueueSize;
+    uint8_t CurrentPiece, CurrentRotation, HoldPiece;
+    int8_t CurrentRow, CurrentCol, GhostRow;    // the ghost is in the column of the piece
+    bool HoldUsed, IsOver;
+    uint32_t LinesCleared, PiecesPlaced, Combo, BackToBack, LinesSent, LastAttack;
+    uint8_t LastSpin;
+    uint8_t PendingPackets;
+    uint8_t PendingLines[MAX_GARBAGE_PACKETS];
+    uint8_t PendingWait[MAX_GARBAGE_PACKETS];   // placements before the packet can enter the board
+
+    void Capture(const GameBoardState& board);
+    // writes the view into a board, which is only good for drawing: the metrics, the generators
+    // and the garbage holes aren't part of the view
+    void Restore(GameBoardState& board) const;
+
+    bool operator==(const SpectatorView& other) const;
+};
+
+// Spectator streams: the state of a board sent as the difference with the previous frame, so a viewer
+// costs a few bytes per tick instead of the whole matrix.
+//
+//   frame      uint8_t Flags, uint8_t Sequence (frame count, modulo 256), then the sections flagged, in order
+//   ROWS       uint8_t Changed[5] (bit n of the 40 is row n), then for every changed row, bottom up, its
+//              colour runs from column 0: uint8_t (MinoType << 4 | length - 1), the lengths add up to 10
+//   QUEUE      uint8_t Advance (pieces gone from the front), uint8_t Added, (Added + 1) / 2 bytes of pieces,
+//              two per byte, low nibble first
+//   PIECE      uint8_t (CurrentPiece << 4 | CurrentRotation), int8_t Row, int8_t Column, int8_t GhostRow
+//   HOLD       uint8_t (HoldUsed << 7 | HoldPiece)
+//   COUNTERS   LinesCleared, PiecesPlaced, Combo, BackToBack, LinesSent, LastAttack as LEB128 varints,
+//              uint8_t LastSpin
+//   GARBAGE    uint8_t Packets, Packets x (uint8_t Lines, uint8_t Wait)
+//
+// OVER isn't a section, it's set in every frame of a board that is over. A keyframe (KEY) is the
+// difference with an empty board and carries every section: it stands alone, the other frames only
+// apply to the frame with the sequence before theirs. A move is 6 bytes, a placement a few dozen.
+enum SpectatorFrameFlags : uint8_t
+{
+    FRAME_KEY = 1 << 0,
+    FRAME_ROWS = 1 << 1,
+    FRAME_QUEUE = 1 << 2,
+    FRAME_PIECE = 1 << 3,
+    FRAME_HOLD = 1 << 4,
+    FRAME_COUNTERS = 1 << 5,
+    FRAME_GARBAGE = 1 << 6,
+    FRAME_OVER = 1 << 7
+};
+
+class SpectatorEncoder
+{
+    public:
+        // a keyframe of a full matrix with every row in 10 runs, and every other section at its largest
+        static const size_t MAX_FRAME_SIZE = 2 + 5 + MATRIX_ROWS * MATRIX_COLS + 2 + PieceQueue::CAPACITY / 2 + 4 + 1 + 6 * 5 + 1 + 1 + 2 * MAX_GARBAGE_PACKETS;
+
+        // a keyframe every that many frames lets a viewer that lost frames (or joined a broadcast) catch up,
+        // 0 for none after the first
+        explicit SpectatorEncoder(unsigned int keyframeInterval = 600);
+
+        // the next frame is a keyframe (a new board, or a stream starting again)
+        void Reset();
+
+        // writes the frame taking the stream from the last board encoded to this one, returns its size,
+        // 0 if nothing changed (no frame, the viewers have the board already)
+        size_t Encode(const GameBoardState& board, uint8_t *buffer);
+        // writes a keyframe of the last board encoded without advancing the stream, for a viewer joining
+        // it: the frames that follow apply to it. Returns 0 before the first frame.
+        size_t EncodeKeyframe(uint8_t *buffer) const;
+
+    private:
+        SpectatorView Last;
+        uint8_t Sequence;
+        bool Started;
+        unsigned int KeyframeInterval;
+        unsigned int SinceKeyframe;
+
+        size_t Write(const SpectatorView& from, const SpectatorView& to, bool keyframe, uint8_t sequence, uint8_t *buffer) const;
+};
+
+// Applies the frames of a stream to a mirror board. Frames are decoded in full before anything is
+// written, so a malformed one leaves the mirror as it was.
+class SpectatorDecoder
+{
+    public:
+        SpectatorView View;
+        bool Synced;                    // a keyframe was applied and no frame was missed since
+        size_t Frames;                  // applied
+        size_t Skipped;                 // dropped while not synced (missed frame, waiting for a keyframe)
+
+        SpectatorDecoder();
+
+        // false if the frame is malformed, or can't be applied (see Skipped); the board is only written
+        // when it returns true
+        bool Apply(const uint8_t *frame, size_t size, GameBoardState& board);
+
+    private:
+        uint8_t Sequence;               // of the last frame applied
+};
+
+#endif // SPECTATOR_H
@@ -0,0 +1,116 @@
+#ifndef SPECTATOR_FEED_H
+#define SPECTATOR_FEED_H
+
+#include "GameBoard.h"
+#include "Versus.h"
+#include "Server.h"
+#include "ThreadPool.h"
+
+#include <netinet/in.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const unsigned int MAX_SPECTATOR_BOARDS = 64;
+
+// where the boards of the spectator grid come from
+enum FeedSource
+{
+    FEED_BOTS,              // 1v1 bot matches, a new one starts whenever one ends
+    FEED_REPLAYS,           // recorded matches played back in a loop
+    FEED_SERVER             // matches of a stacker-server, followed as a spectator
+};
+
+// one board of the grid
+struct FeedTile
+{
+    const GameBoard *Board;         // valid until the next Update
+    unsigned int Match;     // match (or server connection) of the board
+    unsigned int Player;    // board in the match
+    unsigned int Place;     // 1 for the winner, 0 while playing
+};
+
+// Boards for the spectator grid, kept up to date by Update. Local matches run on a thread of the feed at
+// the fixed versus tick, all of them stepped in parallel on a thread pool (each one runs its boards
+// serially), and the boards are copied after every tick: Update only takes the last copy, a slow tick
+// never holds the frame. A finished match stays on screen for a moment before the next one starts in
+// its place. Server matches are followed on one connection each, the connections read without blocking
+// (by Update itself) and follow the next match after an END.
+class SpectatorFeed
+{
+    public:
+        static const float RESTART_DELAY;           // seconds a finished match stays on screen
+        static const float RECONNECT_DELAY;         // seconds between two attempts to reconnect to the server
+        static const unsigned int MAX_CATCHUP_TICKS;    // ticks run back to back after a late one, at most
+
+        FeedSource Source;
+        std::vector<FeedTile> Tiles;                // the boards to draw, rebuilt by every Update
+
+        // throws std::runtime_error for a board count out of range, a replay that can't be read or a server
+        // address that isn't "IPv4:port"
+        SpectatorFeed(FeedSource source, unsigned int boards, const BotConfig& botConfig, float botPPS, unsigned int garbageDelay, unsigned int garbageMessiness, std::shared_ptr<const OpeningBook> book, const std::vector<std::string>& replays, const std::string& server);
+        ~SpectatorFeed();
+
+        SpectatorFeed(const SpectatorFeed&) = delete;
+        SpectatorFeed& operator=(const SpectatorFeed&) = delete;
+
+        void Update(float dt);
+
+    private:
+        struct FeedMatch
+        {
+            std::unique_ptr<VersusMatch> Match;
+            uint64_t EndTick;                       // a replay that stops before the match is over ends there
+            float Delay;                            // seconds before the match starts running
+            float OverTime;                         // seconds since the match ended
+        };
+
+        struct FeedConnection
+        {
+            int Socket;                             // -1 while disconnected
+            bool Connected;                         // the connection (started without blocking) was established
+            float RetryTime;                        // seconds before the next attempt to connect
+            std::vector<uint8_t> In;
+            SpectatorMirror Mirror;
+        };
+
+        // a board of the local matches as it was after a tick
+        struct FeedView
+        {
+            GameBoardState State;
+            unsigned int Match;
+            unsigned int Player;
+            unsigned int Place;
+        };
+
+        unsigned int Boards;
+        ThreadPool Pool;
+        std::vector<FeedMatch> Matches;             // only touched by Runner once it started
+        std::vector<FeedView> Staged;               // (Runner) copy of the boards being made
+        std::vector<FeedView> Published;            // copy of the last tick, handed over under Lock
+        bool Fresh;                                 // Published wasn't taken by Update yet
+        bool Stopping;
+        std::mutex Lock;
+        std::condition_variable Signal;
+        std::thread Runner;
+        std::vector<FeedView> Views;                // (Update) the copy shown
+        std::vector<std::unique_ptr<GameBoard>> Shown;  // (Update) the same, loaded in boards to draw
+        std::vector<FeedConnection> Connections;
+        sockaddr_in ServerAddress;
+
+        // steps the local matches on their tick until Stopping
+        void Run();
+        void StepMatches(unsigned int ticks, float dt);
+        void Publish();
+        void UpdateMatches();
+        void UpdateConnections(float dt);
+        void Connect(FeedConnection& connection);
+        bool Send(FeedConnection& connection, ServerMessageType type);
+        void Disconnect(FeedConnection& connection);
+        bool Receive(FeedConnection& connection);
+};
+
+#endif // SPECTATOR_FEED_H
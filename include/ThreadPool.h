@@ -0,0 +1,56 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Work stealing thread pool. Every worker owns a task deque: it pops its own
+// work from the back (LIFO, cache friendly for nested tasks) and steals from
+// the front of the other workers' deques when it runs out of work.
+class ThreadPool
+{
+    public:
+        // a task receives the index of the worker running it, usable to address per-thread storage
+        using Task = std::function<void(unsigned int)>;
+
+        // 0 threads means one per hardware thread
+        ThreadPool(unsigned int threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        unsigned int Size() const;
+
+        void Submit(Task task);
+
+        // runs fn(index, worker) for every index in [0, count) and blocks until all of them finished
+        void ParallelFor(size_t count, const std::function<void(size_t, unsigned int)>& fn);
+
+    private:
+        struct Worker
+        {
+            std::mutex Lock;
+            std::deque<Task> Tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> Workers;
+        std::vector<std::thread> Threads;
+
+        std::mutex WakeLock;
+        std::condition_variable WakeSignal;
+        std::atomic<size_t> Pending;
+        std::atomic<unsigned int> NextWorker;
+        bool Stopping;
+
+        void WorkerLoop(unsigned int index);
+        bool TryPop(unsigned int index, Task& task);
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,95 @@
+#ifndef TRAININGEXPORTER_H
+#define TRAININGEXPORTER_H
+
+#include "GameBoard.h"
+#include "Bitboard.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// one placement: the position before it, the placement chosen and what it did
+struct TrainingRecord
+{
+    uint16_t Rows[MATRIX_ROWS];
+    uint8_t Current, Hold;
+    uint8_t Queue[PREVIEW_NUMBER];
+    uint8_t UseHold;
+    uint8_t Piece, Rotation;
+    int8_t Row, Column;
+    uint8_t Lines;
+    uint8_t Spin;                   // SpinType of the placement
+    uint16_t Combo;
+};
+
+// Writes records to a chunked columnar file, all numbers little endian:
+//
+//   header   char Magic[4] = "STKD", uint32_t Version, uint32_t Columns,
+//            Columns x { char Name[16], uint32_t ElementSize, uint32_t Elements (per record) }
+//   chunks   char Magic[4] = "CHNK", uint32_t Records,
+//            Columns x { uint32_t Codec (0 raw, 1 LZ4 block), uint64_t RawSize, uint64_t StoredSize, data }
+//
+// Each column of a chunk is a fixed width array of Records x Elements values, so a reader can load a
+// column with one read (np.frombuffer) after decompressing it. Records are collected in one of two
+// chunk buffers while a background thread compresses and writes the other one; Add only waits when
+// both buffers are full. Add may be called from several threads.
+class TrainingExporter
+{
+    public:
+        static const uint32_t VERSION = 1;
+        static const uint32_t DEFAULT_CHUNK_RECORDS = 65536;
+
+        // throws std::runtime_error if the file can't be created
+        TrainingExporter(const std::string& path, bool compress, uint32_t chunkRecords = DEFAULT_CHUNK_RECORDS);
+        ~TrainingExporter();
+
+        TrainingExporter(const TrainingExporter&) = delete;
+        TrainingExporter& operator=(const TrainingExporter&) = delete;
+
+        // throws std::runtime_error once the writer failed to write a chunk (full disk...)
+        void Add(const TrainingRecord& record);
+
+        // writes the last partial chunk and closes the file, called by the destructor if needed (which
+        // ignores errors). Throws std::runtime_error if any write failed: the file is incomplete
+        void Finish();
+
+        uint64_t RecordsWritten() const;
+
+        // reads a whole file back, decompressing every column, and returns its records. Throws
+        // std::runtime_error if the file can't be read or isn't a complete export of this version
+        static uint64_t Verify(const std::string& path);
+
+    private:
+        struct Chunk
+        {
+            uint32_t Records = 0;
+            std::vector<std::vector<uint8_t>> Columns;
+        };
+
+        std::string Path;
+        bool Compress;
+        uint32_t ChunkRecords;
+        std::FILE *File;
+
+        std::array<Chunk, 2> Chunks;
+        int Active;                 // chunk being filled
+        int Pending;                // chunk handed to the writer, -1 when none
+        bool Finishing;
+        bool Failed;                // a write failed, the following chunks are dropped
+        uint64_t Written;
+        mutable std::mutex Lock;
+        std::condition_variable Signal;
+        std::thread Writer;
+
+        void WriteHeader();
+        // false if the file reports an error
+        bool WriteChunk(const Chunk& chunk);
+        void Run();
+};
+
+#endif // TRAININGEXPORTER_H
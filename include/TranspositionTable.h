@@ -0,0 +1,40 @@
+#ifndef TRANSPOSITIONTABLE_H
+#define TRANSPOSITIONTABLE_H
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+
+// Lock-free, fixed size, always replace transposition table shared by the search threads.
+// Every slot stores the data word and the key xor-ed with it, a slot torn by two concurrent
+// writers fails the check on read and counts as empty, so no locks are needed.
+// Entries are tagged with the search generation: starting a new search invalidates the
+// whole table without touching it.
+class TranspositionTable
+{
+    public:
+        // the table has 2^bits slots of 16 bytes
+        TranspositionTable(unsigned int bits);
+
+        void NewSearch();
+
+        // records the score for the state, returns false if the state was already reached
+        // in this search with an equal or better score (the caller should drop its node)
+        bool Improve(uint64_t key, float score);
+
+        // reads back the score stored for the state in this search
+        bool Probe(uint64_t key, float& score) const;
+
+    private:
+        struct Slot
+        {
+            std::atomic<uint64_t> Check;    // key ^ data
+            std::atomic<uint64_t> Data;     // score bits (low 32) | generation (high 32)
+        };
+
+        std::unique_ptr<Slot[]> Slots;
+        uint64_t Mask;
+        uint32_t Generation;
+};
+
+#endif // TRANSPOSITIONTABLE_H
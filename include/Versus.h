@@ -0,0 +1,136 @@
+#ifndef VERSUS_H
+#define VERSUS_H
+
+#include "GameBoard.h"
+#include "Bot.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+const unsigned int MIN_VERSUS_BOARDS = 2;
+const unsigned int MAX_VERSUS_BOARDS = 8;
+const float VERSUS_TICK_RATE = 60.0f;          // ticks per second, every tick every board executes its inputs once
+
+// where the inputs of a board come from
+enum InputSource
+{
+    INPUT_KEYBOARD,         // queued by the game between two ticks
+    INPUT_BOT,              // a single threaded BotController
+    INPUT_REPLAY            // the inputs a replay recorded for the board
+};
+
+// one input of a recorded match
+struct ReplayInput
+{
+    uint32_t Tick;
+    uint8_t Board;
+    uint8_t Move;           // MoveType, or REPLAY_TOP_OUT
+    uint8_t Reserved[2];
+};
+
+// recorded when a board gives up without topping out by itself (a bot with no placement left)
+const uint8_t REPLAY_TOP_OUT = 0xFF;
+
+// A recorded match, all numbers little endian:
+//
+//   header   char Magic[4] = "STKR", uint32_t Version, uint32_t Boards, uint32_t Seed,
+//            uint32_t GarbageDelay, uint32_t GarbageMessiness, uint32_t Inputs, uint32_t Ticks
+//   inputs   Inputs x ReplayInput (8 bytes), by tick then board
+//   hashes   Ticks x uint32_t, low half of the match hash after every tick (see VersusMatch::Hash)
+//
+// The boards are loaded from the seed by GameBoard::LoadMatch, so playing the inputs back
+// on every board gives the same match. A board replayed against live players only gets the same pieces.
+// A replay only plays back under the rules it was recorded with, older versions are refused:
+//   1  no Ticks and no hashes
+//   2  the last kick of a 180 degree T rotation made a full T-spin (3 counts the TST kick of 90 degree
+//      rotations only)
+//   3  a piece swapped in from hold kept the position and rotation of the piece it replaced (4 brings
+//      it back at the spawn)
+struct VersusReplay
+{
+    static const uint32_t VERSION = 4;
+
+    unsigned int Boards = 0;
+    unsigned int Seed = 0;
+    unsigned int GarbageDelay = 0;
+    unsigned int GarbageMessiness = 0;
+    std::vector<ReplayInput> Inputs;
+    std::vector<uint32_t> Hashes;
+
+    // both throw std::runtime_error if the file can't be read or written
+    static VersusReplay Read(const std::string& path);
+    void Write(const std::string& path) const;
+
+    // tick after the last one recorded, a replay that stops before the match is over ends there
+    uint64_t EndTick() const;
+};
+
+struct VersusPlayer
+{
+    InputSource Source;
+    std::unique_ptr<GameBoard> Board;
+    std::unique_ptr<BotController> Bot;     // INPUT_BOT only
+    std::list<MoveType> Queued;             // INPUT_KEYBOARD, inputs waiting for the next tick
+    size_t ReplayCursor;                    // INPUT_REPLAY, next input of the replay
+    unsigned int Sent;                      // garbage sent during the tick, routed once all the boards ran
+    bool ToppedOut;                         // gave up during the tick, see REPLAY_TOP_OUT
+    unsigned int Received;                  // garbage routed to the board during the match
+    unsigned int Place;                     // 1 for the winner, 0 while still playing
+    PlacementObserver *Observer;            // told about the placements of the board, nullptr for none
+};
+
+// Local versus match of 2 to 8 boards. Every board has its own input source and the match advances on a
+// fixed tick: all the boards execute the inputs of the tick in parallel on a thread pool (they don't
+// share anything while doing it), then the garbage they sent is routed serially in board order, each
+// board attacking the next one still playing. The result only depends on the seed and the inputs,
+// which are recorded for replays. Boards are removed from the routing once they topped out and the last
+// one standing wins.
+class VersusMatch
+{
+    public:
+        std::vector<VersusPlayer> Players;
+        uint64_t Tick;                          // ticks since the start
+        unsigned int Playing;                   // boards not topped out yet
+        unsigned int Seed;
+        VersusReplay Recording;                 // every input executed so far
+        std::shared_ptr<const VersusReplay> Replay;     // played back by INPUT_REPLAY boards
+        uint64_t Hash;                          // rolling hash of every board after every tick (GameBoard::StateHash)
+        int64_t DesyncTick;                     // first tick after which a full playback stopped matching the replay's hashes, -1 if none
+        std::string DesyncDump;                 // every board after it
+
+        // throws std::runtime_error for a board count out of range or replay boards without a replay
+        // (or with fewer boards than the match)
+        VersusMatch(const std::vector<InputSource>& sources, const BotConfig& botConfig, float botPPS, unsigned int garbageDelay, unsigned int garbageMessiness, std::shared_ptr<const OpeningBook> book = nullptr, std::shared_ptr<const VersusReplay> replay = nullptr, unsigned int threads = 0);
+
+        VersusMatch(const VersusMatch&) = delete;
+        VersusMatch& operator=(const VersusMatch&) = delete;
+
+        // loads every board: the same pieces for all of them and their own garbage holes
+        // (a match playing a replay back uses the replay's seed)
+        void Start(unsigned int seed);
+
+        // adds inputs of a keyboard board to the next tick
+        void QueueInputs(unsigned int board, const std::list<MoveType>& moves);
+
+        // advances the match by one tick, nothing happens once it's over
+        // (a match playing back a replay on every board checks it against the recorded hashes)
+        void Step();
+
+        bool IsOver() const;
+        // index of the winning board, -1 while the match isn't over
+        int Winner() const;
+
+    private:
+        ThreadPool Pool;
+
+        std::list<MoveType> TickInputs(VersusPlayer& player);
+        void TopOut(VersusPlayer& player);
+        void RouteGarbage();
+        void CheckHash();
+};
+
+#endif // VERSUS_H
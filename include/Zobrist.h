@@ -0,0 +1,52 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include "GameBoard.h"
+
+#include <cstdint>
+
+// Zobrist keys used to hash game states.
+// The matrix is hashed by row: every (row, row occupancy mask) pair has its own key, so
+// placing a piece only touches the keys of the (at most 4) rows it covers. The key of an
+// empty row is 0, so empty rows never have to be hashed.
+// Keys come from a fixed seed: hashes are identical between runs and between machines.
+class Zobrist
+{
+    public:
+        static const int ROWS = 40;
+        static const int ROW_MASKS = 1 << 10;
+        static const int QUEUE_POSITIONS = 64;
+
+        uint64_t Rows[ROWS][ROW_MASKS];
+        uint64_t Current[SPAWN_PREVIEW + 1];
+        uint64_t Hold[SPAWN_PREVIEW + 1];
+        uint64_t QueuePosition[QUEUE_POSITIONS];
+
+        // the shared key set, built on first use
+        static const Zobrist& Keys();
+
+        inline uint64_t Row(int row, uint16_t mask) const
+        {
+            return Rows[row][mask];
+        }
+
+        // hash of the pieces part of a state, to be combined (xor) with the matrix hash
+        inline uint64_t Pieces(MinoType current, MinoType hold, unsigned int queuePosition) const
+        {
+            return Current[current] ^ Hold[hold] ^ QueuePosition[queuePosition % QUEUE_POSITIONS];
+        }
+
+        // folds a value without its own keys into a hash (splitmix64 finalizer), order matters
+        static inline uint64_t Mix(uint64_t hash, uint64_t value)
+        {
+            uint64_t x = hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+    private:
+        Zobrist();
+};
+
+#endif // ZOBRIST_H
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
+layout (location = 1) in vec4 rect;   // per instance <vec2 position, vec2 size>
+layout (location = 2) in vec4 color;  // per instance
+
+out vec2 TexCoords;
+out vec4 SpriteColor;
+
+uniform mat4 projection;
+
+void main()
+{
+    TexCoords = vertex.zw;
+    SpriteColor = color;
+    gl_Position = projection * vec4(rect.xy + vertex.xy * rect.zw, 0.0, 1.0);
+}
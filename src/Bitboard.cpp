@@ -0,0 +1,157 @@
+#include "Bitboard.h"
+
+#include <cctype>
+#include <stdexcept>
+
+PieceTable::PieceTable(const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable)
+{
+    for (MinoType type: SEVEN_PIECE_BAG)
+    {
+        for (int rot = 0; rot < 4; rot++)
+        {
+            PieceShape& shape = Shapes[type][rot];
+            shape.Cells = rotationOffsets.at(type)[rot].PieceOffsets;
+
+            shape.MinRow = shape.MaxRow = shape.Cells[0].x;
+            shape.MinCol = shape.MaxCol = shape.Cells[0].y;
+            for (glm::ivec2 cell: shape.Cells)
+            {
+                shape.MinRow = std::min(shape.MinRow, cell.x);
+                shape.MaxRow = std::max(shape.MaxRow, cell.x);
+                shape.MinCol = std::min(shape.MinCol, cell.y);
+                shape.MaxCol = std::max(shape.MaxCol, cell.y);
+            }
+            shape.Height = shape.MaxRow - shape.MinRow + 1;
+
+            for (int r = 0; r < 4; r++)
+                shape.RowMasks[r] = 0;
+            for (glm::ivec2 cell: shape.Cells)
+                shape.RowMasks[cell.x - shape.MinRow] |= 1 << (cell.y - shape.MinCol);
+
+            for (int newRot = 0; newRot < 4; newRot++)
+                Kicks[type][rot][newRot] = kickTable.at(type)[rot][newRot];
+        }
+    }
+}
+
+void Bitboard::Clear()
+{
+    for (int row = 0; row < MATRIX_ROWS; row++)
+        Rows[row] = 0;
+    SolidRows = 0;
+    Hash = 0;
+}
+
+void Bitboard::FromMatrix(const MinoType (&matrix)[MATRIX_ROWS][MATRIX_COLS])
+{
+    SolidRows = 0;
+    for (int row = 0; row < MATRIX_ROWS; row++)
+    {
+        uint16_t mask = 0;
+        for (int col = 0; col < MATRIX_COLS; col++)
+        {
+            if (matrix[row][col] != MinoType::EMPTY)
+                mask |= 1 << col;
+            if (matrix[row][col] == MinoType::SOLID_GARBAGE)
+                SolidRows |= uint64_t(1) << row;
+        }
+        Rows[row] = mask;
+    }
+    Hash = ComputeHash();
+}
+
+unsigned int Bitboard::ClearLines()
+{
+    // single stable compaction pass, full rows are simply not copied
+    // every index is written at most once and in increasing order, so Rows[write] still holds its old value when rehashed
+    const Zobrist& keys = Zobrist::Keys();
+    int write = 0;
+    uint64_t solid = 0;
+    for (int read = 0; read < MATRIX_ROWS; read++)
+    {
+        bool isSolid = (SolidRows >> read) & 1;
+        if (Rows[read] != FULL_ROW || isSolid)
+        {
+            solid |= uint64_t(isSolid) << write;
+            if (write != read)
+            {
+                Hash ^= keys.Row(write, Rows[write]) ^ keys.Row(write, Rows[read]);
+                Rows[write] = Rows[read];
+            }
+            write = write + 1;
+        }
+    }
+    SolidRows = solid;
+
+    unsigned int cleared = MATRIX_ROWS - write;
+    while (write < MATRIX_ROWS)
+    {
+        Hash ^= keys.Row(write, Rows[write]);
+        Rows[write++] = 0;
+    }
+
+    return cleared;
+}
+
+uint64_t Bitboard::ComputeHash() const
+{
+    const Zobrist& keys = Zobrist::Keys();
+    uint64_t hash = 0;
+    for (int row = 0; row < MATRIX_ROWS; row++)
+        hash ^= keys.Row(row, Rows[row]);
+    return hash;
+}
+
+int Bitboard::StackHeight() const
+{
+    int row = MATRIX_ROWS;
+    while (row > 0 && Rows[row - 1] == 0)
+        row = row - 1;
+    return row;
+}
+
+Bitboard Bitboard::Parse(const std::string& text)
+{
+    std::vector<std::string> rows;
+    size_t start = 0;
+    while (start <= text.size() && !text.empty())
+    {
+        size_t end = text.find('/', start);
+        if (end == std::string::npos)
+            end = text.size();
+        rows.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+
+    Bitboard board;
+    board.Clear();
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (rows[i].size() != MATRIX_COLS)
+            throw std::runtime_error("board rows must be " + std::to_string(MATRIX_COLS) + " cells wide: " + rows[i]);
+
+        int row = rows.size() - 1 - i;
+        for (int col = 0; col < MATRIX_COLS; col++)
+        {
+            if (rows[i][col] != '.' && rows[i][col] != '_')
+                board.Rows[row] |= 1 << col;
+        }
+    }
+    board.Hash = board.ComputeHash();
+    return board;
+}
+
+MinoType ParsePiece(char letter)
+{
+    switch (std::toupper(letter))
+    {
+        case 'I': return BLOCK_I;
+        case 'J': return BLOCK_J;
+        case 'L': return BLOCK_L;
+        case 'O': return BLOCK_O;
+        case 'S': return BLOCK_S;
+        case 'T': return BLOCK_T;
+        case 'Z': return BLOCK_Z;
+    }
+    throw std::runtime_error(std::string("unknown piece '") + letter + "'");
+}
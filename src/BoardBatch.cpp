@@ -0,0 +1,271 @@
+#include "BoardBatch.h"
+
+BoardBatch::BoardBatch(size_t size, const PieceTable& pieces)
+:   Size(size),
+    Rows((MATRIX_ROWS + PADDING_ROWS) * size, 0),
+    Heights(size, 0),
+    Current(size, EMPTY),
+    Hold(size, EMPTY),
+    Queue(QUEUE_CAPACITY * size, EMPTY),
+    QueueHead(size, 0),
+    QueueSize(size, 0),
+    RNG(size, 1),
+    LinesCleared(size, 0),
+    PiecesPlaced(size, 0),
+    IsOver(size, 1),
+    Pieces(pieces),
+    Landing(size, 0),
+    PieceHeights(size, 0)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        Masks[k].assign(size, 0);
+        Full[k].assign(size, 0);
+    }
+}
+
+void BoardBatch::Reset(size_t board, uint32_t seed)
+{
+    for (int row = 0; row < MATRIX_ROWS; row++)
+        Rows[row * Size + board] = 0;
+
+    Heights[board] = 0;
+    Hold[board] = EMPTY;
+    QueueHead[board] = 0;
+    QueueSize[board] = 0;
+    // xorshift must not start from 0
+    RNG[board] = seed ? seed : 0x9E3779B9u;
+    LinesCleared[board] = 0;
+    PiecesPlaced[board] = 0;
+
+    FillQueue(board);
+    Current[board] = PopQueue(board);
+    IsOver[board] = SpawnCollides(board);
+}
+
+void BoardBatch::FillQueue(size_t board)
+{
+    while (QueueSize[board] <= PREVIEW_NUMBER)
+    {
+        std::array<MinoType, 7> bag = SEVEN_PIECE_BAG;
+        for (int i = 6; i > 0; i--)
+        {
+            uint32_t x = RNG[board];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            RNG[board] = x;
+            std::swap(bag[i], bag[x % (i + 1)]);
+        }
+
+        for (MinoType piece: bag)
+        {
+            Queue[board * QUEUE_CAPACITY + (QueueHead[board] + QueueSize[board]) % QUEUE_CAPACITY] = piece;
+            QueueSize[board] = QueueSize[board] + 1;
+        }
+    }
+}
+
+MinoType BoardBatch::PopQueue(size_t board)
+{
+    MinoType piece = static_cast<MinoType>(Queue[board * QUEUE_CAPACITY + QueueHead[board]]);
+    QueueHead[board] = (QueueHead[board] + 1) % QUEUE_CAPACITY;
+    QueueSize[board] = QueueSize[board] - 1;
+    FillQueue(board);
+    return piece;
+}
+
+MinoType BoardBatch::Preview(size_t board, int index) const
+{
+    return static_cast<MinoType>(Queue[board * QUEUE_CAPACITY + (QueueHead[board] + index) % QUEUE_CAPACITY]);
+}
+
+bool BoardBatch::SpawnCollides(size_t board) const
+{
+    const PieceShape& shape = Pieces.Shapes[Current[board]][0];
+    int row = 21 + shape.MinRow;
+    int col = 4 + shape.MinCol;
+    for (int r = 0; r < shape.Height; r++)
+    {
+        if (Rows[(row + r) * Size + board] & (shape.RowMasks[r] << col))
+            return true;
+    }
+    return false;
+}
+
+uint64_t BoardBatch::ValidPlacements(size_t board, MinoType piece) const
+{
+    uint64_t valid = 0;
+    for (int rotation = 0; rotation < 4; rotation++)
+    {
+        const PieceShape& shape = Pieces.Shapes[piece][rotation];
+        int row = MATRIX_ROWS - shape.Height;
+        for (int left = 0; left + shape.MaxCol - shape.MinCol < MATRIX_COLS; left++)
+        {
+            // the piece is dropped from the top, it fits unless it already overlaps the stack there
+            bool fits = true;
+            for (int r = 0; r < shape.Height; r++)
+                fits = fits && !(Rows[(row + r) * Size + board] & (shape.RowMasks[r] << left));
+            if (fits)
+                valid |= 1ull << (rotation * MATRIX_COLS + left);
+        }
+    }
+    return valid;
+}
+
+void BoardBatch::Step(const BoardAction* actions, uint8_t* lines)
+{
+    uint16_t* __restrict mask0 = Masks[0].data();
+    uint16_t* __restrict mask1 = Masks[1].data();
+    uint16_t* __restrict mask2 = Masks[2].data();
+    uint16_t* __restrict mask3 = Masks[3].data();
+    int16_t* __restrict landing = Landing.data();
+    uint16_t* __restrict rows = Rows.data();
+    const size_t size = Size;
+
+    // scalar setup: hold, piece masks shifted into place, empty masks for boards that are over
+    int top = 0;
+    for (size_t b = 0; b < size; b++)
+    {
+        mask0[b] = mask1[b] = mask2[b] = mask3[b] = 0;
+        PieceHeights[b] = 0;
+        if (IsOver[b])
+            continue;
+
+        if (actions[b].Hold)
+        {
+            uint8_t held = Hold[b];
+            Hold[b] = Current[b];
+            Current[b] = held == EMPTY ? static_cast<uint8_t>(PopQueue(b)) : held;
+        }
+
+        const PieceShape& shape = Pieces.Shapes[Current[b]][actions[b].Rotation & 3];
+        int col = std::clamp<int>(actions[b].Column, 0, MATRIX_COLS - 1 - shape.MaxCol + shape.MinCol);
+        mask0[b] = shape.RowMasks[0] << col;
+        mask1[b] = shape.Height > 1 ? shape.RowMasks[1] << col : 0;
+        mask2[b] = shape.Height > 2 ? shape.RowMasks[2] << col : 0;
+        mask3[b] = shape.Height > 3 ? shape.RowMasks[3] << col : 0;
+        PieceHeights[b] = shape.Height;
+        top = std::max<int>(top, Heights[b]);
+    }
+
+    // drop: the bottom row of the piece lands just above the highest row its k-th row hits, minus k
+    for (size_t b = 0; b < size; b++)
+        landing[b] = 0;
+    for (int r = 0; r < top; r++)
+    {
+        const uint16_t* __restrict row = rows + r * size;
+        for (size_t b = 0; b < size; b++)
+        {
+            uint16_t v = row[b];
+            int16_t land = landing[b];
+            land = std::max<int16_t>(land, (v & mask0[b]) ? r + 1 : 0);
+            land = std::max<int16_t>(land, (v & mask1[b]) ? r : 0);
+            land = std::max<int16_t>(land, (v & mask2[b]) ? r - 1 : 0);
+            land = std::max<int16_t>(land, (v & mask3[b]) ? r - 2 : 0);
+            landing[b] = land;
+        }
+    }
+
+    // a piece that doesn't fit below the top of the matrix ends the game and isn't placed
+    int low = MATRIX_ROWS, high = 0;
+    for (size_t b = 0; b < size; b++)
+    {
+        if (PieceHeights[b] == 0)
+            continue;
+
+        if (landing[b] + PieceHeights[b] > MATRIX_ROWS)
+        {
+            IsOver[b] = 1;
+            mask0[b] = mask1[b] = mask2[b] = mask3[b] = 0;
+            PieceHeights[b] = 0;
+            continue;
+        }
+        low = std::min<int>(low, landing[b]);
+        high = std::max<int>(high, landing[b] + PieceHeights[b]);
+    }
+
+    // place: every row ors in the piece row that lands on it, if any
+    for (int r = low; r < high; r++)
+    {
+        uint16_t* __restrict row = rows + r * size;
+        for (size_t b = 0; b < size; b++)
+        {
+            int16_t k = r - landing[b];
+            uint16_t add = (mask0[b] & -static_cast<uint16_t>(k == 0))
+                         | (mask1[b] & -static_cast<uint16_t>(k == 1))
+                         | (mask2[b] & -static_cast<uint16_t>(k == 2))
+                         | (mask3[b] & -static_cast<uint16_t>(k == 3));
+            row[b] = row[b] | add;
+        }
+    }
+
+    // only the rows covered by the piece can have become full, collected in ascending order (255 = none)
+    int clearTop = 0;
+    bool anyClear = false;
+    for (size_t b = 0; b < size; b++)
+    {
+        uint8_t count = 0;
+        for (int k = 0; k < 4; k++)
+            Full[k][b] = 255;
+        for (int k = 0; k < PieceHeights[b]; k++)
+        {
+            int r = landing[b] + k;
+            if (rows[r * size + b] == FULL_ROW)
+                Full[count++][b] = r;
+        }
+        lines[b] = count;
+
+        if (PieceHeights[b] != 0)
+            Heights[b] = std::max<int>(Heights[b], landing[b] + PieceHeights[b]);
+        if (count != 0)
+        {
+            anyClear = true;
+            clearTop = std::max<int>(clearTop, Heights[b]);
+        }
+    }
+
+    // compaction: destination row w reads source row w + d, d being the number of full rows at or below the source.
+    // d is at most 4 so the source is one of 5 contiguous loads, selected with masks instead of branches, and since the
+    // source is never below the destination the rows are compacted in place going up
+    if (anyClear)
+    {
+        const uint8_t* __restrict full0 = Full[0].data();
+        const uint8_t* __restrict full1 = Full[1].data();
+        const uint8_t* __restrict full2 = Full[2].data();
+        const uint8_t* __restrict full3 = Full[3].data();
+        for (int w = low; w < clearTop; w++)
+        {
+            uint16_t* __restrict row = rows + w * size;
+            for (size_t b = 0; b < size; b++)
+            {
+                uint16_t d = 0;
+                d += static_cast<uint16_t>(w + d >= full0[b]);
+                d += static_cast<uint16_t>(w + d >= full1[b]);
+                d += static_cast<uint16_t>(w + d >= full2[b]);
+                d += static_cast<uint16_t>(w + d >= full3[b]);
+                row[b] = (row[b] & -static_cast<uint16_t>(d == 0))
+                       | (row[b + size] & -static_cast<uint16_t>(d == 1))
+                       | (row[b + 2 * size] & -static_cast<uint16_t>(d == 2))
+                       | (row[b + 3 * size] & -static_cast<uint16_t>(d == 3))
+                       | (row[b + 4 * size] & -static_cast<uint16_t>(d == 4));
+            }
+        }
+    }
+
+    // scalar bookkeeping: counters, next piece, spawn check
+    for (size_t b = 0; b < size; b++)
+    {
+        if (PieceHeights[b] == 0)
+        {
+            lines[b] = 0;
+            continue;
+        }
+
+        Heights[b] = Heights[b] - lines[b];
+        LinesCleared[b] = LinesCleared[b] + lines[b];
+        PiecesPlaced[b] = PiecesPlaced[b] + 1;
+        Current[b] = PopQueue(b);
+        IsOver[b] = SpawnCollides(b);
+    }
+}
@@ -0,0 +1,814 @@
+#include "Bot.h"
+
+#include <algorithm>
+#include <cstring>
+
+// the search states are (row, column, rotation), columns go from -2 to 11 since piece centers can sit outside the matrix
+static const int STATE_COLS = MATRIX_COLS + 4;
+static const int STATE_COUNT = MATRIX_ROWS * STATE_COLS * 4;
+static const glm::ivec2 SPAWN_POSITION = glm::ivec2(21, 4);
+
+static const MoveType BOT_MOVES[] = {
+    MoveType::MOVE_LEFT, MoveType::MOVE_RIGHT,
+    MoveType::ROTATE_CLOCKWISE, MoveType::ROTATE_ANTICLOCKWISE, MoveType::ROTATE_180,
+    MoveType::DAS_LEFT, MoveType::DAS_RIGHT,
+    MoveType::SOFTDROP
+};
+
+static inline int StateIndex(glm::ivec2 position, int rotation)
+{
+    return (position.x * STATE_COLS + position.y + 2) * 4 + rotation;
+}
+
+static inline glm::ivec2 StatePosition(int index)
+{
+    index = index / 4;
+    return glm::ivec2(index / STATE_COLS, index % STATE_COLS - 2);
+}
+
+// order independent key of the 4 cells covered by a piece, so that different rotations covering the same cells are merged
+static inline uint64_t CellsKey(const PieceShape& shape, glm::ivec2 position)
+{
+    uint16_t cells[4];
+    for (int i = 0; i < 4; i++)
+        cells[i] = (position.x + shape.Cells[i].x) * MATRIX_COLS + position.y + shape.Cells[i].y;
+    std::sort(cells, cells + 4);
+    return (uint64_t(cells[0]) << 48) | (uint64_t(cells[1]) << 32) | (uint64_t(cells[2]) << 16) | uint64_t(cells[3]);
+}
+
+static const char* WEIGHT_NAMES[BotWeights::COUNT] = {
+    "height", "holes", "bumpiness", "bumpiness_sq", "well_depth", "t_slots",
+    "clear_1", "clear_2", "clear_3", "clear_4", "combo", "attack"
+};
+
+float& BotWeights::operator[](int index)
+{
+    float* weights[COUNT] = { &Height, &Holes, &Bumpiness, &BumpinessSq, &WellDepth, &TSlots, &Clears[1], &Clears[2], &Clears[3], &Clears[4], &Combo, &Attack };
+    return *weights[index];
+}
+
+float BotWeights::operator[](int index) const
+{
+    return const_cast<BotWeights&>(*this)[index];
+}
+
+const char* BotWeights::Name(int index)
+{
+    return WEIGHT_NAMES[index];
+}
+
+Bot::Bot(const BotConfig& config, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable)
+:   Config(config),
+    Pieces(rotationOffsets, kickTable),
+    Pool(config.Threads == 1 ? nullptr : std::make_unique<ThreadPool>(config.Threads))
+{
+    if (Config.HashBits > 0)
+        Table = std::make_unique<TranspositionTable>(Config.HashBits);
+
+    size_t workers = Pool ? Pool->Size() : 1;
+    Arenas.resize(workers);
+    PlacementBuffers.resize(workers);
+    PrunedCounts.resize(workers);
+    for (auto& arena: Arenas)
+        arena.reserve(Config.BeamWidth * 64);
+}
+
+void Bot::GeneratePlacements(const Bitboard& board, MinoType piece, std::vector<Placement>& out, bool withMoves, int startRow) const
+{
+    out.clear();
+    if (board.Collides(Pieces.Shapes[piece][0], SPAWN_POSITION))
+        return;
+
+    // breadth first search over the piece states, so the first path found to a placement uses the least inputs
+    int16_t parent[STATE_COUNT];
+    MoveType via[STATE_COUNT];
+    bool visited[STATE_COUNT];
+    uint16_t open[STATE_COUNT];
+    uint64_t keys[STATE_COUNT];
+    int head = 0, tail = 0;
+    std::memset(visited, 0, sizeof(visited));
+
+    if (startRow < 0 || withMoves)
+    {
+        int start = StateIndex(SPAWN_POSITION, 0);
+        visited[start] = true;
+        parent[start] = -1;
+        open[tail++] = start;
+    }
+    else
+    {
+        // in empty space every column and rotation is reachable from spawn
+        for (int col = -2; col < MATRIX_COLS + 2; col++)
+        {
+            for (int rotation = 0; rotation < 4; rotation++)
+            {
+                glm::ivec2 position(startRow, col);
+                if (board.Collides(Pieces.Shapes[piece][rotation], position))
+                    continue;
+
+                int start = StateIndex(position, rotation);
+                visited[start] = true;
+                parent[start] = -1;
+                open[tail++] = start;
+            }
+        }
+    }
+
+    // a placement reached by rotating the piece into it from 'state', better than any other way to get there
+    auto addSpin = [&](int state, MoveType move, int rotation, glm::ivec2 position, SpinType spin) {
+        uint64_t key = CellsKey(Pieces.Shapes[piece][rotation], position);
+        size_t index = std::find(keys, keys + out.size(), key) - keys;
+        if (index == out.size())
+        {
+            keys[index] = key;
+            out.emplace_back();
+        }
+        else if (out[index].Spin >= spin)
+            return;
+
+        Placement& placement = out[index];
+        placement.Piece = piece;
+        placement.Rotation = rotation;
+        placement.Position = position;
+        placement.Spin = spin;
+        placement.Moves.clear();
+
+        if (withMoves)
+        {
+            for (int s = state; parent[s] != -1; s = parent[s])
+                placement.Moves.push_back(via[s]);
+            std::reverse(placement.Moves.begin(), placement.Moves.end());
+            placement.Moves.push_back(move);
+            placement.Moves.push_back(MoveType::HARDDROP);
+        }
+    };
+
+    while (head < tail)
+    {
+        int state = open[head++];
+        glm::ivec2 position = StatePosition(state);
+        int rotation = state % 4;
+
+        // the landing spot of this state is a placement
+        glm::ivec2 landing = board.DropPosition(Pieces.Shapes[piece][rotation], position);
+        uint64_t key = CellsKey(Pieces.Shapes[piece][rotation], landing);
+        if (std::find(keys, keys + out.size(), key) == keys + out.size())
+        {
+            keys[out.size()] = key;
+            Placement& placement = out.emplace_back();
+            placement.Piece = piece;
+            placement.Rotation = rotation;
+            placement.Position = landing;
+            placement.Spin = SPIN_NONE;
+            placement.Moves.clear();
+
+            if (withMoves)
+            {
+                for (int s = state; parent[s] != -1; s = parent[s])
+                    placement.Moves.push_back(via[s]);
+                std::reverse(placement.Moves.begin(), placement.Moves.end());
+                placement.Moves.push_back(MoveType::HARDDROP);
+            }
+        }
+
+        // the other pieces spin when they end up immobile, which no shift or drop can lead to: the state
+        // was reached by a rotation
+        bool rotated = parent[state] != -1 && (via[state] == ROTATE_CLOCKWISE || via[state] == ROTATE_ANTICLOCKWISE || via[state] == ROTATE_180);
+        if (piece != BLOCK_T && rotated && landing == position)
+        {
+            const PieceShape& shape = Pieces.Shapes[piece][rotation];
+            bool immobile = board.Collides(shape, glm::ivec2(position.x + 1, position.y))
+                && board.Collides(shape, glm::ivec2(position.x, position.y - 1))
+                && board.Collides(shape, glm::ivec2(position.x, position.y + 1));
+            SpinType spin = SpinDetector::Classify(board.Rows, piece, rotation, position, false, immobile);
+            if (spin != SPIN_NONE)
+                addSpin(parent[state], via[state], rotation, position, spin);
+        }
+
+        for (MoveType move: BOT_MOVES)
+        {
+            glm::ivec2 next = position;
+            int nextRotation = rotation;
+
+            switch (move)
+            {
+                case MOVE_LEFT:
+                case MOVE_RIGHT:
+                    next.y = next.y + (move == MOVE_LEFT ? -1 : 1);
+                    if (board.Collides(Pieces.Shapes[piece][rotation], next))
+                        continue;
+                    break;
+
+                case DAS_LEFT:
+                case DAS_RIGHT: {
+                    int step = move == DAS_LEFT ? -1 : 1;
+                    while (!board.Collides(Pieces.Shapes[piece][rotation], glm::ivec2(next.x, next.y + step)))
+                        next.y = next.y + step;
+                    break;
+                }
+
+                case ROTATE_CLOCKWISE:
+                case ROTATE_ANTICLOCKWISE:
+                case ROTATE_180: {
+                    nextRotation = (rotation + (move == ROTATE_CLOCKWISE ? 1 : move == ROTATE_180 ? 2 : 3)) % 4;
+                    const PieceShape& shape = Pieces.Shapes[piece][nextRotation];
+                    const std::vector<glm::ivec2>& kicks = Pieces.Kicks[piece][rotation][nextRotation];
+                    int kick = 0;
+                    while (kick < static_cast<int>(kicks.size()) && board.Collides(shape, position + kicks[kick]))
+                        kick = kick + 1;
+                    if (kick == static_cast<int>(kicks.size()))
+                        continue;
+                    next = position + kicks[kick];
+
+                    // a T rotated into a resting position with its corners filled is a t-spin, whatever path
+                    // reached the state first and whatever kick it used (the corners are the cheaper test)
+                    if (piece == BLOCK_T)
+                    {
+                        bool tstKick = move != ROTATE_180 && kick + 1 == static_cast<int>(kicks.size());
+                        SpinType spin = SpinDetector::Classify(board.Rows, piece, nextRotation, next, tstKick, false);
+                        if (spin != SPIN_NONE && board.Collides(shape, glm::ivec2(next.x - 1, next.y)))
+                            addSpin(state, move, nextRotation, next, spin);
+                    }
+                    break;
+                }
+
+                case SOFTDROP:
+                    next = landing;
+                    break;
+
+                default:
+                    continue;
+            }
+
+            if (next.x >= MATRIX_ROWS)
+                continue;
+
+            int nextState = StateIndex(next, nextRotation);
+            if (visited[nextState])
+                continue;
+
+            visited[nextState] = true;
+            parent[nextState] = state;
+            via[nextState] = move;
+            open[tail++] = nextState;
+        }
+    }
+}
+
+float Bot::Evaluate(const Bitboard& board) const
+{
+    const BotWeights& w = Config.Weights;
+    int top = board.StackHeight();
+
+    // column heights and holes in a single top down pass
+    int heights[MATRIX_COLS] = { 0 };
+    uint16_t covered = 0;
+    int holes = 0;
+    for (int row = top - 1; row >= 0; row--)
+    {
+        uint16_t fresh = board.Rows[row] & ~covered;
+        while (fresh)
+        {
+            int col = std::countr_zero(fresh);
+            heights[col] = row + 1;
+            fresh &= fresh - 1;
+        }
+        holes = holes + std::popcount(static_cast<uint16_t>(covered & ~board.Rows[row]));
+        covered |= board.Rows[row];
+    }
+
+    int bumpiness = 0, bumpinessSq = 0;
+    for (int col = 0; col < MATRIX_COLS - 1; col++)
+    {
+        int diff = std::abs(heights[col] - heights[col + 1]);
+        bumpiness = bumpiness + diff;
+        bumpinessSq = bumpinessSq + diff * diff;
+    }
+
+    int wellDepth = 0;
+    for (int col = 0; col < MATRIX_COLS; col++)
+    {
+        int left = col == 0 ? MATRIX_ROWS : heights[col - 1];
+        int right = col == MATRIX_COLS - 1 ? MATRIX_ROWS : heights[col + 1];
+        wellDepth = std::max(wellDepth, std::min(left, right) - heights[col]);
+    }
+    wellDepth = std::min(wellDepth, 4);
+
+    // t-spin double slots: a row missing only the slot cell, the row above open in the 3 cells around it,
+    // and an overhang on one side of the slot
+    int tSlots = 0;
+    for (int row = 0; row + 2 < top; row++)
+    {
+        for (int col = 1; col < MATRIX_COLS - 1; col++)
+        {
+            uint16_t cell = 1 << col;
+            uint16_t three = 7 << (col - 1);
+            if ((board.Rows[row] | cell) != FULL_ROW || (board.Rows[row] & cell))
+                continue;
+            if ((board.Rows[row + 1] & three) || (board.Rows[row + 1] | three) != FULL_ROW)
+                continue;
+            if ((board.Rows[row + 2] & cell) == 0 && (board.Rows[row + 2] & (three ^ cell)))
+                tSlots = tSlots + 1;
+        }
+    }
+
+    return w.Height * top
+        + w.Holes * holes
+        + w.Bumpiness * bumpiness
+        + w.BumpinessSq * bumpinessSq
+        + w.WellDepth * wellDepth
+        + w.TSlots * tSlots;
+}
+
+size_t Bot::AddChild(const SearchNode& node, const Placement& placement, MinoType nextCurrent, MinoType nextHold, unsigned int nextQueueIndex, std::vector<SearchNode>& arena) const
+{
+    SearchNode& child = arena.emplace_back(node);
+    child.State.Board.Place(Pieces.Shapes[placement.Piece][placement.Rotation], placement.Position);
+
+    unsigned int cleared = child.State.Board.ClearLines();
+    child.State.Combo = cleared ? node.State.Combo + 1 : 0;
+    unsigned int attack = AttackTable::Lines(cleared, placement.Spin, node.State.BackToBack, child.State.Combo);
+    if (cleared && child.State.Board.Rows[0] == 0 && child.State.Board.StackHeight() == 0)
+        attack = attack + AttackTable::PERFECT_CLEAR;
+    child.State.BackToBack = AttackTable::Chain(cleared, placement.Spin, node.State.BackToBack);
+    child.State.Current = nextCurrent;
+    child.State.Hold = nextHold;
+    child.State.QueueIndex = nextQueueIndex;
+
+    // topping out ends the path
+    if (nextCurrent != MinoType::EMPTY && child.State.Board.Collides(Pieces.Shapes[nextCurrent][0], SPAWN_POSITION))
+    {
+        arena.pop_back();
+        return 0;
+    }
+
+    child.Reward = node.Reward + Config.Weights.Clears[cleared] + Config.Weights.Combo * child.State.Combo + Config.Weights.Attack * attack;
+
+    // the same state is reached through different orders of the same placements or through hold. The
+    // board evaluation only depends on the state, so the rewards rank the paths and a worse one is
+    // dropped before it's evaluated. That keeps duplicates out of the beam but saves little time: the
+    // beam expands as many nodes either way and generating their placements is most of the search,
+    // so the table is off unless HashBits is set
+    if (Table && !Table->Improve(child.State.Hash(), child.Reward))
+    {
+        arena.pop_back();
+        return 1;
+    }
+
+    child.Score = child.Reward + Evaluate(child.State.Board);
+    return 0;
+}
+
+size_t Bot::Expand(const SearchNode& node, std::vector<SearchNode>& arena, std::vector<Placement>& buffer) const
+{
+    const BotState& state = node.State;
+    auto queueAt = [this](unsigned int index) {
+        return index < Queue.size() ? Queue[index] : MinoType::EMPTY;
+    };
+
+    size_t pruned = 0;
+
+    // place the current piece
+    GeneratePlacements(state.Board, state.Current, buffer, false);
+    for (const Placement& placement: buffer)
+        pruned = pruned + AddChild(node, placement, queueAt(state.QueueIndex), state.Hold, state.QueueIndex + 1, arena);
+
+    // or hold it and place the held (or next) one
+    MinoType held = state.Hold == MinoType::EMPTY ? queueAt(state.QueueIndex) : state.Hold;
+    if (held == MinoType::EMPTY || held == state.Current)
+        return pruned;
+
+    unsigned int queueIndex = state.Hold == MinoType::EMPTY ? state.QueueIndex + 1 : state.QueueIndex;
+    GeneratePlacements(state.Board, held, buffer, false);
+    for (const Placement& placement: buffer)
+        pruned = pruned + AddChild(node, placement, queueAt(queueIndex), state.Current, queueIndex + 1, arena);
+    return pruned;
+}
+
+BotSnapshot Bot::Snapshot(const GameBoard& board)
+{
+    BotSnapshot snapshot;
+    snapshot.State.Board.FromMatrix(board.Matrix);
+    snapshot.State.Current = board.CurrentPiece;
+    snapshot.State.Hold = board.HoldPiece;
+    snapshot.State.QueueIndex = 0;
+    snapshot.State.Combo = board.Combo;
+    snapshot.State.BackToBack = board.BackToBack;
+    snapshot.HoldUsed = board.HoldUsed;
+
+    // only the visible part of the queue
+    for (MinoType type: board.TetrominoQueue)
+    {
+        if (snapshot.Queue.size() == PREVIEW_NUMBER) break;
+        snapshot.Queue.push_back(type);
+    }
+    return snapshot;
+}
+
+BotSnapshot Bot::Predict(const BotSnapshot& snapshot, const BotDecision& decision) const
+{
+    BotSnapshot next = snapshot;
+    next.HoldUsed = false;
+
+    const Placement& target = decision.Target;
+    next.State.Board.Place(Pieces.Shapes[target.Piece][target.Rotation], target.Position);
+    unsigned int cleared = next.State.Board.ClearLines();
+    next.State.Combo = cleared ? snapshot.State.Combo + 1 : 0;
+    next.State.BackToBack = AttackTable::Chain(cleared, target.Spin, snapshot.State.BackToBack);
+
+    // pieces taken from the queue: the placed one if it wasn't the current one, and the new current piece
+    size_t consumed = 1;
+    if (decision.UseHold)
+    {
+        if (snapshot.State.Hold == MinoType::EMPTY)
+            consumed = 2;
+        next.State.Hold = snapshot.State.Current;
+    }
+
+    next.State.Current = consumed <= next.Queue.size() ? next.Queue[consumed - 1] : MinoType::EMPTY;
+    next.Queue.erase(next.Queue.begin(), next.Queue.begin() + std::min(consumed, next.Queue.size()));
+    return next;
+}
+
+BotDecision Bot::Think(const GameBoard& board, const CancellationToken* token)
+{
+    if (board.IsOver)
+        return BotDecision();
+    return Think(Snapshot(board), token);
+}
+
+bool Bot::SearchIteration(const std::vector<SearchNode>& rootChildren, int depth, int width, const CancellationToken* token, CancellationToken::Clock::time_point stopTime, BotDecision& decision, int& bestRoot)
+{
+    auto stopped = [token, stopTime]() {
+        return token && (token->IsCancelled() || CancellationToken::Clock::now() >= stopTime);
+    };
+
+    if (Table)
+        Table->NewSearch();
+
+    std::vector<SearchNode> beam = rootChildren;
+    std::vector<SearchNode> next;
+    for (int level = 1; level < depth; level++)
+    {
+        if (beam.size() > static_cast<size_t>(width))
+        {
+            std::nth_element(beam.begin(), beam.begin() + width, beam.end(), [](const SearchNode& a, const SearchNode& b) {
+                return a.Score > b.Score;
+            });
+            beam.resize(width);
+        }
+
+        for (auto& arena: Arenas)
+            arena.clear();
+        std::fill(PrunedCounts.begin(), PrunedCounts.end(), 0);
+
+        // every beam node is expanded independently, the token is polled before every expansion
+        auto expand = [this, &beam, &stopped](size_t index, unsigned int worker) {
+            if (stopped())
+                return;
+            if (beam[index].State.Current != MinoType::EMPTY)
+                PrunedCounts[worker] += Expand(beam[index], Arenas[worker], PlacementBuffers[worker]);
+        };
+
+        if (Pool)
+            Pool->ParallelFor(beam.size(), expand);
+        else
+        {
+            for (size_t index = 0; index < beam.size(); index++)
+                expand(index, 0);
+        }
+
+        if (stopped())
+            return false;
+
+        next.clear();
+        for (size_t worker = 0; worker < Arenas.size(); worker++)
+        {
+            next.insert(next.end(), Arenas[worker].begin(), Arenas[worker].end());
+            decision.NodesPruned = decision.NodesPruned + PrunedCounts[worker];
+        }
+
+        decision.NodesExpanded = decision.NodesExpanded + next.size();
+        if (next.empty())
+            break;
+        std::swap(beam, next);
+    }
+
+    const SearchNode& best = *std::max_element(beam.begin(), beam.end(), [](const SearchNode& a, const SearchNode& b) {
+        return a.Score < b.Score;
+    });
+    bestRoot = best.Root;
+    decision.Score = best.Score;
+    return true;
+}
+
+int Bot::BookPlacement(const BotSnapshot& snapshot, const std::vector<Placement>& placements, const std::vector<bool>& useHold) const
+{
+    MinoType pieces[OpeningBook::MAX_PIECES];
+    unsigned int count = 0;
+    pieces[count++] = snapshot.State.Current;
+    for (size_t i = 0; i < snapshot.Queue.size() && count < OpeningBook::MAX_PIECES; i++)
+        pieces[count++] = snapshot.Queue[i];
+
+    const BookEntry *entry = Book->Find(snapshot.State.Board.Hash, snapshot.State.Hold, pieces, count);
+    if (!entry)
+        return -1;
+
+    // the book move is matched on the board it leaves, another rotation may cover the same cells
+    const BookMove& move = Book->Moves(*entry)[0];
+    if (move.Piece < MinoType::BLOCK_I || move.Piece > MinoType::BLOCK_Z || move.Rotation > 3)
+        return -1;
+    const PieceShape& shape = Pieces.Shapes[move.Piece][move.Rotation];
+    if (move.Row + shape.MinRow < 0 || move.Row + shape.MaxRow >= MATRIX_ROWS || move.Column + shape.MinCol < 0 || move.Column + shape.MaxCol >= MATRIX_COLS)
+        return -1;
+    Bitboard target = snapshot.State.Board;
+    target.Place(shape, glm::ivec2(move.Row, move.Column));
+    for (size_t i = 0; i < placements.size(); i++)
+    {
+        if (useHold[i] != (move.UseHold != 0) || placements[i].Piece != move.Piece)
+            continue;
+
+        Bitboard candidate = snapshot.State.Board;
+        candidate.Place(Pieces.Shapes[placements[i].Piece][placements[i].Rotation], placements[i].Position);
+        if (candidate.Hash == target.Hash)
+            return i;
+    }
+    return -1;
+}
+
+BotDecision Bot::Think(const BotSnapshot& snapshot, const CancellationToken* token)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    BotDecision decision;
+    Queue = snapshot.Queue;
+
+    if (Table)
+        Table->NewSearch();
+
+    SearchNode root;
+    root.State = snapshot.State;
+    root.Reward = 0.0f;
+    root.Score = 0.0f;
+    root.Root = -1;
+
+    if (root.State.Current == MinoType::EMPTY)
+        return decision;
+
+    // the first level is expanded serially since the input sequences are needed for it,
+    // it is shared by all the iterations
+    std::vector<Placement> rootPlacements;
+    std::vector<bool> rootHold;
+    std::vector<SearchNode> rootChildren;
+
+    std::vector<Placement> buffer;
+    GeneratePlacements(root.State.Board, root.State.Current, buffer, true);
+    for (Placement& placement: buffer)
+    {
+        rootPlacements.push_back(std::move(placement));
+        rootHold.push_back(false);
+    }
+
+    MinoType held = root.State.Hold == MinoType::EMPTY ? (Queue.empty() ? MinoType::EMPTY : Queue[0]) : root.State.Hold;
+    unsigned int heldQueueIndex = root.State.Hold == MinoType::EMPTY ? 1 : 0;
+    size_t ownPlacements = rootPlacements.size();
+    if (!snapshot.HoldUsed && held != MinoType::EMPTY && held != root.State.Current)
+    {
+        GeneratePlacements(root.State.Board, held, buffer, true);
+        for (Placement& placement: buffer)
+        {
+            placement.Moves.insert(placement.Moves.begin(), MoveType::HOLD);
+            rootPlacements.push_back(std::move(placement));
+            rootHold.push_back(true);
+        }
+    }
+
+    for (size_t i = 0; i < rootPlacements.size(); i++)
+    {
+        size_t before = rootChildren.size();
+        if (i < ownPlacements)
+            AddChild(root, rootPlacements[i], Queue.empty() ? MinoType::EMPTY : Queue[0], root.State.Hold, 1, rootChildren);
+        else
+            AddChild(root, rootPlacements[i], heldQueueIndex < Queue.size() ? Queue[heldQueueIndex] : MinoType::EMPTY, root.State.Current, heldQueueIndex + 1, rootChildren);
+
+        if (rootChildren.size() > before)
+            rootChildren.back().Root = i;
+    }
+
+    decision.NodesExpanded = rootChildren.size();
+    if (rootChildren.empty())
+        return decision;
+
+    // a known opening is played from the book, if its move is still possible
+    int bookRoot = Book ? BookPlacement(snapshot, rootPlacements, rootHold) : -1;
+    if (bookRoot >= 0)
+    {
+        decision.Valid = true;
+        decision.UseHold = rootHold[bookRoot];
+        decision.Target = rootPlacements[bookRoot];
+        decision.Moves.assign(decision.Target.Moves.begin(), decision.Target.Moves.end());
+        decision.Stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        return decision;
+    }
+
+    // the search can't go deeper than the known pieces
+    int maxDepth = std::min(Config.Depth, static_cast<int>(Queue.size()) + 1);
+    bool anytime = token && token->HasDeadline();
+
+    // (depth, width) of every iteration: a single one without deadline,
+    // otherwise deepening from 1 and then widening the beam
+    std::vector<std::pair<int, int>> iterations;
+    if (!anytime)
+        iterations.emplace_back(maxDepth, Config.BeamWidth);
+    else
+    {
+        for (int depth = 1; depth <= maxDepth; depth++)
+            iterations.emplace_back(depth, Config.BeamWidth);
+        for (int width = Config.BeamWidth * 2; width <= Config.MaxBeamWidth; width = width * 2)
+            iterations.emplace_back(maxDepth, width);
+    }
+
+    auto stopTime = CancellationToken::Clock::time_point::max();
+    if (anytime)
+        stopTime = token->GetDeadline() - std::chrono::duration_cast<CancellationToken::Clock::duration>(std::chrono::duration<double>(Config.DeadlineMargin));
+
+    int bestRoot = -1;
+    auto lastDuration = CancellationToken::Clock::duration::zero();
+    for (auto [depth, width]: iterations)
+    {
+        // an iteration takes at least as long as the previous one, don't start it if it can't complete
+        auto iterationStart = CancellationToken::Clock::now();
+        if (anytime && iterationStart + lastDuration > stopTime)
+        {
+            decision.Stats.Cancelled = true;
+            break;
+        }
+
+        int root = -1;
+        if (!SearchIteration(rootChildren, depth, width, token, stopTime, decision, root))
+        {
+            decision.Stats.Cancelled = true;
+            break;
+        }
+        lastDuration = CancellationToken::Clock::now() - iterationStart;
+
+        bestRoot = root;
+        decision.Stats.DepthReached = depth;
+        decision.Stats.BeamWidthReached = width;
+        decision.Stats.Iterations = decision.Stats.Iterations + 1;
+    }
+
+    // cancelled before the first iteration completed: greedy choice on the root children
+    if (bestRoot < 0)
+    {
+        const SearchNode& best = *std::max_element(rootChildren.begin(), rootChildren.end(), [](const SearchNode& a, const SearchNode& b) {
+            return a.Score < b.Score;
+        });
+        bestRoot = best.Root;
+        decision.Score = best.Score;
+        decision.Stats.DepthReached = 1;
+    }
+
+    decision.Valid = true;
+    decision.UseHold = rootHold[bestRoot];
+    decision.Target = rootPlacements[bestRoot];
+    decision.Moves.assign(decision.Target.Moves.begin(), decision.Target.Moves.end());
+    decision.Stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return decision;
+}
+
+BotController::BotController(const BotConfig& config, float pps, float thinkTime, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable, std::shared_ptr<const OpeningBook> book)
+:   PPS(pps),
+    ThinkTime(thinkTime),
+    Engine(config, rotationOffsets, kickTable),
+    PieceTimer(0.0f),
+    PonderDone(false),
+    Deciding(false)
+{
+    Engine.Book = book;
+}
+
+BotController::~BotController()
+{
+    StopPondering(BotSnapshot());
+}
+
+void BotController::Reset()
+{
+    StopPondering(BotSnapshot());
+    Deciding = false;
+    PieceTimer = 0.0f;
+}
+
+float BotController::DecisionBudget() const
+{
+    if (ThinkTime > 0.0f)
+        return ThinkTime;
+    // keep some margin for executing the moves and rendering the frame
+    if (PPS > 0.0f)
+        return 0.8f / PPS;
+    return 0.0f;
+}
+
+void BotController::StartSearch(const BotSnapshot& snapshot, float timeout)
+{
+    PonderSnapshot = snapshot;
+    PonderDecision = BotDecision();
+    PonderDone.store(false, std::memory_order_relaxed);
+    PonderToken.Reset();
+    PonderToken.SetTimeout(timeout);
+    PonderThread = std::thread([this]() {
+        PonderDecision = Engine.Think(PonderSnapshot, &PonderToken);
+        PonderDone.store(true, std::memory_order_release);
+    });
+}
+
+void BotController::StartPondering(const BotSnapshot& snapshot, const BotDecision& decision)
+{
+    // the search for the next piece can use the whole time until that piece is due
+    StartSearch(Engine.Predict(snapshot, decision), 1.0f / PPS);
+}
+
+bool BotController::StopPondering(const BotSnapshot& snapshot)
+{
+    if (!PonderThread.joinable())
+        return false;
+
+    PonderToken.Cancel();
+    PonderThread.join();
+
+    // the prediction holds if the board and the pieces are the same, the actual queue can only know more pieces
+    const BotState& predicted = PonderSnapshot.State;
+    const BotState& actual = snapshot.State;
+    return predicted.Board.Hash == actual.Board.Hash
+        && predicted.Current == actual.Current
+        && predicted.Hold == actual.Hold
+        && predicted.Combo == actual.Combo
+        && predicted.BackToBack == actual.BackToBack
+        && snapshot.Queue.size() >= PonderSnapshot.Queue.size()
+        && std::equal(PonderSnapshot.Queue.begin(), PonderSnapshot.Queue.end(), snapshot.Queue.begin());
+}
+
+std::list<MoveType> BotController::Update(const GameBoard& board, float dt)
+{
+    if (board.IsOver)
+        return {};
+
+    if (Deciding)
+    {
+        // the piece waits for its search, the time keeps running for the next one
+        if (PPS > 0.0f)
+            PieceTimer = std::min(PieceTimer + dt, 1.0f / PPS);
+        if (!PonderDone.load(std::memory_order_acquire))
+            return {};
+
+        Deciding = false;
+        BotSnapshot snapshot = Engine.Snapshot(board);
+        if (!StopPondering(snapshot))
+        {
+            // the board changed while the piece was searched, it is searched again
+            StartSearch(snapshot, DecisionBudget());
+            Deciding = true;
+            return {};
+        }
+
+        if (DecisionBudget() > 0.0f && PonderDecision.Stats.Seconds > DecisionBudget())
+            Stats.DeadlineMisses = Stats.DeadlineMisses + 1;
+        Stats.MaxSeconds = std::max(Stats.MaxSeconds, PonderDecision.Stats.Seconds);
+        return Decide(snapshot, PonderDecision);
+    }
+
+    // a non positive rate places pieces as fast as the bot can think
+    if (PPS > 0.0f)
+    {
+        float interval = 1.0f / PPS;
+        PieceTimer += dt;
+        if (PieceTimer < interval)
+            return {};
+
+        // don't build up a backlog of pieces if a frame took too long
+        PieceTimer = std::min(PieceTimer - interval, interval);
+    }
+
+    BotSnapshot snapshot = Engine.Snapshot(board);
+    if (StopPondering(snapshot) && PonderDecision.Valid)
+    {
+        Stats.PonderHits = Stats.PonderHits + 1;
+        return Decide(snapshot, PonderDecision);
+    }
+
+    // searching here would hold the caller (a game frame or a versus tick) for the whole budget
+    StartSearch(snapshot, DecisionBudget());
+    Deciding = true;
+    return {};
+}
+
+std::list<MoveType> BotController::Decide(const BotSnapshot& snapshot, BotDecision decision)
+{
+    Stats.Decisions = Stats.Decisions + 1;
+    Stats.TotalDepth = Stats.TotalDepth + decision.Stats.DepthReached;
+
+    if (decision.Valid && PPS > 0.0f)
+        StartPondering(snapshot, decision);
+
+    return decision.Moves;
+}
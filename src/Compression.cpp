@@ -0,0 +1,151 @@
+#include "Compression.h"
+
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+static const int HASH_BITS = 14;
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;     // the block always ends with at least 5 literals
+static const size_t MATCH_GUARD = 12;      // and no match starts in its last 12 bytes
+static const size_t MAX_OFFSET = 65535;
+
+static inline uint32_t Read32(const uint8_t *data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void WriteLength(std::vector<uint8_t>& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length = length - 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+static void WriteSequence(std::vector<uint8_t>& out, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+    out.push_back(token);
+    if (literalLength >= 15)
+        WriteLength(out, literalLength - 15);
+    out.insert(out.end(), literals, literals + literalLength);
+
+    if (matchLength == 0)
+        return;
+    out.push_back(static_cast<uint8_t>(offset & 0xFF));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (matchCode >= 15)
+        WriteLength(out, matchCode - 15);
+}
+
+size_t Compression::Compress(const uint8_t *data, size_t size, std::vector<uint8_t>& out)
+{
+    size_t start = out.size();
+    size_t anchor = 0;
+
+    if (size > MATCH_GUARD)
+    {
+        // positions + 1 of the last occurrence of every hashed 4 byte sequence, 0 = none
+        std::unique_ptr<uint32_t[]> table(new uint32_t[1 << HASH_BITS]());
+        size_t matchLimit = size - MATCH_GUARD;
+        size_t endLimit = size - LAST_LITERALS;
+
+        size_t position = 0;
+        while (position < matchLimit)
+        {
+            uint32_t sequence = Read32(data + position);
+            uint32_t& slot = table[Hash(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(position + 1);
+
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || Read32(data + candidate - 1) != sequence)
+            {
+                position = position + 1;
+                continue;
+            }
+
+            size_t reference = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (position + length < endLimit && data[reference + length] == data[position + length])
+                length = length + 1;
+
+            WriteSequence(out, data + anchor, position - anchor, position - reference, length);
+            position = position + length;
+            anchor = position;
+        }
+    }
+
+    WriteSequence(out, data + anchor, size - anchor, 0, 0);
+    return out.size() - start;
+}
+
+bool Compression::Decompress(const uint8_t *data, size_t size, uint8_t *out, size_t outSize)
+{
+    size_t in = 0, written = 0;
+    while (in < size)
+    {
+        uint8_t token = data[in++];
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15)
+        {
+            uint8_t byte;
+            do
+            {
+                if (in >= size)
+                    return false;
+                byte = data[in++];
+                literalLength = literalLength + byte;
+            } while (byte == 255);
+        }
+        if (literalLength > size - in || literalLength > outSize - written)
+            return false;
+        std::memcpy(out + written, data + in, literalLength);
+        in = in + literalLength;
+        written = written + literalLength;
+
+        // the last sequence has no match
+        if (in == size)
+            break;
+
+        if (size - in < 2)
+            return false;
+        size_t offset = data[in] | (data[in + 1] << 8);
+        in = in + 2;
+        if (offset == 0 || offset > written)
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15)
+        {
+            uint8_t byte;
+            do
+            {
+                if (in >= size)
+                    return false;
+                byte = data[in++];
+                matchLength = matchLength + byte;
+            } while (byte == 255);
+        }
+        matchLength = matchLength + MIN_MATCH;
+        if (matchLength > outSize - written)
+            return false;
+
+        // byte by byte: the match may overlap what it is writing
+        for (size_t i = 0; i < matchLength; i++)
+            out[written + i] = out[written - offset + i];
+        written = written + matchLength;
+    }
+    return written == outSize;
+}
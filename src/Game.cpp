@@ -1,12 +1,42 @@
 #include "Game.h"
 
 #include <iostream>
+#include <random>
 
 const glm::vec2 Game::BOARD_SIZE = glm::vec2(300.0f, 600.0f);
 const glm::vec2 Game::BOARD_POS  = glm::vec2(230.0f, 100.0f);
 const glm::vec2 Game::BOARD_BACK_POS = glm::vec2(50.0f, 100.0f);
 const glm::vec2 Game::BOARD_BACK_SIZE = glm::vec2(660.0f, 780.0f);
 const float Game::GHOST_OPACITY  = 0.25f;
+const float Game::HINT_OPACITY   = 0.5f;
+const float Game::KNOCKED_OUT_SHADE = 0.35f;
+const float Game::GRID_TEXTURED_MINO = 8.0f;
+const float Game::GRID_TEXT_MINO = 12.0f;
+const unsigned int Game::MAX_TICKS_PER_FRAME = 4;
+
+// cells of the grids, in minos: hold + board + previews (18 wide) and the spawn rows + board + statistics
+// (24 high), or a flat board with its garbage bar and the spawn rows
+static const glm::vec2 GRID_CELL_MINOS = glm::vec2(18.0f, 24.0f);
+static const glm::vec2 FLAT_CELL_MINOS = glm::vec2(12.0f, 22.0f);
+
+// column count giving the largest whole minos to 'count' cells in the area, returns the mino size
+static float GridLayout(unsigned int count, glm::vec2 area, glm::vec2 cellMinos, unsigned int& columns, glm::vec2& cellSize)
+{
+    float best = -1.0f;
+    for (unsigned int c = 1; c <= count; c++)
+    {
+        unsigned int rows = (count + c - 1) / c;
+        glm::vec2 cell = area / glm::vec2(c, rows);
+        float mino = std::floor(std::min(cell.x / cellMinos.x, cell.y / cellMinos.y));
+        if (mino > best)
+        {
+            best = mino;
+            columns = c;
+            cellSize = cell;
+        }
+    }
+    return best;
+}
 
 Game::Game(unsigned int width, unsigned int height, const GameSettings& settings)
 :   Settings(settings),
@@ -18,30 +48,53 @@ Game::Game(unsigned int width, unsigned int height, const GameSettings& settings
     SoftDropHeldTime(0.0f),
     PreviousDASDirection(MoveType::NO_MOVE), 
     Width(width), 
-    Height(height)
+    Height(height),
+    GridRender(nullptr),
+    BotPlayer(nullptr),
+    Hints(nullptr),
+    Match(nullptr),
+    KeyboardBoard(-1),
+    TickTime(0.0f),
+    MatchRecorded(false),
+    Spectators(nullptr),
+    ShowHint(settings.HintEnabled),
+    HintSubmitted(false),
+    HintSequence(0),
+    HintBoardKey(0)
 {
 
 }
 
 Game::~Game()
 {
+    if (Match)
+        RecordVersus();
+    delete Match;
+    delete Spectators;
     delete SpriteRender;
+    delete GridRender;
     delete TextRender;
     delete Board;
+    delete BotPlayer;
+    delete Hints;
 }
 
 void Game::Init()
 {
     // load shaders
     ResourceManager::LoadShader("shaders/sprite.vert", "shaders/sprite.frag", nullptr, "sprite");
+    ResourceManager::LoadShader("shaders/instanced.vert", "shaders/instanced.frag", nullptr, "instanced");
 
     // configure shaders
     glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(this->Width), static_cast<float>(this->Height), 0.0f, -1.0f, 1.0f);
     ResourceManager::GetShader("sprite").Use().SetInteger("image", 0);
     ResourceManager::GetShader("sprite").SetMatrix4("projection", projection);
+    ResourceManager::GetShader("instanced").Use().SetInteger("image", 0);
+    ResourceManager::GetShader("instanced").SetMatrix4("projection", projection);
 
     // set render-specific controls
     SpriteRender = new SpriteRenderer(ResourceManager::GetShader("sprite"));
+    GridRender = new InstancedRenderer(ResourceManager::GetShader("instanced"));
 
     // configure text renderer
     TextRender = new TextRenderer(this->Width, this->Height);
@@ -54,6 +107,10 @@ void Game::Init()
     ResourceManager::LoadTexture("textures/board2.png", true, "back_board");
     ResourceManager::LoadTexture("textures/x.png", true, "spawn_preview");
 
+    // plain cells of the small boards, coloured per quad
+    unsigned char white[3] = { 255, 255, 255 };
+    ResourceManager::Textures["white"].Generate(1, 1, white);
+
     // prepare board
     Board = new GameBoard(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
     BoardSize = BOARD_SIZE;
@@ -70,6 +127,33 @@ void Game::Init()
 
     Board->Load();
 
+    // the book is only mapped, a missing one just means searching every position
+    if (!Settings.BotBook.empty())
+    {
+        try
+        {
+            Book = std::make_shared<const OpeningBook>(Settings.BotBook);
+        }
+        catch (const std::exception& err)
+        {
+            std::cerr << "Opening book not loaded: " << err.what() << std::endl;
+        }
+    }
+
+    // a match has its own bots, the [Bot] section only configures them
+    if (Settings.SpectatorBoards > 0)
+        InitSpectators();
+    else if (Settings.VersusBoards > 1)
+        InitVersus();
+    else if (Settings.BotEnabled)
+    {
+        BotConfig config;
+        config.BeamWidth = Settings.BotBeamWidth;
+        config.Depth = Settings.BotDepth;
+        config.Threads = Settings.BotThreads;
+        BotPlayer = new BotController(config, Settings.BotPPS, Settings.BotThinkTime, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE, Book);
+    }
+
     // generate shape parts from block texture by setting color
     MinoColors[MinoType::BLOCK_L] = glm::vec4(1.0f, 0.5f, 0.0f, 1.0f);
     MinoColors[MinoType::BLOCK_J] = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
@@ -117,12 +201,141 @@ void Game::Init()
 
 void Game::Update(float dt)
 {
+    if (State == GAME_ACTIVE && Spectators)
+        Spectators->Update(dt);
+    else if (State == GAME_ACTIVE && Match)
+        UpdateVersus(dt);
+    else if (State == GAME_ACTIVE)
+        UpdateHint();
+}
+
+void Game::InitVersus()
+{
+    std::vector<InputSource> sources;
+    for (int i = 0; i < Settings.VersusBoards; i++)
+    {
+        // boards without input play with the bot
+        std::string input = i < static_cast<int>(Settings.VersusInputs.size()) ? Settings.VersusInputs[i] : "bot";
+        if (input == "keyboard")
+        {
+            if (KeyboardBoard >= 0)
+                throw std::runtime_error("only one versus board can be played from the keyboard");
+            KeyboardBoard = i;
+            sources.push_back(INPUT_KEYBOARD);
+        }
+        else if (input == "bot")
+            sources.push_back(INPUT_BOT);
+        else if (input == "replay")
+            sources.push_back(INPUT_REPLAY);
+        else
+            throw std::runtime_error("unknown versus input: " + input);
+    }
+
+    std::shared_ptr<const VersusReplay> replay;
+    if (!Settings.VersusReplay.empty())
+        replay = std::make_shared<const VersusReplay>(VersusReplay::Read(Settings.VersusReplay));
 
+    BotConfig config;
+    config.BeamWidth = Settings.BotBeamWidth;
+    config.Depth = Settings.BotDepth;
+    Match = new VersusMatch(sources, config, Settings.BotPPS, Settings.VersusGarbageDelay, Settings.VersusMessiness, Book, replay);
+    RestartVersus();
+}
+
+void Game::RestartVersus()
+{
+    RecordVersus();
+    std::random_device dev;
+    Match->Start(dev());
+    TickTime = 0.0f;
+    MatchRecorded = false;
+}
+
+void Game::UpdateVersus(float dt)
+{
+    // the match runs on its own fixed tick, a slow frame catches up with a few ticks at most
+    const float tick = 1.0f / VERSUS_TICK_RATE;
+    TickTime = std::min(TickTime + dt, MAX_TICKS_PER_FRAME * tick);
+    while (TickTime >= tick)
+    {
+        Match->Step();
+        TickTime -= tick;
+
+        // reported by the tick that found it, the playback goes on
+        if (Match->DesyncTick >= 0 && static_cast<uint64_t>(Match->DesyncTick) + 1 == Match->Tick)
+            std::cerr << "Replay diverged after tick " << Match->DesyncTick << ":\n" << Match->DesyncDump << std::flush;
+    }
+
+    if (Match->IsOver())
+        RecordVersus();
+}
+
+void Game::InitSpectators()
+{
+    FeedSource source;
+    if (Settings.SpectatorSource == "bot")
+        source = FEED_BOTS;
+    else if (Settings.SpectatorSource == "replay")
+        source = FEED_REPLAYS;
+    else if (Settings.SpectatorSource == "server")
+        source = FEED_SERVER;
+    else
+        throw std::runtime_error("unknown spectator source: " + Settings.SpectatorSource);
+
+    BotConfig config;
+    config.BeamWidth = Settings.BotBeamWidth;
+    config.Depth = Settings.BotDepth;
+    Spectators = new SpectatorFeed(source, Settings.SpectatorBoards, config, Settings.BotPPS, Settings.VersusGarbageDelay, Settings.VersusMessiness, Book, Settings.SpectatorReplays, Settings.SpectatorServer);
+}
+
+void Game::RecordVersus()
+{
+    if (Settings.VersusRecord.empty() || MatchRecorded || Match->Tick == 0)
+        return;
+
+    try
+    {
+        Match->Recording.Write(Settings.VersusRecord);
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Match not recorded: " << err.what() << std::endl;
+    }
+    MatchRecorded = true;
+}
+
+void Game::UpdateHint()
+{
+    if (!ShowHint || Board->IsOver)
+        return;
+
+    if (!Hints)
+    {
+        BotConfig config;
+        config.BeamWidth = Settings.BotBeamWidth;
+        config.Depth = Settings.BotDepth;
+        config.Threads = Settings.BotThreads;
+        Hints = new HintWorker(config, Settings.HintThinkTime, Settings.HintPerfectClear, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE, Book);
+    }
+
+    // a new search is only needed once the piece to place changed: after a placement or a hold
+    uint64_t boardKey = (static_cast<uint64_t>(Board->PiecesPlaced) << 1) | Board->HoldUsed;
+    if (HintSubmitted && boardKey == HintBoardKey)
+        return;
+
+    // the worker never blocks us, if its queue is full we simply try again next frame
+    if (Hints->Submit(*Board, HintSequence + 1))
+    {
+        HintSequence = HintSequence + 1;
+        HintBoardKey = boardKey;
+        HintSubmitted = true;
+    }
 }
 
 void Game::ProcessInput(float dt)
 {
-    if (State == GAME_ACTIVE)
+    // nothing to play while watching
+    if (State == GAME_ACTIVE && !Spectators)
     {
         std::list<MoveType> movelist;
 
@@ -130,11 +343,47 @@ void Game::ProcessInput(float dt)
         MoveType move_direction = MoveType::NO_MOVE;
 
         if (Keys[Settings.Restart] && !KeysProcessed[Settings.Restart]) {
-            Board->Load();
+            if (Match)
+                RestartVersus();
+            else
+                Board->Load();
+            if (BotPlayer)
+                BotPlayer->Reset();
+            HintSubmitted = false;
             KeysProcessed[Settings.Restart] = true;
         }
 
-        if (Board->IsOver) {
+        if (Keys[Settings.ToggleHint] && !KeysProcessed[Settings.ToggleHint]) {
+            ShowHint = !ShowHint;
+            HintSubmitted = false;
+            KeysProcessed[Settings.ToggleHint] = true;
+        }
+
+        // the match plays its own bots and replays, the keyboard only queues inputs for its board
+        if (Match && (KeyboardBoard < 0 || Match->Players[KeyboardBoard].Board->IsOver || Match->IsOver()))
+            return;
+
+        if (!Match && Board->IsOver) {
+            return;
+        }
+
+        // the bot replaces the keyboard input
+        if (BotPlayer)
+        {
+            // a decision without moves means the bot has no placement left, the board tops out
+            size_t decisions = BotPlayer->Stats.Decisions;
+            std::list<MoveType> botMoves = BotPlayer->Update(*Board, dt);
+            if (botMoves.empty() && BotPlayer->Stats.Decisions != decisions)
+            {
+                Board->Stop();
+                Board->IsOver = true;
+            }
+            else if (!botMoves.empty())
+            {
+                if (Board->IsPaused)
+                    Board->Start();
+                Board->ExecuteMoves(botMoves);
+            }
             return;
         }
 
@@ -293,7 +542,11 @@ void Game::ProcessInput(float dt)
             KeysProcessed[Settings.RotateClockwise] = true;
         }
 
-        if (!movelist.empty()) 
+        if (!movelist.empty() && Match)
+        {
+            Match->QueueInputs(KeyboardBoard, movelist);
+        }
+        else if (!movelist.empty()) 
         {
             if (Board->IsPaused) 
                 Board->Start();
@@ -309,6 +562,18 @@ void Game::Render()
         // draw background
         SpriteRender->DrawSprite(ResourceManager::GetTexture("background"), glm::vec2(0.0f, 0.0f), glm::vec2(Width, Height), 0.0f);
 
+        // draw the watched boards, or the boards of the match
+        if (Spectators)
+        {
+            DrawSpectators();
+            return;
+        }
+        if (Match)
+        {
+            DrawGrid();
+            return;
+        }
+
         // draw board
         DrawBoard();
 
@@ -338,7 +603,7 @@ void Game::DrawBoard()
 
     // draw previews
     int i = 0;
-    for (MinoType& type: Board->TetrominoQueue)
+    for (MinoType type: Board->TetrominoQueue)
     {
         if (i == PREVIEW_NUMBER) break;
         DrawTetrominoPreview(type, i);
@@ -355,6 +620,20 @@ void Game::DrawBoard()
     // magic number [9] -> shifts the type from the block variant to the ghost variant
     DrawTetromino(Board->CurrentPiece, (MinoType)(Board->CurrentPiece + 9), Board->CurrentRotation, BoardStartPosition + glm::vec2(Board->GhostPosition.y, -Board->GhostPosition.x) * MinoSize);
 
+    // draw the placement suggested by the bot, only if it was computed for the current state
+    if (ShowHint && Hints && !Board->IsOver)
+    {
+        const Hint* hint = Hints->Latest(HintSequence);
+        if (hint)
+        {
+            glm::vec4 color = MinoColors.at(hint->Piece);
+            color.a = HINT_OPACITY;
+            glm::vec2 pos = BoardStartPosition + glm::vec2(hint->Position.y, -hint->Position.x) * MinoSize;
+            for (glm::ivec2 offset: Board->RotationOffsets.at(hint->Piece)[hint->Rotation].PieceOffsets)
+                SpriteRender->DrawSprite(MinoTexture.at(hint->Piece), pos + MinoSize * glm::vec2(offset.y, -offset.x), MinoSize, 0.0f, color);
+        }
+    }
+
     // draw held piece
     if (Board->HoldPiece != MinoType::EMPTY)
     {
@@ -370,6 +649,7 @@ void Game::DrawStatistics()
     auto elapsedTime = Board->GetElapsedTime();
     unsigned int pieces = Board->PiecesPlaced;
     unsigned int lines = Board->LinesCleared;
+    unsigned int attack = Board->LinesSent;
 
     // time:
     std::string milli = std::to_string(elapsedTime.count() - std::floor(elapsedTime.count())).substr(1, 4);
@@ -382,16 +662,22 @@ void Game::DrawStatistics()
         TextRender->RenderText(std::to_string(0), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 1.0f, 1.0f);
 
     // apm:
-    TextRender->RenderText(std::to_string(0), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 2.0f, 1.0f);
+    if (elapsedTime.count() > 0.0f)
+        TextRender->RenderText(std::to_string(attack * 60.0 / elapsedTime.count()), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 2.0f, 1.0f);
+    else
+        TextRender->RenderText(std::to_string(0), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 2.0f, 1.0f);
 
     // lines:
     TextRender->RenderText(std::to_string(lines), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 3.0f, 1.0f);
 
     // attack:
-    TextRender->RenderText(std::to_string(0), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 4.0f, 1.0f);
+    TextRender->RenderText(std::to_string(attack), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 4.0f, 1.0f);
 
     // app:
-    TextRender->RenderText(std::to_string(0), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 5.0f, 1.0f);
+    if (pieces > 0)
+        TextRender->RenderText(std::to_string(static_cast<float>(attack) / pieces), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 5.0f, 1.0f);
+    else
+        TextRender->RenderText(std::to_string(0), StatsStartPosition.x, StatsStartPosition.y + StatsSpacing.y * 5.0f, 1.0f);
 
     if (Board->IsOver)
         TextRender->RenderText("Game Over!", Width / 2.0f - 100.0f, Height / 2.0f, 1.0f);
@@ -417,3 +703,183 @@ void Game::DrawTetromino(MinoType type, MinoType minoColor, int rotation, glm::v
         SpriteRender->DrawSprite(MinoTexture.at(minoColor), pos + MinoSize * glm::vec2(offset.y, -offset.x), MinoSize, 0.0f, MinoColors.at(minoColor));
     }
 }
+
+void Game::DrawGrid()
+{
+    // boards in the grid with the largest minos
+    unsigned int count = Match->Players.size();
+    unsigned int columns = 1;
+    glm::vec2 cellSize;
+    float mino = GridLayout(count, glm::vec2(Width, Height), GRID_CELL_MINOS, columns, cellSize);
+    glm::vec2 minoSize = glm::vec2(mino, mino);
+
+    std::vector<glm::vec2> positions;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        glm::vec2 cell = cellSize * glm::vec2(i % columns, i / columns);
+        glm::vec2 position = cell + (cellSize - minoSize * GRID_CELL_MINOS) * 0.5f + minoSize * glm::vec2(4.0f, 2.0f);
+        positions.push_back(position);
+        DrawGridBoard(*Match->Players[i].Board, position, minoSize);
+    }
+
+    // every mino of every board in a draw call per texture
+    GridRender->Flush();
+
+    float textScale = mino / (BOARD_SIZE.x / 10.0f) * 0.6f;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const VersusPlayer& player = Match->Players[i];
+        double seconds = player.Board->GetElapsedTime().count();
+        double apm = seconds > 0.0 ? player.Board->LinesSent * 60.0 / seconds : 0.0;
+        std::string name = player.Source == INPUT_KEYBOARD ? "you" : player.Source == INPUT_BOT ? "bot" : "replay";
+        std::string place = player.Place == 1 ? " WIN" : player.Place > 0 ? std::format(" KO #{}", player.Place) : "";
+
+        glm::vec2 text = positions[i] + minoSize * glm::vec2(0.0f, 20.5f);
+        TextRender->RenderText(std::format("P{} {}{}", i + 1, name, place), text.x, text.y, textScale);
+        TextRender->RenderText(std::format("{:.1f} APM {} ATK", apm, player.Board->LinesSent), text.x, text.y + mino, textScale);
+    }
+}
+
+void Game::DrawSpectators()
+{
+    // level of detail by the room the boards get: textured minos with previews and hold while the minos
+    // show their texture, text too when it can be read, and flat cells in a compact layout below that
+    const std::vector<FeedTile>& tiles = Spectators->Tiles;
+    unsigned int count = tiles.size();
+    if (count == 0)
+        return;
+
+    unsigned int columns = 1;
+    glm::vec2 cellSize;
+    glm::vec2 cellMinos = GRID_CELL_MINOS;
+    glm::vec2 boardOffset = glm::vec2(4.0f, 2.0f);
+    float mino = GridLayout(count, glm::vec2(Width, Height), cellMinos, columns, cellSize);
+    bool textured = mino >= GRID_TEXTURED_MINO;
+    if (!textured)
+    {
+        cellMinos = FLAT_CELL_MINOS;
+        boardOffset = glm::vec2(1.0f, 2.0f);
+        mino = GridLayout(count, glm::vec2(Width, Height), cellMinos, columns, cellSize);
+    }
+    glm::vec2 minoSize = glm::vec2(mino, mino);
+
+    auto position = [&](unsigned int i) {
+        glm::vec2 cell = cellSize * glm::vec2(i % columns, i / columns);
+        return cell + (cellSize - minoSize * cellMinos) * 0.5f + minoSize * boardOffset;
+    };
+
+    // every board in a draw call per texture, a single one when they are flat
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (textured)
+            DrawGridBoard(*tiles[i].Board, position(i), minoSize);
+        else
+            DrawFlatBoard(*tiles[i].Board, position(i), minoSize);
+    }
+    GridRender->Flush();
+
+    if (!textured || mino < GRID_TEXT_MINO)
+        return;
+
+    float textScale = mino / (BOARD_SIZE.x / 10.0f) * 0.6f;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const FeedTile& tile = tiles[i];
+        std::string place = tile.Place == 1 ? " WIN" : tile.Place > 0 ? " KO" : "";
+        glm::vec2 text = position(i) + minoSize * glm::vec2(0.0f, 20.5f);
+        TextRender->RenderText(std::format("M{} P{}{}", tile.Match + 1, tile.Player + 1, place), text.x, text.y, textScale);
+        TextRender->RenderText(std::format("{} PCS {} ATK", tile.Board->PiecesPlaced, tile.Board->LinesSent), text.x, text.y + mino, textScale);
+    }
+}
+
+void Game::DrawGridBoard(const GameBoard& board, glm::vec2 position, glm::vec2 minoSize)
+{
+    Texture2D& solid = ResourceManager::GetTexture("block_solid");
+    float shade = board.IsOver ? KNOCKED_OUT_SHADE : 1.0f;
+    glm::vec2 start = position + minoSize * glm::vec2(0.0f, 19.0f);
+
+    GridRender->Add(solid, position, minoSize * glm::vec2(10.0f, 20.0f), glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+    // pending garbage next to the board, from the bottom up
+    unsigned int pending = std::min(board.PendingGarbageLines(), 20u);
+    if (pending > 0)
+        GridRender->Add(solid, position + minoSize * glm::vec2(-0.5f, 20.0f - pending), minoSize * glm::vec2(0.4f, static_cast<float>(pending)), glm::vec4(1.0f, 0.0f, 0.0f, 0.8f));
+
+    // the visible rows and the two above them
+    for (int i = 0; i < 22; i++)
+    {
+        for (int j = 0; j < 10; j++)
+        {
+            MinoType mino = board.Matrix[i][j];
+            if (mino != MinoType::EMPTY)
+                GridRender->Add(MinoTexture.at(mino), start + minoSize * glm::vec2(j, -i), minoSize, MinoColors.at(mino) * glm::vec4(shade, shade, shade, 1.0f));
+        }
+    }
+
+    if (!board.IsOver && board.CurrentPiece != MinoType::EMPTY)
+    {
+        AddGridTetromino(board, board.CurrentPiece, board.CurrentPiece, board.CurrentRotation, start + glm::vec2(board.CurrentPosition.y, -board.CurrentPosition.x) * minoSize, minoSize, shade);
+        AddGridTetromino(board, board.CurrentPiece, (MinoType)(board.CurrentPiece + 9), board.CurrentRotation, start + glm::vec2(board.GhostPosition.y, -board.GhostPosition.x) * minoSize, minoSize, shade);
+    }
+
+    // the first previews on the right, hold on the left
+    int i = 0;
+    for (MinoType type: board.TetrominoQueue)
+    {
+        if (i == 3) break;
+        AddGridTetromino(board, type, type, 0, position + minoSize * glm::vec2(11.5f, 2.0f + i * 3.0f), minoSize, shade);
+        i = i + 1;
+    }
+
+    if (board.HoldPiece != MinoType::EMPTY)
+        AddGridTetromino(board, board.HoldPiece, board.HoldUsed ? (MinoType)(board.HoldPiece + 9) : board.HoldPiece, 0, position + minoSize * glm::vec2(-3.5f, 2.0f), minoSize, shade);
+}
+
+void Game::DrawFlatBoard(const GameBoard& board, glm::vec2 position, glm::vec2 minoSize)
+{
+    Texture2D& white = ResourceManager::GetTexture("white");
+    float shade = board.IsOver ? KNOCKED_OUT_SHADE : 1.0f;
+    glm::vec4 dim = glm::vec4(shade, shade, shade, 1.0f);
+    glm::vec2 start = position + minoSize * glm::vec2(0.0f, 19.0f);
+
+    GridRender->Add(white, position, minoSize * glm::vec2(10.0f, 20.0f), glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+    unsigned int pending = std::min(board.PendingGarbageLines(), 20u);
+    if (pending > 0)
+        GridRender->Add(white, position + minoSize * glm::vec2(-0.5f, 20.0f - pending), minoSize * glm::vec2(0.4f, static_cast<float>(pending)), glm::vec4(1.0f, 0.0f, 0.0f, 0.8f));
+
+    // a quad per run of cells of the same colour, a stack is a few dozen quads instead of a couple hundred
+    for (int i = 0; i < 22; i++)
+    {
+        int j = 0;
+        while (j < 10)
+        {
+            MinoType mino = board.Matrix[i][j];
+            int end = j + 1;
+            while (end < 10 && board.Matrix[i][end] == mino)
+                end = end + 1;
+            if (mino != MinoType::EMPTY)
+                GridRender->Add(white, start + minoSize * glm::vec2(j, -i), minoSize * glm::vec2(end - j, 1.0f), MinoColors.at(mino) * dim);
+            j = end;
+        }
+    }
+
+    // the piece and its ghost, no previews nor hold at this size
+    if (!board.IsOver && board.CurrentPiece != MinoType::EMPTY)
+    {
+        glm::vec4 color = MinoColors.at(board.CurrentPiece) * dim;
+        glm::vec4 ghost = MinoColors.at((MinoType)(board.CurrentPiece + 9)) * dim;
+        for (glm::ivec2 offset: board.RotationOffsets.at(board.CurrentPiece)[board.CurrentRotation].PieceOffsets)
+        {
+            GridRender->Add(white, start + minoSize * glm::vec2(board.CurrentPosition.y + offset.y, -board.CurrentPosition.x - offset.x), minoSize, color);
+            GridRender->Add(white, start + minoSize * glm::vec2(board.GhostPosition.y + offset.y, -board.GhostPosition.x - offset.x), minoSize, ghost);
+        }
+    }
+}
+
+void Game::AddGridTetromino(const GameBoard& board, MinoType type, MinoType minoColor, int rotation, glm::vec2 pos, glm::vec2 minoSize, float shade)
+{
+    glm::vec4 color = MinoColors.at(minoColor) * glm::vec4(shade, shade, shade, 1.0f);
+    for (glm::ivec2 offset: board.RotationOffsets.at(type)[rotation].PieceOffsets)
+        GridRender->Add(MinoTexture.at(minoColor), pos + minoSize * glm::vec2(offset.y, -offset.x), minoSize, color);
+}
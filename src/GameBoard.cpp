@@ -1,14 +1,42 @@
 #include "GameBoard.h"
+#include "Attack.h"
+#include "Zobrist.h"
 
 #include <iostream>
+#include <sstream>
+#include <bit>
+#include <cstring>
+#include <span>
+#include <ranges>
 
 GameBoard::GameBoard(const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable)
 {
     this->RotationOffsets = rotationOffsets;
     this->KickTable = kickTable;
+    GarbageDelay = 0;
+    GarbageMessiness = 0;
 }
 
 void GameBoard::Load()
+{
+    std::random_device dev;
+    Load(dev());
+}
+
+void GameBoard::Load(unsigned int bagSeed)
+{
+    Load(bagSeed, ~bagSeed);
+}
+
+void GameBoard::LoadMatch(unsigned int seed, unsigned int player, unsigned int garbageDelay, unsigned int garbageMessiness)
+{
+    GarbageDelay = garbageDelay;
+    GarbageMessiness = garbageMessiness;
+    Load(seed, seed + 1 + player);
+    Start();
+}
+
+void GameBoard::Load(unsigned int bagSeed, unsigned int garbageSeed)
 {
     ClearBoard();
     TetrominoQueue.clear();
@@ -18,6 +46,17 @@ void GameBoard::Load()
     LinesCleared = 0;
     PiecesPlaced = 0;
     Combo = 0;
+    BackToBack = 0;
+    LinesSent = 0;
+    LastAttack = 0;
+    LastSpin = SPIN_NONE;
+
+    PendingPackets = 0;
+    Outgoing = 0;
+    GarbageSeed = garbageSeed;
+    GarbageRNG.seed(GarbageSeed);
+    GarbageDraws = 0;
+    GarbageHole = -1;
 
     /*
     SetMatrix({
@@ -38,9 +77,9 @@ void GameBoard::Load()
     TetrominoQueue.push_back(MinoType::BLOCK_O);
     */
 
-    std::random_device dev;
-    BagSeed = dev();
+    BagSeed = bagSeed;
     BagRNG.seed(BagSeed);
+    BagDraws = 0;
 
     PopulateQueue();
 
@@ -78,6 +117,76 @@ void GameBoard::ClearBoard()
             Matrix[i][j] = MinoType::EMPTY;
         }
     }
+    ComputeMetrics();
+}
+
+void GameBoard::AddMino(int row, int col, MinoType type)
+{
+    const Zobrist& keys = Zobrist::Keys();
+    uint16_t mask = RowMasks[row] | (1 << col);
+    MatrixHash = MatrixHash ^ keys.Row(row, RowMasks[row]) ^ keys.Row(row, mask);
+
+    Matrix[row][col] = type;
+    RowFill[row] = RowFill[row] + 1;
+    RowMasks[row] = mask;
+    ColumnMasks[col] = ColumnMasks[col] | (1ull << row);
+    if (type == MinoType::SOLID_GARBAGE)
+        SolidRows = SolidRows | (1ull << row);
+
+    // the empty cells between the old top and the new mino are now covered
+    if (row >= ColumnHeights[col])
+    {
+        ColumnHoles[col] = ColumnHoles[col] + row - ColumnHeights[col];
+        Holes = Holes + row - ColumnHeights[col];
+        ColumnHeights[col] = row + 1;
+        StackHeight = std::max(StackHeight, row + 1);
+    }
+    else
+    {
+        ColumnHoles[col] = ColumnHoles[col] - 1;
+        Holes = Holes - 1;
+    }
+}
+
+void GameBoard::ComputeMetrics()
+{
+    StackHeight = 0;
+    Holes = 0;
+    SolidRows = 0;
+    for (int row = 0; row < 40; row++)
+    {
+        RowFill[row] = 0;
+        RowMasks[row] = 0;
+        for (int col = 0; col < 10; col++)
+        {
+            if (Matrix[row][col] != MinoType::EMPTY)
+            {
+                RowFill[row] = RowFill[row] + 1;
+                RowMasks[row] = RowMasks[row] | (1 << col);
+            }
+            if (Matrix[row][col] == MinoType::SOLID_GARBAGE)
+                SolidRows = SolidRows | (1ull << row);
+        }
+    }
+
+    for (int col = 0; col < 10; col++)
+    {
+        ColumnHeights[col] = 0;
+        ColumnHoles[col] = 0;
+        ColumnMasks[col] = 0;
+        for (int row = 0; row < 40; row++)
+        {
+            if (Matrix[row][col] != MinoType::EMPTY)
+            {
+                ColumnMasks[col] = ColumnMasks[col] | (1ull << row);
+                ColumnHoles[col] = ColumnHoles[col] + row - ColumnHeights[col];
+                ColumnHeights[col] = row + 1;
+            }
+        }
+        StackHeight = std::max(StackHeight, ColumnHeights[col]);
+        Holes = Holes + ColumnHoles[col];
+    }
+    ComputeMatrixHash();
 }
 
 void GameBoard::SetMatrix(const std::vector<std::vector<MinoType>>& matrix)
@@ -90,16 +199,26 @@ void GameBoard::SetMatrix(const std::vector<std::vector<MinoType>>& matrix)
             Matrix[row][col] = matrix[row][col];
         }
     }
+    ComputeMetrics();
 }
 
-void GameBoard::ExecuteMoves(const std::list<MoveType>& moves)
+template <typename Moves>
+void GameBoard::ExecuteMoveRange(const Moves& moves)
 {
     if (IsOver || IsPaused) return;
 
+    // the ghost only moves with the piece or the matrix (a placement)
+    MinoType oldPiece = CurrentPiece;
+    glm::ivec2 oldPosition = CurrentPosition;
+    int oldRotation = CurrentRotation;
+    unsigned int oldPlaced = PiecesPlaced;
+
     glm::ivec2 newPos;
     for (MoveType move: moves)
     {
         newPos = CurrentPosition;
+        glm::ivec2 movedFrom = CurrentPosition;
+        int rotatedFrom = CurrentRotation;
 
         switch (move)
         {
@@ -143,21 +262,28 @@ void GameBoard::ExecuteMoves(const std::list<MoveType>& moves)
                 const auto &offsets = RotationOffsets.at(CurrentPiece)[CurrentRotation].PieceOffsets;
                 glm::ivec2 pos = SoftDropPosition();
 
-                Matrix[pos.x + offsets[0].x][pos.y + offsets[0].y] = CurrentPiece;
-                Matrix[pos.x + offsets[1].x][pos.y + offsets[1].y] = CurrentPiece;
-                Matrix[pos.x + offsets[2].x][pos.y + offsets[2].y] = CurrentPiece;
-                Matrix[pos.x + offsets[3].x][pos.y + offsets[3].y] = CurrentPiece;
-
-                int cleared = ClearLines();
-                LinesCleared = LinesCleared + cleared;
-
-                NextPiece();
-                if (!CurrentPieceCanMoveAt(CurrentPosition, CurrentRotation))
+                // a spin needs the piece rotated into place, the drop mustn't move it
+                LastSpin = SPIN_NONE;
+                bool rotated = LastAction == ROTATE_CLOCKWISE || LastAction == ROTATE_ANTICLOCKWISE || LastAction == ROTATE_180;
+                if (rotated && pos == CurrentPosition)
                 {
-                    Stop();
-                    IsOver = true;
+                    bool immobile = !CurrentPieceCanMoveAt(pos + glm::ivec2(0, -1), CurrentRotation)
+                        && !CurrentPieceCanMoveAt(pos + glm::ivec2(0, 1), CurrentRotation)
+                        && !CurrentPieceCanMoveAt(pos + glm::ivec2(1, 0), CurrentRotation);
+                    LastSpin = SpinDetector::Classify(RowMasks, CurrentPiece, CurrentRotation, pos, LastKickTST, immobile);
                 }
 
+                AddMino(pos.x + offsets[0].x, pos.y + offsets[0].y, CurrentPiece);
+                AddMino(pos.x + offsets[1].x, pos.y + offsets[1].y, CurrentPiece);
+                AddMino(pos.x + offsets[2].x, pos.y + offsets[2].y, CurrentPiece);
+                AddMino(pos.x + offsets[3].x, pos.y + offsets[3].y, CurrentPiece);
+
+                // only the rows the piece landed on can have been filled
+                int lowest = std::min({ offsets[0].x, offsets[1].x, offsets[2].x, offsets[3].x });
+                int highest = std::max({ offsets[0].x, offsets[1].x, offsets[2].x, offsets[3].x });
+                int cleared = ClearLines(pos.x + lowest, pos.x + highest);
+                LinesCleared = LinesCleared + cleared;
+
                 HoldUsed = false;
                 PiecesPlaced = PiecesPlaced + 1;
 
@@ -166,7 +292,18 @@ void GameBoard::ExecuteMoves(const std::list<MoveType>& moves)
                 else
                     Combo = 0;
 
+                LastAttack = AttackTable::Lines(cleared, LastSpin, BackToBack, Combo);
+                if (cleared && StackHeight == 0)
+                    LastAttack = LastAttack + AttackTable::PERFECT_CLEAR;
+                BackToBack = AttackTable::Chain(cleared, LastSpin, BackToBack);
+                LinesSent = LinesSent + LastAttack;
 
+                // the attack cancels incoming garbage first, garbage only rises on placements without clears
+                Outgoing = CancelGarbage(LastAttack);
+                if (!cleared)
+                    TakeGarbage();
+
+                NextPiece();
                 break;
             }
 
@@ -177,6 +314,7 @@ void GameBoard::ExecuteMoves(const std::list<MoveType>& moves)
             case HOLD:
                 if (HoldUsed) break;
                 HoldUsed = true;
+                LastAction = NO_MOVE;
 
                 if (HoldPiece == MinoType::EMPTY)
                 {
@@ -185,9 +323,10 @@ void GameBoard::ExecuteMoves(const std::list<MoveType>& moves)
                 }
                 else
                 {
-                    MinoType aux = HoldPiece;
+                    // the held piece comes back at the spawn, not where the other one was moved
+                    MinoType held = HoldPiece;
                     HoldPiece = CurrentPiece;
-                    CurrentPiece = aux;
+                    SpawnPiece(held);
                 }
                 break;
 
@@ -207,14 +346,157 @@ void GameBoard::ExecuteMoves(const std::list<MoveType>& moves)
             case NO_MOVE:
                 break;
         }
+
+        // the last input that moved the piece tells if it was spun into place
+        if (move != HARDDROP && move != HOLD && (CurrentPosition != movedFrom || CurrentRotation != rotatedFrom))
+            LastAction = move;
     }
-    GhostPosition = SoftDropPosition();
+
+    if (CurrentPiece != oldPiece || CurrentPosition != oldPosition || CurrentRotation != oldRotation || PiecesPlaced != oldPlaced)
+        GhostPosition = SoftDropPosition();
+}
+
+void GameBoard::ExecuteMoves(const std::list<MoveType>& moves)
+{
+    ExecuteMoveRange(moves);
+}
+
+void GameBoard::ExecuteMoves(const MoveType *moves, size_t count)
+{
+    ExecuteMoveRange(std::span<const MoveType>(moves, count));
+}
+
+template <typename Moves>
+unsigned int GameBoard::ExecuteTickRange(const Moves& moves, PlacementObserver *observer)
+{
+    // Outgoing only holds the attack of the last placement, so the inputs are executed up to every hard
+    // drop and its attack collected before the next one
+    unsigned int sent = 0;
+    auto first = moves.begin();
+    for (auto move = moves.begin(); move != moves.end(); ++move)
+    {
+        if (*move != HARDDROP)
+            continue;
+
+        // a board that topped out ignores the rest, its last attack isn't sent again
+        unsigned int placed = PiecesPlaced;
+        if (observer)
+        {
+            // an observer sees the piece where the moves before the drop left it
+            ExecuteMoveRange(std::ranges::subrange(first, move));
+            observer->Placing(*this);
+            ExecuteMoveRange(std::ranges::subrange(move, std::next(move)));
+        }
+        else
+            ExecuteMoveRange(std::ranges::subrange(first, std::next(move)));
+        if (PiecesPlaced != placed)
+        {
+            sent = sent + Outgoing;
+            if (observer)
+                observer->Placed(*this);
+        }
+        first = std::next(move);
+    }
+    ExecuteMoveRange(std::ranges::subrange(first, moves.end()));
+    return sent;
+}
+
+unsigned int GameBoard::ExecuteTick(const std::list<MoveType>& moves, PlacementObserver *observer)
+{
+    return ExecuteTickRange(moves, observer);
+}
+
+unsigned int GameBoard::ExecuteTick(const MoveType *moves, size_t count, PlacementObserver *observer)
+{
+    return ExecuteTickRange(std::span<const MoveType>(moves, count), observer);
+}
+
+uint64_t GameBoard::StateHash() const
+{
+    // the queue holds at most 16 pieces of 4 bits
+    uint64_t queue = 0;
+    for (MinoType piece: TetrominoQueue)
+        queue = (queue << 4) | piece;
+
+    uint64_t hash = MatrixHash;
+    hash = Zobrist::Mix(hash, SolidRows);
+    hash = Zobrist::Mix(hash, queue);
+    hash = Zobrist::Mix(hash, TetrominoQueue.size());
+    hash = Zobrist::Mix(hash, uint64_t(CurrentPiece) | uint64_t(HoldPiece) << 4 | uint64_t(CurrentRotation) << 8 | uint64_t(HoldUsed) << 10
+        | uint64_t(IsOver) << 11 | uint64_t(IsPaused) << 12 | uint64_t(LastKickTST) << 13 | uint64_t(LastAction) << 16 | uint64_t(LastKick) << 24 | uint64_t(LastSpin) << 32
+        | uint64_t(uint8_t(CurrentPosition.x)) << 40 | uint64_t(uint8_t(CurrentPosition.y)) << 48 | uint64_t(uint8_t(GarbageHole)) << 56);
+    hash = Zobrist::Mix(hash, uint64_t(LinesCleared) | uint64_t(PiecesPlaced) << 32);
+    hash = Zobrist::Mix(hash, uint64_t(Combo) | uint64_t(BackToBack) << 32);
+    hash = Zobrist::Mix(hash, uint64_t(LinesSent) | uint64_t(LastAttack) << 32);
+    hash = Zobrist::Mix(hash, uint64_t(Outgoing) | uint64_t(PendingPackets) << 32);
+    for (unsigned int i = 0; i < PendingPackets; i++)
+        hash = Zobrist::Mix(hash, uint64_t(PendingGarbage[i].Lines) | uint64_t(PendingGarbage[i].ReadyAt) << 32);
+    hash = Zobrist::Mix(hash, uint64_t(GarbageSeed) | uint64_t(GarbageDraws) << 32);
+    hash = Zobrist::Mix(hash, uint64_t(BagSeed) | uint64_t(BagDraws) << 32);
+    return hash;
+}
+
+std::string GameBoard::DumpState() const
+{
+    static const char LETTERS[] = ".IJLOSTZX#";
+
+    std::ostringstream out;
+    out << "hash " << std::hex << StateHash() << " matrix " << MatrixHash << std::dec << "\n";
+    out << "piece " << LETTERS[CurrentPiece] << " at " << CurrentPosition.x << "," << CurrentPosition.y << " rotation " << CurrentRotation
+        << ", hold " << LETTERS[HoldPiece] << (HoldUsed ? " used" : "") << ", last action " << LastAction << " kick " << LastKick << (LastKickTST ? " (tst)" : "")
+        << (IsOver ? ", over" : "") << (IsPaused ? ", paused" : "") << "\n";
+    out << "queue ";
+    for (MinoType piece: TetrominoQueue)
+        out << LETTERS[piece];
+    out << "\n";
+    out << "placed " << PiecesPlaced << ", lines " << LinesCleared << ", combo " << Combo << ", b2b " << BackToBack
+        << ", sent " << LinesSent << ", last attack " << LastAttack << ", outgoing " << Outgoing << "\n";
+    out << "garbage";
+    for (unsigned int i = 0; i < PendingPackets; i++)
+        out << " " << PendingGarbage[i].Lines << "@" << PendingGarbage[i].ReadyAt;
+    out << ", hole " << GarbageHole << "\n";
+    out << "rng bag " << BagSeed << "+" << BagDraws << ", garbage " << GarbageSeed << "+" << GarbageDraws << "\n";
+
+    // top to bottom, the piece in play in lowercase
+    char cells[MATRIX_ROWS][MATRIX_COLS];
+    for (int row = 0; row < MATRIX_ROWS; row++)
+    {
+        for (int col = 0; col < MATRIX_COLS; col++)
+            cells[row][col] = LETTERS[std::min<int>(Matrix[row][col], SOLID_GARBAGE)];
+    }
+    int top = StackHeight;
+    if (CurrentPiece >= BLOCK_I && CurrentPiece <= BLOCK_Z)
+    {
+        for (const glm::ivec2& offset: RotationOffsets.at(CurrentPiece)[CurrentRotation].PieceOffsets)
+        {
+            glm::ivec2 cell = CurrentPosition + offset;
+            if (cell.x >= 0 && cell.x < MATRIX_ROWS && cell.y >= 0 && cell.y < MATRIX_COLS)
+            {
+                cells[cell.x][cell.y] = LETTERS[CurrentPiece] - 'A' + 'a';
+                top = std::max(top, cell.x + 1);
+            }
+        }
+    }
+    for (int row = top - 1; row >= 0; row--)
+        out << std::string(cells[row], MATRIX_COLS) << ((SolidRows >> row) & 1 ? " solid" : "") << "\n";
+    return out.str();
+}
+
+void GameBoard::SaveState(GameBoardState& state) const
+{
+    state = *this;
+}
+
+void GameBoard::LoadState(const GameBoardState& state)
+{
+    static_cast<GameBoardState&>(*this) = state;
 }
 
 std::array<MinoType, 7> GameBoard::GetNextBag()
 {
     std::array<MinoType, 7> bag = SEVEN_PIECE_BAG;
     std::ranges::shuffle(bag, BagRNG);
+    BagDraws = BagDraws + 1;
     return bag;
 }
 
@@ -222,18 +504,24 @@ void GameBoard::PopulateQueue()
 {
     while (TetrominoQueue.size() <= PREVIEW_NUMBER)
     {
-        auto bag = GetNextBag();
-        TetrominoQueue.insert(TetrominoQueue.end(), bag.begin(), bag.end());
+        for (MinoType piece: GetNextBag())
+            TetrominoQueue.push_back(piece);
     }
 }
 
 glm::ivec2 GameBoard::SoftDropPosition()
 {
-    glm::ivec2 pos = CurrentPosition;
-    while (CurrentPieceCanMoveAt(pos, CurrentRotation))
-        pos.x = pos.x - 1;
-    pos.x = pos.x + 1;
-    return pos;
+    // every column of a piece is contiguous, so each mino can fall down to the highest mino below it
+    // in its column and the piece falls the shortest of those distances
+    int drop = 40;
+    for (glm::ivec2 offset: RotationOffsets.at(CurrentPiece)[CurrentRotation].PieceOffsets)
+    {
+        int row = CurrentPosition.x + offset.x;
+        uint64_t below = ColumnMasks[CurrentPosition.y + offset.y] & ((1ull << row) - 1);
+        int floor = below ? 64 - std::countl_zero(below) : 0;
+        drop = std::min(drop, row - floor);
+    }
+    return glm::ivec2(CurrentPosition.x - drop, CurrentPosition.y);
 }
 
 bool GameBoard::CurrentPieceCanMoveAt(glm::ivec2 position, int rotation)
@@ -255,49 +543,211 @@ bool GameBoard::CurrentPieceCanMoveAt(glm::ivec2 position, int rotation)
 
 void GameBoard::NextPiece()
 {
-    CurrentPiece = TetrominoQueue.front();
+    MinoType piece = TetrominoQueue.front();
     TetrominoQueue.pop_front();
     PopulateQueue();
+    SpawnPiece(piece);
+}
+
+void GameBoard::SpawnPiece(MinoType piece)
+{
+    CurrentPiece = piece;
     CurrentPosition = glm::ivec2(21, 4);
     CurrentRotation = 0;
+    LastAction = NO_MOVE;
+    LastKick = 0;
+    LastKickTST = false;
+
+    // a piece that can't spawn tops the board out
+    if (!CurrentPieceCanMoveAt(CurrentPosition, CurrentRotation))
+    {
+        Stop();
+        IsOver = true;
+    }
 }
 
-unsigned int GameBoard::ClearLines()
+// removes the given rows (bits) from a mask of rows, the ones above them move down
+static uint64_t RemoveRows(uint64_t mask, uint64_t rows)
 {
-    unsigned int cleared = 0;
-    bool rowFull;
-    for (int row = 0; row < 40; row++)
+    // top to bottom so the indices of the remaining rows stay valid
+    while (rows)
     {
-        // check if current row is full (aka doesn't contain air blocks or solid garbage)
-        rowFull = true;
-        for (int col = 0; col < 10; col++)
-        {
-            if (Matrix[row][col] == MinoType::EMPTY || Matrix[row][col] == MinoType::SOLID_GARBAGE)
-            {
-                rowFull = false;
-                break;
-            }
-        }
+        int row = 63 - std::countl_zero(rows);
+        uint64_t low = (1ull << row) - 1;
+        mask = (mask & low) | ((mask >> 1) & ~low);
+        rows = rows & low;
+    }
+    return mask;
+}
 
-        // if there are lines "to be cleared" shift all the rows above
-        if (rowFull)
-        {
-            cleared = cleared + 1;
-            for (int above = row; above < 39; above++)
-            {
-                for(int col = 0; col < 10; col++)
-                    Matrix[above][col] = Matrix[above + 1][col];
-            }
-            row = row - 1;
-        }
+unsigned int GameBoard::ClearLines(int fromRow, int toRow)
+{
+    // full rows (no air blocks or solid garbage) of the range as a mask
+    uint64_t full = 0;
+    for (int row = fromRow; row <= toRow; row++)
+    {
+        if (RowMasks[row] == FULL_ROW && !((SolidRows >> row) & 1))
+            full = full | (1ull << row);
+    }
+    if (!full)
+        return 0;
+
+    // single stable pass: the blocks of rows between full ones are moved down at once, up to the top
+    // of the stack since everything above it is empty
+    int write = std::countr_zero(full);
+    uint64_t remaining = full;
+    while (remaining)
+    {
+        int row = std::countr_zero(remaining);
+        remaining = remaining & (remaining - 1);
+        int end = remaining ? std::countr_zero(remaining) : StackHeight;
+        int count = end - (row + 1);
+        std::memmove(Matrix[write], Matrix[row + 1], count * sizeof(Matrix[0]));
+        std::memmove(&RowFill[write], &RowFill[row + 1], count * sizeof(RowFill[0]));
+        std::memmove(&RowMasks[write], &RowMasks[row + 1], count * sizeof(RowMasks[0]));
+        write = write + count;
+    }
+    for (int row = write; row < StackHeight; row++)
+    {
+        std::fill(Matrix[row], Matrix[row] + 10, MinoType::EMPTY);
+        RowFill[row] = 0;
+        RowMasks[row] = 0;
     }
 
-    // clear the top rows so they don't get cloned
-    for (int row = 39 - cleared; row < 40; row++)
+    // the same rows are removed from the column masks, the heights and holes follow from them
+    for (int col = 0; col < 10; col++)
+        ColumnMasks[col] = RemoveRows(ColumnMasks[col], full);
+    ComputeColumnMetrics();
+    ComputeMatrixHash();
+
+    // solid rows are never full, the ones above cleared rows move down too
+    SolidRows = RemoveRows(SolidRows, full);
+
+    return std::popcount(full);
+}
+
+void GameBoard::ComputeColumnMetrics()
+{
+    StackHeight = 0;
+    Holes = 0;
+    for (int col = 0; col < 10; col++)
+    {
+        ColumnHeights[col] = 64 - std::countl_zero(ColumnMasks[col]);
+        ColumnHoles[col] = ColumnHeights[col] - std::popcount(ColumnMasks[col]);
+        StackHeight = std::max(StackHeight, ColumnHeights[col]);
+        Holes = Holes + ColumnHoles[col];
+    }
+}
+
+void GameBoard::ComputeMatrixHash()
+{
+    // every row moved by a clear or garbage changes its key, rows above the stack are empty (key 0)
+    const Zobrist& keys = Zobrist::Keys();
+    MatrixHash = 0;
+    for (int row = 0; row < StackHeight; row++)
+        MatrixHash = MatrixHash ^ keys.Row(row, RowMasks[row]);
+}
+
+void GameBoard::ReceiveGarbage(unsigned int lines)
+{
+    if (lines == 0)
+        return;
+
+    // a full queue adds to its last packet
+    if (PendingPackets == MAX_GARBAGE_PACKETS)
+    {
+        PendingGarbage[PendingPackets - 1].Lines = PendingGarbage[PendingPackets - 1].Lines + lines;
+        return;
+    }
+
+    // the piece in play doesn't count as one of the placements to wait for
+    PendingGarbage[PendingPackets] = GarbagePacket{ lines, PiecesPlaced + 1 + GarbageDelay };
+    PendingPackets = PendingPackets + 1;
+}
+
+unsigned int GameBoard::PendingGarbageLines() const
+{
+    unsigned int lines = 0;
+    for (unsigned int i = 0; i < PendingPackets; i++)
+        lines = lines + PendingGarbage[i].Lines;
+    return lines;
+}
+
+unsigned int GameBoard::CancelGarbage(unsigned int attack)
+{
+    unsigned int cancelled = 0;
+    while (attack > 0 && cancelled < PendingPackets)
+    {
+        unsigned int lines = std::min(attack, PendingGarbage[cancelled].Lines);
+        PendingGarbage[cancelled].Lines = PendingGarbage[cancelled].Lines - lines;
+        attack = attack - lines;
+        if (PendingGarbage[cancelled].Lines == 0)
+            cancelled = cancelled + 1;
+    }
+
+    PendingPackets = PendingPackets - cancelled;
+    std::memmove(PendingGarbage, PendingGarbage + cancelled, PendingPackets * sizeof(GarbagePacket));
+    return attack;
+}
+
+void GameBoard::TakeGarbage()
+{
+    // packets are ready in the order they were received
+    unsigned int taken = 0;
+    while (taken < PendingPackets && PendingGarbage[taken].ReadyAt <= PiecesPlaced)
+    {
+        InsertGarbage(PendingGarbage[taken].Lines);
+        taken = taken + 1;
+    }
+
+    PendingPackets = PendingPackets - taken;
+    std::memmove(PendingGarbage, PendingGarbage + taken, PendingPackets * sizeof(GarbagePacket));
+}
+
+void GameBoard::InsertGarbage(unsigned int lines)
+{
+    int count = std::min<unsigned int>(lines, MATRIX_ROWS);
+    const uint64_t allRows = (1ull << MATRIX_ROWS) - 1;
+
+    // pushing minos out of the matrix tops out
+    if (StackHeight + count > MATRIX_ROWS)
+    {
+        Stop();
+        IsOver = true;
+    }
+
+    // the stack rises in one block
+    int moved = std::min(StackHeight, MATRIX_ROWS - count);
+    std::memmove(Matrix[count], Matrix[0], moved * sizeof(Matrix[0]));
+    std::memmove(&RowFill[count], &RowFill[0], moved * sizeof(RowFill[0]));
+    std::memmove(&RowMasks[count], &RowMasks[0], moved * sizeof(RowMasks[0]));
+    for (int col = 0; col < 10; col++)
+        ColumnMasks[col] = (ColumnMasks[col] << count) & allRows;
+    SolidRows = (SolidRows << count) & allRows;
+
+    // a new packet never reuses the previous hole, its lines move it with a chance of GarbageMessiness
+    // (raw generator outputs, distributions aren't the same on every standard library)
+    for (int row = count - 1; row >= 0; row--)
+    {
+        if (row == count - 1 || DrawGarbage() % 100 < GarbageMessiness)
+            GarbageHole = GarbageHole < 0 ? DrawGarbage() % 10 : (GarbageHole + 1 + DrawGarbage() % 9) % 10;
+
         for (int col = 0; col < 10; col++)
-            Matrix[row][col] = MinoType::EMPTY;
+        {
+            Matrix[row][col] = col == GarbageHole ? MinoType::EMPTY : MinoType::GARBAGE;
+            ColumnMasks[col] = ColumnMasks[col] | (uint64_t(col != GarbageHole) << row);
+        }
+        RowFill[row] = 9;
+        RowMasks[row] = FULL_ROW & ~(1 << GarbageHole);
+    }
+    ComputeColumnMetrics();
+    ComputeMatrixHash();
+}
 
-    return cleared;
+unsigned int GameBoard::DrawGarbage()
+{
+    GarbageDraws = GarbageDraws + 1;
+    return GarbageRNG();
 }
 
 bool GameBoard::RotateWithKick(MoveType rot)
@@ -321,10 +771,13 @@ bool GameBoard::RotateWithKick(MoveType rot)
             return false;
     }
 
-    for(glm::ivec2 offset: KickTable.at(CurrentPiece)[CurrentRotation][newRot]) {
-        if (CurrentPieceCanMoveAt(CurrentPosition + offset, newRot)) {
+    const auto &kicks = KickTable.at(CurrentPiece)[CurrentRotation][newRot];
+    for (size_t kick = 0; kick < kicks.size(); kick++) {
+        if (CurrentPieceCanMoveAt(CurrentPosition + kicks[kick], newRot)) {
             CurrentRotation = newRot;
-            CurrentPosition = CurrentPosition + offset;
+            CurrentPosition = CurrentPosition + kicks[kick];
+            LastKick = kick;
+            LastKickTST = rot != ROTATE_180 && kick + 1 == kicks.size();
             return true;
         }
     }
@@ -21,11 +21,44 @@ GameSettings::GameSettings(const std::string& filename) {
     RotateAnticlockwise         = ConvertToGlfwScancode(settings["Keybinds"]["rotate_anticlockwise"].value_or<std::string>(""));
     Rotate180                   = ConvertToGlfwScancode(settings["Keybinds"]["rotate_180"].value_or<std::string>(""));
     Restart                     = ConvertToGlfwScancode(settings["Keybinds"]["restart"].value_or<std::string>(""));
+    ToggleHint                  = ConvertToGlfwScancode(settings["Keybinds"]["toggle_hint"].value_or<std::string>(""));
 
     DAS                         = settings["Movement"]["DAS"].value_or<float>(0.0);
     ARR                         = settings["Movement"]["ARR"].value_or<float>(0.0);
     SDR                         = settings["Movement"]["SDR"].value_or<float>(0.0);
     ResetDASOnDirectionChange   = settings["Movement"]["DAS_cancel"].value_or<bool>(true);
+
+    BotEnabled                  = settings["Bot"]["enabled"].value_or<bool>(false);
+    BotPPS                      = settings["Bot"]["pps"].value_or<float>(2.0);
+    BotThinkTime                = settings["Bot"]["think_time"].value_or<float>(0.0);
+    BotBeamWidth                = settings["Bot"]["beam_width"].value_or<int>(64);
+    BotDepth                    = settings["Bot"]["depth"].value_or<int>(3);
+    BotThreads                  = settings["Bot"]["threads"].value_or<int>(0);
+    BotBook                     = settings["Bot"]["book"].value_or<std::string>("");
+
+    HintEnabled                 = settings["Hint"]["enabled"].value_or<bool>(false);
+    HintThinkTime               = settings["Hint"]["think_time"].value_or<float>(0.25);
+    HintPerfectClear            = settings["Hint"]["perfect_clear"].value_or<bool>(true);
+
+    VersusBoards                = settings["Versus"]["boards"].value_or<int>(1);
+    VersusGarbageDelay          = settings["Versus"]["garbage_delay"].value_or<int>(1);
+    VersusMessiness             = settings["Versus"]["messiness"].value_or<int>(30);
+    VersusReplay                = settings["Versus"]["replay"].value_or<std::string>("");
+    VersusRecord                = settings["Versus"]["record"].value_or<std::string>("");
+    if (const toml::array* inputs = settings["Versus"]["inputs"].as_array())
+    {
+        for (const toml::node& input: *inputs)
+            VersusInputs.push_back(input.value_or<std::string>(""));
+    }
+
+    SpectatorBoards             = settings["Spectator"]["boards"].value_or<int>(0);
+    SpectatorSource             = settings["Spectator"]["source"].value_or<std::string>("bot");
+    SpectatorServer             = settings["Spectator"]["server"].value_or<std::string>("127.0.0.1:47200");
+    if (const toml::array* replays = settings["Spectator"]["replays"].as_array())
+    {
+        for (const toml::node& replay: *replays)
+            SpectatorReplays.push_back(replay.value_or<std::string>(""));
+    }
 }
 
 int GameSettings::ConvertToGlfwScancode(const std::string& key) {
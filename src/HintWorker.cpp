@@ -0,0 +1,110 @@
+#include "HintWorker.h"
+
+HintWorker::HintWorker(const BotConfig& config, float thinkTime, bool perfectClear, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable, std::shared_ptr<const OpeningBook> book)
+:   ThinkTime(thinkTime),
+    Engine(config, rotationOffsets, kickTable),
+    Solver(perfectClear ? std::make_unique<PerfectClearSolver>(PerfectClearConfig{ .Threads = config.Threads }, rotationOffsets, kickTable) : nullptr),
+    Signal(0),
+    Stopping(false)
+{
+    Engine.Book = book;
+    Thread = std::thread(&HintWorker::Run, this);
+}
+
+HintWorker::~HintWorker()
+{
+    Stopping.store(true, std::memory_order_release);
+    Token.Cancel();
+    Signal.fetch_add(1, std::memory_order_release);
+    Signal.notify_one();
+    Thread.join();
+}
+
+bool HintWorker::Submit(const GameBoard& board, uint64_t sequence)
+{
+    if (board.IsOver)
+        return true;
+
+    // whatever is being searched now is stale. Cancelled before the push, so the worker can tell a
+    // cancellation meant for a request it already took (see Run)
+    Token.Cancel();
+    if (!Requests.Push(Request{ sequence, Bot::Snapshot(board) }))
+        return false;
+
+    Signal.fetch_add(1, std::memory_order_release);
+    Signal.notify_one();
+    return true;
+}
+
+const Hint* HintWorker::Latest(uint64_t sequence)
+{
+    const Hint& hint = Results.Read();
+    if (!hint.Valid || hint.Sequence != sequence)
+        return nullptr;
+    return &hint;
+}
+
+void HintWorker::Run()
+{
+    Request request;
+    while (!Stopping.load(std::memory_order_acquire))
+    {
+        uint32_t signal = Signal.load(std::memory_order_acquire);
+
+        // Only the newest request matters. A submission cancels the token before pushing its request, so
+        // a cancellation seen after draining may come from a request that was drained: the token is reset
+        // and the queue drained again until the token stays clear, then only later submissions cancel
+        bool found = false;
+        do
+        {
+            Token.Reset();
+            while (Requests.Pop(request))
+                found = true;
+        } while (Token.IsCancelled() && !Stopping.load(std::memory_order_acquire));
+
+        if (!found)
+        {
+            Signal.wait(signal, std::memory_order_acquire);
+            continue;
+        }
+        // the cancellation of the destructor may have been reset above
+        if (Stopping.load(std::memory_order_acquire))
+            break;
+
+        auto startTime = CancellationToken::Clock::now();
+        if (Solver)
+        {
+            Token.SetTimeout(ThinkTime / 2.0f);
+            PerfectClearSolution solution = Solver->Solve(request.Snapshot, &Token);
+            if (solution.Found)
+            {
+                const PerfectClearStep& step = solution.Steps.front();
+                Hint& hint = Results.Write();
+                hint.Sequence = request.Sequence;
+                hint.Valid = true;
+                hint.UseHold = step.UseHold;
+                hint.Piece = step.Target.Piece;
+                hint.Rotation = step.Target.Rotation;
+                hint.Position = step.Target.Position;
+                Results.Publish();
+                continue;
+            }
+
+            // a newer request is waiting, this one is stale
+            if (!Requests.Empty())
+                continue;
+        }
+
+        Token.SetDeadline(startTime + std::chrono::duration_cast<CancellationToken::Clock::duration>(std::chrono::duration<double>(ThinkTime)));
+        BotDecision decision = Engine.Think(request.Snapshot, &Token);
+
+        Hint& hint = Results.Write();
+        hint.Sequence = request.Sequence;
+        hint.Valid = decision.Valid;
+        hint.UseHold = decision.UseHold;
+        hint.Piece = decision.Target.Piece;
+        hint.Rotation = decision.Target.Rotation;
+        hint.Position = decision.Target.Position;
+        Results.Publish();
+    }
+}
@@ -0,0 +1,113 @@
+#include "InstancedRenderer.h"
+
+static const unsigned int INSTANCE_FLOATS = 8;
+
+InstancedRenderer::InstancedRenderer(Shader &shader)
+{
+    this->shader = shader;
+    this->instanceCapacity = 0;
+    this->activeBatches = 0;
+    this->initRenderData();
+}
+
+InstancedRenderer::~InstancedRenderer()
+{
+    glDeleteVertexArrays(1, &this->quadVAO);
+    glDeleteBuffers(1, &this->quadVBO);
+    glDeleteBuffers(1, &this->instanceVBO);
+}
+
+void InstancedRenderer::Add(const Texture2D &texture, glm::vec2 position, glm::vec2 size, glm::vec4 color)
+{
+    // a frame only uses a few textures, a linear search is enough
+    Batch *batch = nullptr;
+    for (size_t i = 0; i < this->activeBatches; i++)
+    {
+        if (this->batches[i].texture.ID == texture.ID)
+        {
+            batch = &this->batches[i];
+            break;
+        }
+    }
+    if (!batch)
+    {
+        // the batches of the previous frames keep their memory, a frame of the same size doesn't allocate
+        if (this->activeBatches == this->batches.size())
+            this->batches.push_back(Batch{ texture, {} });
+        batch = &this->batches[this->activeBatches++];
+        batch->texture = texture;
+    }
+
+    float instance[INSTANCE_FLOATS] = { position.x, position.y, size.x, size.y, color.r, color.g, color.b, color.a };
+    batch->instances.insert(batch->instances.end(), instance, instance + INSTANCE_FLOATS);
+}
+
+void InstancedRenderer::Flush()
+{
+    this->shader.Use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(this->quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
+
+    for (size_t i = 0; i < this->activeBatches; i++)
+    {
+        Batch &batch = this->batches[i];
+        size_t count = batch.instances.size() / INSTANCE_FLOATS;
+        if (count == 0)
+            continue;
+
+        // the buffer only grows, it's orphaned when it's too small
+        if (count > this->instanceCapacity)
+        {
+            this->instanceCapacity = count * 2;
+            glBufferData(GL_ARRAY_BUFFER, this->instanceCapacity * INSTANCE_FLOATS * sizeof(float), nullptr, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, batch.instances.size() * sizeof(float), batch.instances.data());
+
+        batch.texture.Bind();
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+        batch.instances.clear();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    this->activeBatches = 0;
+}
+
+void InstancedRenderer::initRenderData()
+{
+    // same quad as the SpriteRenderer, the instances place and scale it
+    float vertices[] = {
+        // pos      // tex
+        0.0f, 1.0f, 0.0f, 1.0f,
+        1.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f,
+
+        0.0f, 1.0f, 0.0f, 1.0f,
+        1.0f, 1.0f, 1.0f, 1.0f,
+        1.0f, 0.0f, 1.0f, 0.0f
+    };
+
+    glGenVertexArrays(1, &this->quadVAO);
+    glGenBuffers(1, &this->quadVBO);
+    glGenBuffers(1, &this->instanceVBO);
+
+    glBindVertexArray(this->quadVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+
+    // per instance: <vec2 position, vec2 size> and color
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS * sizeof(float), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS * sizeof(float), (void*)(4 * sizeof(float)));
+    glVertexAttribDivisor(2, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
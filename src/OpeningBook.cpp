@@ -0,0 +1,183 @@
+#include "OpeningBook.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+static const size_t HEADER_SIZE = 16;
+static const size_t BINARY_SEARCH_RANGE = 16;     // below this many entries interpolating isn't worth it
+
+static_assert(sizeof(BookMove) == 8 && sizeof(BookEntry) == 24, "book records are written as is");
+
+OpeningBook::OpeningBook(const std::string& path)
+:   Mapping(MAP_FAILED),
+    MappingSize(0),
+    Entries(nullptr),
+    MoveData(nullptr),
+    EntryCount(0),
+    MoveCount(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("failed to open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE)
+    {
+        close(fd);
+        throw std::runtime_error("not an opening book: " + path);
+    }
+
+    MappingSize = info.st_size;
+    Mapping = mmap(nullptr, MappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (Mapping == MAP_FAILED)
+        throw std::runtime_error("failed to map " + path);
+
+    const uint8_t *bytes = static_cast<const uint8_t*>(Mapping);
+    uint32_t version;
+    std::memcpy(&version, bytes + 4, sizeof(version));
+    std::memcpy(&EntryCount, bytes + 8, sizeof(EntryCount));
+    std::memcpy(&MoveCount, bytes + 12, sizeof(MoveCount));
+
+    size_t expected = HEADER_SIZE + static_cast<size_t>(EntryCount) * sizeof(BookEntry) + static_cast<size_t>(MoveCount) * sizeof(BookMove);
+    if (std::memcmp(bytes, "STKB", 4) != 0 || version != VERSION || expected != MappingSize)
+    {
+        munmap(Mapping, MappingSize);
+        throw std::runtime_error("not an opening book (or another version): " + path);
+    }
+
+    // the header keeps the entries 8 byte aligned in the page aligned mapping
+    Entries = reinterpret_cast<const BookEntry*>(bytes + HEADER_SIZE);
+    MoveData = reinterpret_cast<const BookMove*>(bytes + HEADER_SIZE + static_cast<size_t>(EntryCount) * sizeof(BookEntry));
+
+    // every line must have a move and stay inside the moves, Moves() and its callers rely on it
+    for (uint32_t i = 0; i < EntryCount; i++)
+    {
+        if (Entries[i].Count == 0 || Entries[i].First > MoveCount || Entries[i].Count > MoveCount - Entries[i].First)
+        {
+            munmap(Mapping, MappingSize);
+            Mapping = MAP_FAILED;
+            throw std::runtime_error("corrupt opening book: " + path);
+        }
+    }
+}
+
+OpeningBook::~OpeningBook()
+{
+    if (Mapping != MAP_FAILED)
+        munmap(Mapping, MappingSize);
+}
+
+BookKey OpeningBook::Key(uint64_t boardHash, MinoType hold, const MinoType *pieces, unsigned int count)
+{
+    count = std::min(count, MAX_PIECES);
+    uint32_t packed = (static_cast<uint32_t>(hold) << 3) | count;
+    for (unsigned int i = 0; i < count; i++)
+        packed = (packed << 3) | static_cast<uint32_t>(pieces[i]);
+    return BookKey{ boardHash, packed, 0 };
+}
+
+const BookEntry* OpeningBook::Find(const BookKey& key) const
+{
+    if (EntryCount == 0)
+        return nullptr;
+
+    // interpolate on the hashes while the range is large, they are uniform over 64 bits
+    size_t low = 0, high = EntryCount - 1;
+    while (high - low > BINARY_SEARCH_RANGE)
+    {
+        uint64_t lowHash = Entries[low].Key.BoardHash, highHash = Entries[high].Key.BoardHash;
+        if (key.BoardHash < lowHash || key.BoardHash > highHash)
+            return nullptr;
+        if (lowHash == highHash)
+            break;
+
+        // positions of the same board (e.g. the empty one) share a hash, they are binary searched
+        size_t probe = low + static_cast<size_t>(static_cast<unsigned __int128>(key.BoardHash - lowHash) * (high - low) / (highHash - lowHash));
+        uint64_t probeHash = Entries[probe].Key.BoardHash;
+        if (probeHash == key.BoardHash)
+            break;
+        if (probeHash < key.BoardHash)
+            low = probe + 1;
+        else
+            high = probe - 1;
+        if (low > high)
+            return nullptr;
+    }
+
+    const BookEntry *end = Entries + high + 1;
+    const BookEntry *found = std::lower_bound(Entries + low, end, key, [](const BookEntry& entry, const BookKey& value) {
+        return entry.Key < value;
+    });
+    return found != end && found->Key == key ? found : nullptr;
+}
+
+const BookEntry* OpeningBook::Find(uint64_t boardHash, MinoType hold, const MinoType *pieces, unsigned int count) const
+{
+    for (unsigned int length = std::min(count, MAX_PIECES); length > 0; length--)
+    {
+        if (const BookEntry *entry = Find(Key(boardHash, hold, pieces, length)))
+            return entry;
+    }
+    return nullptr;
+}
+
+const BookMove* OpeningBook::Moves(const BookEntry& entry) const
+{
+    return MoveData + entry.First;
+}
+
+size_t OpeningBook::Size() const
+{
+    return EntryCount;
+}
+
+void OpeningBookBuilder::AddLine(const std::vector<BookKey>& keys, const std::vector<BookMove>& moves)
+{
+    uint32_t first = Moves.size();
+    Moves.insert(Moves.end(), moves.begin(), moves.end());
+    for (size_t i = 0; i < keys.size() && i < moves.size(); i++)
+        Entries.push_back(BookEntry{ keys[i], static_cast<uint32_t>(first + i), static_cast<uint32_t>(moves.size() - i) });
+}
+
+void OpeningBookBuilder::Write(const std::string& path) const
+{
+    // sorted by key, the first line added wins for duplicated positions
+    std::vector<BookEntry> entries = Entries;
+    std::stable_sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.Key < b.Key;
+    });
+    entries.erase(std::unique(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.Key == b.Key;
+    }), entries.end());
+
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("failed to create " + path);
+
+    uint32_t version = OpeningBook::VERSION;
+    uint32_t entryCount = entries.size();
+    uint32_t moveCount = Moves.size();
+    std::fwrite("STKB", 1, 4, file);
+    std::fwrite(&version, sizeof(version), 1, file);
+    std::fwrite(&entryCount, sizeof(entryCount), 1, file);
+    std::fwrite(&moveCount, sizeof(moveCount), 1, file);
+    std::fwrite(entries.data(), sizeof(BookEntry), entries.size(), file);
+    std::fwrite(Moves.data(), sizeof(BookMove), Moves.size(), file);
+
+    bool failed = std::ferror(file);
+    if (std::fclose(file) != 0 || failed)
+        throw std::runtime_error("failed to write " + path);
+}
+
+size_t OpeningBookBuilder::Size() const
+{
+    return Entries.size();
+}
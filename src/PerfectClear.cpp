@@ -0,0 +1,304 @@
+#include "PerfectClear.h"
+
+#include <algorithm>
+#include <mutex>
+
+// the rows below the target height packed 10 bits per row, bit (row * 10 + col)
+static const uint64_t COLUMN_0 = 0x0040100401ull;     // col 0 of rows 0 to 3
+static const uint64_t COLUMN_9 = COLUMN_0 << 9;
+
+static const size_t MAX_CACHED_BOARDS = 1 << 20;
+
+static inline uint64_t FieldMask(int height)
+{
+    return (uint64_t(1) << (height * MATRIX_COLS)) - 1;
+}
+
+static inline uint64_t Field(const Bitboard& board, int height)
+{
+    uint64_t field = 0;
+    for (int row = 0; row < height; row++)
+        field |= uint64_t(board.Rows[row]) << (row * MATRIX_COLS);
+    return field;
+}
+
+// cells where (row + col) is even
+static uint64_t DarkCells()
+{
+    uint64_t cells = 0;
+    for (int row = 0; row < 4; row++)
+        for (int col = 0; col < MATRIX_COLS; col++)
+            if ((row + col) % 2 == 0)
+                cells |= uint64_t(1) << (row * MATRIX_COLS + col);
+    return cells;
+}
+
+PerfectClearSolver::PerfectClearSolver(const PerfectClearConfig& config, const std::unordered_map<MinoType, std::array<Tetromino, 4>>& rotationOffsets, const std::unordered_map<MinoType, std::vector<std::vector<std::vector<glm::ivec2>>>>& kickTable, std::shared_ptr<TranspositionTable> memo)
+:   Config(config),
+    Generator(BotConfig{ .Threads = 1, .HashBits = 0, .Weights = BotWeights() }, rotationOffsets, kickTable),
+    Pool(config.Threads == 1 ? nullptr : std::make_unique<ThreadPool>(config.Threads)),
+    Dead(memo ? memo : std::make_shared<TranspositionTable>(config.HashBits)),
+    Found(false),
+    Nodes(0)
+{
+    size_t workers = Pool ? Pool->Size() : 1;
+    PlacementBuffers.resize(workers);
+    PlacementCache.resize(workers);
+    ChoiceBuffers.resize(workers);
+}
+
+PerfectClearSolution PerfectClearSolver::Solve(const GameBoard& board, const CancellationToken* token)
+{
+    return Solve(Bot::Snapshot(board), token);
+}
+
+PerfectClearSolution PerfectClearSolver::Solve(const BotSnapshot& snapshot, const CancellationToken* token)
+{
+    auto startTime = CancellationToken::Clock::now();
+    PerfectClearSolution solution;
+
+    Queue = snapshot.Queue;
+    QueueKeys.assign(Queue.size() + 1, 0);
+    for (size_t i = Queue.size(); i-- > 0;)
+    {
+        // splitmix64 finalizer over the piece and the key of the rest of the queue
+        uint64_t z = QueueKeys[i + 1] + (Queue[i] + 1) * 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        QueueKeys[i] = z ^ (z >> 31);
+    }
+    // one buffer per search depth, a piece is placed at every depth
+    for (auto& buffers: ChoiceBuffers)
+        buffers.resize(std::max(buffers.size(), Queue.size() + 3));
+    Found.store(false, std::memory_order_relaxed);
+    Nodes.store(0, std::memory_order_relaxed);
+
+    const BotState& root = snapshot.State;
+    int stackHeight = root.Board.StackHeight();
+    int filled = 0;
+    for (int row = 0; row < stackHeight; row++)
+        filled = filled + std::popcount(root.Board.Rows[row]);
+
+    std::vector<Choice> best;
+    std::mutex bestLock;
+
+    for (int height = std::max(1, stackHeight); height <= Config.MaxHeight && !solution.Found; height++)
+    {
+        if ((height * MATRIX_COLS - filled) % 4 != 0 || !Feasible(root, height))
+            continue;
+
+        std::vector<Choice> rootChoices;
+        Expand(root, height, Config.Hold && !snapshot.HoldUsed, 0, rootChoices);
+
+        // every first placement is searched as its own task, the first solution found stops the others
+        auto searchRoot = [&](size_t index, unsigned int worker) {
+            std::vector<Choice> path = { rootChoices[index] };
+            if (Found.load(std::memory_order_relaxed))
+                return;
+            if (Search(rootChoices[index].Next, rootChoices[index].Height, 1, worker, token, path))
+            {
+                std::lock_guard<std::mutex> lock(bestLock);
+                if (!Found.exchange(true))
+                    best = path;
+            }
+        };
+
+        if (Pool)
+            Pool->ParallelFor(rootChoices.size(), searchRoot);
+        else
+        {
+            for (size_t i = 0; i < rootChoices.size(); i++)
+                searchRoot(i, 0);
+        }
+
+        if (Found.load())
+        {
+            solution.Found = true;
+            solution.Height = height;
+        }
+        else if (token && token->IsCancelled())
+            break;
+    }
+
+    // inputs of every step, generated on the board the step is played on
+    const Bitboard *board = &root.Board;
+    for (const Choice& choice: best)
+    {
+        std::vector<Placement>& placements = PlacementBuffers[0];
+        Generator.GeneratePlacements(*board, choice.Target.Piece, placements, true);
+
+        // the search may have kept another rotation covering the same cells
+        Bitboard target = *board;
+        target.Place(Generator.Pieces.Shapes[choice.Target.Piece][choice.Target.Rotation], choice.Target.Position);
+        for (const Placement& placement: placements)
+        {
+            Bitboard candidate = *board;
+            candidate.Place(Generator.Pieces.Shapes[placement.Piece][placement.Rotation], placement.Position);
+            if (candidate.Hash == target.Hash)
+            {
+                solution.Steps.push_back(PerfectClearStep{ choice.UseHold, placement });
+                break;
+            }
+        }
+        board = &choice.Next.Board;
+    }
+
+    solution.NodesSearched = Nodes.load();
+    solution.Cancelled = !solution.Found && token && token->IsCancelled();
+    solution.Seconds = std::chrono::duration<double>(CancellationToken::Clock::now() - startTime).count();
+    return solution;
+}
+
+void PerfectClearSolver::Expand(const BotState& state, int height, bool canHold, unsigned int worker, std::vector<Choice>& out)
+{
+    out.clear();
+    auto queueAt = [this](unsigned int index) {
+        return index < Queue.size() ? Queue[index] : MinoType::EMPTY;
+    };
+
+    auto addChildren = [&](MinoType piece, bool useHold, MinoType nextCurrent, MinoType nextHold, unsigned int nextQueueIndex) {
+        // the same boards come back through different piece orders (and different queues), placements are cached
+        std::unordered_map<uint64_t, std::vector<Placement>>& cache = PlacementCache[worker];
+        if (cache.size() > MAX_CACHED_BOARDS)
+            cache.clear();
+        auto [cached, inserted] = cache.try_emplace(state.Board.Hash ^ Zobrist::Keys().Pieces(piece, MinoType::EMPTY, 0));
+        // the board is empty above the height, pieces can start falling just above the kick range
+        if (inserted)
+            Generator.GeneratePlacements(state.Board, piece, cached->second, false, height + 4);
+
+        for (const Placement& placement: cached->second)
+        {
+            const PieceShape& shape = Generator.Pieces.Shapes[piece][placement.Rotation];
+            if (placement.Position.x + shape.MaxRow >= height)
+                continue;
+
+            Choice& choice = out.emplace_back();
+            choice.UseHold = useHold;
+            choice.Target.Piece = placement.Piece;
+            choice.Target.Rotation = placement.Rotation;
+            choice.Target.Position = placement.Position;
+            choice.Target.Spin = placement.Spin;
+            choice.Target.Moves.clear();
+            choice.Next.Board = state.Board;
+            choice.Next.Board.Place(shape, placement.Position);
+            choice.Height = height - choice.Next.Board.ClearLines();
+            choice.Next.Current = nextCurrent;
+            choice.Next.Hold = nextHold;
+            choice.Next.QueueIndex = nextQueueIndex;
+            choice.Next.Combo = 0;
+            choice.Next.BackToBack = 0;
+        }
+    };
+
+    if (state.Current != MinoType::EMPTY)
+        addChildren(state.Current, false, queueAt(state.QueueIndex), state.Hold, state.QueueIndex + 1);
+
+    // hold the current piece and place the held (or next) one
+    MinoType held = state.Hold == MinoType::EMPTY ? queueAt(state.QueueIndex) : state.Hold;
+    if (canHold && held != MinoType::EMPTY && held != state.Current)
+    {
+        unsigned int queueIndex = state.Hold == MinoType::EMPTY ? state.QueueIndex + 1 : state.QueueIndex;
+        addChildren(held, true, queueAt(queueIndex), state.Current, queueIndex + 1);
+    }
+
+    // filling the bottom first, with flat placements first, finds solutions sooner
+    std::stable_sort(out.begin(), out.end(), [this](const Choice& a, const Choice& b) {
+        const PieceShape& shapeA = Generator.Pieces.Shapes[a.Target.Piece][a.Target.Rotation];
+        const PieceShape& shapeB = Generator.Pieces.Shapes[b.Target.Piece][b.Target.Rotation];
+        int bottomA = a.Target.Position.x + shapeA.MinRow, bottomB = b.Target.Position.x + shapeB.MinRow;
+        if (bottomA != bottomB)
+            return bottomA < bottomB;
+        return a.Target.Position.x + shapeA.MaxRow < b.Target.Position.x + shapeB.MaxRow;
+    });
+}
+
+bool PerfectClearSolver::Aborted(const CancellationToken* token) const
+{
+    return Found.load(std::memory_order_relaxed) || (token && token->IsCancelled());
+}
+
+bool PerfectClearSolver::Search(const BotState& state, int height, int depth, unsigned int worker, const CancellationToken* token, std::vector<Choice>& path)
+{
+    Nodes.fetch_add(1, std::memory_order_relaxed);
+    if (height == 0)
+        return true;
+    if (Aborted(token) || !Feasible(state, height))
+        return false;
+
+    uint64_t key = MemoKey(state, height);
+    float ignored;
+    if (Dead->Probe(key, ignored))
+        return false;
+
+    std::vector<Choice>& children = ChoiceBuffers[worker][depth];
+    Expand(state, height, Config.Hold, worker, children);
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        // the buffer of the next depth is reused by the recursion, this one stays valid
+        path.push_back(children[i]);
+        if (Search(children[i].Next, children[i].Height, depth + 1, worker, token, path))
+            return true;
+        path.pop_back();
+    }
+
+    // an interrupted search proved nothing
+    if (!Aborted(token))
+        Dead->Improve(key, 0.0f);
+    return false;
+}
+
+uint64_t PerfectClearSolver::MemoKey(const BotState& state, int height) const
+{
+    uint64_t queueKey = state.QueueIndex < QueueKeys.size() ? QueueKeys[state.QueueIndex] : 0;
+    return state.Board.Hash ^ Zobrist::Keys().Pieces(state.Current, state.Hold, 0) ^ queueKey ^ (uint64_t(height) * 0xD6E8FEB86659FD93ull);
+}
+
+bool PerfectClearSolver::Feasible(const BotState& state, int height) const
+{
+    static const uint64_t darkCells = DarkCells();
+
+    uint64_t mask = FieldMask(height);
+    uint64_t empty = ~Field(state.Board, height) & mask;
+    int emptyCells = std::popcount(empty);
+
+    // enough pieces left to fill the empty cells
+    int pieces = 0, tPieces = 0;
+    auto count = [&](MinoType piece) {
+        pieces = pieces + (piece != MinoType::EMPTY);
+        tPieces = tPieces + (piece == MinoType::BLOCK_T);
+    };
+    count(state.Current);
+    count(state.Hold);
+    for (size_t i = state.QueueIndex; i < Queue.size(); i++)
+        count(Queue[i]);
+    if (emptyCells % 4 != 0 || emptyCells / 4 > pieces)
+        return false;
+
+    // every T changes the dark / light balance by 2, the other pieces keep it
+    int imbalance = std::popcount(empty & darkCells) - std::popcount(empty & ~darkCells);
+    if (imbalance % 2 != 0 || std::abs(imbalance) > 2 * tPieces)
+        return false;
+
+    // flood fill every empty region, each one is filled by whole pieces
+    uint64_t remaining = empty;
+    while (remaining)
+    {
+        uint64_t region = remaining & (~remaining + 1);
+        uint64_t previous;
+        do
+        {
+            previous = region;
+            region = region
+                   | ((region << 1) & ~COLUMN_0)
+                   | ((region >> 1) & ~COLUMN_9)
+                   | (region << MATRIX_COLS)
+                   | (region >> MATRIX_COLS);
+            region = region & empty;
+        } while (region != previous);
+
+        if (std::popcount(region) % 4 != 0)
+            return false;
+        remaining = remaining & ~region;
+    }
+    return true;
+}
@@ -0,0 +1,307 @@
+#include "Rollback.h"
+#include "Zobrist.h"
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+static_assert(sizeof(TickInput) == 16, "tick inputs are written as is");
+
+static const size_t HEADER_SIZE = 28;
+
+unsigned int RunTickInput(GameBoard& board, const TickInput& input)
+{
+    MoveType moves[MAX_TICK_MOVES];
+    for (size_t i = 0; i < input.Count; i++)
+        moves[i] = static_cast<MoveType>(input.Moves[i]);
+    return board.ExecuteTick(moves, input.Count);
+}
+
+RollbackSession::RollbackSession(unsigned int localPlayer, unsigned int seed, unsigned int garbageDelay, unsigned int garbageMessiness)
+:   LocalPlayer(localPlayer),
+    Tick(0),
+    RemoteReceived(0),
+    RemoteAcked(0),
+    HashesChecked(0),
+    DesyncTick(-1),
+    DesyncHashes(),
+    LocalInputs(),
+    RemoteInputs(),
+    Mispredicted(0),
+    HashesConfirmed(0),
+    RemoteHashesReceived(0),
+    RemoteHashesAcked(0)
+{
+    for (unsigned int player = 0; player < PLAYERS; player++)
+    {
+        Boards[player] = std::make_unique<GameBoard>(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+        Boards[player]->LoadMatch(seed, player, garbageDelay, garbageMessiness);
+    }
+}
+
+bool RollbackSession::CanAdvance() const
+{
+    // the hash windows never fill in practice, the input ones are tighter
+    return Tick < RemoteReceived + MAX_ROLLBACK && Tick < RemoteAcked + INPUT_WINDOW
+        && Tick < RemoteHashesReceived + HASH_WINDOW && Tick < RemoteHashesAcked + HASH_WINDOW;
+}
+
+void RollbackSession::AdvanceTick(const TickInput& local)
+{
+    Resimulate();
+    LocalInputs[Tick % INPUT_WINDOW] = local;
+    Simulate(Tick);
+    Tick = Tick + 1;
+    Mispredicted = Tick;
+    ConfirmHashes();
+}
+
+void RollbackSession::Resimulate()
+{
+    if (Mispredicted < Tick)
+    {
+        // back to the boards before the first wrong prediction, then forward again with the inputs received
+        unsigned int count = Tick - Mispredicted;
+        for (unsigned int player = 0; player < PLAYERS; player++)
+            Boards[player]->LoadState(Snapshots[Mispredicted % (HASH_WINDOW + 1)][player]);
+        for (uint32_t tick = Mispredicted; tick < Tick; tick++)
+            Simulate(tick);
+
+        Stats.Rollbacks = Stats.Rollbacks + 1;
+        Stats.ResimulatedTicks = Stats.ResimulatedTicks + count;
+        Stats.MaxRollback = std::max(Stats.MaxRollback, count);
+        Mispredicted = Tick;
+    }
+    ConfirmHashes();
+}
+
+uint32_t RollbackSession::ConfirmedTick() const
+{
+    return std::min(Tick, RemoteReceived);
+}
+
+TickInput RollbackSession::Input(unsigned int player, uint32_t tick) const
+{
+    if (player == LocalPlayer)
+        return LocalInputs[tick % INPUT_WINDOW];
+    if (tick < RemoteReceived)
+        return RemoteInputs[tick % INPUT_WINDOW];
+    return TickInput();
+}
+
+void RollbackSession::Simulate(uint32_t tick)
+{
+    for (unsigned int player = 0; player < PLAYERS; player++)
+        Boards[player]->SaveState(Snapshots[tick % (HASH_WINDOW + 1)][player]);
+    SimulateTick(*Boards[0], *Boards[1], Input(0, tick), Input(1, tick));
+    TickHashes[tick % HASH_WINDOW] = Zobrist::Mix(Boards[0]->StateHash(), Boards[1]->StateHash());
+}
+
+void RollbackSession::ConfirmHashes()
+{
+    // ticks predicted right are never re-simulated, their hash from the first time is already final
+    for (; HashesConfirmed < ConfirmedTick(); HashesConfirmed++)
+    {
+        uint64_t previous = HashesConfirmed > 0 ? LocalHashes[(HashesConfirmed - 1) % HASH_WINDOW] : 0;
+        LocalHashes[HashesConfirmed % HASH_WINDOW] = Zobrist::Mix(previous, TickHashes[HashesConfirmed % HASH_WINDOW]);
+    }
+    CheckHashes();
+}
+
+void RollbackSession::CheckHashes()
+{
+    // the hashes are rolling, only the first difference tells where the boards diverged
+    for (; HashesChecked < std::min(HashesConfirmed, RemoteHashesReceived); HashesChecked++)
+    {
+        uint32_t local = static_cast<uint32_t>(LocalHashes[HashesChecked % HASH_WINDOW]);
+        uint32_t remote = RemoteHashes[HashesChecked % HASH_WINDOW];
+        if (local != remote && DesyncTick < 0)
+        {
+            DesyncTick = HashesChecked;
+            DesyncHashes[0] = local;
+            DesyncHashes[1] = remote;
+            DesyncDump = DumpBoards(HashesChecked);
+        }
+    }
+}
+
+std::string RollbackSession::DumpBoards(uint32_t tick) const
+{
+    // the boards after the tick are the snapshot of the next one, or the boards themselves for the last
+    std::string dump;
+    for (unsigned int player = 0; player < PLAYERS; player++)
+    {
+        GameBoard board = *Boards[player];
+        if (tick + 1 < Tick)
+            board.LoadState(Snapshots[(tick + 1) % (HASH_WINDOW + 1)][player]);
+        dump = dump + "player " + std::to_string(player) + (player == LocalPlayer ? " (local)" : "") + "\n" + board.DumpState();
+    }
+    return dump;
+}
+
+void RollbackSession::SimulateTick(GameBoard& first, GameBoard& second, const TickInput& firstInput, const TickInput& secondInput)
+{
+    unsigned int firstSent = RunTickInput(first, firstInput);
+    unsigned int secondSent = RunTickInput(second, secondInput);
+    if (firstSent > 0 && !second.IsOver)
+        second.ReceiveGarbage(firstSent);
+    if (secondSent > 0 && !first.IsOver)
+        first.ReceiveGarbage(secondSent);
+}
+
+size_t RollbackSession::WritePacket(uint8_t *buffer) const
+{
+    uint32_t header[7] = { MAGIC, RemoteAcked, RemoteReceived, Tick - RemoteAcked, RemoteHashesAcked, RemoteHashesReceived, HashesConfirmed - RemoteHashesAcked };
+    std::memcpy(buffer, header, HEADER_SIZE);
+    uint8_t *inputs = buffer + HEADER_SIZE;
+    for (uint32_t tick = RemoteAcked; tick < Tick; tick++)
+        std::memcpy(inputs + (tick - RemoteAcked) * sizeof(TickInput), &LocalInputs[tick % INPUT_WINDOW], sizeof(TickInput));
+    uint8_t *hashes = inputs + (Tick - RemoteAcked) * sizeof(TickInput);
+    for (uint32_t tick = RemoteHashesAcked; tick < HashesConfirmed; tick++)
+    {
+        uint32_t hash = static_cast<uint32_t>(LocalHashes[tick % HASH_WINDOW]);
+        std::memcpy(hashes + (tick - RemoteHashesAcked) * sizeof(uint32_t), &hash, sizeof(uint32_t));
+    }
+    return hashes + (HashesConfirmed - RemoteHashesAcked) * sizeof(uint32_t) - buffer;
+}
+
+void RollbackSession::ReadPacket(const uint8_t *data, size_t size)
+{
+    uint32_t header[7];
+    if (size < HEADER_SIZE)
+    {
+        Stats.PacketsIgnored = Stats.PacketsIgnored + 1;
+        return;
+    }
+    std::memcpy(header, data, HEADER_SIZE);
+    uint32_t firstTick = header[1], ack = header[2], count = header[3];
+    uint32_t firstHash = header[4], hashAck = header[5], hashCount = header[6];
+    if (header[0] != MAGIC || count > INPUT_WINDOW || hashCount > HASH_WINDOW
+        || size != HEADER_SIZE + count * sizeof(TickInput) + hashCount * sizeof(uint32_t))
+    {
+        Stats.PacketsIgnored = Stats.PacketsIgnored + 1;
+        return;
+    }
+
+    Stats.PacketsReceived = Stats.PacketsReceived + 1;
+    RemoteAcked = std::clamp(ack, RemoteAcked, Tick);
+    RemoteHashesAcked = std::clamp(hashAck, RemoteHashesAcked, HashesConfirmed);
+
+    // hashes continuing the ones received, not further than the ones not compared yet can hold
+    const uint8_t *hashes = data + HEADER_SIZE + count * sizeof(TickInput);
+    uint32_t hashEnd = std::min(firstHash + hashCount, HashesChecked + HASH_WINDOW);
+    if (firstHash <= RemoteHashesReceived && hashEnd > RemoteHashesReceived)
+    {
+        for (uint32_t tick = RemoteHashesReceived; tick < hashEnd; tick++)
+            std::memcpy(&RemoteHashes[tick % HASH_WINDOW], hashes + (tick - firstHash) * sizeof(uint32_t), sizeof(uint32_t));
+        RemoteHashesReceived = hashEnd;
+        CheckHashes();
+    }
+
+    // packets can arrive out of order, only the ones continuing the inputs received are useful
+    // (a later packet resends whatever a lost or late one had)
+    if (firstTick > RemoteReceived)
+    {
+        Stats.PacketsIgnored = Stats.PacketsIgnored + 1;
+        return;
+    }
+
+    // inputs too far ahead would overwrite ones still needed to roll back, the remote peer resends them
+    uint32_t end = std::min(firstTick + count, ConfirmedTick() + INPUT_WINDOW);
+    for (uint32_t tick = RemoteReceived; tick < end; tick++)
+    {
+        TickInput input;
+        std::memcpy(&input, data + HEADER_SIZE + (tick - firstTick) * sizeof(TickInput), sizeof(TickInput));
+        input.Count = std::min<uint8_t>(input.Count, MAX_TICK_MOVES);
+
+        // ticks already simulated were predicted without input
+        if (tick < Tick && input.Count > 0)
+            Mispredicted = std::min(Mispredicted, tick);
+        RemoteInputs[tick % INPUT_WINDOW] = input;
+        RemoteReceived = tick + 1;
+    }
+}
+
+LossyLink::LossyLink(double latency, double jitter, double loss, unsigned int seed)
+:   Sent(0),
+    Dropped(0),
+    Latency(latency),
+    Jitter(jitter),
+    Loss(loss),
+    RNG(seed)
+{
+
+}
+
+void LossyLink::Send(double now, const uint8_t *data, size_t size)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    Sent = Sent + 1;
+    if (uniform(RNG) < Loss)
+    {
+        Dropped = Dropped + 1;
+        return;
+    }
+    Packets.push_back(InFlight{ now + Latency + Jitter * uniform(RNG), std::vector<uint8_t>(data, data + size) });
+}
+
+bool LossyLink::Receive(double now, std::vector<uint8_t>& packet)
+{
+    auto next = std::min_element(Packets.begin(), Packets.end(), [](const InFlight& a, const InFlight& b) {
+        return a.DeliverAt < b.DeliverAt;
+    });
+    if (next == Packets.end() || next->DeliverAt > now)
+        return false;
+
+    packet.swap(next->Data);
+    *next = std::move(Packets.back());
+    Packets.pop_back();
+    return true;
+}
+
+UdpSocket::UdpSocket(uint16_t localPort, const std::string& remoteHost, uint16_t remotePort)
+:   Socket(-1),
+    RemoteAddress()
+{
+    RemoteAddress.sin_family = AF_INET;
+    RemoteAddress.sin_port = htons(remotePort);
+    if (inet_pton(AF_INET, remoteHost.c_str(), &RemoteAddress.sin_addr) != 1)
+        throw std::runtime_error("not an IPv4 address: " + remoteHost);
+
+    Socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (Socket < 0)
+        throw std::runtime_error(std::string("failed to create a UDP socket: ") + std::strerror(errno));
+
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(localPort);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(Socket, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0)
+    {
+        std::string error = std::strerror(errno);
+        close(Socket);
+        throw std::runtime_error("failed to bind UDP port " + std::to_string(localPort) + ": " + error);
+    }
+}
+
+UdpSocket::~UdpSocket()
+{
+    close(Socket);
+}
+
+void UdpSocket::Send(const uint8_t *data, size_t size)
+{
+    // datagrams are best effort, a full buffer is just another lost packet
+    sendto(Socket, data, size, 0, reinterpret_cast<const sockaddr*>(&RemoteAddress), sizeof(RemoteAddress));
+}
+
+size_t UdpSocket::Receive(uint8_t *buffer, size_t size)
+{
+    ssize_t received = recv(Socket, buffer, size, 0);
+    return received > 0 ? static_cast<size_t>(received) : 0;
+}
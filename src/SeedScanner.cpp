@@ -0,0 +1,269 @@
+#include "SeedScanner.h"
+
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+// std::mt19937 parameters
+static const unsigned int MT_SHIFT = 397;
+static const uint32_t MT_MATRIX_A = 0x9908B0DF;
+static const uint32_t MT_UPPER = 0x80000000;
+static const uint32_t MT_LOWER = 0x7FFFFFFF;
+static const uint32_t MT_INIT = 1812433253;
+
+// a bag takes 3 outputs (std::shuffle draws two indices at a time), the rest covers rejections
+static const unsigned int OUTPUTS = 8 * MAX_SCAN_BAGS;
+
+// hands the precomputed outputs of one lane to std::shuffle, flags the rare seed needing more
+struct ReplayGenerator
+{
+    using result_type = std::mt19937::result_type;
+
+    const uint32_t *Outputs;
+    unsigned int Next;
+    bool Overflow;
+
+    static constexpr result_type min() { return std::mt19937::min(); }
+    static constexpr result_type max() { return std::mt19937::max(); }
+
+    result_type operator()()
+    {
+        if (Next == OUTPUTS)
+        {
+            Overflow = true;
+            return 0;
+        }
+        return Outputs[(Next++) * SeedScanner::LANES];
+    }
+};
+
+void SeedScanner::Deal(uint32_t seed, unsigned int bags, MinoType *pieces)
+{
+    // same as GameBoard::Load and GameBoard::GetNextBag
+    std::mt19937 rng(seed);
+    for (unsigned int b = 0; b < bags; b++)
+    {
+        std::array<MinoType, 7> bag = SEVEN_PIECE_BAG;
+        std::ranges::shuffle(bag, rng);
+        std::copy(bag.begin(), bag.end(), pieces + b * 7);
+    }
+}
+
+void SeedScanner::DealLanes(uint32_t firstSeed, unsigned int bags, MinoType *pieces)
+{
+    // only the words the outputs read are kept: [0, OUTPUTS] and [MT_SHIFT, MT_SHIFT + OUTPUTS)
+    uint32_t low[OUTPUTS + 1][LANES];
+    uint32_t high[OUTPUTS][LANES];
+    uint32_t word[LANES];
+    uint32_t outputs[OUTPUTS][LANES];
+
+    auto step = [&word](unsigned int i) {
+        for (unsigned int lane = 0; lane < LANES; lane++)
+            word[lane] = MT_INIT * (word[lane] ^ (word[lane] >> 30)) + i;
+    };
+
+    for (unsigned int lane = 0; lane < LANES; lane++)
+        low[0][lane] = word[lane] = firstSeed + lane;
+    for (unsigned int i = 1; i <= OUTPUTS; i++)
+    {
+        step(i);
+        std::copy(word, word + LANES, low[i]);
+    }
+    for (unsigned int i = OUTPUTS + 1; i < MT_SHIFT; i++)
+        step(i);
+    for (unsigned int i = MT_SHIFT; i < MT_SHIFT + OUTPUTS; i++)
+    {
+        step(i);
+        std::copy(word, word + LANES, high[i - MT_SHIFT]);
+    }
+
+    // the twist of the first words and the tempering, without touching the rest of the state
+    for (unsigned int k = 0; k < OUTPUTS; k++)
+    {
+        for (unsigned int lane = 0; lane < LANES; lane++)
+        {
+            uint32_t y = (low[k][lane] & MT_UPPER) | (low[k + 1][lane] & MT_LOWER);
+            y = high[k][lane] ^ (y >> 1) ^ (-(y & 1) & MT_MATRIX_A);
+            y = y ^ (y >> 11);
+            y = y ^ ((y << 7) & 0x9D2C5680);
+            y = y ^ ((y << 15) & 0xEFC60000);
+            outputs[k][lane] = y ^ (y >> 18);
+        }
+    }
+
+    for (unsigned int lane = 0; lane < LANES; lane++)
+    {
+        MinoType *lanePieces = pieces + lane * bags * 7;
+        ReplayGenerator rng{ &outputs[0][lane], 0, false };
+        for (unsigned int b = 0; b < bags; b++)
+        {
+            std::array<MinoType, 7> bag = SEVEN_PIECE_BAG;
+            std::ranges::shuffle(bag, rng);
+            std::copy(bag.begin(), bag.end(), lanePieces + b * 7);
+        }
+
+        if (rng.Overflow)
+            Deal(firstSeed + lane, bags, lanePieces);
+    }
+}
+
+std::vector<SeedMatch> SeedScanner::ReadMatches(const std::string& path, uint32_t first, uint32_t last, unsigned int *bags)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("failed to open " + path);
+
+    auto read = [&](void *data, size_t size) {
+        if (std::fread(data, 1, size, file) != size)
+        {
+            std::fclose(file);
+            throw std::runtime_error("truncated seed file " + path);
+        }
+    };
+
+    char magic[4];
+    uint32_t version, fileBags;
+    read(magic, sizeof(magic));
+    read(&version, sizeof(version));
+    read(&fileBags, sizeof(fileBags));
+    if (std::memcmp(magic, "STKS", 4) != 0 || version != SeedMatchWriter::VERSION || fileBags == 0 || fileBags > MAX_SCAN_BAGS)
+    {
+        std::fclose(file);
+        throw std::runtime_error("not a seed file: " + path);
+    }
+    if (bags)
+        *bags = fileBags;
+
+    uint64_t indexOffset;
+    uint32_t blocks;
+    std::fseek(file, -static_cast<long>(sizeof(indexOffset) + sizeof(blocks) + sizeof(magic)), SEEK_END);
+    read(&indexOffset, sizeof(indexOffset));
+    read(&blocks, sizeof(blocks));
+    read(magic, sizeof(magic));
+    if (std::memcmp(magic, "STKI", 4) != 0)
+    {
+        std::fclose(file);
+        throw std::runtime_error("seed file without index (unfinished scan?): " + path);
+    }
+
+    std::vector<uint8_t> index(static_cast<size_t>(blocks) * 16);
+    std::fseek(file, static_cast<long>(indexOffset), SEEK_SET);
+    read(index.data(), index.size());
+
+    std::vector<SeedMatch> matches;
+    std::vector<uint8_t> record(4 + fileBags * 7);
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        uint32_t firstSeed, count;
+        uint64_t offset;
+        std::memcpy(&firstSeed, &index[b * 16], sizeof(firstSeed));
+        std::memcpy(&count, &index[b * 16 + 4], sizeof(count));
+        std::memcpy(&offset, &index[b * 16 + 8], sizeof(offset));
+
+        // blocks are in seed order, a block may hold wanted seeds if the next one starts after first
+        uint32_t nextSeed = 0;
+        if (b + 1 < blocks)
+            std::memcpy(&nextSeed, &index[(b + 1) * 16], sizeof(nextSeed));
+        if (count == 0 || firstSeed > last || (b + 1 < blocks && nextSeed <= first))
+            continue;
+
+        std::fseek(file, static_cast<long>(offset), SEEK_SET);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            read(record.data(), record.size());
+            SeedMatch match = {};
+            std::memcpy(&match.Seed, record.data(), sizeof(match.Seed));
+            for (unsigned int p = 0; p < fileBags * 7; p++)
+                match.Pieces[p] = static_cast<MinoType>(record[4 + p]);
+            if (match.Seed >= first && match.Seed <= last)
+                matches.push_back(match);
+        }
+    }
+
+    std::fclose(file);
+    return matches;
+}
+
+SeedMatchWriter::SeedMatchWriter(const std::string& path, unsigned int bags, const std::string& filter)
+:   Path(path),
+    File(nullptr),
+    Bags(bags),
+    Offset(0),
+    Written(0)
+{
+    if (bags == 0 || bags > MAX_SCAN_BAGS)
+        throw std::runtime_error("between 1 and " + std::to_string(MAX_SCAN_BAGS) + " bags can be scanned");
+
+    File = std::fopen(path.c_str(), "wb");
+    if (!File)
+        throw std::runtime_error("failed to create " + path);
+
+    uint32_t version = VERSION;
+    uint32_t fileBags = bags;
+    uint32_t filterLength = filter.size();
+    std::fwrite("STKS", 1, 4, File);
+    std::fwrite(&version, sizeof(version), 1, File);
+    std::fwrite(&fileBags, sizeof(fileBags), 1, File);
+    std::fwrite(&filterLength, sizeof(filterLength), 1, File);
+    std::fwrite(filter.data(), 1, filter.size(), File);
+    Offset = 16 + filter.size();
+}
+
+SeedMatchWriter::~SeedMatchWriter()
+{
+    try
+    {
+        Finish();
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+}
+
+void SeedMatchWriter::AddBlock(uint32_t firstSeed, const std::vector<SeedMatch>& matches)
+{
+    Index.push_back(IndexEntry{ firstSeed, static_cast<uint32_t>(matches.size()), Offset });
+
+    std::vector<uint8_t> record(4 + Bags * 7);
+    for (const SeedMatch& match: matches)
+    {
+        std::memcpy(record.data(), &match.Seed, sizeof(match.Seed));
+        for (unsigned int p = 0; p < Bags * 7; p++)
+            record[4 + p] = static_cast<uint8_t>(match.Pieces[p]);
+        std::fwrite(record.data(), 1, record.size(), File);
+    }
+    if (std::ferror(File))
+        throw std::runtime_error("failed to write " + Path);
+    Offset = Offset + matches.size() * record.size();
+    Written = Written + matches.size();
+}
+
+void SeedMatchWriter::Finish()
+{
+    if (!File)
+        return;
+
+    for (const IndexEntry& entry: Index)
+    {
+        std::fwrite(&entry.FirstSeed, sizeof(entry.FirstSeed), 1, File);
+        std::fwrite(&entry.Matches, sizeof(entry.Matches), 1, File);
+        std::fwrite(&entry.Offset, sizeof(entry.Offset), 1, File);
+    }
+    uint32_t blocks = Index.size();
+    std::fwrite(&Offset, sizeof(Offset), 1, File);
+    std::fwrite(&blocks, sizeof(blocks), 1, File);
+    std::fwrite("STKI", 1, 4, File);
+
+    bool failed = std::ferror(File);
+    if (std::fclose(File) != 0)
+        failed = true;
+    File = nullptr;
+    if (failed)
+        throw std::runtime_error("failed to write " + Path);
+}
+
+uint64_t SeedMatchWriter::MatchesWritten() const
+{
+    return Written;
+}
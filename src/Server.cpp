@@ -0,0 +1,897 @@
+#include "Server.h"
+#include "Zobrist.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+size_t ServerProtocol::Write(uint8_t *buffer, size_t capacity, ServerMessageType type, const uint8_t *payload, size_t size)
+{
+    if (HEADER_SIZE + size > capacity)
+        return 0;
+
+    uint16_t length = static_cast<uint16_t>(size + 1);
+    std::memcpy(buffer, &length, sizeof(length));
+    buffer[2] = type;
+    std::memcpy(buffer + HEADER_SIZE, payload, size);
+    return HEADER_SIZE + size;
+}
+
+size_t ServerProtocol::Read(const uint8_t *data, size_t size, uint8_t& type, const uint8_t *&payload, size_t& payloadSize)
+{
+    if (size < HEADER_SIZE)
+        return 0;
+
+    uint16_t length;
+    std::memcpy(&length, data, sizeof(length));
+    if (length == 0 || length > MAX_MESSAGE_SIZE)
+        return SIZE_MAX;
+    if (size < 2 + size_t(length))
+        return 0;
+
+    type = data[2];
+    payload = data + HEADER_SIZE;
+    payloadSize = length - 1;
+    return 2 + size_t(length);
+}
+
+// hash of the boards after a tick, as sent with TICK
+static uint32_t MatchHash(GameBoard *const *boards, unsigned int count)
+{
+    uint64_t hash = 0;
+    for (unsigned int i = 0; i < count; i++)
+        hash = Zobrist::Mix(hash, boards[i]->StateHash());
+    return static_cast<uint32_t>(hash);
+}
+
+static void WriteStart(uint8_t *payload, uint32_t seed, MatchMode mode, uint8_t player, unsigned int boards, unsigned int garbageDelay, unsigned int garbageMessiness)
+{
+    std::memcpy(payload, &seed, sizeof(seed));
+    payload[4] = mode;
+    payload[5] = player;
+    payload[6] = static_cast<uint8_t>(boards);
+    payload[7] = static_cast<uint8_t>(garbageDelay);
+    payload[8] = static_cast<uint8_t>(garbageMessiness);
+}
+
+MatchMirror::MatchMirror()
+:   Mode(MODE_SPRINT),
+    Boards(0),
+    Player(0),
+    Seed(0),
+    Tick(0),
+    Playing(false),
+    Winner(NO_WINNER),
+    Desyncs(0)
+{
+
+}
+
+bool MatchMirror::Apply(uint8_t type, const uint8_t *payload, size_t size)
+{
+    switch (type)
+    {
+        case MSG_START:
+        {
+            if (size != 9 || payload[4] > MODE_VERSUS || payload[6] != (payload[4] == MODE_VERSUS ? 2 : 1) || payload[5] >= payload[6])
+                return false;
+            std::memcpy(&Seed, payload, sizeof(Seed));
+            Mode = static_cast<MatchMode>(payload[4]);
+            Player = payload[5];
+            Boards = payload[6];
+            for (unsigned int i = 0; i < Boards; i++)
+            {
+                if (!Board[i])
+                    Board[i] = std::make_unique<GameBoard>(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+                Board[i]->LoadMatch(Seed, i, payload[7], payload[8]);
+            }
+            Tick = 0;
+            Playing = true;
+            Winner = NO_WINNER;
+            return true;
+        }
+        case MSG_TICK:
+        {
+            uint32_t tick, hash;
+            TickInput inputs[SERVER_MAX_BOARDS] = {};
+            size_t offset = 8;
+            if (!Playing || size < offset)
+                return false;
+            std::memcpy(&tick, payload, sizeof(tick));
+            std::memcpy(&hash, payload + 4, sizeof(hash));
+            for (unsigned int i = 0; i < Boards; i++)
+            {
+                if (offset >= size || payload[offset] > MAX_TICK_MOVES || offset + 1 + payload[offset] > size)
+                    return false;
+                inputs[i].Count = payload[offset];
+                std::memcpy(inputs[i].Moves, payload + offset + 1, inputs[i].Count);
+                offset = offset + 1 + inputs[i].Count;
+            }
+            if (offset != size || tick < Tick)
+                return false;
+
+            // the ticks skipped had no inputs, nothing happened on them
+            if (Mode == MODE_VERSUS)
+                RollbackSession::SimulateTick(*Board[0], *Board[1], inputs[0], inputs[1]);
+            else
+                RunTickInput(*Board[0], inputs[0]);
+            GameBoard *boards[SERVER_MAX_BOARDS] = { Board[0].get(), Board[1].get() };
+            if (MatchHash(boards, Boards) != hash)
+                Desyncs = Desyncs + 1;
+            Tick = tick + 1;
+            return true;
+        }
+        case MSG_END:
+        {
+            if (!Playing || size != 5 + Boards * 12)
+                return false;
+            Winner = payload[4];
+            Playing = false;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+SpectatorMirror::SpectatorMirror()
+:   Boards(0),
+    Playing(false),
+    Winner(NO_WINNER),
+    Mismatches(0)
+{
+
+}
+
+bool SpectatorMirror::Apply(uint8_t type, const uint8_t *payload, size_t size)
+{
+    switch (type)
+    {
+        case MSG_START:
+        {
+            if (size != 9 || payload[4] > MODE_VERSUS || payload[5] != SPECTATOR || payload[6] != (payload[4] == MODE_VERSUS ? 2 : 1))
+                return false;
+            Boards = payload[6];
+            for (unsigned int i = 0; i < Boards; i++)
+            {
+                if (!Board[i])
+                    Board[i] = std::make_unique<GameBoard>(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+                Decoder[i] = SpectatorDecoder();
+            }
+            Playing = true;
+            Winner = NO_WINNER;
+            return true;
+        }
+        case MSG_FRAME:
+        {
+            if (!Playing || size < 1 || payload[0] >= Boards)
+                return false;
+            return Decoder[payload[0]].Apply(payload + 1, size - 1, *Board[payload[0]]);
+        }
+        case MSG_END:
+        {
+            if (!Playing || size != 5 + Boards * 12)
+                return false;
+            for (unsigned int i = 0; i < Boards; i++)
+            {
+                uint32_t results[3];
+                std::memcpy(results, payload + 5 + i * 12, sizeof(results));
+                if (results[0] != Board[i]->PiecesPlaced || results[1] != Board[i]->LinesCleared || results[2] != Board[i]->LinesSent)
+                    Mismatches = Mismatches + 1;
+            }
+            Winner = payload[4];
+            Playing = false;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static const size_t CLIENT_IN_SIZE = 512;
+static const size_t CLIENT_OUT_SIZE = 4096;         // a client that doesn't read that much is dropped
+static const unsigned int INPUT_QUEUE = 32;         // inputs waiting for their tick, more is flooding
+static const unsigned int MAX_TICKS_PER_FRAME = 4;  // a late frame catches up with a few ticks at most
+static const uint64_t LISTEN_EVENT = UINT64_MAX;
+static const uint64_t TIMER_EVENT = UINT64_MAX - 1;
+
+struct ServerClient
+{
+    int Socket;                     // -1 for a free slot
+    int Match;                      // -1 while not playing (or watching)
+    unsigned int Player;
+    bool Spectating;
+    int NextSpectator;              // next in the list of the match, or of the ones waiting for a match
+    bool Dropped;                   // closed at the end of the frame
+    bool Writing;                   // waiting for the socket to accept the rest of Out
+    size_t InSize, OutSize;
+    uint8_t In[CLIENT_IN_SIZE];
+    uint8_t Out[CLIENT_OUT_SIZE];
+};
+
+struct QueuedInput
+{
+    uint32_t Tick;
+    TickInput Input;
+};
+
+struct ServerMatch
+{
+    bool Active;
+    MatchMode Mode;
+    unsigned int Boards;
+    uint32_t Seed;
+    uint32_t Tick;
+    int Clients[SERVER_MAX_BOARDS];                     // -1 once disconnected
+    std::unique_ptr<GameBoard> Board[SERVER_MAX_BOARDS];
+    QueuedInput Queue[SERVER_MAX_BOARDS][INPUT_QUEUE];  // ring buffers, oldest first
+    unsigned int QueueFirst[SERVER_MAX_BOARDS];
+    unsigned int QueueCount[SERVER_MAX_BOARDS];
+    int FirstSpectator;                                 // -1 if nobody is watching, the boards aren't encoded then
+    SpectatorEncoder Encoder[SERVER_MAX_BOARDS];
+};
+
+class ServerShard
+{
+    public:
+        ServerShard(uint16_t port, unsigned int matches, unsigned int garbageDelay, unsigned int garbageMessiness, unsigned int seed);
+        ~ServerShard();
+
+        void Run(const std::atomic<bool>& running);
+        ServerStats Stats() const;
+
+    private:
+        int Listener, Epoll, Timer;
+        unsigned int GarbageDelay, GarbageMessiness;
+        std::mt19937 SeedRNG;
+
+        std::vector<ServerClient> Clients;
+        std::vector<int> FreeClients;
+        std::vector<ServerMatch> Matches;
+        std::vector<int> FreeMatches;
+        int WaitingClient;                  // the client waiting for a versus opponent, -1 if none
+        int WaitingSpectators;              // list of the spectators waiting for a match to start, -1 if none
+        size_t SpectateCursor;              // match after the last one given to a spectator
+
+        // counted by the loop, published once per frame
+        ServerStats Local;
+        mutable std::mutex StatsLock;
+        ServerStats Published;
+
+        void Accept();
+        void Receive(int client);
+        void Handle(int client, uint8_t type, const uint8_t *payload, size_t size);
+        void Join(int client, MatchMode mode);
+        void StartMatch(MatchMode mode, const int *clients);
+        void Spectate(int client);
+        void AddSpectator(ServerMatch& match, int client);
+        void RemoveSpectator(int client);
+        void Queue(int client, uint32_t tick, const TickInput& input);
+        void StepMatch(ServerMatch& match);
+        void EndMatch(ServerMatch& match, uint8_t winner);
+        void Send(int client, ServerMessageType type, const uint8_t *payload, size_t size);
+        void Flush(int client);
+        void Disconnect(int client);
+        void Watch(int client, bool writing);
+};
+
+ServerShard::ServerShard(uint16_t port, unsigned int matches, unsigned int garbageDelay, unsigned int garbageMessiness, unsigned int seed)
+:   Listener(-1),
+    Epoll(-1),
+    Timer(-1),
+    GarbageDelay(garbageDelay),
+    GarbageMessiness(garbageMessiness),
+    SeedRNG(seed),
+    WaitingClient(-1),
+    WaitingSpectators(-1),
+    SpectateCursor(0)
+{
+    Listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int enable = 1;
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (Listener < 0 || setsockopt(Listener, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0
+        || bind(Listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(Listener, SOMAXCONN) != 0)
+    {
+        std::string error = std::strerror(errno);
+        if (Listener >= 0)
+            close(Listener);
+        throw std::runtime_error("failed to listen on TCP port " + std::to_string(port) + ": " + error);
+    }
+
+    Epoll = epoll_create1(0);
+    Timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    itimerspec interval = {};
+    interval.it_interval.tv_nsec = 1000000000 / SERVER_TICK_RATE;
+    interval.it_value = interval.it_interval;
+    epoll_event listenEvent = { EPOLLIN, { .u64 = LISTEN_EVENT } };
+    epoll_event timerEvent = { EPOLLIN, { .u64 = TIMER_EVENT } };
+    if (Epoll < 0 || Timer < 0 || timerfd_settime(Timer, 0, &interval, nullptr) != 0
+        || epoll_ctl(Epoll, EPOLL_CTL_ADD, Listener, &listenEvent) != 0 || epoll_ctl(Epoll, EPOLL_CTL_ADD, Timer, &timerEvent) != 0)
+    {
+        std::string error = std::strerror(errno);
+        close(Listener);
+        if (Epoll >= 0)
+            close(Epoll);
+        if (Timer >= 0)
+            close(Timer);
+        throw std::runtime_error("failed to create the event loop: " + error);
+    }
+
+    // two clients per match and a few more waiting for one
+    Clients.resize(2 * matches + 64);
+    for (size_t i = Clients.size(); i > 0; i--)
+    {
+        Clients[i - 1].Socket = -1;
+        FreeClients.push_back(i - 1);
+    }
+    Matches.resize(matches);
+    for (size_t i = Matches.size(); i > 0; i--)
+    {
+        Matches[i - 1].Active = false;
+        for (unsigned int player = 0; player < SERVER_MAX_BOARDS; player++)
+            Matches[i - 1].Board[player] = std::make_unique<GameBoard>(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+        FreeMatches.push_back(i - 1);
+    }
+}
+
+ServerShard::~ServerShard()
+{
+    for (ServerClient& client: Clients)
+    {
+        if (client.Socket >= 0)
+            close(client.Socket);
+    }
+    close(Timer);
+    close(Epoll);
+    close(Listener);
+}
+
+void ServerShard::Run(const std::atomic<bool>& running)
+{
+    epoll_event events[256];
+    while (running.load(std::memory_order_relaxed))
+    {
+        // the timer wakes the loop at least once per tick
+        int count = epoll_wait(Epoll, events, 256, 100);
+        for (int i = 0; i < count; i++)
+        {
+            uint64_t id = events[i].data.u64;
+            if (id == LISTEN_EVENT)
+                Accept();
+            else if (id == TIMER_EVENT)
+            {
+                uint64_t expirations = 0;
+                if (read(Timer, &expirations, sizeof(expirations)) != sizeof(expirations))
+                    continue;
+
+                auto start = std::chrono::steady_clock::now();
+                unsigned int ticks = std::min<uint64_t>(expirations, MAX_TICKS_PER_FRAME);
+                for (unsigned int tick = 0; tick < ticks; tick++)
+                {
+                    for (ServerMatch& match: Matches)
+                    {
+                        if (match.Active)
+                            StepMatch(match);
+                    }
+                }
+                for (size_t client = 0; client < Clients.size(); client++)
+                {
+                    if (Clients[client].Socket >= 0 && Clients[client].OutSize > 0 && !Clients[client].Writing)
+                        Flush(client);
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                Local.MaxFrameSeconds = std::max(Local.MaxFrameSeconds, seconds);
+
+                std::lock_guard<std::mutex> lock(StatsLock);
+                Published = Local;
+            }
+            else
+            {
+                int client = static_cast<int>(id);
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    Clients[client].Dropped = true;
+                else
+                {
+                    if (events[i].events & EPOLLIN)
+                        Receive(client);
+                    if ((events[i].events & EPOLLOUT) && !Clients[client].Dropped)
+                        Flush(client);
+                }
+            }
+        }
+
+        // not closed while handling the events, they could refer to the slot again
+        for (size_t client = 0; client < Clients.size(); client++)
+        {
+            if (Clients[client].Socket >= 0 && Clients[client].Dropped)
+                Disconnect(client);
+        }
+    }
+}
+
+ServerStats ServerShard::Stats() const
+{
+    std::lock_guard<std::mutex> lock(StatsLock);
+    return Published;
+}
+
+void ServerShard::Accept()
+{
+    while (true)
+    {
+        int socket = accept4(Listener, nullptr, nullptr, SOCK_NONBLOCK);
+        if (socket < 0)
+            return;
+
+        if (FreeClients.empty())
+        {
+            close(socket);
+            Local.Rejected = Local.Rejected + 1;
+            continue;
+        }
+
+        // inputs are tiny and latency matters more than packet count
+        int enable = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        int client = FreeClients.back();
+        FreeClients.pop_back();
+        ServerClient& slot = Clients[client];
+        slot.Socket = socket;
+        slot.Match = -1;
+        slot.Player = 0;
+        slot.Spectating = false;
+        slot.NextSpectator = -1;
+        slot.Dropped = false;
+        slot.Writing = false;
+        slot.InSize = 0;
+        slot.OutSize = 0;
+        epoll_event event = { EPOLLIN, { .u64 = static_cast<uint64_t>(client) } };
+        if (epoll_ctl(Epoll, EPOLL_CTL_ADD, socket, &event) != 0)
+            slot.Dropped = true;
+        Local.Clients = Local.Clients + 1;
+    }
+}
+
+void ServerShard::Watch(int client, bool writing)
+{
+    epoll_event event = { EPOLLIN | (writing ? EPOLLOUT : 0u), { .u64 = static_cast<uint64_t>(client) } };
+    ServerClient& slot = Clients[client];
+    if (epoll_ctl(Epoll, EPOLL_CTL_MOD, slot.Socket, &event) != 0)
+        slot.Dropped = true;
+    slot.Writing = writing;
+}
+
+void ServerShard::Receive(int client)
+{
+    ServerClient& slot = Clients[client];
+    ssize_t received = recv(slot.Socket, slot.In + slot.InSize, CLIENT_IN_SIZE - slot.InSize, 0);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        slot.Dropped = true;
+        return;
+    }
+    if (received < 0)
+        return;
+    slot.InSize = slot.InSize + received;
+    Local.BytesIn = Local.BytesIn + received;
+
+    size_t offset = 0;
+    while (!slot.Dropped)
+    {
+        uint8_t type;
+        const uint8_t *payload;
+        size_t size;
+        size_t length = ServerProtocol::Read(slot.In + offset, slot.InSize - offset, type, payload, size);
+        if (length == SIZE_MAX)
+            slot.Dropped = true;
+        if (length == 0 || length == SIZE_MAX)
+            break;
+        Handle(client, type, payload, size);
+        offset = offset + length;
+    }
+    std::memmove(slot.In, slot.In + offset, slot.InSize - offset);
+    slot.InSize = slot.InSize - offset;
+}
+
+void ServerShard::Handle(int client, uint8_t type, const uint8_t *payload, size_t size)
+{
+    if (type == MSG_JOIN && size == 1 && payload[0] <= MODE_VERSUS && !Clients[client].Spectating)
+        Join(client, static_cast<MatchMode>(payload[0]));
+    else if (type == MSG_SPECTATE && size == 0 && Clients[client].Match < 0 && WaitingClient != client && !Clients[client].Spectating)
+        Spectate(client);
+    else if (type == MSG_INPUT && size == 4 + sizeof(TickInput))
+    {
+        uint32_t tick;
+        TickInput input;
+        std::memcpy(&tick, payload, sizeof(tick));
+        std::memcpy(&input, payload + 4, sizeof(input));
+        if (input.Count > MAX_TICK_MOVES)
+            Clients[client].Dropped = true;
+        else
+            Queue(client, tick, input);
+    }
+    else
+        Clients[client].Dropped = true;
+
+    if (Clients[client].Dropped)
+        Local.Rejected = Local.Rejected + 1;
+}
+
+void ServerShard::Join(int client, MatchMode mode)
+{
+    // already playing or waiting
+    if (Clients[client].Match >= 0 || WaitingClient == client)
+        return;
+
+    if (mode == MODE_SPRINT)
+        StartMatch(mode, &client);
+    else if (WaitingClient < 0)
+        WaitingClient = client;
+    else
+    {
+        int clients[2] = { WaitingClient, client };
+        WaitingClient = -1;
+        StartMatch(mode, clients);
+    }
+}
+
+void ServerShard::StartMatch(MatchMode mode, const int *clients)
+{
+    unsigned int boards = mode == MODE_VERSUS ? 2 : 1;
+    if (FreeMatches.empty())
+    {
+        for (unsigned int player = 0; player < boards; player++)
+            Clients[clients[player]].Dropped = true;
+        Local.Rejected = Local.Rejected + boards;
+        return;
+    }
+
+    int index = FreeMatches.back();
+    FreeMatches.pop_back();
+    ServerMatch& match = Matches[index];
+    match.Active = true;
+    match.Mode = mode;
+    match.Boards = boards;
+    match.Seed = SeedRNG();
+    match.Tick = 0;
+
+    match.FirstSpectator = -1;
+    for (unsigned int player = 0; player < SERVER_MAX_BOARDS; player++)
+    {
+        match.Clients[player] = player < boards ? clients[player] : -1;
+        match.QueueFirst[player] = 0;
+        match.QueueCount[player] = 0;
+        if (player >= boards)
+            continue;
+
+        match.Board[player]->LoadMatch(match.Seed, player, GarbageDelay, GarbageMessiness);
+        Clients[clients[player]].Match = index;
+        Clients[clients[player]].Player = player;
+        uint8_t payload[9];
+        WriteStart(payload, match.Seed, mode, player, boards, GarbageDelay, GarbageMessiness);
+        Send(clients[player], MSG_START, payload, sizeof(payload));
+    }
+    Local.Matches = Local.Matches + 1;
+
+    // the spectators waiting for a match follow this one
+    int spectator = WaitingSpectators;
+    WaitingSpectators = -1;
+    while (spectator >= 0)
+    {
+        int next = Clients[spectator].NextSpectator;
+        AddSpectator(match, spectator);
+        spectator = next;
+    }
+}
+
+void ServerShard::Spectate(int client)
+{
+    Clients[client].Spectating = true;
+    Local.Spectators = Local.Spectators + 1;
+
+    // the first match being played after the last one given to a spectator, they spread over the matches
+    for (size_t i = 0; i < Matches.size(); i++)
+    {
+        size_t index = (SpectateCursor + i) % Matches.size();
+        if (Matches[index].Active)
+        {
+            SpectateCursor = index + 1;
+            AddSpectator(Matches[index], client);
+            return;
+        }
+    }
+    Clients[client].NextSpectator = WaitingSpectators;
+    WaitingSpectators = client;
+}
+
+void ServerShard::AddSpectator(ServerMatch& match, int client)
+{
+    uint8_t payload[9];
+    WriteStart(payload, match.Seed, match.Mode, SPECTATOR, match.Boards, GarbageDelay, GarbageMessiness);
+    Send(client, MSG_START, payload, sizeof(payload));
+
+    // the boards aren't encoded while nobody watches, the first spectator starts the streams again
+    for (unsigned int player = 0; player < match.Boards; player++)
+    {
+        uint8_t frame[1 + SpectatorEncoder::MAX_FRAME_SIZE];
+        frame[0] = player;
+        if (match.FirstSpectator < 0)
+            match.Encoder[player].Reset();
+        size_t size = match.FirstSpectator < 0 ? match.Encoder[player].Encode(*match.Board[player], frame + 1) : match.Encoder[player].EncodeKeyframe(frame + 1);
+        Send(client, MSG_FRAME, frame, 1 + size);
+    }
+
+    Clients[client].Match = &match - Matches.data();
+    Clients[client].NextSpectator = match.FirstSpectator;
+    match.FirstSpectator = client;
+}
+
+void ServerShard::RemoveSpectator(int client)
+{
+    ServerClient& slot = Clients[client];
+    int *link = slot.Match >= 0 ? &Matches[slot.Match].FirstSpectator : &WaitingSpectators;
+    while (*link != client)
+        link = &Clients[*link].NextSpectator;
+    *link = slot.NextSpectator;
+
+    slot.Match = -1;
+    slot.Spectating = false;
+    slot.NextSpectator = -1;
+    Local.Spectators = Local.Spectators - 1;
+}
+
+void ServerShard::Queue(int client, uint32_t tick, const TickInput& input)
+{
+    ServerClient& slot = Clients[client];
+    if (slot.Match < 0 || slot.Spectating)
+        return;
+
+    ServerMatch& match = Matches[slot.Match];
+    unsigned int player = slot.Player;
+    if (match.QueueCount[player] == INPUT_QUEUE)
+    {
+        slot.Dropped = true;
+        return;
+    }
+    match.Queue[player][(match.QueueFirst[player] + match.QueueCount[player]) % INPUT_QUEUE] = QueuedInput{ tick, input };
+    match.QueueCount[player] = match.QueueCount[player] + 1;
+    Local.Inputs = Local.Inputs + 1;
+}
+
+void ServerShard::StepMatch(ServerMatch& match)
+{
+    // a player who left loses, the boards stay as the clients know them
+    if (match.Mode == MODE_VERSUS && (match.Clients[0] < 0 || match.Clients[1] < 0))
+    {
+        EndMatch(match, match.Clients[0] == match.Clients[1] ? NO_WINNER : (match.Clients[0] < 0 ? 1 : 0));
+        return;
+    }
+
+    // the inputs due, in the order received, as many as fit in the tick (the others wait for the next one)
+    TickInput inputs[SERVER_MAX_BOARDS] = {};
+    bool moved = false;
+    for (unsigned int player = 0; player < match.Boards; player++)
+    {
+        while (match.QueueCount[player] > 0)
+        {
+            const QueuedInput& queued = match.Queue[player][match.QueueFirst[player]];
+            if (queued.Tick > match.Tick || inputs[player].Count + queued.Input.Count > MAX_TICK_MOVES)
+                break;
+            if (queued.Tick < match.Tick)
+            {
+                Local.LateInputs = Local.LateInputs + 1;
+                Local.LateTicks = Local.LateTicks + match.Tick - queued.Tick;
+            }
+            std::memcpy(inputs[player].Moves + inputs[player].Count, queued.Input.Moves, queued.Input.Count);
+            inputs[player].Count = inputs[player].Count + queued.Input.Count;
+            match.QueueFirst[player] = (match.QueueFirst[player] + 1) % INPUT_QUEUE;
+            match.QueueCount[player] = match.QueueCount[player] - 1;
+        }
+        moved = moved || inputs[player].Count > 0;
+    }
+
+    if (match.Mode == MODE_VERSUS)
+        RollbackSession::SimulateTick(*match.Board[0], *match.Board[1], inputs[0], inputs[1]);
+    else
+        RunTickInput(*match.Board[0], inputs[0]);
+    Local.Ticks = Local.Ticks + 1;
+
+    if (moved)
+    {
+        GameBoard *boards[SERVER_MAX_BOARDS] = { match.Board[0].get(), match.Board[1].get() };
+        uint32_t hash = MatchHash(boards, match.Boards);
+        uint8_t payload[8 + SERVER_MAX_BOARDS * (1 + MAX_TICK_MOVES)];
+        size_t size = 8;
+        std::memcpy(payload, &match.Tick, sizeof(match.Tick));
+        std::memcpy(payload + 4, &hash, sizeof(hash));
+        for (unsigned int player = 0; player < match.Boards; player++)
+        {
+            payload[size] = inputs[player].Count;
+            std::memcpy(payload + size + 1, inputs[player].Moves, inputs[player].Count);
+            size = size + 1 + inputs[player].Count;
+        }
+        for (unsigned int player = 0; player < match.Boards; player++)
+        {
+            if (match.Clients[player] >= 0)
+                Send(match.Clients[player], MSG_TICK, payload, size);
+        }
+
+        // the frames of the tick are encoded once for all the spectators
+        for (unsigned int player = 0; player < match.Boards && match.FirstSpectator >= 0; player++)
+        {
+            uint8_t frame[1 + SpectatorEncoder::MAX_FRAME_SIZE];
+            frame[0] = player;
+            size_t frameSize = match.Encoder[player].Encode(*match.Board[player], frame + 1);
+            for (int spectator = match.FirstSpectator; frameSize > 0 && spectator >= 0; spectator = Clients[spectator].NextSpectator)
+                Send(spectator, MSG_FRAME, frame, 1 + frameSize);
+        }
+    }
+
+    // a versus is won by the last board standing, a sprint by clearing its lines
+    const GameBoard& first = *match.Board[0];
+    if (match.Mode == MODE_SPRINT && (first.IsOver || first.LinesCleared >= SPRINT_LINES))
+        EndMatch(match, first.IsOver ? NO_WINNER : 0);
+    else if (match.Mode == MODE_VERSUS && (first.IsOver || match.Board[1]->IsOver))
+        EndMatch(match, first.IsOver == match.Board[1]->IsOver ? NO_WINNER : (first.IsOver ? 1 : 0));
+    else if (match.Tick + 1 >= MAX_MATCH_TICKS)
+        EndMatch(match, NO_WINNER);
+    else
+        match.Tick = match.Tick + 1;
+}
+
+void ServerShard::EndMatch(ServerMatch& match, uint8_t winner)
+{
+    uint8_t payload[5 + SERVER_MAX_BOARDS * 12];
+    std::memcpy(payload, &match.Tick, sizeof(match.Tick));
+    payload[4] = winner;
+    for (unsigned int player = 0; player < match.Boards; player++)
+    {
+        const GameBoard& board = *match.Board[player];
+        uint32_t results[3] = { board.PiecesPlaced, board.LinesCleared, board.LinesSent };
+        std::memcpy(payload + 5 + player * 12, results, sizeof(results));
+    }
+
+    for (unsigned int player = 0; player < match.Boards; player++)
+    {
+        int client = match.Clients[player];
+        if (client < 0)
+            continue;
+        Send(client, MSG_END, payload, 5 + match.Boards * 12);
+        Clients[client].Match = -1;
+    }
+
+    // spectators ask for another match
+    while (match.FirstSpectator >= 0)
+    {
+        int spectator = match.FirstSpectator;
+        Send(spectator, MSG_END, payload, 5 + match.Boards * 12);
+        RemoveSpectator(spectator);
+    }
+
+    match.Active = false;
+    FreeMatches.push_back(&match - Matches.data());
+    Local.Matches = Local.Matches - 1;
+    Local.MatchesPlayed = Local.MatchesPlayed + 1;
+}
+
+void ServerShard::Send(int client, ServerMessageType type, const uint8_t *payload, size_t size)
+{
+    ServerClient& slot = Clients[client];
+    size_t written = ServerProtocol::Write(slot.Out + slot.OutSize, CLIENT_OUT_SIZE - slot.OutSize, type, payload, size);
+    if (written == 0)
+        slot.Dropped = true;
+    slot.OutSize = slot.OutSize + written;
+}
+
+void ServerShard::Flush(int client)
+{
+    ServerClient& slot = Clients[client];
+    ssize_t sent = send(slot.Socket, slot.Out, slot.OutSize, MSG_NOSIGNAL);
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        slot.Dropped = true;
+        return;
+    }
+    if (sent > 0)
+    {
+        std::memmove(slot.Out, slot.Out + sent, slot.OutSize - sent);
+        slot.OutSize = slot.OutSize - sent;
+        Local.BytesOut = Local.BytesOut + sent;
+    }
+
+    // the rest goes once the socket is writable again
+    if ((slot.OutSize > 0) != slot.Writing)
+        Watch(client, slot.OutSize > 0);
+}
+
+void ServerShard::Disconnect(int client)
+{
+    ServerClient& slot = Clients[client];
+    if (WaitingClient == client)
+        WaitingClient = -1;
+
+    // the opponent of a versus wins on the next tick (see StepMatch), a sprint just ends
+    if (slot.Spectating)
+        RemoveSpectator(client);
+    else if (slot.Match >= 0)
+    {
+        ServerMatch& match = Matches[slot.Match];
+        match.Clients[slot.Player] = -1;
+        if (match.Mode == MODE_SPRINT)
+            EndMatch(match, NO_WINNER);
+    }
+
+    epoll_ctl(Epoll, EPOLL_CTL_DEL, slot.Socket, nullptr);
+    close(slot.Socket);
+    slot.Socket = -1;
+    FreeClients.push_back(client);
+    Local.Clients = Local.Clients - 1;
+}
+
+MatchServer::MatchServer(uint16_t port, unsigned int shards, unsigned int matchesPerShard, unsigned int garbageDelay, unsigned int garbageMessiness, unsigned int seed)
+:   Running(false)
+{
+    for (unsigned int shard = 0; shard < std::max(1u, shards); shard++)
+        Shards.push_back(std::make_unique<ServerShard>(port, matchesPerShard, garbageDelay, garbageMessiness, seed + shard));
+}
+
+MatchServer::~MatchServer()
+{
+    Stop();
+}
+
+void MatchServer::Start()
+{
+    if (Running)
+        return;
+
+    Running = true;
+    for (auto& shard: Shards)
+        Threads.emplace_back([this, &shard]() { shard->Run(Running); });
+}
+
+void MatchServer::Stop()
+{
+    Running = false;
+    for (std::thread& thread: Threads)
+        thread.join();
+    Threads.clear();
+}
+
+ServerStats MatchServer::Stats() const
+{
+    ServerStats total;
+    for (const auto& shard: Shards)
+    {
+        ServerStats stats = shard->Stats();
+        total.Clients = total.Clients + stats.Clients;
+        total.Spectators = total.Spectators + stats.Spectators;
+        total.Matches = total.Matches + stats.Matches;
+        total.MatchesPlayed = total.MatchesPlayed + stats.MatchesPlayed;
+        total.Ticks = total.Ticks + stats.Ticks;
+        total.Inputs = total.Inputs + stats.Inputs;
+        total.LateInputs = total.LateInputs + stats.LateInputs;
+        total.LateTicks = total.LateTicks + stats.LateTicks;
+        total.BytesIn = total.BytesIn + stats.BytesIn;
+        total.BytesOut = total.BytesOut + stats.BytesOut;
+        total.Rejected = total.Rejected + stats.Rejected;
+        total.MaxFrameSeconds = std::max(total.MaxFrameSeconds, stats.MaxFrameSeconds);
+    }
+    return total;
+}
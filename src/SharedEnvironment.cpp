@@ -0,0 +1,279 @@
+#include "SharedEnvironment.h"
+#include "Simulation.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <new>
+
+// offsets of the arrays inside a slot, every array starts on a cache line
+struct SlotLayout
+{
+    uint64_t Step, Rows, Current, Hold, Queue, Lines, Over, Valid, ValidHold, ObservationSize;
+    uint64_t ActionHold, ActionRotation, ActionColumn, ActionSize;
+};
+
+static uint64_t Align(uint64_t offset)
+{
+    return (offset + 63) & ~uint64_t(63);
+}
+
+static SlotLayout Layout(uint64_t boards)
+{
+    SlotLayout layout;
+    layout.Step = 0;
+    layout.Rows = Align(layout.Step + sizeof(uint64_t));
+    layout.Current = Align(layout.Rows + MATRIX_ROWS * boards * sizeof(uint16_t));
+    layout.Hold = Align(layout.Current + boards);
+    layout.Queue = Align(layout.Hold + boards);
+    layout.Lines = Align(layout.Queue + PREVIEW_NUMBER * boards);
+    layout.Over = Align(layout.Lines + boards);
+    layout.Valid = Align(layout.Over + boards);
+    layout.ValidHold = Align(layout.Valid + boards * sizeof(uint64_t));
+    layout.ObservationSize = Align(layout.ValidHold + boards * sizeof(uint64_t));
+
+    layout.ActionHold = 0;
+    layout.ActionRotation = Align(boards);
+    layout.ActionColumn = Align(layout.ActionRotation + boards);
+    layout.ActionSize = Align(layout.ActionColumn + boards);
+    return layout;
+}
+
+SharedEnvironmentRegion::SharedEnvironmentRegion(const std::string& name, uint32_t boards, uint32_t slots)
+:   Header(nullptr),
+    Name(name),
+    Owner(true),
+    Memory(nullptr),
+    Length(0)
+{
+    if (boards == 0 || slots == 0)
+        throw std::runtime_error("shared environment needs at least one board and one slot");
+
+    SlotLayout layout = Layout(boards);
+    uint64_t observationOffset = Align(sizeof(SharedEnvironmentHeader));
+    uint64_t actionOffset = observationOffset + slots * layout.ObservationSize;
+    Length = actionOffset + slots * layout.ActionSize;
+
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        throw std::runtime_error("failed to create shared memory " + name + ": " + std::strerror(errno));
+    if (ftruncate(fd, Length) != 0)
+    {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("failed to size shared memory " + name + ": " + std::strerror(errno));
+    }
+
+    Memory = mmap(nullptr, Length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (Memory == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("failed to map shared memory " + name + ": " + std::strerror(errno));
+    }
+
+    // the magic is written last, a trainer opening the region early sees an invalid header
+    Header = new (Memory) SharedEnvironmentHeader();
+    Header->Version = SharedEnvironmentHeader::VERSION;
+    Header->Boards = boards;
+    Header->Slots = slots;
+    Header->ObservationOffset = observationOffset;
+    Header->ObservationStride = layout.ObservationSize;
+    Header->ActionOffset = actionOffset;
+    Header->ActionStride = layout.ActionSize;
+    Header->Size = Length;
+    Header->Observations.store(0, std::memory_order_relaxed);
+    Header->Actions.store(0, std::memory_order_relaxed);
+    Header->Closed.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Header->Magic = SharedEnvironmentHeader::MAGIC;
+}
+
+SharedEnvironmentRegion::SharedEnvironmentRegion(const std::string& name)
+:   Header(nullptr),
+    Name(name),
+    Owner(false),
+    Memory(nullptr),
+    Length(0)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        throw std::runtime_error("failed to open shared memory " + name + ": " + std::strerror(errno));
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SharedEnvironmentHeader))
+    {
+        close(fd);
+        throw std::runtime_error("shared memory " + name + " is not a shared environment");
+    }
+    Length = info.st_size;
+
+    Memory = mmap(nullptr, Length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (Memory == MAP_FAILED)
+        throw std::runtime_error("failed to map shared memory " + name + ": " + std::strerror(errno));
+
+    Header = static_cast<SharedEnvironmentHeader*>(Memory);
+    if (Header->Magic != SharedEnvironmentHeader::MAGIC || Header->Version != SharedEnvironmentHeader::VERSION || Header->Size != Length)
+    {
+        munmap(Memory, Length);
+        throw std::runtime_error("shared memory " + name + " has an unsupported layout");
+    }
+}
+
+SharedEnvironmentRegion::~SharedEnvironmentRegion()
+{
+    munmap(Memory, Length);
+    if (Owner)
+        shm_unlink(Name.c_str());
+}
+
+SharedObservation SharedEnvironmentRegion::Observation(uint32_t step) const
+{
+    SlotLayout layout = Layout(Header->Boards);
+    uint8_t *slot = static_cast<uint8_t*>(Memory) + Header->ObservationOffset + (step % Header->Slots) * Header->ObservationStride;
+
+    SharedObservation observation;
+    observation.Step = reinterpret_cast<uint64_t*>(slot + layout.Step);
+    observation.Rows = reinterpret_cast<uint16_t*>(slot + layout.Rows);
+    observation.Current = slot + layout.Current;
+    observation.Hold = slot + layout.Hold;
+    observation.Queue = slot + layout.Queue;
+    observation.Lines = slot + layout.Lines;
+    observation.Over = slot + layout.Over;
+    observation.Valid = reinterpret_cast<uint64_t*>(slot + layout.Valid);
+    observation.ValidHold = reinterpret_cast<uint64_t*>(slot + layout.ValidHold);
+    return observation;
+}
+
+SharedActions SharedEnvironmentRegion::Actions(uint32_t step) const
+{
+    SlotLayout layout = Layout(Header->Boards);
+    uint8_t *slot = static_cast<uint8_t*>(Memory) + Header->ActionOffset + (step % Header->Slots) * Header->ActionStride;
+
+    SharedActions actions;
+    actions.Hold = slot + layout.ActionHold;
+    actions.Rotation = slot + layout.ActionRotation;
+    actions.Column = reinterpret_cast<int8_t*>(slot + layout.ActionColumn);
+    return actions;
+}
+
+uint32_t SharedEnvironmentRegion::Wait(const std::atomic<uint32_t>& counter, uint32_t seen) const
+{
+    // the other side usually answers within microseconds, spin a little before sleeping
+    for (int spin = 0; spin < 2000; spin++)
+    {
+        uint32_t value = counter.load(std::memory_order_acquire);
+        if (value != seen || Header->Closed.load(std::memory_order_acquire))
+            return value;
+    }
+
+    while (true)
+    {
+        uint32_t value = counter.load(std::memory_order_acquire);
+        if (value != seen || Header->Closed.load(std::memory_order_acquire))
+            return value;
+        // returns immediately if the counter already moved, so no wake up can be missed
+        syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&counter), FUTEX_WAIT, seen, nullptr, nullptr, 0);
+    }
+}
+
+void SharedEnvironmentRegion::Publish(std::atomic<uint32_t>& counter, uint32_t value) const
+{
+    counter.store(value, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&counter), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+void SharedEnvironmentRegion::Close() const
+{
+    Header->Closed.store(1, std::memory_order_release);
+    Publish(Header->Observations, Header->Observations.load(std::memory_order_relaxed) + 1);
+    Publish(Header->Actions, Header->Actions.load(std::memory_order_relaxed) + 1);
+}
+
+SharedEnvironment::SharedEnvironment(const std::string& name, uint32_t boards, uint32_t slots, uint64_t seed)
+:   Region(name, boards, slots),
+    Pieces(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE),
+    Batch(boards, Pieces),
+    Seed(seed),
+    Episodes(boards, 0),
+    StepActions(boards),
+    StepLines(boards, 0)
+{
+    for (uint32_t board = 0; board < boards; board++)
+        ResetBoard(board);
+}
+
+void SharedEnvironment::ResetBoard(uint32_t board)
+{
+    Batch.Reset(board, Simulation::GameSeed(Seed, (static_cast<uint64_t>(Episodes[board]) << 32) | board));
+    Episodes[board] = Episodes[board] + 1;
+}
+
+uint64_t SharedEnvironment::Run()
+{
+    const SharedEnvironmentHeader& header = *Region.Header;
+    uint32_t boards = header.Boards;
+    std::vector<uint8_t> over(boards, 0);
+
+    uint32_t step = 0;
+    WriteObservation(step, over);
+    Region.Publish(Region.Header->Observations, step + 1);
+
+    while (true)
+    {
+        Region.Wait(header.Actions, step);
+        if (header.Closed.load(std::memory_order_acquire))
+            break;
+
+        SharedActions actions = Region.Actions(step);
+        for (uint32_t board = 0; board < boards; board++)
+            StepActions[board] = BoardAction{ actions.Hold[board], actions.Rotation[board], actions.Column[board] };
+        Batch.Step(StepActions.data(), StepLines.data());
+
+        for (uint32_t board = 0; board < boards; board++)
+        {
+            over[board] = Batch.IsOver[board];
+            if (over[board])
+                ResetBoard(board);
+        }
+
+        step = step + 1;
+        WriteObservation(step, over);
+        Region.Publish(Region.Header->Observations, step + 1);
+    }
+
+    Region.Close();
+    return step;
+}
+
+void SharedEnvironment::WriteObservation(uint32_t step, const std::vector<uint8_t>& over)
+{
+    uint32_t boards = Region.Header->Boards;
+    SharedObservation observation = Region.Observation(step);
+
+    *observation.Step = step;
+    std::memcpy(observation.Rows, Batch.Rows.data(), MATRIX_ROWS * boards * sizeof(uint16_t));
+    std::memcpy(observation.Current, Batch.Current.data(), boards);
+    std::memcpy(observation.Hold, Batch.Hold.data(), boards);
+    std::memcpy(observation.Lines, StepLines.data(), boards);
+    std::memcpy(observation.Over, over.data(), boards);
+
+    for (uint32_t board = 0; board < boards; board++)
+    {
+        for (int i = 0; i < PREVIEW_NUMBER; i++)
+            observation.Queue[i * boards + board] = Batch.Preview(board, i);
+
+        MinoType current = static_cast<MinoType>(Batch.Current[board]);
+        MinoType held = Batch.Hold[board] == EMPTY ? Batch.Preview(board, 0) : static_cast<MinoType>(Batch.Hold[board]);
+        observation.Valid[board] = Batch.ValidPlacements(board, current);
+        observation.ValidHold[board] = Batch.ValidPlacements(board, held);
+    }
+}
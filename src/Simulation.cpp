@@ -0,0 +1,197 @@
+#include "Simulation.h"
+
+#include <chrono>
+
+// the position a piece spawned on: board, piece in play, hold and previews
+static void RecordPosition(TrainingRecord& record, const GameBoard& board)
+{
+    Bitboard bitboard;
+    bitboard.FromMatrix(board.Matrix);
+    std::copy(std::begin(bitboard.Rows), std::end(bitboard.Rows), record.Rows);
+    record.Current = board.CurrentPiece;
+    record.Hold = board.HoldPiece;
+    auto next = board.TetrominoQueue.begin();
+    for (int i = 0; i < PREVIEW_NUMBER; i++)
+        record.Queue[i] = next != board.TetrominoQueue.end() ? *next++ : EMPTY;
+}
+
+// what the placement did
+static void RecordResult(TrainingRecord& record, const GameBoard& board, unsigned int lines)
+{
+    record.Lines = board.LinesCleared - lines;
+    record.Spin = board.LastSpin;
+    record.Combo = std::min(board.Combo, 0xFFFFu);
+}
+
+// records the placements of a replayed board, from the moves that led to each hard drop
+class ReplayRecorder : public PlacementObserver
+{
+    public:
+        unsigned int Records;
+
+        ReplayRecorder(TrainingExporter& exporter, const GameBoard& board)
+        :   Records(0),
+            Exporter(exporter),
+            Record(),
+            Lines(0)
+        {
+            RecordPosition(Record, board);
+        }
+
+        void Placing(const GameBoard& board) override
+        {
+            Record.UseHold = board.HoldUsed;
+            Record.Piece = board.CurrentPiece;
+            Record.Rotation = board.CurrentRotation;
+            Record.Row = board.GhostPosition.x;
+            Record.Column = board.GhostPosition.y;
+            Lines = board.LinesCleared;
+        }
+
+        void Placed(const GameBoard& board) override
+        {
+            RecordResult(Record, board, Lines);
+            Exporter.Add(Record);
+            Records = Records + 1;
+            RecordPosition(Record, board);
+        }
+
+    private:
+        TrainingExporter& Exporter;
+        TrainingRecord Record;
+        unsigned int Lines;
+};
+
+GameResult Simulation::PlayBotGame(Bot& bot, unsigned int bagSeed, unsigned int maxPieces, TrainingExporter *exporter)
+{
+    GameBoard board(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+    board.Load(bagSeed);
+    board.Start();
+
+    GameResult result;
+    while (!board.IsOver && board.PiecesPlaced < maxPieces)
+    {
+        BotDecision decision = bot.Think(board);
+        if (!decision.Valid)
+        {
+            result.ToppedOut = true;
+            break;
+        }
+
+        TrainingRecord record;
+        if (exporter)
+        {
+            RecordPosition(record, board);
+            record.UseHold = decision.UseHold;
+            record.Piece = decision.Target.Piece;
+            record.Rotation = decision.Target.Rotation;
+            record.Row = decision.Target.Position.x;
+            record.Column = decision.Target.Position.y;
+        }
+
+        unsigned int lines = board.LinesCleared;
+        board.ExecuteMoves(decision.Moves);
+        if (board.LinesCleared - lines == 4)
+            result.Tetrises = result.Tetrises + 1;
+
+        if (exporter)
+        {
+            RecordResult(record, board, lines);
+            exporter->Add(record);
+        }
+    }
+
+    result.Pieces = board.PiecesPlaced;
+    result.Lines = board.LinesCleared;
+    result.Attack = board.LinesSent;
+    result.ToppedOut = result.ToppedOut || board.IsOver;
+    return result;
+}
+
+MatchResult Simulation::PlayBotMatch(Bot& first, Bot& second, const float pps[2], unsigned int bagSeed, unsigned int garbageDelay, unsigned int garbageMessiness, unsigned int maxPieces)
+{
+    Bot *bots[2] = { &first, &second };
+    GameBoard firstBoard(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE), secondBoard(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+    GameBoard *boards[2] = { &firstBoard, &secondBoard };
+    for (int i = 0; i < 2; i++)
+        boards[i]->LoadMatch(bagSeed, i, garbageDelay, garbageMessiness);
+
+    MatchResult result;
+    bool toppedOut[2] = { false, false };
+    while (true)
+    {
+        // next placement on the clock, among the boards that still have pieces to place
+        int turn = -1;
+        double turnTime = 0.0;
+        for (int i = 0; i < 2; i++)
+        {
+            double time = (boards[i]->PiecesPlaced + 1) / static_cast<double>(pps[i]);
+            if (boards[i]->PiecesPlaced < maxPieces && (turn < 0 || time < turnTime))
+            {
+                turn = i;
+                turnTime = time;
+            }
+        }
+        if (turn < 0)
+            break;
+
+        auto start = std::chrono::steady_clock::now();
+        BotDecision decision = bots[turn]->Think(*boards[turn]);
+        result.ThinkSeconds[turn] = result.ThinkSeconds[turn] + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.Seconds = turnTime;
+
+        unsigned int placed = boards[turn]->PiecesPlaced;
+        unsigned int lines = boards[turn]->LinesCleared;
+        if (decision.Valid)
+            boards[turn]->ExecuteMoves(decision.Moves);
+        if (boards[turn]->LinesCleared - lines == 4)
+            result.Players[turn].Tetrises = result.Players[turn].Tetrises + 1;
+        toppedOut[turn] = !decision.Valid || boards[turn]->IsOver;
+        if (boards[turn]->PiecesPlaced != placed && boards[turn]->Outgoing > 0)
+            boards[1 - turn]->ReceiveGarbage(boards[turn]->Outgoing);
+        if (toppedOut[turn])
+        {
+            result.Winner = 1 - turn;
+            break;
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        result.Players[i].Pieces = boards[i]->PiecesPlaced;
+        result.Players[i].Lines = boards[i]->LinesCleared;
+        result.Players[i].Attack = boards[i]->LinesSent;
+        result.Players[i].ToppedOut = toppedOut[i];
+    }
+    return result;
+}
+
+unsigned int Simulation::ExportReplay(std::shared_ptr<const VersusReplay> replay, TrainingExporter& exporter)
+{
+    VersusMatch match(std::vector<InputSource>(replay->Boards, INPUT_REPLAY), BotConfig(), 0.0f, 0, 0, nullptr, replay, 1);
+    match.Start(0);
+
+    std::vector<std::unique_ptr<ReplayRecorder>> recorders;
+    for (VersusPlayer& player: match.Players)
+    {
+        recorders.push_back(std::make_unique<ReplayRecorder>(exporter, *player.Board));
+        player.Observer = recorders.back().get();
+    }
+
+    while (!match.IsOver() && match.Tick < replay->EndTick())
+        match.Step();
+
+    unsigned int records = 0;
+    for (const std::unique_ptr<ReplayRecorder>& recorder: recorders)
+        records = records + recorder->Records;
+    return records;
+}
+
+unsigned int Simulation::GameSeed(uint64_t runSeed, uint64_t index)
+{
+    // splitmix64 finalizer, consecutive indices give unrelated seeds
+    uint64_t z = runSeed + (index + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<unsigned int>(z ^ (z >> 31));
+}
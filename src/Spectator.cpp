@@ -0,0 +1,396 @@
+#include "Spectator.h"
+
+#include <cstring>
+#include <algorithm>
+
+static const unsigned int ROW_MASK_BYTES = 5;
+
+static uint8_t *WriteVarint(uint8_t *out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value = value >> 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+// false past the end of the frame or over 32 bits
+static bool ReadVarint(const uint8_t *&in, const uint8_t *end, uint32_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 35; shift = shift + 7)
+    {
+        if (in == end)
+            return false;
+        uint8_t byte = *in++;
+        value = value | (uint32_t(byte & 0x7F) << shift);
+        if ((byte & 0x80) == 0)
+            return shift < 28 || byte < 0x10;
+    }
+    return false;
+}
+
+void SpectatorView::Capture(const GameBoardState& board)
+{
+    for (int i = 0; i < MATRIX_ROWS; i++)
+    {
+        for (int j = 0; j < MATRIX_COLS; j++)
+            Matrix[i][j] = static_cast<uint8_t>(board.Matrix[i][j]);
+    }
+
+    QueueSize = 0;
+    for (MinoType piece: board.TetrominoQueue)
+        Queue[QueueSize++] = static_cast<uint8_t>(piece);
+
+    CurrentPiece = static_cast<uint8_t>(board.CurrentPiece);
+    CurrentRotation = static_cast<uint8_t>(board.CurrentRotation);
+    HoldPiece = static_cast<uint8_t>(board.HoldPiece);
+    CurrentRow = static_cast<int8_t>(board.CurrentPosition.x);
+    CurrentCol = static_cast<int8_t>(board.CurrentPosition.y);
+    GhostRow = static_cast<int8_t>(board.GhostPosition.x);
+    HoldUsed = board.HoldUsed;
+    IsOver = board.IsOver;
+
+    LinesCleared = board.LinesCleared;
+    PiecesPlaced = board.PiecesPlaced;
+    Combo = board.Combo;
+    BackToBack = board.BackToBack;
+    LinesSent = board.LinesSent;
+    LastAttack = board.LastAttack;
+    LastSpin = board.LastSpin;
+
+    PendingPackets = static_cast<uint8_t>(board.PendingPackets);
+    for (unsigned int i = 0; i < MAX_GARBAGE_PACKETS; i++)
+    {
+        const GarbagePacket& packet = board.PendingGarbage[i];
+        bool pending = i < board.PendingPackets;
+        PendingLines[i] = pending ? static_cast<uint8_t>(std::min(packet.Lines, 255u)) : 0;
+        PendingWait[i] = pending && packet.ReadyAt > board.PiecesPlaced ? static_cast<uint8_t>(std::min(packet.ReadyAt - board.PiecesPlaced, 255u)) : 0;
+    }
+}
+
+void SpectatorView::Restore(GameBoardState& board) const
+{
+    for (int i = 0; i < MATRIX_ROWS; i++)
+    {
+        for (int j = 0; j < MATRIX_COLS; j++)
+            board.Matrix[i][j] = static_cast<MinoType>(Matrix[i][j]);
+    }
+
+    board.TetrominoQueue.clear();
+    for (unsigned int i = 0; i < QueueSize; i++)
+        board.TetrominoQueue.push_back(static_cast<MinoType>(Queue[i]));
+
+    board.CurrentPiece = static_cast<MinoType>(CurrentPiece);
+    board.CurrentRotation = CurrentRotation;
+    board.HoldPiece = static_cast<MinoType>(HoldPiece);
+    board.CurrentPosition = glm::ivec2(CurrentRow, CurrentCol);
+    board.GhostPosition = glm::ivec2(GhostRow, CurrentCol);
+    board.HoldUsed = HoldUsed;
+    board.IsOver = IsOver;
+
+    board.LinesCleared = LinesCleared;
+    board.PiecesPlaced = PiecesPlaced;
+    board.Combo = Combo;
+    board.BackToBack = BackToBack;
+    board.LinesSent = LinesSent;
+    board.LastAttack = LastAttack;
+    board.LastSpin = static_cast<SpinType>(LastSpin);
+
+    board.PendingPackets = PendingPackets;
+    for (unsigned int i = 0; i < PendingPackets; i++)
+        board.PendingGarbage[i] = GarbagePacket{ PendingLines[i], PiecesPlaced + PendingWait[i] };
+}
+
+bool SpectatorView::operator==(const SpectatorView& other) const
+{
+    return std::memcmp(Matrix, other.Matrix, sizeof(Matrix)) == 0
+        && QueueSize == other.QueueSize && std::equal(Queue, Queue + QueueSize, other.Queue)
+        && CurrentPiece == other.CurrentPiece && CurrentRotation == other.CurrentRotation && HoldPiece == other.HoldPiece
+        && CurrentRow == other.CurrentRow && CurrentCol == other.CurrentCol && GhostRow == other.GhostRow
+        && HoldUsed == other.HoldUsed && IsOver == other.IsOver
+        && LinesCleared == other.LinesCleared && PiecesPlaced == other.PiecesPlaced && Combo == other.Combo
+        && BackToBack == other.BackToBack && LinesSent == other.LinesSent && LastAttack == other.LastAttack && LastSpin == other.LastSpin
+        && PendingPackets == other.PendingPackets
+        && std::equal(PendingLines, PendingLines + PendingPackets, other.PendingLines)
+        && std::equal(PendingWait, PendingWait + PendingPackets, other.PendingWait);
+}
+
+SpectatorEncoder::SpectatorEncoder(unsigned int keyframeInterval)
+:   Last(),
+    Sequence(0),
+    Started(false),
+    KeyframeInterval(keyframeInterval),
+    SinceKeyframe(0)
+{
+
+}
+
+void SpectatorEncoder::Reset()
+{
+    Started = false;
+}
+
+size_t SpectatorEncoder::Encode(const GameBoardState& board, uint8_t *buffer)
+{
+    SpectatorView current = {};
+    current.Capture(board);
+
+    bool keyframe = !Started || (KeyframeInterval > 0 && SinceKeyframe + 1 >= KeyframeInterval);
+    if (!keyframe && current == Last)
+        return 0;
+
+    Sequence = static_cast<uint8_t>(Sequence + 1);
+    size_t size = keyframe ? Write(SpectatorView(), current, true, Sequence, buffer) : Write(Last, current, false, Sequence, buffer);
+    SinceKeyframe = keyframe ? 0 : SinceKeyframe + 1;
+    Started = true;
+    Last = current;
+    return size;
+}
+
+size_t SpectatorEncoder::EncodeKeyframe(uint8_t *buffer) const
+{
+    if (!Started)
+        return 0;
+    return Write(SpectatorView(), Last, true, Sequence, buffer);
+}
+
+size_t SpectatorEncoder::Write(const SpectatorView& from, const SpectatorView& to, bool keyframe, uint8_t sequence, uint8_t *buffer) const
+{
+    uint8_t flags = keyframe ? FRAME_KEY : 0;
+    uint8_t *out = buffer + 2;
+
+    // rows, a keyframe only has the ones that aren't empty (from is an empty board)
+    uint64_t changed = 0;
+    for (int i = 0; i < MATRIX_ROWS; i++)
+    {
+        if (std::memcmp(from.Matrix[i], to.Matrix[i], MATRIX_COLS) != 0)
+            changed = changed | (uint64_t(1) << i);
+    }
+    if (changed != 0 || keyframe)
+    {
+        flags = flags | FRAME_ROWS;
+        for (unsigned int i = 0; i < ROW_MASK_BYTES; i++)
+            *out++ = static_cast<uint8_t>(changed >> (8 * i));
+        for (int i = 0; i < MATRIX_ROWS; i++)
+        {
+            if ((changed & (uint64_t(1) << i)) == 0)
+                continue;
+            int start = 0;
+            for (int j = 1; j <= MATRIX_COLS; j++)
+            {
+                if (j < MATRIX_COLS && to.Matrix[i][j] == to.Matrix[i][start])
+                    continue;
+                *out++ = static_cast<uint8_t>(to.Matrix[i][start] << 4 | (j - start - 1));
+                start = j;
+            }
+        }
+    }
+
+    // the queue moves forward and gets bags at the back: the pieces left of the old one are found at
+    // the front of the new one, only the others are sent
+    unsigned int advance = from.QueueSize;
+    for (unsigned int i = 0; i < from.QueueSize; i++)
+    {
+        unsigned int kept = from.QueueSize - i;
+        if (kept <= to.QueueSize && std::equal(from.Queue + i, from.Queue + from.QueueSize, to.Queue))
+        {
+            advance = i;
+            break;
+        }
+    }
+    unsigned int added = to.QueueSize - (from.QueueSize - advance);
+    if (advance > 0 || added > 0 || keyframe)
+    {
+        flags = flags | FRAME_QUEUE;
+        *out++ = static_cast<uint8_t>(advance);
+        *out++ = static_cast<uint8_t>(added);
+        const uint8_t *pieces = to.Queue + (to.QueueSize - added);
+        for (unsigned int i = 0; i < added; i = i + 2)
+            *out++ = static_cast<uint8_t>(pieces[i] | (i + 1 < added ? pieces[i + 1] << 4 : 0));
+    }
+
+    if (keyframe || from.CurrentPiece != to.CurrentPiece || from.CurrentRotation != to.CurrentRotation
+        || from.CurrentRow != to.CurrentRow || from.CurrentCol != to.CurrentCol || from.GhostRow != to.GhostRow)
+    {
+        flags = flags | FRAME_PIECE;
+        *out++ = static_cast<uint8_t>(to.CurrentPiece << 4 | to.CurrentRotation);
+        *out++ = static_cast<uint8_t>(to.CurrentRow);
+        *out++ = static_cast<uint8_t>(to.CurrentCol);
+        *out++ = static_cast<uint8_t>(to.GhostRow);
+    }
+
+    if (keyframe || from.HoldPiece != to.HoldPiece || from.HoldUsed != to.HoldUsed)
+    {
+        flags = flags | FRAME_HOLD;
+        *out++ = static_cast<uint8_t>((to.HoldUsed ? 0x80 : 0) | to.HoldPiece);
+    }
+
+    if (keyframe || from.LinesCleared != to.LinesCleared || from.PiecesPlaced != to.PiecesPlaced || from.Combo != to.Combo
+        || from.BackToBack != to.BackToBack || from.LinesSent != to.LinesSent || from.LastAttack != to.LastAttack || from.LastSpin != to.LastSpin)
+    {
+        flags = flags | FRAME_COUNTERS;
+        out = WriteVarint(out, to.LinesCleared);
+        out = WriteVarint(out, to.PiecesPlaced);
+        out = WriteVarint(out, to.Combo);
+        out = WriteVarint(out, to.BackToBack);
+        out = WriteVarint(out, to.LinesSent);
+        out = WriteVarint(out, to.LastAttack);
+        *out++ = to.LastSpin;
+    }
+
+    if (keyframe || from.PendingPackets != to.PendingPackets
+        || !std::equal(from.PendingLines, from.PendingLines + from.PendingPackets, to.PendingLines)
+        || !std::equal(from.PendingWait, from.PendingWait + from.PendingPackets, to.PendingWait))
+    {
+        flags = flags | FRAME_GARBAGE;
+        *out++ = to.PendingPackets;
+        for (unsigned int i = 0; i < to.PendingPackets; i++)
+        {
+            *out++ = to.PendingLines[i];
+            *out++ = to.PendingWait[i];
+        }
+    }
+
+    if (to.IsOver)
+        flags = flags | FRAME_OVER;
+    buffer[0] = flags;
+    buffer[1] = sequence;
+    return out - buffer;
+}
+
+SpectatorDecoder::SpectatorDecoder()
+:   View(),
+    Synced(false),
+    Frames(0),
+    Skipped(0),
+    Sequence(0)
+{
+
+}
+
+bool SpectatorDecoder::Apply(const uint8_t *frame, size_t size, GameBoardState& board)
+{
+    if (size < 2)
+        return false;
+
+    uint8_t flags = frame[0];
+    uint8_t sequence = frame[1];
+    bool keyframe = (flags & FRAME_KEY) != 0;
+    if (!keyframe && (!Synced || sequence != static_cast<uint8_t>(Sequence + 1)))
+    {
+        // a frame was lost, nothing applies until the next keyframe
+        Synced = false;
+        Skipped = Skipped + 1;
+        return false;
+    }
+
+    const uint8_t *in = frame + 2;
+    const uint8_t *end = frame + size;
+    SpectatorView next = keyframe ? SpectatorView() : View;
+
+    if (flags & FRAME_ROWS)
+    {
+        if (end - in < ptrdiff_t(ROW_MASK_BYTES))
+            return false;
+        uint64_t changed = 0;
+        for (unsigned int i = 0; i < ROW_MASK_BYTES; i++)
+            changed = changed | (uint64_t(*in++) << (8 * i));
+        if (changed >> MATRIX_ROWS)
+            return false;
+        for (int i = 0; i < MATRIX_ROWS; i++)
+        {
+            if ((changed & (uint64_t(1) << i)) == 0)
+                continue;
+            int column = 0;
+            while (column < MATRIX_COLS)
+            {
+                if (in == end)
+                    return false;
+                uint8_t type = *in >> 4;
+                int length = (*in & 0x0F) + 1;
+                in++;
+                // the matrix only holds minos and garbage, ghosts and previews are drawn over it
+                if (type > SOLID_GARBAGE || column + length > MATRIX_COLS)
+                    return false;
+                std::fill(next.Matrix[i] + column, next.Matrix[i] + column + length, type);
+                column = column + length;
+            }
+        }
+    }
+
+    if (flags & FRAME_QUEUE)
+    {
+        if (end - in < 2)
+            return false;
+        unsigned int advance = *in++;
+        unsigned int added = *in++;
+        if (advance > next.QueueSize || next.QueueSize - advance + added > PieceQueue::CAPACITY || end - in < ptrdiff_t(added + 1) / 2)
+            return false;
+        std::copy(next.Queue + advance, next.Queue + next.QueueSize, next.Queue);
+        next.QueueSize = static_cast<uint8_t>(next.QueueSize - advance);
+        for (unsigned int i = 0; i < added; i++)
+        {
+            uint8_t piece = (in[i / 2] >> (i % 2 == 0 ? 0 : 4)) & 0x0F;
+            if (piece < BLOCK_I || piece > BLOCK_Z)
+                return false;
+            next.Queue[next.QueueSize++] = piece;
+        }
+        in = in + (added + 1) / 2;
+    }
+
+    if (flags & FRAME_PIECE)
+    {
+        if (end - in < 4 || (in[0] >> 4) > BLOCK_Z || (in[0] & 0x0F) > 3)
+            return false;
+        next.CurrentPiece = in[0] >> 4;
+        next.CurrentRotation = in[0] & 0x0F;
+        next.CurrentRow = static_cast<int8_t>(in[1]);
+        next.CurrentCol = static_cast<int8_t>(in[2]);
+        next.GhostRow = static_cast<int8_t>(in[3]);
+        in = in + 4;
+    }
+
+    if (flags & FRAME_HOLD)
+    {
+        if (in == end || (*in & 0x7F) > BLOCK_Z)
+            return false;
+        next.HoldUsed = (*in & 0x80) != 0;
+        next.HoldPiece = *in & 0x7F;
+        in++;
+    }
+
+    if (flags & FRAME_COUNTERS)
+    {
+        if (!ReadVarint(in, end, next.LinesCleared) || !ReadVarint(in, end, next.PiecesPlaced) || !ReadVarint(in, end, next.Combo)
+            || !ReadVarint(in, end, next.BackToBack) || !ReadVarint(in, end, next.LinesSent) || !ReadVarint(in, end, next.LastAttack)
+            || in == end || *in > SPIN_FULL)
+            return false;
+        next.LastSpin = *in++;
+    }
+
+    if (flags & FRAME_GARBAGE)
+    {
+        if (in == end || *in > MAX_GARBAGE_PACKETS || end - in < 1 + 2 * *in)
+            return false;
+        next.PendingPackets = *in++;
+        for (unsigned int i = 0; i < next.PendingPackets; i++)
+        {
+            next.PendingLines[i] = *in++;
+            next.PendingWait[i] = *in++;
+        }
+    }
+
+    if (in != end)
+        return false;
+    next.IsOver = (flags & FRAME_OVER) != 0;
+
+    View = next;
+    View.Restore(board);
+    Synced = true;
+    Sequence = sequence;
+    Frames = Frames + 1;
+    return true;
+}
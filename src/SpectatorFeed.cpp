@@ -0,0 +1,330 @@
+#include "SpectatorFeed.h"
+
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cctype>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+
+const float SpectatorFeed::RESTART_DELAY = 2.0f;
+const float SpectatorFeed::RECONNECT_DELAY = 1.0f;
+const unsigned int SpectatorFeed::MAX_CATCHUP_TICKS = 4;
+
+// a worker per match at most, the server connections don't need any
+static unsigned int FeedThreads(FeedSource source, unsigned int boards)
+{
+    if (source == FEED_SERVER)
+        return 1;
+    return std::min((boards + 1) / 2, std::max(1u, std::thread::hardware_concurrency()));
+}
+
+SpectatorFeed::SpectatorFeed(FeedSource source, unsigned int boards, const BotConfig& botConfig, float botPPS, unsigned int garbageDelay, unsigned int garbageMessiness, std::shared_ptr<const OpeningBook> book, const std::vector<std::string>& replays, const std::string& server)
+:   Source(source),
+    Boards(boards),
+    Pool(FeedThreads(source, boards)),
+    Fresh(false),
+    Stopping(false),
+    ServerAddress()
+{
+    if (boards < 1 || boards > MAX_SPECTATOR_BOARDS)
+        throw std::runtime_error("the spectator grid shows 1 to " + std::to_string(MAX_SPECTATOR_BOARDS) + " boards");
+
+    std::random_device dev;
+    if (source == FEED_BOTS)
+    {
+        // single threaded bots, each one searches on its own pondering thread. The starts are spread over
+        // a piece, or the first searches of every bot (before any pondering) all compete for the cores
+        unsigned int count = (boards + 1) / 2;
+        float spread = botPPS > 0.0f ? 1.0f / botPPS : 0.0f;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            FeedMatch match = { std::make_unique<VersusMatch>(std::vector<InputSource>{ INPUT_BOT, INPUT_BOT }, botConfig, botPPS, garbageDelay, garbageMessiness, book, nullptr, 1), UINT64_MAX, spread * i / count, 0.0f };
+            match.Match->Start(dev());
+            Matches.push_back(std::move(match));
+        }
+    }
+    else if (source == FEED_REPLAYS)
+    {
+        if (replays.empty())
+            throw std::runtime_error("the spectator grid has no replay to play");
+
+        std::vector<std::shared_ptr<const VersusReplay>> loaded;
+        for (const std::string& path : replays)
+            loaded.push_back(std::make_shared<const VersusReplay>(VersusReplay::Read(path)));
+
+        // the replays again and again until the grid is full
+        for (unsigned int shown = 0, i = 0; shown < boards; i++)
+        {
+            std::shared_ptr<const VersusReplay> replay = loaded[i % loaded.size()];
+            std::vector<InputSource> sources(replay->Boards, INPUT_REPLAY);
+            FeedMatch match = { std::make_unique<VersusMatch>(sources, botConfig, botPPS, garbageDelay, garbageMessiness, book, replay, 1), replay->EndTick(), 0.0f, 0.0f };
+            match.Match->Start(0);
+            Matches.push_back(std::move(match));
+            shown = shown + replay->Boards;
+        }
+    }
+    else
+    {
+        size_t colon = server.rfind(':');
+        std::string host = server.substr(0, colon);
+        std::string port = colon == std::string::npos ? "" : server.substr(colon + 1);
+        ServerAddress.sin_family = AF_INET;
+        if (port.empty() || port.size() > 5 || !std::all_of(port.begin(), port.end(), ::isdigit) || std::stoul(port) > 65535
+            || inet_pton(AF_INET, host.c_str(), &ServerAddress.sin_addr) != 1)
+            throw std::runtime_error("not an IPv4:port address: " + server);
+        ServerAddress.sin_port = htons(static_cast<uint16_t>(std::stoul(port)));
+
+        // a server match has 2 boards at most, the connections are opened by the first Update
+        Connections.resize((boards + 1) / 2);
+        for (FeedConnection& connection : Connections)
+        {
+            connection.Socket = -1;
+            connection.Connected = false;
+            connection.RetryTime = 0.0f;
+        }
+        return;
+    }
+
+    // the first frame already shows the boards, the matches start running from there
+    for (unsigned int i = 0; i < boards; i++)
+        Shown.push_back(std::make_unique<GameBoard>(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE));
+    Publish();
+    Runner = std::thread(&SpectatorFeed::Run, this);
+}
+
+SpectatorFeed::~SpectatorFeed()
+{
+    if (Runner.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(Lock);
+            Stopping = true;
+        }
+        Signal.notify_all();
+        Runner.join();
+    }
+
+    for (FeedConnection& connection : Connections)
+        Disconnect(connection);
+}
+
+void SpectatorFeed::Update(float dt)
+{
+    Tiles.clear();
+    if (Source == FEED_SERVER)
+        UpdateConnections(dt);
+    else
+        UpdateMatches();
+}
+
+void SpectatorFeed::Run()
+{
+    // the matches run on their own fixed tick, a late tick is caught up with a few ticks at most
+    const std::chrono::steady_clock::duration tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / VERSUS_TICK_RATE));
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now() + tick;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            if (Signal.wait_until(lock, next, [this] { return Stopping; }))
+                return;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        unsigned int ticks = static_cast<unsigned int>(std::min<int64_t>((now - next) / tick + 1, MAX_CATCHUP_TICKS));
+        next = ticks == MAX_CATCHUP_TICKS ? now + tick : next + ticks * tick;
+
+        StepMatches(ticks, 1.0f / VERSUS_TICK_RATE);
+        Publish();
+    }
+}
+
+void SpectatorFeed::StepMatches(unsigned int ticks, float dt)
+{
+    // the matches don't share anything, each one runs the ticks on a worker
+    Pool.ParallelFor(Matches.size(), [&](size_t i, unsigned int) {
+        for (unsigned int t = 0; t < ticks && Matches[i].Delay <= 0.0f; t++)
+            Matches[i].Match->Step();
+    });
+
+    for (FeedMatch& match : Matches)
+    {
+        if (match.Delay > 0.0f)
+            match.Delay = match.Delay - ticks * dt;
+        else if (match.Match->IsOver() || match.Match->Tick >= match.EndTick)
+        {
+            match.OverTime = match.OverTime + ticks * dt;
+            if (match.OverTime >= RESTART_DELAY)
+            {
+                std::random_device dev;
+                match.Match->Start(dev());
+                match.OverTime = 0.0f;
+            }
+        }
+    }
+}
+
+void SpectatorFeed::Publish()
+{
+    // copied without the lock, only the hand over takes it
+    Staged.clear();
+    for (unsigned int m = 0; m < Matches.size(); m++)
+    {
+        const VersusMatch& match = *Matches[m].Match;
+        for (unsigned int i = 0; i < match.Players.size() && Staged.size() < Boards; i++)
+        {
+            const VersusPlayer& player = match.Players[i];
+            Staged.push_back({ GameBoardState(), m, i, player.Place });
+            player.Board->SaveState(Staged.back().State);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(Lock);
+    Published.swap(Staged);
+    Fresh = true;
+}
+
+void SpectatorFeed::UpdateMatches()
+{
+    // the frame takes the copy of the last tick (if there was one since the previous frame), it never waits for the matches
+    bool fresh = false;
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        if (Fresh)
+        {
+            Views.swap(Published);
+            Fresh = false;
+            fresh = true;
+        }
+    }
+
+    for (unsigned int i = 0; i < Views.size(); i++)
+    {
+        if (fresh)
+            Shown[i]->LoadState(Views[i].State);
+        Tiles.push_back({ Shown[i].get(), Views[i].Match, Views[i].Player, Views[i].Place });
+    }
+}
+
+void SpectatorFeed::UpdateConnections(float dt)
+{
+    for (unsigned int c = 0; c < Connections.size(); c++)
+    {
+        FeedConnection& connection = Connections[c];
+        if (connection.Socket < 0)
+        {
+            connection.RetryTime = connection.RetryTime - dt;
+            if (connection.RetryTime <= 0.0f)
+                Connect(connection);
+            continue;
+        }
+
+        if (!connection.Connected)
+        {
+            // established once the socket is writable, without error
+            pollfd fd = { connection.Socket, POLLOUT, 0 };
+            if (poll(&fd, 1, 0) <= 0)
+                continue;
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(connection.Socket, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0 || !Send(connection, MSG_SPECTATE))
+            {
+                Disconnect(connection);
+                continue;
+            }
+            connection.Connected = true;
+        }
+
+        if (!Receive(connection))
+        {
+            Disconnect(connection);
+            continue;
+        }
+
+        // a board shows up with the keyframe that follows START, and stays until the next match starts
+        const SpectatorMirror& mirror = connection.Mirror;
+        for (unsigned int i = 0; i < mirror.Boards && Tiles.size() < Boards; i++)
+        {
+            if (mirror.Decoder[i].Frames == 0)
+                continue;
+            unsigned int place = mirror.Playing || mirror.Winner == NO_WINNER ? 0 : mirror.Winner == i ? 1 : 2;
+            Tiles.push_back({ mirror.Board[i].get(), c, i, place });
+        }
+    }
+}
+
+void SpectatorFeed::Connect(FeedConnection& connection)
+{
+    // the connection completes in the background, the frame doesn't wait for it
+    connection.Socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (connection.Socket < 0 || (connect(connection.Socket, reinterpret_cast<const sockaddr*>(&ServerAddress), sizeof(ServerAddress)) != 0 && errno != EINPROGRESS))
+    {
+        Disconnect(connection);
+        return;
+    }
+
+    int enable = 1;
+    setsockopt(connection.Socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
+bool SpectatorFeed::Send(FeedConnection& connection, ServerMessageType type)
+{
+    // the only messages sent have no payload, a socket that can't take one is as good as lost
+    uint8_t buffer[ServerProtocol::HEADER_SIZE];
+    size_t length = ServerProtocol::Write(buffer, sizeof(buffer), type, nullptr, 0);
+    return send(connection.Socket, buffer, length, MSG_NOSIGNAL) == static_cast<ssize_t>(length);
+}
+
+void SpectatorFeed::Disconnect(FeedConnection& connection)
+{
+    if (connection.Socket >= 0)
+        close(connection.Socket);
+    connection.Socket = -1;
+    connection.Connected = false;
+    connection.RetryTime = RECONNECT_DELAY;
+    connection.In.clear();
+    connection.Mirror.Boards = 0;
+    connection.Mirror.Playing = false;
+}
+
+bool SpectatorFeed::Receive(FeedConnection& connection)
+{
+    // everything the server sent since the last frame
+    uint8_t buffer[4096];
+    while (true)
+    {
+        ssize_t received = recv(connection.Socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            return false;
+        if (received < 0)
+            break;
+        connection.In.insert(connection.In.end(), buffer, buffer + received);
+    }
+
+    size_t offset = 0;
+    while (true)
+    {
+        uint8_t type;
+        const uint8_t *payload;
+        size_t size;
+        size_t length = ServerProtocol::Read(connection.In.data() + offset, connection.In.size() - offset, type, payload, size);
+        if (length == 0)
+            break;
+        if (length == SIZE_MAX || !connection.Mirror.Apply(type, payload, size))
+            return false;
+        offset = offset + length;
+
+        // the board of the match just ended stays on screen until the next one starts
+        if (type == MSG_END && !Send(connection, MSG_SPECTATE))
+            return false;
+    }
+    connection.In.erase(connection.In.begin(), connection.In.begin() + offset);
+    return true;
+}
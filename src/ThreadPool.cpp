@@ -0,0 +1,165 @@
+#include "ThreadPool.h"
+
+// index of the pool worker owning the current thread, used to keep nested submissions local
+static thread_local ThreadPool* CurrentPool = nullptr;
+static thread_local unsigned int CurrentWorker = 0;
+
+ThreadPool::ThreadPool(unsigned int threads)
+:   Pending(0),
+    NextWorker(0),
+    Stopping(false)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < threads; i++)
+        Workers.push_back(std::make_unique<Worker>());
+
+    for (unsigned int i = 0; i < threads; i++)
+        Threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(WakeLock);
+        Stopping = true;
+    }
+    WakeSignal.notify_all();
+
+    for (std::thread& thread: Threads)
+        thread.join();
+}
+
+unsigned int ThreadPool::Size() const
+{
+    return Workers.size();
+}
+
+void ThreadPool::Submit(Task task)
+{
+    // tasks spawned from inside the pool go to the spawning worker, the rest are spread round robin
+    unsigned int index;
+    if (CurrentPool == this)
+        index = CurrentWorker;
+    else
+        index = NextWorker.fetch_add(1, std::memory_order_relaxed) % Workers.size();
+
+    {
+        std::lock_guard<std::mutex> lock(Workers[index]->Lock);
+        Workers[index]->Tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(WakeLock);
+        Pending.fetch_add(1, std::memory_order_release);
+    }
+    WakeSignal.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t, unsigned int)>& fn)
+{
+    if (count == 0) return;
+
+    // a few chunks per worker so that stealing can even out uneven work
+    size_t chunks = std::min(count, static_cast<size_t>(Workers.size()) * 4);
+    size_t chunkSize = (count + chunks - 1) / chunks;
+
+    std::mutex doneLock;
+    std::condition_variable doneSignal;
+    size_t remaining = 0;
+
+    for (size_t begin = 0; begin < count; begin += chunkSize)
+        remaining = remaining + 1;
+
+    for (size_t begin = 0; begin < count; begin += chunkSize)
+    {
+        size_t end = std::min(count, begin + chunkSize);
+        Submit([&, begin, end](unsigned int worker) {
+            for (size_t i = begin; i < end; i++)
+                fn(i, worker);
+
+            std::lock_guard<std::mutex> lock(doneLock);
+            remaining = remaining - 1;
+            if (remaining == 0)
+                doneSignal.notify_all();
+        });
+    }
+
+    // when called from a worker, keep executing tasks instead of blocking the thread
+    if (CurrentPool == this)
+    {
+        Task task;
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(doneLock);
+                if (remaining == 0) break;
+            }
+            if (TryPop(CurrentWorker, task))
+            {
+                Pending.fetch_sub(1, std::memory_order_acq_rel);
+                task(CurrentWorker);
+            }
+            else
+                std::this_thread::yield();
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(doneLock);
+    doneSignal.wait(lock, [&] { return remaining == 0; });
+}
+
+bool ThreadPool::TryPop(unsigned int index, Task& task)
+{
+    // own deque first, newest task
+    {
+        Worker& own = *Workers[index];
+        std::lock_guard<std::mutex> lock(own.Lock);
+        if (!own.Tasks.empty())
+        {
+            task = std::move(own.Tasks.back());
+            own.Tasks.pop_back();
+            return true;
+        }
+    }
+
+    // then steal the oldest task of another worker
+    for (size_t i = 1; i < Workers.size(); i++)
+    {
+        Worker& victim = *Workers[(index + i) % Workers.size()];
+        std::lock_guard<std::mutex> lock(victim.Lock);
+        if (!victim.Tasks.empty())
+        {
+            task = std::move(victim.Tasks.front());
+            victim.Tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned int index)
+{
+    CurrentPool = this;
+    CurrentWorker = index;
+
+    Task task;
+    while (true)
+    {
+        if (TryPop(index, task))
+        {
+            Pending.fetch_sub(1, std::memory_order_acq_rel);
+            task(index);
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(WakeLock);
+        WakeSignal.wait(lock, [&] { return Stopping || Pending.load(std::memory_order_acquire) > 0; });
+        if (Stopping && Pending.load(std::memory_order_acquire) == 0)
+            return;
+    }
+}
@@ -0,0 +1,280 @@
+#include "TrainingExporter.h"
+#include "Compression.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+struct ColumnInfo
+{
+    const char *Name;
+    uint32_t ElementSize;
+    uint32_t Elements;
+    size_t Offset;
+};
+
+static const ColumnInfo COLUMNS[] = {
+    { "rows",       sizeof(uint16_t),   MATRIX_ROWS,        offsetof(TrainingRecord, Rows) },
+    { "current",    sizeof(uint8_t),    1,                  offsetof(TrainingRecord, Current) },
+    { "hold",       sizeof(uint8_t),    1,                  offsetof(TrainingRecord, Hold) },
+    { "queue",      sizeof(uint8_t),    PREVIEW_NUMBER,     offsetof(TrainingRecord, Queue) },
+    { "use_hold",   sizeof(uint8_t),    1,                  offsetof(TrainingRecord, UseHold) },
+    { "piece",      sizeof(uint8_t),    1,                  offsetof(TrainingRecord, Piece) },
+    { "rotation",   sizeof(uint8_t),    1,                  offsetof(TrainingRecord, Rotation) },
+    { "row",        sizeof(int8_t),     1,                  offsetof(TrainingRecord, Row) },
+    { "column",     sizeof(int8_t),     1,                  offsetof(TrainingRecord, Column) },
+    { "lines",      sizeof(uint8_t),    1,                  offsetof(TrainingRecord, Lines) },
+    { "spin",       sizeof(uint8_t),    1,                  offsetof(TrainingRecord, Spin) },
+    { "combo",      sizeof(uint16_t),   1,                  offsetof(TrainingRecord, Combo) },
+};
+static const uint32_t COLUMN_COUNT = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+
+static const uint32_t CODEC_RAW = 0;
+static const uint32_t CODEC_LZ4 = 1;
+
+TrainingExporter::TrainingExporter(const std::string& path, bool compress, uint32_t chunkRecords)
+:   Path(path),
+    Compress(compress),
+    ChunkRecords(std::max<uint32_t>(1, chunkRecords)),
+    File(nullptr),
+    Active(0),
+    Pending(-1),
+    Finishing(false),
+    Failed(false),
+    Written(0)
+{
+    File = std::fopen(path.c_str(), "wb");
+    if (!File)
+        throw std::runtime_error("failed to create " + path);
+
+    for (Chunk& chunk: Chunks)
+    {
+        chunk.Columns.resize(COLUMN_COUNT);
+        for (uint32_t c = 0; c < COLUMN_COUNT; c++)
+            chunk.Columns[c].reserve(static_cast<size_t>(ChunkRecords) * COLUMNS[c].ElementSize * COLUMNS[c].Elements);
+    }
+
+    WriteHeader();
+    Writer = std::thread(&TrainingExporter::Run, this);
+}
+
+TrainingExporter::~TrainingExporter()
+{
+    try
+    {
+        Finish();
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+}
+
+void TrainingExporter::Add(const TrainingRecord& record)
+{
+    std::unique_lock<std::mutex> lock(Lock);
+    if (Failed)
+        throw std::runtime_error("failed to write " + Path);
+
+    Chunk& chunk = Chunks[Active];
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&record);
+    for (uint32_t c = 0; c < COLUMN_COUNT; c++)
+    {
+        const uint8_t *field = bytes + COLUMNS[c].Offset;
+        chunk.Columns[c].insert(chunk.Columns[c].end(), field, field + COLUMNS[c].ElementSize * COLUMNS[c].Elements);
+    }
+    chunk.Records = chunk.Records + 1;
+
+    if (chunk.Records == ChunkRecords)
+    {
+        // hand the full chunk to the writer, waiting only if it is still busy with the other one
+        Signal.wait(lock, [this] { return Pending < 0; });
+        Pending = Active;
+        Active = 1 - Active;
+        Signal.notify_all();
+    }
+}
+
+void TrainingExporter::Finish()
+{
+    {
+        std::unique_lock<std::mutex> lock(Lock);
+        if (!File)
+            return;
+
+        if (Chunks[Active].Records != 0)
+        {
+            Signal.wait(lock, [this] { return Pending < 0; });
+            Pending = Active;
+            Active = 1 - Active;
+        }
+        Finishing = true;
+        Signal.notify_all();
+    }
+
+    Writer.join();
+    bool failed = Failed || std::ferror(File);
+    if (std::fclose(File) != 0)
+        failed = true;
+    File = nullptr;
+    if (failed)
+        throw std::runtime_error("failed to write " + Path);
+}
+
+uint64_t TrainingExporter::RecordsWritten() const
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    return Written;
+}
+
+// every column of every chunk, checked against the layout and decompressed
+static bool ReadChunks(std::FILE *file, uint64_t& records)
+{
+    std::vector<uint8_t> stored, raw;
+    while (true)
+    {
+        // the file ends between two chunks, never inside one
+        char magic[4];
+        size_t read = std::fread(magic, 1, 4, file);
+        if (read == 0)
+            return std::feof(file) && !std::ferror(file);
+
+        uint32_t count;
+        if (read != 4 || std::memcmp(magic, "CHNK", 4) != 0 || std::fread(&count, sizeof(count), 1, file) != 1)
+            return false;
+
+        for (const ColumnInfo& column: COLUMNS)
+        {
+            uint32_t codec;
+            uint64_t rawSize, storedSize;
+            if (std::fread(&codec, sizeof(codec), 1, file) != 1 || std::fread(&rawSize, sizeof(rawSize), 1, file) != 1
+                || std::fread(&storedSize, sizeof(storedSize), 1, file) != 1)
+                return false;
+
+            // the writer only keeps a compressed column when it's smaller
+            if (rawSize != static_cast<uint64_t>(count) * column.ElementSize * column.Elements
+                || (codec == CODEC_RAW && storedSize != rawSize) || (codec == CODEC_LZ4 && storedSize >= rawSize)
+                || (codec != CODEC_RAW && codec != CODEC_LZ4))
+                return false;
+
+            stored.resize(storedSize);
+            if (std::fread(stored.data(), 1, stored.size(), file) != stored.size())
+                return false;
+            raw.resize(rawSize);
+            if (codec == CODEC_LZ4 && !Compression::Decompress(stored.data(), stored.size(), raw.data(), raw.size()))
+                return false;
+        }
+        records = records + count;
+    }
+}
+
+uint64_t TrainingExporter::Verify(const std::string& path)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("failed to open " + path);
+
+    char magic[4];
+    uint32_t version = 0, columns = 0;
+    bool valid = std::fread(magic, 1, 4, file) == 4 && std::fread(&version, sizeof(version), 1, file) == 1
+        && std::fread(&columns, sizeof(columns), 1, file) == 1
+        && std::memcmp(magic, "STKD", 4) == 0 && version == VERSION && columns == COLUMN_COUNT;
+    for (uint32_t c = 0; valid && c < COLUMN_COUNT; c++)
+    {
+        char name[16];
+        uint32_t layout[2];
+        valid = std::fread(name, 1, sizeof(name), file) == sizeof(name) && std::fread(layout, sizeof(uint32_t), 2, file) == 2
+            && std::strncmp(name, COLUMNS[c].Name, sizeof(name)) == 0
+            && layout[0] == COLUMNS[c].ElementSize && layout[1] == COLUMNS[c].Elements;
+    }
+
+    uint64_t records = 0;
+    valid = valid && ReadChunks(file, records);
+    std::fclose(file);
+
+    if (!valid)
+        throw std::runtime_error("not a complete training export (or another version): " + path);
+    return records;
+}
+
+void TrainingExporter::WriteHeader()
+{
+    uint32_t version = VERSION;
+    std::fwrite("STKD", 1, 4, File);
+    std::fwrite(&version, sizeof(version), 1, File);
+    std::fwrite(&COLUMN_COUNT, sizeof(COLUMN_COUNT), 1, File);
+    for (const ColumnInfo& column: COLUMNS)
+    {
+        char name[16] = {};
+        std::strncpy(name, column.Name, sizeof(name) - 1);
+        std::fwrite(name, 1, sizeof(name), File);
+        std::fwrite(&column.ElementSize, sizeof(column.ElementSize), 1, File);
+        std::fwrite(&column.Elements, sizeof(column.Elements), 1, File);
+    }
+}
+
+bool TrainingExporter::WriteChunk(const Chunk& chunk)
+{
+    std::vector<uint8_t> compressed;
+
+    std::fwrite("CHNK", 1, 4, File);
+    std::fwrite(&chunk.Records, sizeof(chunk.Records), 1, File);
+    for (const std::vector<uint8_t>& column: chunk.Columns)
+    {
+        uint32_t codec = CODEC_RAW;
+        uint64_t rawSize = column.size();
+        const uint8_t *data = column.data();
+        uint64_t storedSize = rawSize;
+
+        // a column that doesn't shrink is stored raw
+        if (Compress)
+        {
+            compressed.clear();
+            Compression::Compress(column.data(), column.size(), compressed);
+            if (compressed.size() < column.size())
+            {
+                codec = CODEC_LZ4;
+                data = compressed.data();
+                storedSize = compressed.size();
+            }
+        }
+
+        std::fwrite(&codec, sizeof(codec), 1, File);
+        std::fwrite(&rawSize, sizeof(rawSize), 1, File);
+        std::fwrite(&storedSize, sizeof(storedSize), 1, File);
+        std::fwrite(data, 1, storedSize, File);
+    }
+    return !std::ferror(File);
+}
+
+void TrainingExporter::Run()
+{
+    std::unique_lock<std::mutex> lock(Lock);
+    while (true)
+    {
+        Signal.wait(lock, [this] { return Pending >= 0 || Finishing; });
+        if (Pending < 0)
+            break;
+
+        // the pending chunk belongs to this thread until Pending is cleared
+        // after a failure the chunks are still taken, so Add never waits for a writer that gave up
+        Chunk& chunk = Chunks[Pending];
+        bool failed = Failed;
+        lock.unlock();
+        if (!failed)
+            failed = !WriteChunk(chunk);
+        lock.lock();
+
+        if (failed)
+            Failed = true;
+        else
+            Written = Written + chunk.Records;
+        chunk.Records = 0;
+        for (std::vector<uint8_t>& column: chunk.Columns)
+            column.clear();
+        Pending = -1;
+        Signal.notify_all();
+    }
+    if (std::fflush(File) != 0)
+        Failed = true;
+}
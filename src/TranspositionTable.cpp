@@ -0,0 +1,51 @@
+#include "TranspositionTable.h"
+
+#include <bit>
+
+TranspositionTable::TranspositionTable(unsigned int bits)
+:   Slots(new Slot[uint64_t(1) << bits]),
+    Mask((uint64_t(1) << bits) - 1),
+    Generation(1)
+{
+    for (uint64_t i = 0; i <= Mask; i++)
+    {
+        Slots[i].Check.store(0, std::memory_order_relaxed);
+        Slots[i].Data.store(0, std::memory_order_relaxed);
+    }
+}
+
+void TranspositionTable::NewSearch()
+{
+    // generation 0 is never used so that zeroed slots are always stale
+    Generation = Generation + 1;
+    if (Generation == 0)
+        Generation = 1;
+}
+
+bool TranspositionTable::Improve(uint64_t key, float score)
+{
+    Slot& slot = Slots[key & Mask];
+    uint64_t data = slot.Data.load(std::memory_order_relaxed);
+    uint64_t check = slot.Check.load(std::memory_order_relaxed);
+
+    if ((check ^ data) == key && (data >> 32) == Generation && std::bit_cast<float>(static_cast<uint32_t>(data)) >= score)
+        return false;
+
+    uint64_t newData = (uint64_t(Generation) << 32) | std::bit_cast<uint32_t>(score);
+    slot.Data.store(newData, std::memory_order_relaxed);
+    slot.Check.store(key ^ newData, std::memory_order_relaxed);
+    return true;
+}
+
+bool TranspositionTable::Probe(uint64_t key, float& score) const
+{
+    const Slot& slot = Slots[key & Mask];
+    uint64_t data = slot.Data.load(std::memory_order_relaxed);
+    uint64_t check = slot.Check.load(std::memory_order_relaxed);
+
+    if ((check ^ data) != key || (data >> 32) != Generation)
+        return false;
+
+    score = std::bit_cast<float>(static_cast<uint32_t>(data));
+    return true;
+}
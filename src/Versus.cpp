@@ -0,0 +1,290 @@
+#include "Versus.h"
+#include "Zobrist.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+static_assert(sizeof(ReplayInput) == 8, "replay inputs are written as is");
+
+VersusReplay VersusReplay::Read(const std::string& path)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("failed to open " + path);
+
+    // older versions were recorded under other rules, they wouldn't play back the same match
+    char magic[4];
+    uint32_t header[7] = {};
+    bool valid = std::fread(magic, 1, 4, file) == 4 && std::fread(header, sizeof(uint32_t), 7, file) == 7
+        && std::memcmp(magic, "STKR", 4) == 0 && header[0] == VERSION;
+
+    VersusReplay replay;
+    if (valid)
+    {
+        replay.Boards = header[1];
+        replay.Seed = header[2];
+        replay.GarbageDelay = header[3];
+        replay.GarbageMessiness = header[4];
+        replay.Inputs.resize(header[5]);
+        replay.Hashes.resize(header[6]);
+        valid = std::fread(replay.Inputs.data(), sizeof(ReplayInput), replay.Inputs.size(), file) == replay.Inputs.size()
+            && std::fread(replay.Hashes.data(), sizeof(uint32_t), replay.Hashes.size(), file) == replay.Hashes.size();
+    }
+    std::fclose(file);
+
+    if (!valid)
+        throw std::runtime_error("not a replay (or another version): " + path);
+    return replay;
+}
+
+uint64_t VersusReplay::EndTick() const
+{
+    uint64_t end = Hashes.size();
+    if (!Inputs.empty())
+        end = std::max<uint64_t>(end, Inputs.back().Tick + 1);
+    return end;
+}
+
+void VersusReplay::Write(const std::string& path) const
+{
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("failed to create " + path);
+
+    uint32_t header[7] = { VERSION, Boards, Seed, GarbageDelay, GarbageMessiness, static_cast<uint32_t>(Inputs.size()), static_cast<uint32_t>(Hashes.size()) };
+    std::fwrite("STKR", 1, 4, file);
+    std::fwrite(header, sizeof(uint32_t), 7, file);
+    std::fwrite(Inputs.data(), sizeof(ReplayInput), Inputs.size(), file);
+    std::fwrite(Hashes.data(), sizeof(uint32_t), Hashes.size(), file);
+
+    bool failed = std::ferror(file);
+    if (std::fclose(file) != 0 || failed)
+        throw std::runtime_error("failed to write " + path);
+}
+
+VersusMatch::VersusMatch(const std::vector<InputSource>& sources, const BotConfig& botConfig, float botPPS, unsigned int garbageDelay, unsigned int garbageMessiness, std::shared_ptr<const OpeningBook> book, std::shared_ptr<const VersusReplay> replay, unsigned int threads)
+:   Tick(0),
+    Playing(0),
+    Seed(0),
+    Replay(replay),
+    Hash(0),
+    DesyncTick(-1),
+    Pool(threads > 0 ? threads : std::min<unsigned int>(sources.size(), std::max(1u, std::thread::hardware_concurrency())))
+{
+    if (sources.size() < MIN_VERSUS_BOARDS || sources.size() > MAX_VERSUS_BOARDS)
+        throw std::runtime_error("a versus match needs " + std::to_string(MIN_VERSUS_BOARDS) + " to " + std::to_string(MAX_VERSUS_BOARDS) + " boards");
+
+    bool replayed = std::find(sources.begin(), sources.end(), INPUT_REPLAY) != sources.end();
+    if (replayed && (!Replay || Replay->Boards < sources.size()))
+        throw std::runtime_error("replay boards need a replay of at least " + std::to_string(sources.size()) + " boards");
+
+    // the boards already run in parallel, a bot searching on several threads would only compete with them
+    BotConfig config = botConfig;
+    config.Threads = 1;
+
+    Players.resize(sources.size());
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        VersusPlayer& player = Players[i];
+        player.Source = sources[i];
+        player.Board = std::make_unique<GameBoard>(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+        player.Observer = nullptr;
+        if (player.Source == INPUT_BOT)
+            player.Bot = std::make_unique<BotController>(config, botPPS, 0.0f, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE, book);
+    }
+
+    Recording.Boards = Players.size();
+    Recording.GarbageDelay = replayed ? Replay->GarbageDelay : garbageDelay;
+    Recording.GarbageMessiness = replayed ? Replay->GarbageMessiness : garbageMessiness;
+}
+
+void VersusMatch::Start(unsigned int seed)
+{
+    bool replayed = std::any_of(Players.begin(), Players.end(), [](const VersusPlayer& player) {
+        return player.Source == INPUT_REPLAY;
+    });
+    Seed = replayed ? Replay->Seed : seed;
+    Tick = 0;
+    Playing = Players.size();
+    Recording.Seed = Seed;
+    Recording.Inputs.clear();
+    Recording.Hashes.clear();
+    Hash = 0;
+    DesyncTick = -1;
+    DesyncDump.clear();
+
+    for (size_t i = 0; i < Players.size(); i++)
+    {
+        VersusPlayer& player = Players[i];
+        player.Board->LoadMatch(Seed, i, Recording.GarbageDelay, Recording.GarbageMessiness);
+        if (player.Bot)
+            player.Bot->Reset();
+        player.Queued.clear();
+        player.ReplayCursor = 0;
+        player.Sent = 0;
+        player.ToppedOut = false;
+        player.Received = 0;
+        player.Place = 0;
+    }
+}
+
+void VersusMatch::QueueInputs(unsigned int board, const std::list<MoveType>& moves)
+{
+    if (board < Players.size() && Players[board].Source == INPUT_KEYBOARD)
+        Players[board].Queued.insert(Players[board].Queued.end(), moves.begin(), moves.end());
+}
+
+void VersusMatch::Step()
+{
+    if (IsOver())
+        return;
+
+    // the boards only touch their own state here, the inputs are recorded afterwards in board order
+    std::vector<std::list<MoveType>> inputs(Players.size());
+    Pool.ParallelFor(Players.size(), [&](size_t index, unsigned int) {
+        VersusPlayer& player = Players[index];
+        player.Sent = 0;
+        player.ToppedOut = false;
+        if (player.Board->IsOver)
+            return;
+        inputs[index] = TickInputs(player);
+        player.Sent = player.Board->ExecuteTick(inputs[index], player.Observer);
+    });
+
+    for (size_t i = 0; i < Players.size(); i++)
+    {
+        for (MoveType move: inputs[i])
+            Recording.Inputs.push_back(ReplayInput{ static_cast<uint32_t>(Tick), static_cast<uint8_t>(i), static_cast<uint8_t>(move), { 0, 0 } });
+        if (Players[i].ToppedOut)
+            Recording.Inputs.push_back(ReplayInput{ static_cast<uint32_t>(Tick), static_cast<uint8_t>(i), REPLAY_TOP_OUT, { 0, 0 } });
+    }
+
+    RouteGarbage();
+    CheckHash();
+    Tick = Tick + 1;
+}
+
+std::list<MoveType> VersusMatch::TickInputs(VersusPlayer& player)
+{
+    std::list<MoveType> moves;
+    switch (player.Source)
+    {
+        case INPUT_KEYBOARD:
+            moves.swap(player.Queued);
+            break;
+        case INPUT_BOT:
+        {
+            // a decision without moves means the bot has no placement left, the board tops out
+            size_t decisions = player.Bot->Stats.Decisions;
+            moves = player.Bot->Update(*player.Board, 1.0f / VERSUS_TICK_RATE);
+            if (moves.empty() && player.Bot->Stats.Decisions != decisions)
+                TopOut(player);
+            break;
+        }
+        case INPUT_REPLAY:
+        {
+            // inputs are sorted by tick, the ones of the other boards are skipped
+            unsigned int board = &player - Players.data();
+            const std::vector<ReplayInput>& recorded = Replay->Inputs;
+            while (player.ReplayCursor < recorded.size() && recorded[player.ReplayCursor].Tick <= Tick)
+            {
+                const ReplayInput& input = recorded[player.ReplayCursor];
+                if (input.Board == board && input.Tick == Tick && input.Move == REPLAY_TOP_OUT)
+                    TopOut(player);
+                else if (input.Board == board && input.Tick == Tick)
+                    moves.push_back(static_cast<MoveType>(input.Move));
+                player.ReplayCursor = player.ReplayCursor + 1;
+            }
+            break;
+        }
+    }
+    return moves;
+}
+
+void VersusMatch::TopOut(VersusPlayer& player)
+{
+    player.Board->Stop();
+    player.Board->IsOver = true;
+    player.ToppedOut = true;
+}
+
+void VersusMatch::RouteGarbage()
+{
+    // boards that topped out this tick still send what they cleared before, then leave the routing
+    for (size_t i = 0; i < Players.size(); i++)
+    {
+        if (Players[i].Sent == 0)
+            continue;
+
+        for (size_t offset = 1; offset < Players.size(); offset++)
+        {
+            VersusPlayer& target = Players[(i + offset) % Players.size()];
+            if (!target.Board->IsOver)
+            {
+                target.Board->ReceiveGarbage(Players[i].Sent);
+                target.Received = target.Received + Players[i].Sent;
+                break;
+            }
+        }
+    }
+
+    // boards topping out on the same tick share the place
+    unsigned int place = Playing;
+    for (VersusPlayer& player: Players)
+    {
+        if (player.Board->IsOver && player.Place == 0)
+        {
+            player.Place = place;
+            Playing = Playing - 1;
+        }
+    }
+
+    if (Playing == 1)
+    {
+        for (VersusPlayer& player: Players)
+        {
+            if (!player.Board->IsOver)
+            {
+                player.Place = 1;
+                player.Board->Stop();
+            }
+        }
+    }
+}
+
+void VersusMatch::CheckHash()
+{
+    for (const VersusPlayer& player: Players)
+        Hash = Zobrist::Mix(Hash, player.Board->StateHash());
+    Recording.Hashes.push_back(static_cast<uint32_t>(Hash));
+
+    // with a live board the match is expected to differ from the replay
+    bool replayed = std::all_of(Players.begin(), Players.end(), [](const VersusPlayer& player) {
+        return player.Source == INPUT_REPLAY;
+    });
+    if (!replayed || DesyncTick >= 0 || Tick >= Replay->Hashes.size() || Replay->Hashes[Tick] == Recording.Hashes.back())
+        return;
+
+    DesyncTick = Tick;
+    for (size_t i = 0; i < Players.size(); i++)
+        DesyncDump = DesyncDump + "board " + std::to_string(i) + "\n" + Players[i].Board->DumpState();
+}
+
+bool VersusMatch::IsOver() const
+{
+    return Playing <= 1;
+}
+
+int VersusMatch::Winner() const
+{
+    if (!IsOver())
+        return -1;
+    for (size_t i = 0; i < Players.size(); i++)
+    {
+        if (Players[i].Place == 1)
+            return i;
+    }
+    return -1;
+}
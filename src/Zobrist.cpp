@@ -0,0 +1,33 @@
+#include "Zobrist.h"
+
+#include <random>
+
+static const uint64_t ZOBRIST_SEED = 0x5354414B4552ull;   // "STAKER"
+
+Zobrist::Zobrist()
+{
+    std::mt19937_64 rng(ZOBRIST_SEED);
+
+    for (int row = 0; row < ROWS; row++)
+    {
+        Rows[row][0] = 0;
+        for (int mask = 1; mask < ROW_MASKS; mask++)
+            Rows[row][mask] = rng();
+    }
+
+    for (int type = 0; type <= SPAWN_PREVIEW; type++)
+    {
+        Current[type] = rng();
+        Hold[type] = rng();
+    }
+
+    for (int i = 0; i < QUEUE_POSITIONS; i++)
+        QueuePosition[i] = rng();
+}
+
+const Zobrist& Zobrist::Keys()
+{
+    // ~330KB, too big for the stack of whoever calls this first
+    static const Zobrist* keys = new Zobrist();
+    return *keys;
+}
@@ -0,0 +1,142 @@
+// stacker-book: builds the opening book used by the bot and the hints.
+//
+// For every order the first bag can come in, the bot plans the whole bag with the 7 pieces visible
+// (a deep and wide search, all the time it needs) and the line is added to the book with an entry for
+// every position along it. Starting from another board (--board) builds the lines of a setup instead.
+// See OpeningBook.h for the file format.
+
+#include "Bot.h"
+#include "OpeningBook.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+struct BookOptions
+{
+    std::string Board;              // rows from top to bottom separated by '/', '.' or '_' for empty cells
+    int Depth = 7;
+    int BeamWidth = 256;
+    unsigned int Threads = 0;
+    std::string Output = "openings.stkb";
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-book [options]\n"
+        "  --board ROWS      starting board, rows from top to bottom separated by '/', '.' is empty (default empty)\n"
+        "  --depth N         bot search depth (default 7, the whole bag)\n"
+        "  --beam N          bot beam width (default 256)\n"
+        "  --threads N       worker threads, 0 for all cores (default 0)\n"
+        "  --output FILE     output file (default openings.stkb)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], BookOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--board")               options.Board = value;
+        else if (arg == "--depth")          options.Depth = std::stoi(value);
+        else if (arg == "--beam")           options.BeamWidth = std::stoi(value);
+        else if (arg == "--threads")        options.Threads = std::stoul(value);
+        else if (arg == "--output")         options.Output = value;
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BookOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        Bitboard start = Bitboard::Parse(options.Board);
+
+        std::vector<std::array<MinoType, 7>> bags;
+        std::array<MinoType, 7> bag = SEVEN_PIECE_BAG;
+        std::sort(bag.begin(), bag.end());
+        do
+            bags.push_back(bag);
+        while (std::next_permutation(bag.begin(), bag.end()));
+
+        // one single threaded bot per worker, the lines are collected per bag and added in order
+        ThreadPool pool(options.Threads);
+        BotConfig config;
+        config.Depth = options.Depth;
+        config.BeamWidth = options.BeamWidth;
+        config.Threads = 1;
+        std::vector<std::unique_ptr<Bot>> bots;
+        for (unsigned int i = 0; i < pool.Size(); i++)
+            bots.push_back(std::make_unique<Bot>(config, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE));
+
+        std::vector<std::vector<BookKey>> keys(bags.size());
+        std::vector<std::vector<BookMove>> moves(bags.size());
+
+        auto startTime = std::chrono::steady_clock::now();
+        pool.ParallelFor(bags.size(), [&](size_t index, unsigned int worker) {
+            BotSnapshot snapshot;
+            snapshot.State.Board = start;
+            snapshot.State.Current = bags[index][0];
+            snapshot.State.Hold = EMPTY;
+            snapshot.State.QueueIndex = 0;
+            snapshot.State.Combo = 0;
+            snapshot.State.BackToBack = 0;
+            snapshot.Queue.assign(bags[index].begin() + 1, bags[index].end());
+            snapshot.HoldUsed = false;
+
+            // the bag is played until its pieces run out, the last one may stay in hold
+            while (snapshot.State.Current != EMPTY)
+            {
+                BotDecision decision = bots[worker]->Think(snapshot);
+                if (!decision.Valid)
+                    break;
+
+                std::vector<MinoType> pieces = { snapshot.State.Current };
+                pieces.insert(pieces.end(), snapshot.Queue.begin(), snapshot.Queue.end());
+                keys[index].push_back(OpeningBook::Key(snapshot.State.Board.Hash, snapshot.State.Hold, pieces.data(), pieces.size()));
+
+                BookMove& move = moves[index].emplace_back();
+                move = BookMove();
+                move.UseHold = decision.UseHold;
+                move.Piece = decision.Target.Piece;
+                move.Rotation = decision.Target.Rotation;
+                move.Row = decision.Target.Position.x;
+                move.Column = decision.Target.Position.y;
+
+                snapshot = bots[worker]->Predict(snapshot, decision);
+            }
+        });
+
+        OpeningBookBuilder builder;
+        for (size_t i = 0; i < bags.size(); i++)
+            builder.AddLine(keys[i], moves[i]);
+        builder.Write(options.Output);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << bags.size() << " lines, " << builder.Size() << " positions written to " << options.Output
+                  << " in " << seconds << "s" << std::endl;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
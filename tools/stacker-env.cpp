@@ -0,0 +1,75 @@
+// stacker-env: serves a vectorised environment to a trainer over shared memory.
+//
+// Creates the shared memory region described in SharedEnvironment.h and steps every board with the
+// actions the trainer writes back, until the trainer closes the session.
+
+#include "SharedEnvironment.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+
+struct EnvOptions
+{
+    std::string Name = "/stacker-env";
+    uint32_t Boards = 1024;
+    uint32_t Slots = 4;
+    uint64_t Seed = 1;
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-env [options]\n"
+        "  --name NAME       shared memory name (default /stacker-env)\n"
+        "  --boards N        boards stepped in lockstep (default 1024)\n"
+        "  --slots N         observation and action slots (default 4)\n"
+        "  --seed N          run seed (default 1)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], EnvOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--name")                options.Name = value;
+        else if (arg == "--boards")         options.Boards = std::stoul(value);
+        else if (arg == "--slots")          options.Slots = std::stoul(value);
+        else if (arg == "--seed")           options.Seed = std::stoull(value);
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    EnvOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        SharedEnvironment environment(options.Name, options.Boards, options.Slots, options.Seed);
+        std::cout << "serving " << options.Boards << " boards on " << options.Name << std::endl;
+
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t steps = environment.Run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        std::cout << steps << " steps (" << static_cast<uint64_t>(steps * options.Boards / seconds) << " board steps/s)" << std::endl;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,422 @@
+// stacker-loadgen: load generator for stacker-server.
+//
+// Spawns many bot clients spread over a few threads, each thread with its own epoll loop and bot. Every
+// client joins a match, keeps a MatchMirror of it from the server's messages (checking the hash of every
+// tick it receives) and plays its board at the requested rate, joining again once the match is over.
+// Inputs are stamped with the match tick of the client's clock; the time until the server broadcasts the
+// placement back is the input latency.
+//
+// Spectators can be added: they follow matches through their spectator streams instead, and check the
+// boards streamed against the results of the match.
+
+#include "Server.h"
+#include "Bot.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions
+{
+    std::string Host = "127.0.0.1";
+    unsigned int Port = 47200;
+    unsigned int Clients = 1000;
+    unsigned int Spectators = 0;
+    unsigned int Threads = 0;       // 0 means one per hardware thread
+    std::string Mode = "mixed";     // sprint, versus or mixed (every other client)
+    unsigned int Seconds = 30;
+    float PPS = 1.0f;
+    int Depth = 1;
+    int BeamWidth = 8;
+};
+
+struct LoadClient
+{
+    int Socket = -1;
+    MatchMode Mode = MODE_SPRINT;
+    bool Spectator = false;
+    MatchMirror Mirror;
+    SpectatorMirror Viewer;         // spectators only
+    std::vector<uint8_t> In;
+    Clock::time_point MatchStart, NextDecision, SentAt;
+    unsigned int Expected = 0;      // PiecesPlaced once the input sent is executed, 0 while none is
+};
+
+struct LoadResults
+{
+    size_t Connected = 0;
+    size_t Matches = 0;             // played to the end
+    size_t Wins = 0;                // versus won, sprint finished
+    size_t Placements = 0;
+    size_t Inputs = 0;
+    size_t Desyncs = 0;             // ticks whose hash didn't match the mirror
+    size_t Errors = 0;              // malformed messages, lost connections
+    size_t GaveUp = 0;              // no placement left, reconnected to top out
+    size_t BytesIn = 0, BytesOut = 0;
+    size_t Followed = 0;            // matches followed to the end by spectators
+    size_t Frames = 0;
+    size_t SpectatorBytes = 0;      // received by spectators
+    size_t Mismatches = 0;          // boards streamed whose results weren't the ones of the match
+    std::vector<double> Latencies;  // ms from the input sent to its placement received
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-loadgen [options]\n"
+        "  --host HOST       server IPv4 address (default 127.0.0.1)\n"
+        "  --port N          server port (default 47200)\n"
+        "  --clients N       simulated clients (default 1000)\n"
+        "  --spectators N    clients following matches as spectators, in addition (default 0)\n"
+        "  --threads N       client threads (default one per hardware thread)\n"
+        "  --mode MODE       sprint, versus or mixed (default mixed)\n"
+        "  --seconds N       duration (default 30)\n"
+        "  --pps N           pieces per second of every bot (default 1)\n"
+        "  --depth N         bot search depth (default 1)\n"
+        "  --beam N          bot beam width (default 8)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], LoadOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--host")                options.Host = value;
+        else if (arg == "--port")           options.Port = std::stoul(value);
+        else if (arg == "--clients")        options.Clients = std::stoul(value);
+        else if (arg == "--spectators")     options.Spectators = std::stoul(value);
+        else if (arg == "--threads")        options.Threads = std::stoul(value);
+        else if (arg == "--mode")           options.Mode = value;
+        else if (arg == "--seconds")        options.Seconds = std::stoul(value);
+        else if (arg == "--pps")            options.PPS = std::stof(value);
+        else if (arg == "--depth")          options.Depth = std::stoi(value);
+        else if (arg == "--beam")           options.BeamWidth = std::stoi(value);
+        else return false;
+    }
+    return options.Mode == "sprint" || options.Mode == "versus" || options.Mode == "mixed";
+}
+
+static bool Send(LoadClient& client, ServerMessageType type, const uint8_t *payload, size_t size, LoadResults& results)
+{
+    // the messages are tiny, a socket that can't take one is as good as lost
+    uint8_t buffer[ServerProtocol::HEADER_SIZE + ServerProtocol::MAX_MESSAGE_SIZE];
+    size_t length = ServerProtocol::Write(buffer, sizeof(buffer), type, payload, size);
+    if (send(client.Socket, buffer, length, MSG_NOSIGNAL) != static_cast<ssize_t>(length))
+        return false;
+    results.BytesOut = results.BytesOut + length;
+    return true;
+}
+
+// joins a match, or follows one
+static bool Join(LoadClient& client, LoadResults& results)
+{
+    uint8_t mode = client.Mode;
+    return client.Spectator ? Send(client, MSG_SPECTATE, &mode, 0, results) : Send(client, MSG_JOIN, &mode, 1, results);
+}
+
+// (re)connects the client and joins a match, the server tops out the board of the previous connection
+static bool Connect(LoadClient& client, int epoll, uint64_t id, const sockaddr_in& server, LoadResults& results)
+{
+    if (client.Socket >= 0)
+        close(client.Socket);
+    client.In.clear();
+    client.Mirror.Playing = false;
+    client.Viewer.Playing = false;
+    client.Expected = 0;
+
+    client.Socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (client.Socket >= 0 && connect(client.Socket, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0)
+    {
+        close(client.Socket);
+        client.Socket = -1;
+    }
+    if (client.Socket < 0)
+        return false;
+
+    int enable = 1;
+    setsockopt(client.Socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    epoll_event event = { EPOLLIN, { .u64 = id } };
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, client.Socket, &event) != 0)
+        return false;
+
+    results.Connected = results.Connected + 1;
+    return Join(client, results);
+}
+
+static void Receive(LoadClient& client, LoadResults& results, bool& lost)
+{
+    uint8_t buffer[4096];
+    ssize_t received = recv(client.Socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        lost = true;
+        return;
+    }
+    if (received < 0)
+        return;
+    results.BytesIn = results.BytesIn + received;
+    if (client.Spectator)
+        results.SpectatorBytes = results.SpectatorBytes + received;
+    client.In.insert(client.In.end(), buffer, buffer + received);
+
+    size_t offset = 0;
+    while (true)
+    {
+        uint8_t type;
+        const uint8_t *payload;
+        size_t size;
+        size_t length = ServerProtocol::Read(client.In.data() + offset, client.In.size() - offset, type, payload, size);
+        if (length == 0)
+            break;
+        if (client.Spectator)
+        {
+            size_t mismatches = client.Viewer.Mismatches;
+            if (length == SIZE_MAX || !client.Viewer.Apply(type, payload, size))
+            {
+                lost = true;
+                return;
+            }
+            offset = offset + length;
+            results.Mismatches = results.Mismatches + client.Viewer.Mismatches - mismatches;
+            if (type == MSG_FRAME)
+                results.Frames = results.Frames + 1;
+            else if (type == MSG_END)
+            {
+                results.Followed = results.Followed + 1;
+                if (!Join(client, results))
+                    lost = true;
+            }
+            continue;
+        }
+
+        size_t desyncs = client.Mirror.Desyncs;
+        if (length == SIZE_MAX || !client.Mirror.Apply(type, payload, size))
+        {
+            lost = true;
+            return;
+        }
+        offset = offset + length;
+        results.Desyncs = results.Desyncs + client.Mirror.Desyncs - desyncs;
+
+        Clock::time_point now = Clock::now();
+        const GameBoard *board = client.Mirror.Board[client.Mirror.Player].get();
+        if (type == MSG_START)
+        {
+            client.MatchStart = now;
+            client.NextDecision = now;
+            client.Expected = 0;
+        }
+        else if (type == MSG_TICK && client.Expected > 0 && board->PiecesPlaced >= client.Expected)
+        {
+            results.Latencies.push_back(std::chrono::duration<double, std::milli>(now - client.SentAt).count());
+            results.Placements = results.Placements + 1;
+            client.Expected = 0;
+        }
+        else if (type == MSG_END)
+        {
+            results.Matches = results.Matches + 1;
+            if (client.Mirror.Winner == client.Mirror.Player)
+                results.Wins = results.Wins + 1;
+            if (!Join(client, results))
+                lost = true;
+        }
+    }
+    client.In.erase(client.In.begin(), client.In.begin() + offset);
+}
+
+// decides and sends the next placement of the client's board if it's time
+static bool Play(LoadClient& client, Bot& bot, float pps, LoadResults& results)
+{
+    Clock::time_point now = Clock::now();
+    if (!client.Mirror.Playing || client.Expected > 0 || now < client.NextDecision)
+        return true;
+    const GameBoard& board = *client.Mirror.Board[client.Mirror.Player];
+    if (board.IsOver)
+        return true;
+
+    BotDecision decision = bot.Think(board);
+    if (!decision.Valid || decision.Moves.empty())
+    {
+        results.GaveUp = results.GaveUp + 1;
+        return false;
+    }
+
+    // stamped with the tick of the client's clock, split in inputs of a tick at most
+    uint32_t tick = static_cast<uint32_t>(std::chrono::duration<double>(now - client.MatchStart).count() * SERVER_TICK_RATE);
+    uint8_t payload[4 + sizeof(TickInput)];
+    TickInput input = {};
+    for (auto move = decision.Moves.begin(); move != decision.Moves.end(); move++)
+    {
+        input.Moves[input.Count] = static_cast<uint8_t>(*move);
+        input.Count = input.Count + 1;
+        if (input.Count == MAX_TICK_MOVES || std::next(move) == decision.Moves.end())
+        {
+            std::memcpy(payload, &tick, sizeof(tick));
+            std::memcpy(payload + 4, &input, sizeof(input));
+            if (!Send(client, MSG_INPUT, payload, sizeof(payload), results))
+                return false;
+            results.Inputs = results.Inputs + 1;
+            input = {};
+        }
+    }
+
+    client.Expected = board.PiecesPlaced + 1;
+    client.SentAt = now;
+    client.NextDecision = now + std::chrono::microseconds(static_cast<int64_t>(1e6f / pps));
+    return true;
+}
+
+static void RunClients(const LoadOptions& options, const sockaddr_in& server, unsigned int first, unsigned int players, unsigned int spectators, LoadResults& results)
+{
+    BotConfig config;
+    config.Depth = options.Depth;
+    config.BeamWidth = options.BeamWidth;
+    config.Threads = 1;
+    Bot bot(config, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+
+    int epoll = epoll_create1(0);
+    if (epoll < 0)
+        return;
+
+    unsigned int count = players + spectators;
+    std::vector<LoadClient> clients(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int index = first + i;
+        clients[i].Spectator = i >= players;
+        clients[i].Mode = options.Mode == "sprint" ? MODE_SPRINT : options.Mode == "versus" ? MODE_VERSUS : MatchMode(index % 2);
+        if (!Connect(clients[i], epoll, i, server, results))
+            results.Errors = results.Errors + 1;
+    }
+
+    Clock::time_point end = Clock::now() + std::chrono::seconds(options.Seconds);
+    epoll_event events[256];
+    while (Clock::now() < end)
+    {
+        int ready = epoll_wait(epoll, events, 256, 1);
+        for (int i = 0; i < ready; i++)
+        {
+            LoadClient& client = clients[events[i].data.u64];
+            bool lost = false;
+            Receive(client, results, lost);
+            if (lost)
+            {
+                results.Errors = results.Errors + 1;
+                if (!Connect(client, epoll, events[i].data.u64, server, results))
+                    results.Errors = results.Errors + 1;
+            }
+        }
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (clients[i].Socket >= 0 && !Play(clients[i], bot, options.PPS, results) && !Connect(clients[i], epoll, i, server, results))
+                results.Errors = results.Errors + 1;
+        }
+    }
+
+    for (LoadClient& client: clients)
+    {
+        if (client.Socket >= 0)
+            close(client.Socket);
+    }
+    close(epoll);
+}
+
+int main(int argc, char *argv[])
+{
+    LoadOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        sockaddr_in server = {};
+        server.sin_family = AF_INET;
+        server.sin_port = htons(options.Port);
+        if (inet_pton(AF_INET, options.Host.c_str(), &server.sin_addr) != 1)
+            throw std::runtime_error("not an IPv4 address: " + options.Host);
+
+        unsigned int threads = options.Threads > 0 ? options.Threads : std::max(1u, std::thread::hardware_concurrency());
+        threads = std::max(1u, std::min(threads, options.Clients + options.Spectators));
+        std::vector<LoadResults> results(threads);
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            unsigned int first = options.Clients * t / threads;
+            unsigned int last = options.Clients * (t + 1) / threads;
+            unsigned int spectators = options.Spectators * (t + 1) / threads - options.Spectators * t / threads;
+            workers.emplace_back(RunClients, std::cref(options), std::cref(server), first, last - first, spectators, std::ref(results[t]));
+        }
+        for (std::thread& worker: workers)
+            worker.join();
+
+        LoadResults total;
+        for (const LoadResults& result: results)
+        {
+            total.Connected = total.Connected + result.Connected;
+            total.Matches = total.Matches + result.Matches;
+            total.Wins = total.Wins + result.Wins;
+            total.Placements = total.Placements + result.Placements;
+            total.Inputs = total.Inputs + result.Inputs;
+            total.Desyncs = total.Desyncs + result.Desyncs;
+            total.Errors = total.Errors + result.Errors;
+            total.GaveUp = total.GaveUp + result.GaveUp;
+            total.BytesIn = total.BytesIn + result.BytesIn;
+            total.BytesOut = total.BytesOut + result.BytesOut;
+            total.Followed = total.Followed + result.Followed;
+            total.Frames = total.Frames + result.Frames;
+            total.SpectatorBytes = total.SpectatorBytes + result.SpectatorBytes;
+            total.Mismatches = total.Mismatches + result.Mismatches;
+            total.Latencies.insert(total.Latencies.end(), result.Latencies.begin(), result.Latencies.end());
+        }
+
+        std::sort(total.Latencies.begin(), total.Latencies.end());
+        auto percentile = [&](double p) {
+            return total.Latencies.empty() ? 0.0 : total.Latencies[std::min(total.Latencies.size() - 1, size_t(p * total.Latencies.size()))];
+        };
+        double seconds = options.Seconds;
+        std::cout << options.Clients << " clients on " << threads << " threads, " << total.Connected << " connections, " << total.Errors << " errors, " << total.GaveUp << " gave up" << std::endl;
+        std::cout << "matches " << total.Matches << " finished (" << total.Wins << " won), placements " << total.Placements << " (" << total.Placements / seconds << "/s), inputs " << total.Inputs << std::endl;
+        std::cout << "latency ms: p50 " << percentile(0.5) << ", p99 " << percentile(0.99) << ", max " << (total.Latencies.empty() ? 0.0 : total.Latencies.back()) << std::endl;
+        std::cout << "bytes: " << total.BytesIn / seconds / 1024 << " KB/s in, " << total.BytesOut / seconds / 1024 << " KB/s out, "
+                  << double(total.BytesIn - total.SpectatorBytes) / seconds / std::max(1u, options.Clients) << " B/s per client" << std::endl;
+        if (options.Spectators > 0)
+        {
+            std::cout << "spectators: " << total.Followed << " matches followed, " << total.Frames << " frames, "
+                      << double(total.SpectatorBytes) / seconds / options.Spectators << " B/s per spectator, " << total.Mismatches << " mismatches" << std::endl;
+        }
+        std::cout << "desyncs " << total.Desyncs << std::endl;
+        if (total.Desyncs > 0 || total.Mismatches > 0)
+            return 1;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,277 @@
+// stacker-netsim: loopback harness of the rollback netcode.
+//
+// Two peers play a bot versus match, each with its own RollbackSession, and exchange their packets
+// through a simulated network (latency, jitter, loss), optionally over real UDP sockets on localhost.
+// Each bot decides on its boards as predicted at that moment, like a player would. Once both peers
+// reached the last tick and received all the remote inputs, their boards must equal a plain
+// simulation of both input logs without any rollback. --corrupt alters an input on its way to one
+// peer only, to check that the state hashes catch the desync at the tick it happened.
+
+#include "Rollback.h"
+#include "Bot.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+struct NetsimOptions
+{
+    unsigned int Ticks = 3600;
+    double Latency = 60.0;          // ms, one way
+    double Jitter = 20.0;           // ms
+    double Loss = 5.0;              // percent
+    unsigned int Seed = 1;
+    float PPS = 3.0f;
+    int Depth = 2;
+    int BeamWidth = 32;
+    unsigned int GarbageDelay = 1;
+    unsigned int Messiness = 30;
+    unsigned int Port = 0;          // 0 passes the packets in memory
+    int CorruptTick = -1;           // -1 never corrupts
+};
+
+struct Peer
+{
+    std::unique_ptr<RollbackSession> Session;
+    std::unique_ptr<Bot> Player;
+    std::unique_ptr<UdpSocket> Socket;
+    std::deque<MoveType> Plan;      // moves of the last decision not executed yet
+    std::vector<TickInput> Log;     // local input of every tick
+    uint32_t NextDecision = 0;
+    size_t Stalls = 0;              // frames waiting for the remote peer
+    double TotalSeconds = 0.0;      // in AdvanceTick
+    double MaxSeconds = 0.0;
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-netsim [options]\n"
+        "  --ticks N         ticks of the match, 60 per second (default 3600)\n"
+        "  --latency MS      one way latency (default 60)\n"
+        "  --jitter MS       random extra delay, packets can arrive out of order (default 20)\n"
+        "  --loss PERCENT    packets lost (default 5)\n"
+        "  --seed N          seed of the match and the network (default 1)\n"
+        "  --pps N           pieces per second of the bots (default 3)\n"
+        "  --depth N         bot search depth (default 2)\n"
+        "  --beam N          bot beam width (default 32)\n"
+        "  --delay N         garbage delay in placements (default 1)\n"
+        "  --messiness N     garbage messiness in percent (default 30)\n"
+        "  --udp PORT        send the packets over UDP on localhost, ports PORT and PORT + 1 (default in memory)\n"
+        "  --corrupt TICK    peer 1 receives a hard drop instead of the remote input of TICK, a desync to detect\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], NetsimOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--ticks")               options.Ticks = std::stoul(value);
+        else if (arg == "--latency")        options.Latency = std::stod(value);
+        else if (arg == "--jitter")         options.Jitter = std::stod(value);
+        else if (arg == "--loss")           options.Loss = std::stod(value);
+        else if (arg == "--seed")           options.Seed = std::stoul(value);
+        else if (arg == "--pps")            options.PPS = std::stof(value);
+        else if (arg == "--depth")          options.Depth = std::stoi(value);
+        else if (arg == "--beam")           options.BeamWidth = std::stoi(value);
+        else if (arg == "--delay")          options.GarbageDelay = std::stoul(value);
+        else if (arg == "--messiness")      options.Messiness = std::stoul(value);
+        else if (arg == "--udp")            options.Port = std::stoul(value);
+        else if (arg == "--corrupt")        options.CorruptTick = std::stoi(value);
+        else return false;
+    }
+    return true;
+}
+
+// the next input of the peer's bot, a new decision is taken at the requested rate
+static TickInput NextInput(Peer& peer, unsigned int ticksPerPiece)
+{
+    RollbackSession& session = *peer.Session;
+    const GameBoard& board = *session.Boards[session.LocalPlayer];
+    if (peer.Plan.empty() && session.Tick >= peer.NextDecision && !board.IsOver)
+    {
+        BotDecision decision = peer.Player->Think(board);
+        if (decision.Valid)
+            peer.Plan.insert(peer.Plan.end(), decision.Moves.begin(), decision.Moves.end());
+        peer.NextDecision = session.Tick + ticksPerPiece;
+    }
+
+    TickInput input = {};
+    while (!peer.Plan.empty() && input.Count < MAX_TICK_MOVES)
+    {
+        input.Moves[input.Count] = peer.Plan.front();
+        input.Count = input.Count + 1;
+        peer.Plan.pop_front();
+    }
+    return input;
+}
+
+// replaces the input of the tick if the packet carries it, like a corruption the packet checks can't see
+static void CorruptPacket(std::vector<uint8_t>& packet, uint32_t tick)
+{
+    // see the packet layout in Rollback.h
+    uint32_t header[7];
+    if (packet.size() < sizeof(header))
+        return;
+    std::memcpy(header, packet.data(), sizeof(header));
+    if (tick < header[1] || tick >= header[1] + header[3])
+        return;
+
+    TickInput input = {};
+    input.Count = 1;
+    input.Moves[0] = HARDDROP;
+    std::memcpy(packet.data() + sizeof(header) + (tick - header[1]) * sizeof(TickInput), &input, sizeof(TickInput));
+}
+
+static bool SameBoard(const GameBoard& a, const GameBoard& b)
+{
+    return std::memcmp(a.Matrix, b.Matrix, sizeof(a.Matrix)) == 0
+        && std::equal(a.TetrominoQueue.begin(), a.TetrominoQueue.end(), b.TetrominoQueue.begin(), b.TetrominoQueue.end())
+        && a.CurrentPiece == b.CurrentPiece && a.HoldPiece == b.HoldPiece
+        && a.CurrentPosition == b.CurrentPosition && a.CurrentRotation == b.CurrentRotation
+        && a.PiecesPlaced == b.PiecesPlaced && a.LinesSent == b.LinesSent
+        && a.PendingGarbageLines() == b.PendingGarbageLines() && a.IsOver == b.IsOver;
+}
+
+int main(int argc, char *argv[])
+{
+    NetsimOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        BotConfig config;
+        config.Depth = options.Depth;
+        config.BeamWidth = options.BeamWidth;
+        config.Threads = 1;
+        unsigned int ticksPerPiece = std::max(1, static_cast<int>(60.0f / options.PPS));
+
+        Peer peers[2];
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            peers[i].Session = std::make_unique<RollbackSession>(i, options.Seed, options.GarbageDelay, options.Messiness);
+            peers[i].Player = std::make_unique<Bot>(config, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+            if (options.Port > 0)
+                peers[i].Socket = std::make_unique<UdpSocket>(options.Port + i, "127.0.0.1", options.Port + 1 - i);
+        }
+
+        // links[i] carries the packets peer i sends
+        LossyLink links[2] = {
+            LossyLink(options.Latency, options.Jitter, options.Loss / 100.0, options.Seed * 2),
+            LossyLink(options.Latency, options.Jitter, options.Loss / 100.0, options.Seed * 2 + 1),
+        };
+
+        // a frame per tick, until both peers played all the ticks and know all the remote inputs
+        std::vector<uint8_t> packet;
+        uint8_t buffer[RollbackSession::MAX_PACKET_SIZE];
+        uint64_t frame = 0;
+        auto done = [&](const Peer& peer) {
+            return peer.Session->Tick == options.Ticks && peer.Session->ConfirmedTick() == options.Ticks;
+        };
+        while (!done(peers[0]) || !done(peers[1]))
+        {
+            double now = frame * 1000.0 / 60.0;
+            for (unsigned int i = 0; i < 2; i++)
+            {
+                Peer& peer = peers[i];
+                while (links[1 - i].Receive(now, packet))
+                {
+                    if (i == 1 && options.CorruptTick >= 0)
+                        CorruptPacket(packet, options.CorruptTick);
+                    if (peer.Socket)
+                        peers[1 - i].Socket->Send(packet.data(), packet.size());
+                    else
+                        peer.Session->ReadPacket(packet.data(), packet.size());
+                }
+                while (size_t size = peer.Socket ? peer.Socket->Receive(buffer, sizeof(buffer)) : 0)
+                    peer.Session->ReadPacket(buffer, size);
+
+                if (peer.Session->Tick < options.Ticks && peer.Session->CanAdvance())
+                {
+                    TickInput input = NextInput(peer, ticksPerPiece);
+                    auto start = std::chrono::steady_clock::now();
+                    peer.Session->AdvanceTick(input);
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    peer.TotalSeconds = peer.TotalSeconds + seconds;
+                    peer.MaxSeconds = std::max(peer.MaxSeconds, seconds);
+                    peer.Log.push_back(input);
+                }
+                else if (peer.Session->Tick < options.Ticks)
+                    peer.Stalls = peer.Stalls + 1;
+
+                links[i].Send(now, buffer, peer.Session->WritePacket(buffer));
+            }
+
+            frame = frame + 1;
+            if (frame > 100ull * options.Ticks + 10000)
+                throw std::runtime_error("the peers stopped exchanging inputs");
+        }
+
+        // the inputs received last haven't been rolled back into the boards yet
+        peers[0].Session->Resimulate();
+        peers[1].Session->Resimulate();
+
+        // the same match without network: both logs, tick by tick
+        GameBoard reference[2] = {
+            GameBoard(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE),
+            GameBoard(SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE),
+        };
+        for (unsigned int i = 0; i < 2; i++)
+            reference[i].LoadMatch(options.Seed, i, options.GarbageDelay, options.Messiness);
+        for (unsigned int tick = 0; tick < options.Ticks; tick++)
+            RollbackSession::SimulateTick(reference[0], reference[1], peers[0].Log[tick], peers[1].Log[tick]);
+
+        bool synchronized = true;
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            const Peer& peer = peers[i];
+            const RollbackStats& stats = peer.Session->Stats;
+            bool same = SameBoard(*peer.Session->Boards[0], reference[0]) && SameBoard(*peer.Session->Boards[1], reference[1]);
+            synchronized = synchronized && same;
+
+            std::cout << "peer " << i << ": " << (same ? "in sync" : "DESYNC")
+                      << ", rollbacks " << stats.Rollbacks << " (" << stats.ResimulatedTicks << " ticks, at most " << stats.MaxRollback << ")"
+                      << ", stalls " << peer.Stalls
+                      << ", packets " << stats.PacketsReceived << " received, " << links[1 - i].Dropped << " lost, " << stats.PacketsIgnored << " ignored"
+                      << ", tick " << peer.TotalSeconds * 1e6 / options.Ticks << "us avg, " << peer.MaxSeconds * 1e6 << "us max"
+                      << ", hashes " << peer.Session->HashesChecked << " checked" << std::endl;
+        }
+
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            const RollbackSession& session = *peers[i].Session;
+            if (session.DesyncTick < 0)
+                continue;
+            synchronized = false;
+            std::cout << "peer " << i << ": hashes differ after tick " << session.DesyncTick
+                      << std::hex << ", local " << session.DesyncHashes[0] << ", remote " << session.DesyncHashes[1] << std::dec << "\n"
+                      << session.DesyncDump;
+        }
+        std::cout << "boards: " << reference[0].PiecesPlaced << " / " << reference[1].PiecesPlaced << " pieces, "
+                  << reference[0].LinesSent << " / " << reference[1].LinesSent << " lines sent"
+                  << (reference[0].IsOver ? ", player 0 topped out" : "") << (reference[1].IsOver ? ", player 1 topped out" : "") << std::endl;
+
+        if (!synchronized)
+            return 1;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+// stacker-pcprob: perfect clear odds of a position over every continuation of the bag.
+//
+// The pieces beyond the known queue are unknown but follow the 7-bag: the tool enumerates every
+// order the rest of the current bag (and the next bags if more pieces are needed) can come in,
+// solves each resulting queue with and without hold on all cores, and reports the success rates.
+// Solvers share their memo tables, so states reached by several continuations are solved once.
+
+#include "PerfectClear.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+
+struct OddsOptions
+{
+    std::string Board;              // rows from top to bottom separated by '/', '.' or '_' for empty cells
+    std::string Queue;              // current piece followed by the previews
+    std::string Hold;
+    std::string BagUsed;            // pieces of the current bag drawn before the current piece
+    int MaxHeight = 4;
+    unsigned int Threads = 0;
+    size_t MaxSequences = 1000000;
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-pcprob --queue PIECES [options]\n"
+        "  --queue PIECES    current piece followed by the known previews, e.g. TIOSZ\n"
+        "  --board ROWS      rows from top to bottom separated by '/', '.' is empty, e.g. X...XXXXXX/XX..XXXXXX\n"
+        "  --hold P          piece in hold (default none)\n"
+        "  --bag-used PIECES pieces of the current bag drawn before the current piece (default none)\n"
+        "  --height N        highest perfect clear searched, in lines (default 4)\n"
+        "  --threads N       worker threads, 0 for all cores (default 0)\n"
+        "  --max N           refuse to enumerate more continuations than this (default 1000000)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], OddsOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--queue")               options.Queue = value;
+        else if (arg == "--board")          options.Board = value;
+        else if (arg == "--hold")           options.Hold = value;
+        else if (arg == "--bag-used")       options.BagUsed = value;
+        else if (arg == "--height")         options.MaxHeight = std::stoi(value);
+        else if (arg == "--threads")        options.Threads = std::stoul(value);
+        else if (arg == "--max")            options.MaxSequences = std::stoull(value);
+        else return false;
+    }
+    return !options.Queue.empty();
+}
+
+static std::vector<MinoType> ParsePieces(const std::string& letters)
+{
+    std::vector<MinoType> pieces;
+    for (char letter: letters)
+        pieces.push_back(ParsePiece(letter));
+    return pieces;
+}
+
+// appends every order of 'count' pieces the bags can deal, starting with the pieces left in the current bag
+static void Continuations(std::vector<MinoType>& sequence, std::vector<MinoType> bagLeft, size_t count, std::vector<std::vector<MinoType>>& out, size_t limit)
+{
+    if (out.size() > limit)
+        return;
+    if (count == 0)
+    {
+        out.push_back(sequence);
+        return;
+    }
+    if (bagLeft.empty())
+        bagLeft.assign(SEVEN_PIECE_BAG.begin(), SEVEN_PIECE_BAG.end());
+
+    for (size_t i = 0; i < bagLeft.size(); i++)
+    {
+        std::vector<MinoType> rest = bagLeft;
+        rest.erase(rest.begin() + i);
+        sequence.push_back(bagLeft[i]);
+        Continuations(sequence, rest, count - 1, out, limit);
+        sequence.pop_back();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    OddsOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        BotSnapshot snapshot;
+        snapshot.State.Board = Bitboard::Parse(options.Board);
+        snapshot.State.Hold = options.Hold.empty() ? EMPTY : ParsePiece(options.Hold[0]);
+        snapshot.State.QueueIndex = 0;
+        snapshot.State.Combo = 0;
+        snapshot.State.BackToBack = 0;
+        snapshot.HoldUsed = false;
+
+        std::vector<MinoType> known = ParsePieces(options.Queue);
+        snapshot.State.Current = known.front();
+
+        // replay the bag to know which pieces are left in it once the known queue is exhausted
+        std::vector<MinoType> bagLeft(SEVEN_PIECE_BAG.begin(), SEVEN_PIECE_BAG.end());
+        std::vector<MinoType> drawn = ParsePieces(options.BagUsed);
+        drawn.insert(drawn.end(), known.begin(), known.end());
+        for (MinoType piece: drawn)
+        {
+            if (bagLeft.empty())
+                bagLeft.assign(SEVEN_PIECE_BAG.begin(), SEVEN_PIECE_BAG.end());
+            auto found = std::find(bagLeft.begin(), bagLeft.end(), piece);
+            if (found == bagLeft.end())
+                throw std::runtime_error("the queue can't come from a 7-bag (piece drawn twice in a bag)");
+            bagLeft.erase(found);
+        }
+
+        // pieces needed by the highest reachable perfect clear, plus one that may stay in hold
+        int stackHeight = snapshot.State.Board.StackHeight();
+        int filled = 0;
+        for (int row = 0; row < stackHeight; row++)
+            filled = filled + std::popcount(snapshot.State.Board.Rows[row]);
+        int placements = 0;
+        for (int height = std::max(1, stackHeight); height <= options.MaxHeight; height++)
+        {
+            if ((height * MATRIX_COLS - filled) % 4 == 0)
+                placements = (height * MATRIX_COLS - filled) / 4;
+        }
+        if (placements == 0)
+            throw std::runtime_error("no perfect clear fits within " + std::to_string(options.MaxHeight) + " lines");
+
+        int available = known.size() + (snapshot.State.Hold != EMPTY);
+        size_t unknown = std::max(0, placements + 1 - available);
+
+        std::vector<std::vector<MinoType>> sequences;
+        std::vector<MinoType> sequence;
+        Continuations(sequence, bagLeft, unknown, sequences, options.MaxSequences);
+        if (sequences.size() > options.MaxSequences)
+            throw std::runtime_error("more than " + std::to_string(options.MaxSequences) + " continuations, raise --max");
+
+        std::cout << sequences.size() << " continuations of " << unknown << " unknown pieces" << std::endl;
+
+        // one single threaded solver per worker and per rule, the memo tables are shared
+        ThreadPool pool(options.Threads);
+        PerfectClearConfig withHold;
+        withHold.MaxHeight = options.MaxHeight;
+        withHold.Threads = 1;
+        PerfectClearConfig withoutHold = withHold;
+        withoutHold.Hold = false;
+        auto memoHold = std::make_shared<TranspositionTable>(22);
+        auto memoNoHold = std::make_shared<TranspositionTable>(22);
+
+        std::vector<std::unique_ptr<PerfectClearSolver>> holdSolvers, noHoldSolvers;
+        for (unsigned int i = 0; i < pool.Size(); i++)
+        {
+            holdSolvers.push_back(std::make_unique<PerfectClearSolver>(withHold, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE, memoHold));
+            noHoldSolvers.push_back(std::make_unique<PerfectClearSolver>(withoutHold, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE, memoNoHold));
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        std::atomic<size_t> successHold(0), successNoHold(0);
+        pool.ParallelFor(sequences.size(), [&](size_t index, unsigned int worker) {
+            BotSnapshot query = snapshot;
+            query.Queue.assign(known.begin() + 1, known.end());
+            query.Queue.insert(query.Queue.end(), sequences[index].begin(), sequences[index].end());
+
+            // whatever works without hold also works with it, only the failures are searched twice
+            if (noHoldSolvers[worker]->Solve(query).Found)
+            {
+                successNoHold.fetch_add(1, std::memory_order_relaxed);
+                successHold.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (holdSolvers[worker]->Solve(query).Found)
+                successHold.fetch_add(1, std::memory_order_relaxed);
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        auto report = [&](const char* label, size_t successes) {
+            std::cout << label << successes << "/" << sequences.size()
+                      << " (" << 100.0 * successes / sequences.size() << "%)" << std::endl;
+        };
+        report("with hold:    ", successHold.load());
+        report("without hold: ", successNoHold.load());
+        std::cout << "solved in " << seconds << "s" << std::endl;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
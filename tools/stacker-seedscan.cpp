@@ -0,0 +1,401 @@
+// stacker-seedscan: finds bag seeds whose first bags have given properties, for curated challenges.
+//
+// Deals the first bags of every seed of a range on all cores (SeedScanner::DealLanes, bit exact with
+// GameBoard::Load) and keeps the seeds passing every filter, cheapest filters first:
+//  - piece positions: a piece among the first N pieces
+//  - opener: a field (e.g. an opener's shape) can be built from the dealt pieces, the pieces it doesn't
+//    use can only go to hold
+//  - perfect clear: a perfect clear of up to 4 lines exists with hold using the first N pieces
+// Matches are written in seed order to an indexed file, see SeedScanner.h for the format.
+
+#include "SeedScanner.h"
+#include "PerfectClear.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <algorithm>
+#include <bit>
+
+static const uint32_t BLOCK_SEEDS = 1 << 16;
+static const unsigned int MAX_PC_PIECES = 11;
+
+struct PieceWithin
+{
+    MinoType Piece;
+    unsigned int Count;             // the piece is among the first Count pieces
+};
+
+struct ScanOptions
+{
+    uint32_t First = 0;
+    uint32_t Last = 0xFFFFFFFF;
+    unsigned int Bags = 2;
+    std::vector<PieceWithin> Pieces;
+    std::string Opener;
+    unsigned int PerfectClear = 0;  // pieces the perfect clear is searched with, 0 for no search
+    unsigned int Threads = 0;
+    uint64_t Limit = 0;             // 0 for no limit
+    std::string Output = "seeds.stks";
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-seedscan [options]\n"
+        "  --from N          first seed scanned (default 0)\n"
+        "  --to N            last seed scanned (default 4294967295)\n"
+        "  --bags N          bags dealt per seed, 1 to " << MAX_SCAN_BAGS << " (default 2)\n"
+        "  --piece PN        piece P among the first N pieces, e.g. I3, may be repeated\n"
+        "  --opener ROWS     field built with hold from the dealt pieces, rows from top to bottom separated\n"
+        "                    by '/', piece letters for the opener, X for cells filled beforehand, '.' empty\n"
+        "  --pc N            a perfect clear with hold using the first N pieces, 5 to " << MAX_PC_PIECES << " (slow, checked last)\n"
+        "  --threads N       worker threads, 0 for all cores (default 0)\n"
+        "  --limit N         stop after N matches (default no limit)\n"
+        "  --output FILE     output file (default seeds.stks)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], ScanOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--from")                options.First = std::stoul(value);
+        else if (arg == "--to")             options.Last = std::stoul(value);
+        else if (arg == "--bags")           options.Bags = std::stoul(value);
+        else if (arg == "--piece")          options.Pieces.push_back(PieceWithin{ ParsePiece(value[0]), static_cast<unsigned int>(std::stoul(value.substr(1))) });
+        else if (arg == "--opener")         options.Opener = value;
+        else if (arg == "--pc")             options.PerfectClear = std::stoul(value);
+        else if (arg == "--threads")        options.Threads = std::stoul(value);
+        else if (arg == "--limit")          options.Limit = std::stoull(value);
+        else if (arg == "--output")         options.Output = value;
+        else return false;
+    }
+    return options.First <= options.Last;
+}
+
+// An opener split into pieces, with for every set of pieces already built which of the others can
+// then be placed exactly on their cells. Checking a seed is then a small search over the hold choices.
+class Opener
+{
+    public:
+        Opener(const std::string& rows, Bot& generator)
+        {
+            std::vector<std::string> lines;
+            size_t start = 0;
+            while (start <= rows.size())
+            {
+                size_t end = rows.find('/', start);
+                if (end == std::string::npos)
+                    end = rows.size();
+                lines.push_back(rows.substr(start, end - start));
+                start = end + 1;
+            }
+
+            std::vector<std::string> cells(lines.rbegin(), lines.rend());
+            Bitboard base;
+            base.Clear();
+            for (size_t row = 0; row < cells.size(); row++)
+            {
+                if (cells[row].size() != MATRIX_COLS)
+                    throw std::runtime_error("opener rows must be " + std::to_string(MATRIX_COLS) + " cells wide: " + cells[row]);
+                for (int col = 0; col < MATRIX_COLS; col++)
+                {
+                    if (cells[row][col] == 'X' || cells[row][col] == 'x')
+                        base.Rows[row] |= 1 << col;
+                }
+            }
+            base.Hash = base.ComputeHash();
+
+            // every 4 connected cells of a letter are a piece
+            for (size_t row = 0; row < cells.size(); row++)
+            {
+                for (int col = 0; col < MATRIX_COLS; col++)
+                {
+                    char letter = cells[row][col];
+                    if (letter == '.' || letter == '_' || letter == 'X' || letter == 'x' || letter == '*')
+                        continue;
+
+                    Part part = { ParsePiece(letter), {} };
+                    std::vector<glm::ivec2> stack = { glm::ivec2(row, col) };
+                    int size = 0;
+                    while (!stack.empty())
+                    {
+                        glm::ivec2 cell = stack.back();
+                        stack.pop_back();
+                        if (cell.x < 0 || cell.x >= static_cast<int>(cells.size()) || cell.y < 0 || cell.y >= MATRIX_COLS || cells[cell.x][cell.y] != letter)
+                            continue;
+
+                        cells[cell.x][cell.y] = '*';
+                        part.Rows[cell.x] |= 1 << cell.y;
+                        size = size + 1;
+                        stack.insert(stack.end(), { cell + glm::ivec2(1, 0), cell - glm::ivec2(1, 0), cell + glm::ivec2(0, 1), cell - glm::ivec2(0, 1) });
+                    }
+                    if (size != 4)
+                        throw std::runtime_error(std::string("opener piece ") + letter + " has " + std::to_string(size) + " cells, pieces of the same kind can't touch");
+                    Parts.push_back(part);
+                }
+            }
+            if (Parts.empty() || Parts.size() > MAX_PARTS)
+                throw std::runtime_error("an opener has 1 to " + std::to_string(MAX_PARTS) + " pieces");
+
+            // placements covering exactly the cells of a part, on the board of every set of built parts
+            Placeable.assign(static_cast<size_t>(1) << Parts.size(), 0);
+            std::vector<Placement> placements;
+            for (uint32_t built = 0; built < Placeable.size(); built++)
+            {
+                Bitboard board = base;
+                for (size_t p = 0; p < Parts.size(); p++)
+                {
+                    if (built & (1 << p))
+                        Add(board, Parts[p]);
+                }
+                board.Hash = board.ComputeHash();
+
+                for (size_t p = 0; p < Parts.size(); p++)
+                {
+                    if (built & (1 << p))
+                        continue;
+
+                    Bitboard target = board;
+                    Add(target, Parts[p]);
+                    generator.GeneratePlacements(board, Parts[p].Piece, placements, false);
+                    for (const Placement& placement: placements)
+                    {
+                        Bitboard candidate = board;
+                        candidate.Place(generator.Pieces.Shapes[placement.Piece][placement.Rotation], placement.Position);
+                        if (std::equal(candidate.Rows, candidate.Rows + MATRIX_ROWS, target.Rows))
+                        {
+                            Placeable[built] |= 1 << p;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        bool Buildable(const MinoType *pieces, unsigned int count) const
+        {
+            return Build(pieces, count, 1, pieces[0], EMPTY, 0, true);
+        }
+
+    private:
+        static const size_t MAX_PARTS = 12;
+
+        struct Part
+        {
+            MinoType Piece;
+            uint16_t Rows[MATRIX_ROWS];
+        };
+
+        std::vector<Part> Parts;
+        std::vector<uint16_t> Placeable;         // [built parts], bit p when part p can be placed next
+
+        static void Add(Bitboard& board, const Part& part)
+        {
+            for (int row = 0; row < MATRIX_ROWS; row++)
+                board.Rows[row] |= part.Rows[row];
+        }
+
+        // next is the index of the next piece to draw, a piece can only be held once
+        bool Build(const MinoType *pieces, unsigned int count, unsigned int next, MinoType current, MinoType hold, uint32_t built, bool canHold) const
+        {
+            if (built == Placeable.size() - 1)
+                return true;
+            if (current == EMPTY)
+                return false;
+
+            MinoType drawn = next < count ? pieces[next] : EMPTY;
+            for (size_t p = 0; p < Parts.size(); p++)
+            {
+                if (Parts[p].Piece == current && (Placeable[built] & (1 << p)) && Build(pieces, count, next + 1, drawn, hold, built | (1 << p), true))
+                    return true;
+            }
+
+            if (!canHold)
+                return false;
+            if (hold == EMPTY)
+                return Build(pieces, count, next + 1, drawn, current, built, false);
+            return Build(pieces, count, next, hold, current, built, false);
+        }
+};
+
+// index of the first pieces among every order of distinct pieces of a bag
+static uint32_t ArrangementIndex(const MinoType *pieces, unsigned int count)
+{
+    uint32_t index = 0;
+    uint8_t used = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        int rank = std::popcount(static_cast<uint8_t>(~used & ((1 << pieces[i]) - 1) & 0xFE));
+        index = index * (7 - i) + rank;
+        used |= 1 << pieces[i];
+    }
+    return index;
+}
+
+static uint32_t Arrangements(unsigned int count)
+{
+    uint32_t arrangements = 1;
+    for (unsigned int i = 0; i < count; i++)
+        arrangements = arrangements * (7 - i);
+    return arrangements;
+}
+
+int main(int argc, char *argv[])
+{
+    ScanOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        if (options.PerfectClear && (options.PerfectClear < 5 || options.PerfectClear > MAX_PC_PIECES))
+            throw std::runtime_error("--pc searches with 5 to " + std::to_string(MAX_PC_PIECES) + " pieces");
+        if (options.PerfectClear > options.Bags * 7)
+            throw std::runtime_error("--pc " + std::to_string(options.PerfectClear) + " needs more bags dealt");
+        for (const PieceWithin& condition: options.Pieces)
+        {
+            if (condition.Count == 0 || condition.Count > options.Bags * 7)
+                throw std::runtime_error("--piece looks at 1 to " + std::to_string(options.Bags * 7) + " pieces");
+        }
+
+        std::string filter;
+        for (int i = 1; i < argc; i++)
+            filter = filter + (i > 1 ? " " : "") + argv[i];
+        SeedMatchWriter writer(options.Output, options.Bags, filter);
+
+        ThreadPool pool(options.Threads);
+        Bot generator(BotConfig{ .Threads = 1, .HashBits = 0, .Weights = BotWeights() }, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE);
+        std::unique_ptr<Opener> opener = options.Opener.empty() ? nullptr : std::make_unique<Opener>(options.Opener, generator);
+
+        // the pieces searched are the start of the first bag and maybe of the second one, each order is solved once
+        std::unique_ptr<std::atomic<uint8_t>[]> pcResults;
+        std::vector<std::unique_ptr<PerfectClearSolver>> solvers;
+        if (options.PerfectClear)
+        {
+            pcResults.reset(new std::atomic<uint8_t>[Arrangements(std::min(options.PerfectClear, 7u)) * Arrangements(options.PerfectClear - std::min(options.PerfectClear, 7u))]());
+            PerfectClearConfig config;
+            config.Threads = 1;
+            auto memo = std::make_shared<TranspositionTable>(22);
+            for (unsigned int i = 0; i < pool.Size(); i++)
+                solvers.push_back(std::make_unique<PerfectClearSolver>(config, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE, memo));
+        }
+
+        auto passes = [&](const MinoType *pieces, unsigned int worker) {
+            for (const PieceWithin& condition: options.Pieces)
+            {
+                if (std::find(pieces, pieces + condition.Count, condition.Piece) == pieces + condition.Count)
+                    return false;
+            }
+            if (opener && !opener->Buildable(pieces, options.Bags * 7))
+                return false;
+            if (options.PerfectClear)
+            {
+                // 0 unknown, 1 no perfect clear, 2 perfect clear
+                unsigned int first = std::min(options.PerfectClear, 7u), second = options.PerfectClear - first;
+                std::atomic<uint8_t>& known = pcResults[ArrangementIndex(pieces, first) * Arrangements(second) + ArrangementIndex(pieces + 7, second)];
+                if (known.load(std::memory_order_relaxed) == 0)
+                {
+                    BotSnapshot query;
+                    query.State.Board.Clear();
+                    query.State.Current = pieces[0];
+                    query.State.Hold = EMPTY;
+                    query.State.QueueIndex = 0;
+                    query.State.Combo = 0;
+                    query.State.BackToBack = 0;
+                    query.Queue.assign(pieces + 1, pieces + options.PerfectClear);
+                    query.HoldUsed = false;
+                    known.store(solvers[worker]->Solve(query).Found ? 2 : 1, std::memory_order_relaxed);
+                }
+                if (known.load(std::memory_order_relaxed) != 2)
+                    return false;
+            }
+            return true;
+        };
+
+        uint64_t seeds = static_cast<uint64_t>(options.Last) - options.First + 1;
+        uint64_t blocks = (seeds + BLOCK_SEEDS - 1) / BLOCK_SEEDS;
+        uint64_t wave = pool.Size() * 4;
+        std::vector<std::vector<SeedMatch>> results(wave);
+
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t scanned = 0;
+        double nextReport = 0.0;
+        for (uint64_t firstBlock = 0; firstBlock < blocks; firstBlock = firstBlock + wave)
+        {
+            uint64_t count = std::min(wave, blocks - firstBlock);
+            pool.ParallelFor(count, [&](size_t index, unsigned int worker) {
+                std::vector<SeedMatch>& matches = results[index];
+                matches.clear();
+
+                uint64_t blockFirst = options.First + (firstBlock + index) * BLOCK_SEEDS;
+                uint64_t blockEnd = std::min<uint64_t>(blockFirst + BLOCK_SEEDS, static_cast<uint64_t>(options.Last) + 1);
+                MinoType pieces[SeedScanner::LANES * MAX_SCAN_BAGS * 7];
+                for (uint64_t seed = blockFirst; seed < blockEnd; seed = seed + SeedScanner::LANES)
+                {
+                    // the last lanes of the range may wrap past the last seed, they are skipped
+                    SeedScanner::DealLanes(static_cast<uint32_t>(seed), options.Bags, pieces);
+                    for (unsigned int lane = 0; lane < SeedScanner::LANES && seed + lane < blockEnd; lane++)
+                    {
+                        const MinoType *lanePieces = pieces + lane * options.Bags * 7;
+                        if (!passes(lanePieces, worker))
+                            continue;
+
+                        SeedMatch& match = matches.emplace_back();
+                        match.Seed = static_cast<uint32_t>(seed + lane);
+                        std::fill(std::begin(match.Pieces), std::end(match.Pieces), EMPTY);
+                        std::copy(lanePieces, lanePieces + options.Bags * 7, match.Pieces);
+                    }
+                }
+            });
+
+            // blocks are written in seed order, the file stays sorted whatever the worker order was
+            bool done = false;
+            for (uint64_t index = 0; index < count && !done; index++)
+            {
+                std::vector<SeedMatch>& matches = results[index];
+                if (options.Limit && writer.MatchesWritten() + matches.size() >= options.Limit)
+                {
+                    matches.resize(options.Limit - writer.MatchesWritten());
+                    done = true;
+                }
+                writer.AddBlock(static_cast<uint32_t>(options.First + (firstBlock + index) * BLOCK_SEEDS), matches);
+                scanned = std::min(seeds, (firstBlock + index + 1) * BLOCK_SEEDS);
+            }
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            if (seconds < nextReport && !done)
+                continue;
+            nextReport = seconds + 1.0;
+            std::cout << "\rscanned " << scanned << "/" << seeds << " seeds, " << writer.MatchesWritten() << " matches, "
+                      << static_cast<uint64_t>(scanned / std::max(seconds, 1e-9)) << " seeds/s" << std::flush;
+            if (done)
+                break;
+        }
+        writer.Finish();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "\n" << writer.MatchesWritten() << " matches in " << scanned << " seeds written to " << options.Output
+                  << " in " << seconds << "s" << std::endl;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+// stacker-selfplay: generates training data from bot self-play.
+//
+// Plays seeded headless games on all cores and streams every placement (position before it, chosen
+// placement, lines and combo after it) into a columnar file, see TrainingExporter.h for the format.
+// With --replay the placements come from recorded versus matches played back instead of new games, with
+// --verify it only reads such a file back, decompressing every column.
+
+#include "Bot.h"
+#include "Simulation.h"
+#include "ThreadPool.h"
+#include "TrainingExporter.h"
+#include "Versus.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+struct SelfPlayOptions
+{
+    uint64_t Seed = 1;
+    int Games = 100;
+    unsigned int Pieces = 1000;     // per game
+    unsigned int Threads = 0;
+    int Depth = 2;
+    int BeamWidth = 32;
+    bool Compress = true;
+    uint32_t ChunkRecords = TrainingExporter::DEFAULT_CHUNK_RECORDS;
+    std::string Output = "selfplay.stkd";
+    std::vector<std::string> Replays;   // recorded matches played back instead of new games
+    std::string Verify;             // file read back instead of playing
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-selfplay [options]\n"
+        "  --seed N          run seed (default 1)\n"
+        "  --games N         games to play (default 100)\n"
+        "  --pieces N        pieces per game (default 1000)\n"
+        "  --threads N       worker threads, 0 for all cores (default 0)\n"
+        "  --depth N         bot search depth (default 2)\n"
+        "  --beam N          bot beam width (default 32)\n"
+        "  --compress 0|1    LZ4 compress the columns (default 1)\n"
+        "  --chunk N         records per chunk (default 65536)\n"
+        "  --output F        output file (default selfplay.stkd)\n"
+        "  --replay F        export the placements of the recorded versus match F instead of playing\n"
+        "                    games, may be repeated\n"
+        "  --verify F        read F back and count its placements instead of playing\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], SelfPlayOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--seed")                options.Seed = std::stoull(value);
+        else if (arg == "--games")          options.Games = std::max(1, std::stoi(value));
+        else if (arg == "--pieces")         options.Pieces = std::stoul(value);
+        else if (arg == "--threads")        options.Threads = std::stoul(value);
+        else if (arg == "--depth")          options.Depth = std::stoi(value);
+        else if (arg == "--beam")           options.BeamWidth = std::stoi(value);
+        else if (arg == "--compress")       options.Compress = std::stoi(value) != 0;
+        else if (arg == "--chunk")          options.ChunkRecords = std::stoul(value);
+        else if (arg == "--output")         options.Output = value;
+        else if (arg == "--replay")         options.Replays.push_back(value);
+        else if (arg == "--verify")         options.Verify = value;
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    SelfPlayOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        if (!options.Verify.empty())
+        {
+            std::cout << TrainingExporter::Verify(options.Verify) << " placements read back from " << options.Verify << std::endl;
+            return 0;
+        }
+
+        TrainingExporter exporter(options.Output, options.Compress, options.ChunkRecords);
+        ThreadPool pool(options.Threads);
+
+        if (!options.Replays.empty())
+        {
+            // read first, a replay that can't be read stops the run before anything is played
+            std::vector<std::shared_ptr<const VersusReplay>> replays;
+            for (const std::string& path: options.Replays)
+                replays.push_back(std::make_shared<const VersusReplay>(VersusReplay::Read(path)));
+
+            std::atomic<bool> failed(false);
+            pool.ParallelFor(replays.size(), [&](size_t index, unsigned int) {
+                if (failed.load(std::memory_order_relaxed))
+                    return;
+                try
+                {
+                    Simulation::ExportReplay(replays[index], exporter);
+                }
+                catch (const std::runtime_error&)
+                {
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            });
+            exporter.Finish();
+            std::cout << exporter.RecordsWritten() << " placements of " << replays.size() << " replays written to " << options.Output << std::endl;
+            return 0;
+        }
+
+        BotConfig config;
+        config.Depth = options.Depth;
+        config.BeamWidth = options.BeamWidth;
+        config.Threads = 1;
+        std::vector<std::unique_ptr<Bot>> bots;
+        for (unsigned int i = 0; i < pool.Size(); i++)
+            bots.push_back(std::make_unique<Bot>(config, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE));
+
+        auto startTime = std::chrono::steady_clock::now();
+        std::atomic<uint64_t> placements(0);
+        std::atomic<bool> failed(false);
+        pool.ParallelFor(options.Games, [&](size_t game, unsigned int worker) {
+            // a failed write can't leave the worker, the games left are skipped and Finish reports it
+            if (failed.load(std::memory_order_relaxed))
+                return;
+            try
+            {
+                unsigned int seed = Simulation::GameSeed(options.Seed, game);
+                GameResult result = Simulation::PlayBotGame(*bots[worker], seed, options.Pieces, &exporter);
+                placements.fetch_add(result.Pieces, std::memory_order_relaxed);
+            }
+            catch (const std::runtime_error&)
+            {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        });
+        exporter.Finish();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << exporter.RecordsWritten() << " placements written to " << options.Output
+                  << " (" << static_cast<uint64_t>(placements.load() / seconds) << " placements/s)" << std::endl;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
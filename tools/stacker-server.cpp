@@ -0,0 +1,128 @@
+// stacker-server: headless match server.
+//
+// Hosts sprint and versus matches for TCP clients (see the protocol in Server.h), one event loop per
+// shard, and prints its load regularly. stacker-loadgen plays against it with many bot clients.
+
+#include "Server.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <stdexcept>
+
+struct ServerOptions
+{
+    unsigned int Port = 47200;
+    unsigned int Shards = 0;        // 0 means one per hardware thread
+    unsigned int Matches = 1024;    // per shard
+    unsigned int GarbageDelay = 1;
+    unsigned int Messiness = 30;
+    unsigned int Seed = 1;
+    unsigned int Seconds = 0;       // 0 runs until interrupted
+    unsigned int Report = 5;        // seconds between two reports, 0 for none
+};
+
+static volatile std::sig_atomic_t Interrupted = 0;
+
+static void OnInterrupt(int)
+{
+    Interrupted = 1;
+}
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-server [options]\n"
+        "  --port N          TCP port (default 47200)\n"
+        "  --shards N        event loops, each on its own thread (default one per hardware thread)\n"
+        "  --matches N       match slots of every shard, allocated at start (default 1024)\n"
+        "  --delay N         garbage delay in placements (default 1)\n"
+        "  --messiness N     garbage messiness in percent (default 30)\n"
+        "  --seed N          seed of the match seeds (default 1)\n"
+        "  --seconds N       stops after that long (default 0, until interrupted)\n"
+        "  --report N        seconds between two load reports, 0 for none (default 5)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], ServerOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--port")                options.Port = std::stoul(value);
+        else if (arg == "--shards")         options.Shards = std::stoul(value);
+        else if (arg == "--matches")        options.Matches = std::stoul(value);
+        else if (arg == "--delay")          options.GarbageDelay = std::stoul(value);
+        else if (arg == "--messiness")      options.Messiness = std::stoul(value);
+        else if (arg == "--seed")           options.Seed = std::stoul(value);
+        else if (arg == "--seconds")        options.Seconds = std::stoul(value);
+        else if (arg == "--report")         options.Report = std::stoul(value);
+        else return false;
+    }
+    return true;
+}
+
+static void PrintStats(const ServerStats& stats, const ServerStats& last, double seconds)
+{
+    std::cout << "clients " << stats.Clients << " (" << stats.Spectators << " spectators), matches " << stats.Matches << " playing, " << stats.MatchesPlayed << " played"
+              << ", " << (stats.Ticks - last.Ticks) / seconds << " ticks/s"
+              << ", " << (stats.Inputs - last.Inputs) / seconds << " inputs/s ("
+              << (stats.LateInputs ? double(stats.LateTicks) / stats.LateInputs : 0.0) << " ticks late on average for " << stats.LateInputs << ")"
+              << ", " << (stats.BytesIn - last.BytesIn) / seconds / 1024 << " KB/s in, " << (stats.BytesOut - last.BytesOut) / seconds / 1024 << " KB/s out"
+              << ", " << stats.Rejected << " rejected"
+              << ", longest frame " << stats.MaxFrameSeconds * 1000 << " ms" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    ServerOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        unsigned int shards = options.Shards > 0 ? options.Shards : std::max(1u, std::thread::hardware_concurrency());
+        MatchServer server(options.Port, shards, options.Matches, options.GarbageDelay, options.Messiness, options.Seed);
+        std::signal(SIGINT, OnInterrupt);
+        std::signal(SIGTERM, OnInterrupt);
+        server.Start();
+        std::cout << "listening on port " << options.Port << ", " << shards << " shards of " << options.Matches << " matches" << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        auto lastReport = start;
+        ServerStats last;
+        while (!Interrupted)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto now = std::chrono::steady_clock::now();
+            if (options.Seconds > 0 && now - start >= std::chrono::seconds(options.Seconds))
+                break;
+            if (options.Report > 0 && now - lastReport >= std::chrono::seconds(options.Report))
+            {
+                ServerStats stats = server.Stats();
+                PrintStats(stats, last, std::chrono::duration<double>(now - lastReport).count());
+                last = stats;
+                lastReport = now;
+            }
+        }
+
+        server.Stop();
+        ServerStats stats = server.Stats();
+        PrintStats(stats, last, std::max(1e-3, std::chrono::duration<double>(std::chrono::steady_clock::now() - lastReport).count()));
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
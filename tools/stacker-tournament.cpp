@@ -0,0 +1,539 @@
+// stacker-tournament: rates bot configurations against each other.
+//
+// Plays headless 1v1 matches (Simulation::PlayBotMatch) between bot configurations, as a round robin
+// (every pair meets) or a Swiss tournament (every round pairs bots with close scores that didn't meet
+// yet). A pairing plays the same fixed set of seeds twice, sides swapped, so both bots get the same
+// pieces and garbage holes. The matches of a round are spread on a thread pool, one match per worker at
+// a time with its own bot of every configuration; searches have no deadline, so the results only depend
+// on the seeds. Ratings (Elo fitted on every game, Glicko-2 updated by round), win rates, search speed
+// and attack go to a JSON report.
+
+#include "Bot.h"
+#include "Simulation.h"
+#include "ThreadPool.h"
+#include "OpeningBook.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <chrono>
+#include <stdexcept>
+#include <cstdio>
+
+struct TournamentOptions
+{
+    std::vector<std::string> Bots;  // "name:key=value,..." specs
+    std::string Format = "roundrobin";
+    unsigned int Rounds = 0;        // swiss only, 0 for enough rounds to single out a winner
+    unsigned int Seeds = 16;        // per pairing, each one played on both sides
+    uint64_t Seed = 1;
+    unsigned int Pieces = 500;      // per board, a match still going after that is a draw
+    unsigned int GarbageDelay = 1;
+    unsigned int Messiness = 30;
+    unsigned int Threads = 0;
+    std::string Output = "tournament.json";
+};
+
+struct TournamentBot
+{
+    std::string Name;
+    BotConfig Config;
+    float PPS = 2.0f;               // placement rate on the match clock
+    std::shared_ptr<const OpeningBook> Book;
+
+    // results
+    unsigned int Games = 0, Wins = 0, Losses = 0, Draws = 0;
+    double Points = 0.0;            // swiss standings: 1 per pairing won or bye, 0.5 per pairing tied
+    unsigned int Byes = 0;
+    uint64_t Pieces = 0, Attack = 0;
+    double ThinkSeconds = 0.0, MatchSeconds = 0.0;
+    double Elo = 1500.0;
+    double Rating = 1500.0, RD = 350.0, Volatility = 0.06;     // Glicko-2, on the Glicko scale
+};
+
+struct TournamentGame
+{
+    unsigned int Bots[2];
+    unsigned int Seed;
+    MatchResult Result;
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-tournament --bot SPEC --bot SPEC [...] [options]\n"
+        "  --bot SPEC        a bot configuration, NAME:key=value,... with the keys depth (default 1), beam (default 16),\n"
+        "                    hash (bits, default 0), pps (placements per second on the match clock, default 2),\n"
+        "                    book (opening book file) and the weight names of stacker-tune (height, holes, ...)\n"
+        "  --format F        roundrobin or swiss (default roundrobin)\n"
+        "  --rounds N        swiss rounds, 0 for ceil(log2(bots)) (default 0)\n"
+        "  --seeds N         seeds per pairing, each played with both sides (default 16)\n"
+        "  --seed N          seed of the seed set (default 1)\n"
+        "  --pieces N        pieces per board before a match is a draw (default 500)\n"
+        "  --delay N         garbage delay in placements (default 1)\n"
+        "  --messiness N     garbage messiness in percent (default 30)\n"
+        "  --threads N       worker threads, 0 for all cores (default 0)\n"
+        "  --output F        JSON report (default tournament.json)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], TournamentOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--bot")                 options.Bots.push_back(value);
+        else if (arg == "--format")         options.Format = value;
+        else if (arg == "--rounds")         options.Rounds = std::stoul(value);
+        else if (arg == "--seeds")          options.Seeds = std::max(1ul, std::stoul(value));
+        else if (arg == "--seed")           options.Seed = std::stoull(value);
+        else if (arg == "--pieces")         options.Pieces = std::max(1ul, std::stoul(value));
+        else if (arg == "--delay")          options.GarbageDelay = std::stoul(value);
+        else if (arg == "--messiness")      options.Messiness = std::min(100ul, std::stoul(value));
+        else if (arg == "--threads")        options.Threads = std::stoul(value);
+        else if (arg == "--output")         options.Output = value;
+        else return false;
+    }
+    return options.Bots.size() >= 2 && (options.Format == "roundrobin" || options.Format == "swiss");
+}
+
+// throws std::runtime_error for an unknown key or a value that isn't a number
+static TournamentBot ParseBot(const std::string& spec)
+{
+    TournamentBot bot;
+    size_t colon = spec.find(':');
+    bot.Name = spec.substr(0, colon);
+    if (bot.Name.empty())
+        throw std::runtime_error("bot without a name: " + spec);
+
+    // small searches on the calling thread (the defaults of stacker-tune), the matches already run on
+    // every core
+    bot.Config.Depth = 1;
+    bot.Config.BeamWidth = 16;
+    bot.Config.Threads = 1;
+
+    std::istringstream fields(colon == std::string::npos ? "" : spec.substr(colon + 1));
+    std::string field;
+    while (std::getline(fields, field, ','))
+    {
+        size_t equals = field.find('=');
+        std::string key = field.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+        try
+        {
+            if (key == "depth")             bot.Config.Depth = std::max(1, std::stoi(value));
+            else if (key == "beam")         bot.Config.BeamWidth = std::max(1, std::stoi(value));
+            else if (key == "hash")         bot.Config.HashBits = std::stoul(value);
+            else if (key == "pps")          bot.PPS = std::stof(value);
+            else if (key == "book")         bot.Book = std::make_shared<const OpeningBook>(value);
+            else
+            {
+                int weight = 0;
+                while (weight < BotWeights::COUNT && key != BotWeights::Name(weight))
+                    weight = weight + 1;
+                if (weight == BotWeights::COUNT)
+                    throw std::runtime_error("unknown key " + key + " in bot " + bot.Name);
+                bot.Config.Weights[weight] = std::stof(value);
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            throw std::runtime_error("bad value for " + key + " in bot " + bot.Name + ": " + value);
+        }
+    }
+    if (!(bot.PPS > 0.0f))
+        throw std::runtime_error("bot " + bot.Name + " needs a positive pps");
+    return bot;
+}
+
+// every seed of the set on both sides
+static void AddPairing(std::vector<TournamentGame>& games, unsigned int a, unsigned int b, const std::vector<unsigned int>& seeds)
+{
+    for (unsigned int seed: seeds)
+    {
+        games.push_back(TournamentGame{ { a, b }, seed, MatchResult() });
+        games.push_back(TournamentGame{ { b, a }, seed, MatchResult() });
+    }
+}
+
+// pairs bots with close scores, avoiding rematches while possible. With an odd count the lowest ranked
+// bot that didn't have one yet sits the round out (a bye is worth a pairing won).
+static std::vector<std::pair<unsigned int, unsigned int>> SwissPairings(std::vector<TournamentBot>& bots, const std::vector<std::vector<unsigned int>>& met)
+{
+    std::vector<unsigned int> order(bots.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+        return bots[a].Points != bots[b].Points ? bots[a].Points > bots[b].Points : bots[a].Rating > bots[b].Rating;
+    });
+
+    std::vector<bool> paired(bots.size(), false);
+    if (bots.size() % 2 == 1)
+    {
+        unsigned int fewest = bots[0].Byes;
+        for (const TournamentBot& bot: bots)
+            fewest = std::min(fewest, bot.Byes);
+        auto bye = std::find_if(order.rbegin(), order.rend(), [&](unsigned int bot) { return bots[bot].Byes == fewest; });
+        paired[*bye] = true;
+        bots[*bye].Byes = bots[*bye].Byes + 1;
+        bots[*bye].Points = bots[*bye].Points + 1.0;
+    }
+
+    std::vector<std::pair<unsigned int, unsigned int>> pairings;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        unsigned int a = order[i];
+        if (paired[a])
+            continue;
+
+        // the next bot down that a didn't meet, the next one down at all if a met every one of them
+        int opponent = -1, next = -1;
+        for (size_t j = i + 1; j < order.size() && opponent < 0; j++)
+        {
+            unsigned int b = order[j];
+            if (paired[b])
+                continue;
+            if (next < 0)
+                next = b;
+            if (met[a][b] == 0)
+                opponent = b;
+        }
+        opponent = opponent >= 0 ? opponent : next;
+        paired[a] = true;
+        paired[opponent] = true;
+        pairings.push_back({ a, static_cast<unsigned int>(opponent) });
+    }
+    return pairings;
+}
+
+// Elo of every bot by maximum likelihood over all the games (Bradley-Terry, fitted by minorization-
+// maximization), draws count as half a win each. Every bot also gets a virtual draw against a 1500 bot,
+// which anchors the scale and keeps the ratings of a bot that never won (or never lost) finite.
+static void FitElo(std::vector<TournamentBot>& bots, const std::vector<std::vector<double>>& score, const std::vector<std::vector<unsigned int>>& met)
+{
+    size_t count = bots.size();
+    std::vector<double> strength(count, 1.0);
+    for (int iteration = 0; iteration < 10000; iteration++)
+    {
+        double change = 0.0;
+        for (size_t i = 0; i < count; i++)
+        {
+            double wins = 0.5, weight = 1.0 / (strength[i] + 1.0);
+            for (size_t j = 0; j < count; j++)
+            {
+                wins = wins + score[i][j];
+                weight = weight + met[i][j] / (strength[i] + strength[j]);
+            }
+            double updated = wins / weight;
+            change = std::max(change, std::abs(std::log(updated / strength[i])));
+            strength[i] = updated;
+        }
+        if (change < 1e-9)
+            break;
+    }
+    for (size_t i = 0; i < count; i++)
+        bots[i].Elo = 1500.0 + 400.0 * std::log10(strength[i]);
+}
+
+// One Glicko-2 rating period (Glickman, "Example of the Glicko-2 system"), every bot against the
+// ratings the others had before the period.
+static void UpdateGlicko(std::vector<TournamentBot>& bots, const std::vector<TournamentGame>& games)
+{
+    const double SCALE = 173.7178;
+    const double TAU = 0.5;
+    const double PI = 3.14159265358979323846;
+
+    std::vector<double> mu(bots.size()), phi(bots.size());
+    for (size_t i = 0; i < bots.size(); i++)
+    {
+        mu[i] = (bots[i].Rating - 1500.0) / SCALE;
+        phi[i] = bots[i].RD / SCALE;
+    }
+    auto g = [&](double p) { return 1.0 / std::sqrt(1.0 + 3.0 * p * p / (PI * PI)); };
+
+    for (size_t i = 0; i < bots.size(); i++)
+    {
+        double inverseV = 0.0, sum = 0.0;
+        for (const TournamentGame& game: games)
+        {
+            int side = game.Bots[0] == i ? 0 : game.Bots[1] == i ? 1 : -1;
+            if (side < 0)
+                continue;
+            unsigned int opponent = game.Bots[1 - side];
+            double s = game.Result.Winner < 0 ? 0.5 : game.Result.Winner == side ? 1.0 : 0.0;
+            double gj = g(phi[opponent]);
+            double e = 1.0 / (1.0 + std::exp(-gj * (mu[i] - mu[opponent])));
+            inverseV = inverseV + gj * gj * e * (1.0 - e);
+            sum = sum + gj * (s - e);
+        }
+
+        TournamentBot& bot = bots[i];
+        if (inverseV == 0.0)
+        {
+            // sat the period out, only the uncertainty grows
+            bot.RD = std::min(350.0, std::sqrt(phi[i] * phi[i] + bot.Volatility * bot.Volatility) * SCALE);
+            continue;
+        }
+
+        // new volatility: root of f by the Illinois algorithm
+        double v = 1.0 / inverseV;
+        double delta = v * sum;
+        double a = std::log(bot.Volatility * bot.Volatility);
+        double phi2 = phi[i] * phi[i];
+        auto f = [&](double x) {
+            double ex = std::exp(x);
+            return ex * (delta * delta - phi2 - v - ex) / (2.0 * (phi2 + v + ex) * (phi2 + v + ex)) - (x - a) / (TAU * TAU);
+        };
+        double A = a, B;
+        if (delta * delta > phi2 + v)
+            B = std::log(delta * delta - phi2 - v);
+        else
+        {
+            int k = 1;
+            while (f(a - k * TAU) < 0.0)
+                k = k + 1;
+            B = a - k * TAU;
+        }
+        double fA = f(A), fB = f(B);
+        while (std::abs(B - A) > 1e-6)
+        {
+            double C = A + (A - B) * fA / (fB - fA);
+            double fC = f(C);
+            if (fC * fB <= 0.0)
+            {
+                A = B;
+                fA = fB;
+            }
+            else
+                fA = fA / 2.0;
+            B = C;
+            fB = fC;
+        }
+        bot.Volatility = std::exp(A / 2.0);
+
+        double phiStar = std::sqrt(phi2 + bot.Volatility * bot.Volatility);
+        double newPhi = 1.0 / std::sqrt(1.0 / (phiStar * phiStar) + 1.0 / v);
+        bot.Rating = 1500.0 + SCALE * (mu[i] + newPhi * newPhi * sum);
+        bot.RD = newPhi * SCALE;
+    }
+}
+
+static std::string JsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (char c: text)
+    {
+        if (c == '"' || c == '\\')
+            quoted = quoted + '\\' + c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted = quoted + escaped;
+        }
+        else
+            quoted = quoted + c;
+    }
+    return quoted + "\"";
+}
+
+static void WriteReport(const std::string& path, const TournamentOptions& options, const std::vector<TournamentBot>& bots, const std::vector<std::vector<unsigned int>>& wins, const std::vector<std::vector<unsigned int>>& met, size_t matches, double seconds)
+{
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("can't write " + path);
+    out.precision(6);
+
+    out << "{\n";
+    out << "  \"format\": " << JsonString(options.Format) << ",\n";
+    out << "  \"seed\": " << options.Seed << ",\n";
+    out << "  \"seeds\": " << options.Seeds << ",\n";
+    out << "  \"pieces\": " << options.Pieces << ",\n";
+    out << "  \"garbage_delay\": " << options.GarbageDelay << ",\n";
+    out << "  \"messiness\": " << options.Messiness << ",\n";
+    out << "  \"matches\": " << matches << ",\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+    out << "  \"matches_per_minute\": " << matches * 60.0 / seconds << ",\n";
+
+    out << "  \"bots\": [\n";
+    for (size_t i = 0; i < bots.size(); i++)
+    {
+        const TournamentBot& bot = bots[i];
+        out << "    {\n";
+        out << "      \"name\": " << JsonString(bot.Name) << ",\n";
+        out << "      \"depth\": " << bot.Config.Depth << ", \"beam\": " << bot.Config.BeamWidth << ", \"pps\": " << bot.PPS << ",\n";
+        out << "      \"games\": " << bot.Games << ", \"wins\": " << bot.Wins << ", \"losses\": " << bot.Losses << ", \"draws\": " << bot.Draws << ",\n";
+        out << "      \"win_rate\": " << (bot.Games > 0 ? (bot.Wins + 0.5 * bot.Draws) / bot.Games : 0.0) << ",\n";
+        if (options.Format == "swiss")
+            out << "      \"points\": " << bot.Points << ", \"byes\": " << bot.Byes << ",\n";
+        out << "      \"elo\": " << bot.Elo << ",\n";
+        out << "      \"glicko\": { \"rating\": " << bot.Rating << ", \"rd\": " << bot.RD << ", \"volatility\": " << bot.Volatility << " },\n";
+        out << "      \"search_pps\": " << (bot.ThinkSeconds > 0.0 ? bot.Pieces / bot.ThinkSeconds : 0.0) << ",\n";
+        out << "      \"apm\": " << (bot.MatchSeconds > 0.0 ? bot.Attack * 60.0 / bot.MatchSeconds : 0.0) << ",\n";
+        out << "      \"app\": " << (bot.Pieces > 0 ? static_cast<double>(bot.Attack) / bot.Pieces : 0.0) << "\n";
+        out << "    }" << (i + 1 < bots.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+
+    // wins of the first bot against the second, and of the second against the first
+    out << "  \"pairs\": [";
+    bool first = true;
+    for (size_t i = 0; i < bots.size(); i++)
+    {
+        for (size_t j = i + 1; j < bots.size(); j++)
+        {
+            if (met[i][j] == 0)
+                continue;
+            out << (first ? "\n" : ",\n") << "    { \"bots\": [" << JsonString(bots[i].Name) << ", " << JsonString(bots[j].Name) << "], \"games\": " << met[i][j]
+                << ", \"wins\": [" << wins[i][j] << ", " << wins[j][i] << "], \"draws\": " << met[i][j] - wins[i][j] - wins[j][i] << " }";
+            first = false;
+        }
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    TournamentOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        std::vector<TournamentBot> bots;
+        for (const std::string& spec: options.Bots)
+        {
+            bots.push_back(ParseBot(spec));
+            for (size_t i = 0; i + 1 < bots.size(); i++)
+            {
+                if (bots[i].Name == bots.back().Name)
+                    throw std::runtime_error("two bots are named " + bots.back().Name);
+            }
+        }
+        size_t count = bots.size();
+
+        // a bot of every configuration per worker, their transposition tables and arenas are reused by
+        // all the matches the worker plays
+        ThreadPool pool(options.Threads);
+        std::vector<std::vector<std::unique_ptr<Bot>>> workers(pool.Size());
+        for (auto& worker: workers)
+        {
+            for (const TournamentBot& bot: bots)
+            {
+                worker.push_back(std::make_unique<Bot>(bot.Config, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE));
+                worker.back()->Book = bot.Book;
+            }
+        }
+
+        std::vector<unsigned int> seeds;
+        for (unsigned int i = 0; i < options.Seeds; i++)
+            seeds.push_back(Simulation::GameSeed(options.Seed, i));
+
+        unsigned int rounds = 1;
+        if (options.Format == "swiss")
+            rounds = options.Rounds > 0 ? options.Rounds : static_cast<unsigned int>(std::ceil(std::log2(static_cast<double>(count))));
+
+        std::vector<std::vector<unsigned int>> wins(count, std::vector<unsigned int>(count, 0));
+        std::vector<std::vector<unsigned int>> met(count, std::vector<unsigned int>(count, 0));     // games played
+        std::vector<std::vector<double>> score(count, std::vector<double>(count, 0.0));
+        size_t matches = 0;
+        auto startTime = std::chrono::steady_clock::now();
+
+        for (unsigned int round = 0; round < rounds; round++)
+        {
+            // a round robin is a single round of every pair
+            std::vector<std::pair<unsigned int, unsigned int>> pairings;
+            if (options.Format == "roundrobin")
+            {
+                for (unsigned int a = 0; a < count; a++)
+                    for (unsigned int b = a + 1; b < count; b++)
+                        pairings.push_back({ a, b });
+            }
+            else
+                pairings = SwissPairings(bots, met);
+
+            std::vector<TournamentGame> games;
+            for (auto [a, b]: pairings)
+                AddPairing(games, a, b, seeds);
+
+            pool.ParallelFor(games.size(), [&](size_t index, unsigned int worker) {
+                TournamentGame& game = games[index];
+                float pps[2] = { bots[game.Bots[0]].PPS, bots[game.Bots[1]].PPS };
+                game.Result = Simulation::PlayBotMatch(*workers[worker][game.Bots[0]], *workers[worker][game.Bots[1]], pps, game.Seed, options.GarbageDelay, options.Messiness, options.Pieces);
+            });
+            matches = matches + games.size();
+
+            // tallied in the order of the schedule, the report doesn't depend on the threads
+            std::vector<std::vector<double>> pairingScore(count, std::vector<double>(count, 0.0));
+            for (const TournamentGame& game: games)
+            {
+                const MatchResult& result = game.Result;
+                for (int side = 0; side < 2; side++)
+                {
+                    TournamentBot& bot = bots[game.Bots[side]];
+                    unsigned int opponent = game.Bots[1 - side];
+                    double s = result.Winner < 0 ? 0.5 : result.Winner == side ? 1.0 : 0.0;
+                    bot.Games = bot.Games + 1;
+                    bot.Wins = bot.Wins + (s == 1.0);
+                    bot.Losses = bot.Losses + (s == 0.0);
+                    bot.Draws = bot.Draws + (s == 0.5);
+                    bot.Pieces = bot.Pieces + result.Players[side].Pieces;
+                    bot.Attack = bot.Attack + result.Players[side].Attack;
+                    bot.ThinkSeconds = bot.ThinkSeconds + result.ThinkSeconds[side];
+                    bot.MatchSeconds = bot.MatchSeconds + result.Seconds;
+                    wins[game.Bots[side]][opponent] = wins[game.Bots[side]][opponent] + (s == 1.0);
+                    met[game.Bots[side]][opponent] = met[game.Bots[side]][opponent] + 1;
+                    score[game.Bots[side]][opponent] = score[game.Bots[side]][opponent] + s;
+                    pairingScore[game.Bots[side]][opponent] = pairingScore[game.Bots[side]][opponent] + s;
+                }
+            }
+            for (auto [a, b]: pairings)
+            {
+                double difference = pairingScore[a][b] - pairingScore[b][a];
+                bots[a].Points = bots[a].Points + (difference > 0.0 ? 1.0 : difference == 0.0 ? 0.5 : 0.0);
+                bots[b].Points = bots[b].Points + (difference < 0.0 ? 1.0 : difference == 0.0 ? 0.5 : 0.0);
+            }
+            UpdateGlicko(bots, games);
+
+            if (options.Format == "swiss")
+                std::cout << "round " << round + 1 << "/" << rounds << ": " << pairings.size() << " pairings, " << games.size() << " matches" << std::endl;
+        }
+        FitElo(bots, score, met);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        WriteReport(options.Output, options, bots, wins, met, matches, seconds);
+
+        std::vector<unsigned int> ranking(count);
+        std::iota(ranking.begin(), ranking.end(), 0);
+        std::stable_sort(ranking.begin(), ranking.end(), [&](unsigned int a, unsigned int b) { return bots[a].Elo > bots[b].Elo; });
+        for (unsigned int i: ranking)
+        {
+            const TournamentBot& bot = bots[i];
+            std::cout << bot.Name << ": elo " << static_cast<int>(std::round(bot.Elo))
+                      << ", glicko " << static_cast<int>(std::round(bot.Rating)) << " (rd " << static_cast<int>(std::round(bot.RD)) << ")"
+                      << ", " << bot.Wins << "-" << bot.Losses << "-" << bot.Draws
+                      << ", " << static_cast<int>(bot.ThinkSeconds > 0.0 ? bot.Pieces / bot.ThinkSeconds : 0.0) << " search pps"
+                      << ", " << (bot.MatchSeconds > 0.0 ? bot.Attack * 60.0 / bot.MatchSeconds : 0.0) << " apm" << std::endl;
+        }
+        std::cout << matches << " matches in " << seconds << " s (" << static_cast<int>(matches * 60.0 / seconds) << " per minute), report written to " << options.Output << std::endl;
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
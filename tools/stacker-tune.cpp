@@ -0,0 +1,294 @@
+// stacker-tune: optimizes the bot evaluation weights by self-play.
+//
+// Separable CMA-ES style evolution strategy: every generation samples candidate weights around
+// the current mean with per weight step sizes, scores each candidate over the same set of seeded
+// headless games (played in parallel on all cores) and moves the mean and the step sizes towards
+// the best half. The state is checkpointed after every generation and a run resumes from its
+// checkpoint, every random number derives from the run seed so a run is fully reproducible.
+
+#include "Bot.h"
+#include "Simulation.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+struct TuneOptions
+{
+    uint64_t Seed = 1;
+    int Generations = 50;
+    int Population = 16;
+    int Games = 100;                // per candidate
+    unsigned int Pieces = 300;      // per game
+    unsigned int Threads = 0;
+    int Depth = 1;
+    int BeamWidth = 16;
+    double Sigma = 0.3;             // initial step size, relative to the magnitude of every weight
+    std::string Checkpoint = "tune_checkpoint.txt";
+};
+
+struct TuneState
+{
+    int Generation = 0;             // next generation to run
+    std::vector<double> Mean, Sigma;
+    double BestFitness = -1e30;
+    std::vector<double> Best;
+};
+
+static void PrintUsage()
+{
+    std::cout <<
+        "usage: stacker-tune [options]\n"
+        "  --seed N          run seed (default 1)\n"
+        "  --generations N   generations to run (default 50)\n"
+        "  --population N    candidates per generation (default 16)\n"
+        "  --games N         games per candidate (default 100)\n"
+        "  --pieces N        pieces per game (default 300)\n"
+        "  --threads N       worker threads, 0 for all cores (default 0)\n"
+        "  --depth N         bot search depth (default 1)\n"
+        "  --beam N          bot beam width (default 16)\n"
+        "  --sigma X         initial relative step size (default 0.3)\n"
+        "  --checkpoint F    checkpoint file, resumed if it exists (default tune_checkpoint.txt)\n";
+}
+
+static bool ParseOptions(int argc, char *argv[], TuneOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        if (arg == "--seed")                options.Seed = std::stoull(value);
+        else if (arg == "--generations")    options.Generations = std::stoi(value);
+        else if (arg == "--population")     options.Population = std::max(2, std::stoi(value));
+        else if (arg == "--games")          options.Games = std::max(1, std::stoi(value));
+        else if (arg == "--pieces")         options.Pieces = std::stoul(value);
+        else if (arg == "--threads")        options.Threads = std::stoul(value);
+        else if (arg == "--depth")          options.Depth = std::stoi(value);
+        else if (arg == "--beam")           options.BeamWidth = std::stoi(value);
+        else if (arg == "--sigma")          options.Sigma = std::stod(value);
+        else if (arg == "--checkpoint")     options.Checkpoint = value;
+        else return false;
+    }
+    return true;
+}
+
+static BotWeights ToWeights(const std::vector<double>& values)
+{
+    BotWeights weights;
+    for (int i = 0; i < BotWeights::COUNT; i++)
+        weights[i] = static_cast<float>(values[i]);
+    return weights;
+}
+
+static void WriteValues(std::ostream& out, const char* key, const std::vector<double>& values)
+{
+    out << key;
+    for (double value: values)
+        out << ' ' << value;
+    out << '\n';
+}
+
+static bool LoadCheckpoint(const std::string& path, uint64_t seed, TuneState& state)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        if (key == "seed")
+        {
+            uint64_t checkpointSeed;
+            fields >> checkpointSeed;
+            if (checkpointSeed != seed)
+                throw std::runtime_error("checkpoint " + path + " belongs to a run with seed " + std::to_string(checkpointSeed));
+        }
+        else if (key == "generation")
+            fields >> state.Generation;
+        else if (key == "best_fitness")
+            fields >> state.BestFitness;
+        else if (key == "mean" || key == "sigma" || key == "best")
+        {
+            std::vector<double>& values = key == "mean" ? state.Mean : key == "sigma" ? state.Sigma : state.Best;
+            values.assign(BotWeights::COUNT, 0.0);
+            for (double& value: values)
+                fields >> value;
+        }
+    }
+    return state.Mean.size() == BotWeights::COUNT && state.Sigma.size() == BotWeights::COUNT;
+}
+
+static void SaveCheckpoint(const std::string& path, uint64_t seed, const TuneState& state)
+{
+    // written next to the checkpoint and renamed, so a crash never leaves a truncated file
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary);
+        // every digit of the doubles, a resumed run goes on exactly like an uninterrupted one
+        out.precision(std::numeric_limits<double>::max_digits10);
+        out << "# stacker-tune checkpoint, weights order:";
+        for (int i = 0; i < BotWeights::COUNT; i++)
+            out << ' ' << BotWeights::Name(i);
+        out << '\n';
+        out << "seed " << seed << '\n';
+        out << "generation " << state.Generation << '\n';
+        WriteValues(out, "mean", state.Mean);
+        WriteValues(out, "sigma", state.Sigma);
+        out << "best_fitness " << state.BestFitness << '\n';
+        WriteValues(out, "best", state.Best);
+        out.close();
+        if (!out)
+            throw std::runtime_error("can't write checkpoint " + temporary);
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("can't replace checkpoint " + path + " with " + temporary);
+}
+
+int main(int argc, char *argv[])
+{
+    TuneOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        TuneState state;
+        if (LoadCheckpoint(options.Checkpoint, options.Seed, state))
+            std::cout << "resuming from " << options.Checkpoint << " at generation " << state.Generation << std::endl;
+        else
+        {
+            // start from the hand tuned defaults
+            BotWeights defaults;
+            state = TuneState();
+            for (int i = 0; i < BotWeights::COUNT; i++)
+            {
+                state.Mean.push_back(defaults[i]);
+                state.Sigma.push_back(options.Sigma * std::max(0.1, std::abs(static_cast<double>(defaults[i]))));
+            }
+            state.Best = state.Mean;
+        }
+
+        ThreadPool pool(options.Threads);
+
+        // one single threaded bot per worker, only the weights change between games
+        BotConfig config;
+        config.Depth = options.Depth;
+        config.BeamWidth = options.BeamWidth;
+        config.Threads = 1;
+        std::vector<std::unique_ptr<Bot>> bots;
+        for (unsigned int i = 0; i < pool.Size(); i++)
+            bots.push_back(std::make_unique<Bot>(config, SRS_TETROMINO_ROTATIONS, SRS_PLUS_KICK_TABLE));
+
+        // recombination weights of the best half
+        int parents = options.Population / 2;
+        std::vector<double> recombination(parents);
+        for (int i = 0; i < parents; i++)
+            recombination[i] = std::log(parents + 0.5) - std::log(i + 1.0);
+        double total = std::accumulate(recombination.begin(), recombination.end(), 0.0);
+        for (double& weight: recombination)
+            weight = weight / total;
+
+        while (state.Generation < options.Generations)
+        {
+            auto startTime = std::chrono::steady_clock::now();
+
+            // candidates of this generation, drawn from a generator seeded by (run seed, generation)
+            std::mt19937_64 rng(Simulation::GameSeed(options.Seed, 0xC0FFEE00ull + state.Generation));
+            std::normal_distribution<double> normal(0.0, 1.0);
+            std::vector<std::vector<double>> candidates(options.Population, std::vector<double>(BotWeights::COUNT));
+            for (auto& candidate: candidates)
+                for (int i = 0; i < BotWeights::COUNT; i++)
+                    candidate[i] = state.Mean[i] + state.Sigma[i] * normal(rng);
+
+            // all the candidates play the same games
+            std::vector<double> scores(options.Population * options.Games);
+            pool.ParallelFor(scores.size(), [&](size_t job, unsigned int worker) {
+                size_t candidate = job / options.Games;
+                size_t game = job % options.Games;
+
+                Bot& bot = *bots[worker];
+                bot.Config.Weights = ToWeights(candidates[candidate]);
+                unsigned int seed = Simulation::GameSeed(options.Seed, static_cast<uint64_t>(state.Generation) * options.Games + game);
+                GameResult result = Simulation::PlayBotGame(bot, seed, options.Pieces);
+
+                // lines, with a bonus line for every tetris
+                scores[job] = result.Lines + result.Tetrises;
+            });
+
+            std::vector<double> fitness(options.Population, 0.0);
+            for (size_t job = 0; job < scores.size(); job++)
+                fitness[job / options.Games] += scores[job] / options.Games;
+
+            std::vector<int> order(options.Population);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](int a, int b) { return fitness[a] > fitness[b]; });
+
+            if (fitness[order[0]] > state.BestFitness)
+            {
+                state.BestFitness = fitness[order[0]];
+                state.Best = candidates[order[0]];
+            }
+
+            // move the mean to the weighted best half, adapt every step size to the spread of the selected steps
+            std::vector<double> oldMean = state.Mean;
+            for (int i = 0; i < BotWeights::COUNT; i++)
+            {
+                double mean = 0.0;
+                for (int p = 0; p < parents; p++)
+                    mean += recombination[p] * candidates[order[p]][i];
+                state.Mean[i] = mean;
+
+                double spread = 0.0;
+                for (int p = 0; p < parents; p++)
+                {
+                    double step = candidates[order[p]][i] - oldMean[i];
+                    spread += recombination[p] * step * step;
+                }
+                state.Sigma[i] = std::max(1e-4, 0.7 * state.Sigma[i] + 0.3 * std::sqrt(spread));
+            }
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            double averageFitness = std::accumulate(fitness.begin(), fitness.end(), 0.0) / options.Population;
+            std::cout << "generation " << state.Generation
+                      << "  best " << fitness[order[0]]
+                      << "  average " << averageFitness
+                      << "  best so far " << state.BestFitness
+                      << "  (" << static_cast<long>(scores.size() / seconds * 3600.0) << " games/hour)" << std::endl;
+
+            state.Generation = state.Generation + 1;
+            SaveCheckpoint(options.Checkpoint, options.Seed, state);
+        }
+
+        std::cout << "best weights (fitness " << state.BestFitness << "):\n";
+        for (int i = 0; i < BotWeights::COUNT; i++)
+            std::cout << "  " << BotWeights::Name(i) << " = " << state.Best[i] << '\n';
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Error:\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}